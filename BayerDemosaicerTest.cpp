@@ -0,0 +1,123 @@
+/***********************************************************************
+BayerDemosaicerTest - Utility to check the vectorized and multi-threaded
+Bayer demosaicing kernels against the scalar reference kernel, and to
+measure their throughput at both supported color frame sizes.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <iostream>
+#include <Misc/Timer.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/BayerDemosaicer.h>
+
+typedef Kinect::FrameSource::ColorComponent ColorComponent;
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	unsigned int numFrames=100;
+	unsigned int maxNumThreads=4;
+	for(int i=1;i<argc;++i)
+		{
+		if(strcasecmp(argv[i],"-frames")==0&&i+1<argc)
+			{
+			++i;
+			numFrames=(unsigned int)atoi(argv[i]);
+			}
+		else if(strcasecmp(argv[i],"-threads")==0&&i+1<argc)
+			{
+			++i;
+			maxNumThreads=(unsigned int)atoi(argv[i]);
+			}
+		else
+			{
+			std::cerr<<"Usage: "<<argv[0]<<" [-frames <number of frames>] [-threads <maximum number of threads>]"<<std::endl;
+			return 1;
+			}
+		}
+	
+	/* Test both color frame sizes supported by the Kinect: */
+	static const unsigned int frameSizes[2][2]={{640,480},{1280,1024}};
+	static const char* modeNames[2]={"bilinear","edge-aware"};
+	bool allCorrect=true;
+	for(int sizeIndex=0;sizeIndex<2;++sizeIndex)
+		{
+		const unsigned int* frameSize=frameSizes[sizeIndex];
+		size_t numPixels=size_t(frameSize[0])*size_t(frameSize[1]);
+		
+		/* Create a raw frame of random pixels: */
+		ColorComponent* rawFrame=new ColorComponent[numPixels];
+		for(size_t i=0;i<numPixels;++i)
+			rawFrame[i]=ColorComponent(rand());
+		
+		for(int mode=0;mode<2;++mode)
+			{
+			/* Calculate the reference result with the scalar kernel: */
+			ColorComponent* referenceFrame=new ColorComponent[numPixels*3];
+			{
+			Kinect::BayerDemosaicer demosaicer(frameSize);
+			demosaicer.setKernel(Kinect::BayerDemosaicer::SCALAR);
+			demosaicer.setMode(Kinect::BayerDemosaicer::Mode(mode));
+			demosaicer.demosaic(rawFrame,referenceFrame);
+			}
+			
+			/* Test all supported kernels with increasing numbers of threads: */
+			ColorComponent* frame=new ColorComponent[numPixels*3];
+			for(int kernel=0;kernel<Kinect::BayerDemosaicer::NUM_KERNELS;++kernel)
+				{
+				Kinect::BayerDemosaicer::Kernel k=Kinect::BayerDemosaicer::Kernel(kernel);
+				if(!Kinect::BayerDemosaicer::isSupported(k))
+					continue;
+				
+				for(unsigned int numThreads=1;numThreads<=maxNumThreads;numThreads*=2)
+					{
+					Kinect::BayerDemosaicer demosaicer(frameSize,numThreads);
+					demosaicer.setKernel(k);
+					demosaicer.setMode(Kinect::BayerDemosaicer::Mode(mode));
+					
+					/* Check the result against the reference result: */
+					memset(frame,0,numPixels*3);
+					demosaicer.demosaic(rawFrame,frame);
+					bool correct=memcmp(frame,referenceFrame,numPixels*3)==0;
+					allCorrect=allCorrect&&correct;
+					
+					/* Measure the demosaicer's throughput: */
+					Misc::Timer timer;
+					for(unsigned int i=0;i<numFrames;++i)
+						demosaicer.demosaic(rawFrame,frame);
+					timer.elapse();
+					double time=timer.getTime();
+					
+					std::cout<<frameSize[0]<<'x'<<frameSize[1]<<", "<<modeNames[mode]<<", "<<Kinect::BayerDemosaicer::getKernelName(k)<<", "<<numThreads<<" thread(s): ";
+					std::cout<<(correct?"identical":"MISMATCH")<<", "<<time*1000.0/double(numFrames)<<" ms/frame, "<<double(numPixels)*double(numFrames)/(time*1.0e6)<<" Mpixels/s"<<std::endl;
+					}
+				}
+			
+			delete[] frame;
+			delete[] referenceFrame;
+			}
+		
+		delete[] rawFrame;
+		}
+	
+	return allCorrect?0:1;
+	}
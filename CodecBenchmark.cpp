@@ -0,0 +1,536 @@
+/***********************************************************************
+CodecBenchmark - Utility to measure compression ratio, throughput,
+per-frame latency, and round-trip accuracy of all color and depth frame
+codecs on recorded 3D video streams or synthetic frames.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <Misc/SizedTypes.h>
+#include <Misc/Timer.h>
+#include <IO/File.h>
+#include <IO/OpenFile.h>
+#include <Math/Constants.h>
+#include <Video/Config.h>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/FileFrameSource.h>
+#include <Kinect/DepthFrameWriter.h>
+#include <Kinect/DepthFrameReader.h>
+#include <Kinect/RansDepthFrameWriter.h>
+#include <Kinect/RansDepthFrameReader.h>
+#include <Kinect/LossyDepthFrameWriter.h>
+#include <Kinect/LossyDepthFrameReader.h>
+#include <Kinect/ColorFrameWriter.h>
+#include <Kinect/ColorFrameReader.h>
+
+/**************
+Helper classes:
+**************/
+
+enum Codec // Enumerated type for benchmarked codecs
+	{
+	DEPTH_HUFFMAN=0,DEPTH_NEARLOSSLESS_HUFFMAN,DEPTH_RANS,DEPTH_THEORA,COLOR_THEORA,NUM_CODECS
+	};
+
+const char* codecNames[NUM_CODECS]={"DepthHuffman","DepthNearLosslessHuffman","DepthRans","DepthTheora","ColorTheora"};
+
+struct Settings // Structure holding codec settings shared by all benchmarks
+	{
+	/* Elements: */
+	public:
+	unsigned int numThreads; // Number of threads for the Huffman depth codec
+	unsigned int maxError; // Maximum reconstruction error for the near-lossless depth codec
+	const char* scratchFileName; // Name of the file receiving compressed streams
+	};
+
+struct Results // Structure holding the measurements of one benchmark run
+	{
+	/* Elements: */
+	public:
+	size_t compressedSize; // Total size of all compressed frames in bytes
+	std::vector<double> encodeTimes; // Compression time of each frame in seconds
+	std::vector<double> decodeTimes; // Decompression time of each frame in seconds
+	unsigned int numMismatches; // Number of frames not reproduced within the codec's guaranteed accuracy
+	unsigned int maxError; // Largest absolute difference between an original and a decompressed pixel component
+	};
+
+/****************
+Helper functions:
+****************/
+
+bool isDepthCodec(Codec codec)
+	{
+	return codec!=COLOR_THEORA;
+	}
+
+bool isCodecAvailable(Codec codec)
+	{
+	#if VIDEO_CONFIG_HAVE_THEORA
+	return true;
+	#else
+	return codec!=DEPTH_THEORA&&codec!=COLOR_THEORA;
+	#endif
+	}
+
+Kinect::FrameWriter* createWriter(Codec codec,IO::File& sink,const unsigned int size[2],const Settings& settings)
+	{
+	switch(codec)
+		{
+		case DEPTH_NEARLOSSLESS_HUFFMAN:
+			{
+			Kinect::DepthFrameWriter* writer=new Kinect::DepthFrameWriter(sink,size,settings.numThreads);
+			writer->setMaxError(settings.maxError);
+			return writer;
+			}
+		
+		case DEPTH_RANS:
+			return new Kinect::RansDepthFrameWriter(sink,size);
+		
+		case DEPTH_THEORA:
+			return new Kinect::LossyDepthFrameWriter(sink,size);
+		
+		case COLOR_THEORA:
+			return new Kinect::ColorFrameWriter(sink,size);
+		
+		default:
+			return new Kinect::DepthFrameWriter(sink,size,settings.numThreads);
+		}
+	}
+
+Kinect::FrameReader* createReader(Codec codec,IO::File& source,const Settings& settings)
+	{
+	switch(codec)
+		{
+		case DEPTH_RANS:
+			return new Kinect::RansDepthFrameReader(source);
+		
+		case DEPTH_THEORA:
+			return new Kinect::LossyDepthFrameReader(source);
+		
+		case COLOR_THEORA:
+			return new Kinect::ColorFrameReader(source);
+		
+		default:
+			return new Kinect::DepthFrameReader(source,Kinect::DepthFrameWriter::encodingVersion,settings.numThreads);
+		}
+	}
+
+Misc::UInt32 nextRandom(Misc::UInt32& state) // Returns a pseudo-random number from a linear congruential generator, to create the same synthetic frames on all platforms
+	{
+	state=state*1664525U+1013904223U;
+	return state>>16;
+	}
+
+Kinect::FrameBuffer createSyntheticDepthFrame(const unsigned int size[2],unsigned int frameIndex,Misc::UInt32& randomState)
+	{
+	Kinect::FrameBuffer result(size[0],size[1],size[0]*size[1]*sizeof(Kinect::FrameSource::DepthPixel));
+	result.timeStamp=double(frameIndex)/30.0;
+	Kinect::FrameSource::DepthPixel* fPtr=static_cast<Kinect::FrameSource::DepthPixel*>(result.getBuffer());
+	
+	/* Move an object in front of a slanted wall: */
+	int w=int(size[0]);
+	int h=int(size[1]);
+	int cx=w/5+int((frameIndex*4U)%(unsigned int)(w*3/5));
+	int cy=h/2;
+	int r=h/4;
+	for(int y=0;y<h;++y)
+		for(int x=0;x<w;++x,++fPtr)
+			{
+			int dx=x-cx;
+			int dy=y-cy;
+			int depth;
+			if(dx*dx+dy*dy<r*r)
+				{
+				/* Object pixel with a curved surface: */
+				depth=650+((dx*dx+dy*dy)*60)/(r*r);
+				}
+			else if(dx>=0&&dx<r/6+r&&dy*dy<r*r)
+				{
+				/* Shadow cast by the object onto the wall: */
+				depth=Kinect::FrameSource::invalidDepth;
+				}
+			else
+				{
+				/* Wall pixel: */
+				depth=900+(x*100)/w+(y*60)/h;
+				}
+			
+			/* Add sensor noise and dropouts: */
+			if(depth!=Kinect::FrameSource::invalidDepth)
+				{
+				Misc::UInt32 noise=nextRandom(randomState);
+				if(noise%200==0)
+					depth=Kinect::FrameSource::invalidDepth;
+				else if(noise%4==0)
+					depth+=int((noise>>8)%3)-1;
+				}
+			
+			*fPtr=Kinect::FrameSource::DepthPixel(depth);
+			}
+	
+	return result;
+	}
+
+Kinect::FrameBuffer createSingleSpanDepthFrame(const unsigned int size[2],unsigned int frameIndex,Misc::UInt32& randomState) // Creates a worst-case depth frame in which every pixel is a valid span of a single pixel in keyframes, and needs an escaped residual in inter frames
+	{
+	Kinect::FrameBuffer result(size[0],size[1],size[0]*size[1]*sizeof(Kinect::FrameSource::DepthPixel));
+	result.timeStamp=double(frameIndex)/30.0;
+	Kinect::FrameSource::DepthPixel* fPtr=static_cast<Kinect::FrameSource::DepthPixel*>(result.getBuffer());
+	
+	/* Alternate near and far pixels in a checkerboard whose phase flips every frame, such that neighboring pixels and consecutive frames differ by more than any coded delta or residual: */
+	for(unsigned int y=0;y<size[1];++y)
+		for(unsigned int x=0;x<size[0];++x,++fPtr)
+			{
+			int depth=int(nextRandom(randomState)%1000U);
+			if(((x+y+frameIndex)&0x1U)!=0)
+				depth+=1024;
+			*fPtr=Kinect::FrameSource::DepthPixel(depth);
+			}
+	
+	return result;
+	}
+
+Kinect::FrameBuffer createSyntheticColorFrame(const unsigned int size[2],unsigned int frameIndex,Misc::UInt32& randomState)
+	{
+	Kinect::FrameBuffer result(size[0],size[1],size[0]*size[1]*3);
+	result.timeStamp=double(frameIndex)/30.0;
+	Misc::UInt8* fPtr=static_cast<Misc::UInt8*>(result.getBuffer());
+	
+	/* Move a colored disk in front of a color gradient: */
+	int w=int(size[0]);
+	int h=int(size[1]);
+	int cx=w/5+int((frameIndex*4U)%(unsigned int)(w*3/5));
+	int cy=h/2;
+	int r=h/4;
+	for(int y=0;y<h;++y)
+		for(int x=0;x<w;++x,fPtr+=3)
+			{
+			int dx=x-cx;
+			int dy=y-cy;
+			int color[3];
+			if(dx*dx+dy*dy<r*r)
+				{
+				color[0]=200;
+				color[1]=60+(dy*dy*100)/(r*r);
+				color[2]=40;
+				}
+			else
+				{
+				color[0]=(x*160)/w+40;
+				color[1]=(y*160)/h+40;
+				color[2]=120;
+				}
+			
+			/* Add sensor noise: */
+			for(int i=0;i<3;++i)
+				fPtr[i]=Misc::UInt8(color[i]+int(nextRandom(randomState)%5)-2);
+			}
+	
+	return result;
+	}
+
+unsigned int compareFrames(Codec codec,const Kinect::FrameBuffer& original,const Kinect::FrameBuffer& decoded,size_t frameSize)
+	{
+	/* Check the time stamps, which every codec must preserve exactly, and count a mismatch as a failed frame: */
+	if(decoded.timeStamp!=original.timeStamp)
+		return ~0U;
+	
+	/* Find the largest pixel component difference: */
+	unsigned int maxError=0;
+	if(isDepthCodec(codec))
+		{
+		const Kinect::FrameSource::DepthPixel* oPtr=static_cast<const Kinect::FrameSource::DepthPixel*>(original.getBuffer());
+		const Kinect::FrameSource::DepthPixel* dPtr=static_cast<const Kinect::FrameSource::DepthPixel*>(decoded.getBuffer());
+		for(size_t i=0;i<frameSize/sizeof(Kinect::FrameSource::DepthPixel);++i)
+			{
+			/* Count a pixel that changed validity as the largest possible error: */
+			unsigned int error;
+			if((oPtr[i]==Kinect::FrameSource::invalidDepth)!=(dPtr[i]==Kinect::FrameSource::invalidDepth))
+				error=Kinect::FrameSource::invalidDepth;
+			else
+				error=oPtr[i]>=dPtr[i]?oPtr[i]-dPtr[i]:dPtr[i]-oPtr[i];
+			if(maxError<error)
+				maxError=error;
+			}
+		}
+	else
+		{
+		const Misc::UInt8* oPtr=static_cast<const Misc::UInt8*>(original.getBuffer());
+		const Misc::UInt8* dPtr=static_cast<const Misc::UInt8*>(decoded.getBuffer());
+		for(size_t i=0;i<frameSize;++i)
+			{
+			unsigned int error=oPtr[i]>=dPtr[i]?oPtr[i]-dPtr[i]:dPtr[i]-oPtr[i];
+			if(maxError<error)
+				maxError=error;
+			}
+		}
+	
+	return maxError;
+	}
+
+Results benchmarkCodec(Codec codec,const std::vector<Kinect::FrameBuffer>& frames,const unsigned int size[2],size_t frameSize,const Settings& settings)
+	{
+	Results results;
+	results.compressedSize=0;
+	results.numMismatches=0;
+	results.maxError=0;
+	
+	/* Determine the codec's guaranteed accuracy: */
+	unsigned int guaranteedError=0;
+	if(codec==DEPTH_NEARLOSSLESS_HUFFMAN)
+		guaranteedError=settings.maxError;
+	else if(codec==DEPTH_THEORA||codec==COLOR_THEORA)
+		guaranteedError=~0U;
+	
+	/* Compress all frames into the scratch file: */
+	{
+	IO::FilePtr sink(IO::openFile(settings.scratchFileName,IO::File::WriteOnly));
+	sink->setEndianness(Misc::LittleEndian);
+	Kinect::FrameWriter* writer=createWriter(codec,*sink,size,settings);
+	for(std::vector<Kinect::FrameBuffer>::const_iterator fIt=frames.begin();fIt!=frames.end();++fIt)
+		{
+		Misc::Timer timer;
+		results.compressedSize+=writer->writeFrame(*fIt);
+		results.encodeTimes.push_back(timer.peekTime());
+		}
+	delete writer;
+	}
+	
+	/* Decompress all frames from the scratch file and compare them to the originals: */
+	{
+	IO::FilePtr source(IO::openFile(settings.scratchFileName));
+	source->setEndianness(Misc::LittleEndian);
+	Kinect::FrameReader* reader=createReader(codec,*source,settings);
+	for(std::vector<Kinect::FrameBuffer>::const_iterator fIt=frames.begin();fIt!=frames.end();++fIt)
+		{
+		Misc::Timer timer;
+		Kinect::FrameBuffer frame=reader->readNextFrame();
+		results.decodeTimes.push_back(timer.peekTime());
+		
+		unsigned int error=compareFrames(codec,*fIt,frame,frameSize);
+		if(error>guaranteedError||error==~0U)
+			++results.numMismatches;
+		if(results.maxError<error)
+			results.maxError=error;
+		}
+	delete reader;
+	}
+	
+	return results;
+	}
+
+double percentile(std::vector<double> times,double p) // Returns the given percentile of the given times, using the nearest-rank method
+	{
+	std::sort(times.begin(),times.end());
+	size_t rank=size_t(ceil(p*double(times.size())));
+	return times[rank>0?rank-1:0];
+	}
+
+double sum(const std::vector<double>& times)
+	{
+	double result=0.0;
+	for(std::vector<double>::const_iterator tIt=times.begin();tIt!=times.end();++tIt)
+		result+=*tIt;
+	return result;
+	}
+
+void printResults(Codec codec,const Results& results,size_t numFrames,const unsigned int size[2],size_t frameSize)
+	{
+	double rawSize=double(frameSize)*double(numFrames);
+	std::cout<<codecNames[codec]<<','<<numFrames<<','<<size[0]<<','<<size[1]<<',';
+	std::cout<<size_t(rawSize)<<','<<results.compressedSize<<','<<rawSize/double(results.compressedSize)<<',';
+	std::cout<<rawSize/(sum(results.encodeTimes)*1024.0*1024.0)<<','<<rawSize/(sum(results.decodeTimes)*1024.0*1024.0)<<',';
+	std::cout<<percentile(results.encodeTimes,0.5)*1000.0<<','<<percentile(results.encodeTimes,0.99)*1000.0<<',';
+	std::cout<<percentile(results.decodeTimes,0.5)*1000.0<<','<<percentile(results.decodeTimes,0.99)*1000.0<<',';
+	std::cout<<results.numMismatches<<','<<(results.maxError==~0U?-1:int(results.maxError))<<std::endl;
+	}
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	const char* fileNames[2]={0,0};
+	unsigned int numSyntheticFrames=60;
+	unsigned int syntheticSize[2]={640,480};
+	bool singleSpans=false;
+	unsigned int maxNumFrames=~0U;
+	Settings settings;
+	settings.numThreads=1;
+	settings.maxError=2;
+	settings.scratchFileName="CodecBenchmark.tmp";
+	bool codecSelected[NUM_CODECS];
+	bool selectAllCodecs=true;
+	for(int i=0;i<NUM_CODECS;++i)
+		codecSelected[i]=false;
+	int numFileNames=0;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"synthetic")==0&&i+1<argc)
+				{
+				++i;
+				numSyntheticFrames=(unsigned int)atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"size")==0&&i+2<argc)
+				{
+				for(int j=0;j<2;++j)
+					{
+					++i;
+					syntheticSize[j]=(unsigned int)atoi(argv[i]);
+					}
+				}
+			else if(strcasecmp(argv[i]+1,"singleSpans")==0)
+				singleSpans=true;
+			else if(strcasecmp(argv[i]+1,"frames")==0&&i+1<argc)
+				{
+				++i;
+				maxNumFrames=(unsigned int)atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"threads")==0&&i+1<argc)
+				{
+				++i;
+				settings.numThreads=(unsigned int)atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"maxError")==0&&i+1<argc)
+				{
+				++i;
+				settings.maxError=(unsigned int)atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"codec")==0&&i+1<argc)
+				{
+				++i;
+				int codec;
+				for(codec=0;codec<NUM_CODECS&&strcasecmp(argv[i],codecNames[codec])!=0;++codec)
+					;
+				if(codec<NUM_CODECS)
+					{
+					codecSelected[codec]=true;
+					selectAllCodecs=false;
+					}
+				else
+					std::cerr<<"Ignoring unknown codec "<<argv[i]<<std::endl;
+				}
+			else if(strcasecmp(argv[i]+1,"scratch")==0&&i+1<argc)
+				{
+				++i;
+				settings.scratchFileName=argv[i];
+				}
+			else
+				std::cerr<<"Ignoring unrecognized option "<<argv[i]<<std::endl;
+			}
+		else if(numFileNames<2)
+			fileNames[numFileNames++]=argv[i];
+		}
+	if(numFileNames==1)
+		{
+		std::cerr<<"Usage: "<<argv[0]<<" [<color file name> <depth file name>] [-synthetic <number of synthetic frames>] [-size <synthetic frame width> <synthetic frame height>] [-singleSpans] [-frames <maximum number of frames>] [-threads <number of Huffman codec threads>] [-maxError <near-lossless maximum error>] [-codec <codec name>]* [-scratch <scratch file name>]"<<std::endl;
+		std::cerr<<"Codec names:";
+		for(int codec=0;codec<NUM_CODECS;++codec)
+			std::cerr<<' '<<codecNames[codec];
+		std::cerr<<std::endl;
+		return 1;
+		}
+	for(int codec=0;codec<NUM_CODECS;++codec)
+		{
+		if(selectAllCodecs)
+			codecSelected[codec]=isCodecAvailable(Codec(codec));
+		else if(codecSelected[codec]&&!isCodecAvailable(Codec(codec)))
+			{
+			std::cerr<<"Skipping codec "<<codecNames[codec]<<" due to lack of Theora library"<<std::endl;
+			codecSelected[codec]=false;
+			}
+		}
+	bool needColor=codecSelected[COLOR_THEORA];
+	bool needDepth=false;
+	for(int codec=0;codec<NUM_CODECS;++codec)
+		if(codecSelected[codec]&&isDepthCodec(Codec(codec)))
+			needDepth=true;
+	
+	/* Read recorded frames or create synthetic frames: */
+	std::vector<Kinect::FrameBuffer> colorFrames,depthFrames;
+	unsigned int colorSize[2],depthSize[2];
+	if(numFileNames==2)
+		{
+		Kinect::FileFrameSource frameSource(fileNames[0],fileNames[1]);
+		for(int i=0;i<2;++i)
+			{
+			colorSize[i]=frameSource.getActualFrameSize(Kinect::FrameSource::COLOR)[i];
+			depthSize[i]=frameSource.getActualFrameSize(Kinect::FrameSource::DEPTH)[i];
+			}
+		while(needColor&&colorFrames.size()<maxNumFrames)
+			{
+			Kinect::FrameBuffer frame=frameSource.readNextColorFrame();
+			if(frame.timeStamp==Math::Constants<double>::max)
+				break;
+			colorFrames.push_back(frame);
+			}
+		while(needDepth&&depthFrames.size()<maxNumFrames)
+			{
+			Kinect::FrameBuffer frame=frameSource.readNextDepthFrame();
+			if(frame.timeStamp==Math::Constants<double>::max)
+				break;
+			depthFrames.push_back(frame);
+			}
+		}
+	else
+		{
+		Misc::UInt32 randomState=1;
+		for(int i=0;i<2;++i)
+			colorSize[i]=depthSize[i]=syntheticSize[i];
+		for(unsigned int frameIndex=0;frameIndex<numSyntheticFrames&&frameIndex<maxNumFrames;++frameIndex)
+			{
+			if(needColor)
+				colorFrames.push_back(createSyntheticColorFrame(colorSize,frameIndex,randomState));
+			if(needDepth&&singleSpans)
+				depthFrames.push_back(createSingleSpanDepthFrame(depthSize,frameIndex,randomState));
+			else if(needDepth)
+				depthFrames.push_back(createSyntheticDepthFrame(depthSize,frameIndex,randomState));
+			}
+		}
+	
+	/* Benchmark all selected codecs and print one comma-separated line of results per codec: */
+	std::cout<<"codec,frames,width,height,raw_bytes,compressed_bytes,ratio,encode_mb_per_s,decode_mb_per_s,encode_p50_ms,encode_p99_ms,decode_p50_ms,decode_p99_ms,mismatched_frames,max_error"<<std::endl;
+	unsigned int numMismatches=0;
+	for(int codec=0;codec<NUM_CODECS;++codec)
+		{
+		if(!codecSelected[codec])
+			continue;
+		
+		const std::vector<Kinect::FrameBuffer>& frames=isDepthCodec(Codec(codec))?depthFrames:colorFrames;
+		const unsigned int* size=isDepthCodec(Codec(codec))?depthSize:colorSize;
+		if(frames.empty())
+			continue;
+		size_t frameSize=isDepthCodec(Codec(codec))?size_t(size[0])*size_t(size[1])*sizeof(Kinect::FrameSource::DepthPixel):size_t(size[0])*size_t(size[1])*3;
+		Results results=benchmarkCodec(Codec(codec),frames,size,frameSize,settings);
+		printResults(Codec(codec),results,frames.size(),size,frameSize);
+		numMismatches+=results.numMismatches;
+		}
+	unlink(settings.scratchFileName);
+	
+	/* Signal failure if any codec did not reproduce frames within its guaranteed accuracy: */
+	return numMismatches!=0?2:0;
+	}
@@ -0,0 +1,209 @@
+/***********************************************************************
+BackgroundMask - Class to represent the set of pixels of a depth frame
+that belong to the static background and are therefore invalid, in
+segments of consecutive pixels along a Hilbert curve.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/BackgroundMask.h>
+
+#include <string.h>
+#include <Misc/ThrowStdErr.h>
+#include <IO/File.h>
+#include <Kinect/HilbertCurve.h>
+
+namespace Kinect {
+
+/*******************************
+Methods of class BackgroundMask:
+*******************************/
+
+BackgroundMask::BackgroundMask(unsigned int sNumPixels)
+	:numPixels(sNumPixels),numSegments((sNumPixels+segmentSize-1)/segmentSize),
+	 segments(new Misc::UInt8[numSegments]),numMaskedSegments(0)
+	{
+	memset(segments,0,numSegments);
+	}
+
+BackgroundMask::~BackgroundMask(void)
+	{
+	delete[] segments;
+	}
+
+void BackgroundMask::setAll(bool masked)
+	{
+	memset(segments,masked?1:0,numSegments);
+	numMaskedSegments=masked?numSegments:0;
+	}
+
+bool BackgroundMask::unmaskValidPixels(const HilbertCurve& hilbertCurve,const FrameSource::DepthPixel* frame)
+	{
+	bool changed=false;
+	HilbertCurve::Iterator hcIt=hilbertCurve.getIterator(0);
+	unsigned int pixelIndex=0;
+	for(unsigned int segment=0;segment<numSegments;++segment)
+		{
+		/* Check all pixels of a masked segment, and skip an unmasked segment: */
+		unsigned int segmentEnd=pixelIndex+segmentSize<=numPixels?pixelIndex+segmentSize:numPixels;
+		bool valid=false;
+		for(;pixelIndex<segmentEnd;++pixelIndex,++hcIt)
+			if(segments[segment]!=0&&frame[*hcIt]!=FrameSource::invalidDepth)
+				valid=true;
+		
+		/* Unmask the segment if any of its pixels are valid: */
+		if(valid)
+			{
+			segments[segment]=0;
+			--numMaskedSegments;
+			changed=true;
+			}
+		}
+	
+	return changed;
+	}
+
+unsigned int BackgroundMask::partition(const HilbertCurve& hilbertCurve,unsigned int firstPixel,unsigned int lastPixel,unsigned int* pixelOffsets) const
+	{
+	/* Fill unmasked pixels from the front and masked pixels from the back of the offset array: */
+	unsigned int* unmaskedPtr=pixelOffsets;
+	unsigned int* maskedPtr=pixelOffsets+(lastPixel-firstPixel);
+	HilbertCurve::Iterator hcIt=hilbertCurve.getIterator(firstPixel);
+	for(unsigned int pixelIndex=firstPixel;pixelIndex<lastPixel;++pixelIndex,++hcIt)
+		{
+		if(segments[pixelIndex/segmentSize]!=0)
+			*(--maskedPtr)=*hcIt;
+		else
+			*(unmaskedPtr++)=*hcIt;
+		}
+	
+	return (unsigned int)(unmaskedPtr-pixelOffsets);
+	}
+
+size_t BackgroundMask::write(IO::File& sink) const
+	{
+	/* Count the runs of equally masked segments: */
+	size_t numRuns=1;
+	for(unsigned int segment=1;segment<numSegments;++segment)
+		if(segments[segment]!=segments[segment-1])
+			++numRuns;
+	
+	/* Write the mask as run lengths if that is likely smaller than a bit field: */
+	size_t numBytes=(numSegments+7)/8;
+	if(numRuns*2<numBytes)
+		{
+		sink.write<Misc::UInt8>(1);
+		size_t writtenSize=1;
+		
+		/* Write the lengths of alternating runs of unmasked and masked segments, starting with a possibly empty run of unmasked segments: */
+		Misc::UInt8 runMasked=0;
+		unsigned int segment=0;
+		while(segment<numSegments)
+			{
+			unsigned int runLength=0;
+			for(;segment<numSegments&&segments[segment]==runMasked;++segment)
+				++runLength;
+			
+			/* Write the run length seven bits at a time, least significant first, with the high bit marking continuation: */
+			while(runLength>=0x80U)
+				{
+				sink.write<Misc::UInt8>(0x80U|(runLength&0x7fU));
+				++writtenSize;
+				runLength>>=7;
+				}
+			sink.write<Misc::UInt8>(runLength);
+			++writtenSize;
+			
+			runMasked=1-runMasked;
+			}
+		
+		return writtenSize;
+		}
+	else
+		{
+		sink.write<Misc::UInt8>(0);
+		
+		/* Pack the segment flags into bytes, first segment in the lowest bit: */
+		for(size_t byte=0;byte<numBytes;++byte)
+			{
+			Misc::UInt8 bits=0x0U;
+			for(unsigned int bit=0;bit<8&&byte*8+bit<numSegments;++bit)
+				if(segments[byte*8+bit]!=0)
+					bits|=Misc::UInt8(0x1U<<bit);
+			sink.write<Misc::UInt8>(bits);
+			}
+		
+		return 1+numBytes;
+		}
+	}
+
+void BackgroundMask::read(IO::File& source)
+	{
+	numMaskedSegments=0;
+	unsigned int encoding=source.read<Misc::UInt8>();
+	if(encoding==1)
+		{
+		/* Read the lengths of alternating runs of unmasked and masked segments: */
+		Misc::UInt8 runMasked=0;
+		unsigned int segment=0;
+		while(segment<numSegments)
+			{
+			/* Read a run length seven bits at a time: */
+			unsigned int runLength=0;
+			unsigned int shift=0;
+			unsigned int byte;
+			do
+				{
+				byte=source.read<Misc::UInt8>();
+				if(shift<32)
+					runLength|=(byte&0x7fU)<<shift;
+				shift+=7;
+				}
+			while(byte&0x80U);
+			if(runLength>numSegments-segment)
+				Misc::throwStdErr("Kinect::BackgroundMask::read: Corrupted background mask");
+			
+			/* Set the run's segments: */
+			for(unsigned int i=0;i<runLength;++i,++segment)
+				segments[segment]=runMasked;
+			if(runMasked)
+				numMaskedSegments+=runLength;
+			
+			runMasked=1-runMasked;
+			}
+		}
+	else if(encoding==0)
+		{
+		/* Unpack the segment flags from bytes: */
+		size_t numBytes=(numSegments+7)/8;
+		for(size_t byte=0;byte<numBytes;++byte)
+			{
+			unsigned int bits=source.read<Misc::UInt8>();
+			for(unsigned int bit=0;bit<8&&byte*8+bit<numSegments;++bit)
+				{
+				segments[byte*8+bit]=Misc::UInt8((bits>>bit)&0x1U);
+				numMaskedSegments+=(bits>>bit)&0x1U;
+				}
+			}
+		}
+	else
+		Misc::throwStdErr("Kinect::BackgroundMask::read: Unknown background mask encoding %u",encoding);
+	}
+
+}
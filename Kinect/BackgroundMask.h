@@ -0,0 +1,76 @@
+/***********************************************************************
+BackgroundMask - Class to represent the set of pixels of a depth frame
+that belong to the static background and are therefore invalid, in
+segments of consecutive pixels along a Hilbert curve.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_BACKGROUNDMASK_INCLUDED
+#define KINECT_BACKGROUNDMASK_INCLUDED
+
+#include <stddef.h>
+#include <Misc/SizedTypes.h>
+#include <Kinect/FrameSource.h>
+
+/* Forward declarations: */
+namespace IO {
+class File;
+}
+namespace Kinect {
+class HilbertCurve;
+}
+
+namespace Kinect {
+
+class BackgroundMask
+	{
+	/* Elements: */
+	public:
+	static const unsigned int segmentSize=16; // Number of consecutive pixels along the Hilbert curve covered by one mask segment
+	private:
+	unsigned int numPixels; // Number of pixels in a depth frame
+	unsigned int numSegments; // Number of mask segments covering a depth frame
+	Misc::UInt8* segments; // Array of flags whether each segment is masked
+	unsigned int numMaskedSegments; // Number of currently masked segments
+	
+	/* Constructors and destructors: */
+	public:
+	BackgroundMask(unsigned int sNumPixels); // Creates an empty mask for depth frames of the given number of pixels
+	~BackgroundMask(void);
+	
+	/* Methods: */
+	bool empty(void) const // Returns true if no pixels are masked
+		{
+		return numMaskedSegments==0;
+		}
+	bool isMasked(unsigned int pixelIndex) const // Returns true if the pixel of the given index along the Hilbert curve is masked
+		{
+		return segments[pixelIndex/segmentSize]!=0;
+		}
+	void setAll(bool masked); // Masks or unmasks all pixels
+	bool unmaskValidPixels(const HilbertCurve& hilbertCurve,const FrameSource::DepthPixel* frame); // Unmasks all segments containing valid pixels in the given depth frame; returns true if the mask changed
+	unsigned int partition(const HilbertCurve& hilbertCurve,unsigned int firstPixel,unsigned int lastPixel,unsigned int* pixelOffsets) const; // Writes the array offsets of the unmasked pixels in the given range of the Hilbert curve, followed by those of the masked pixels, into the given array; returns number of unmasked pixels
+	size_t write(IO::File& sink) const; // Writes the mask to the given sink as a bit field; returns number of written bytes
+	void read(IO::File& source); // Reads the mask from the given source
+	};
+
+}
+
+#endif
@@ -0,0 +1,532 @@
+/***********************************************************************
+BayerDemosaicer - Class to convert raw color frames in Bayer GRBG
+pattern as streamed by the Kinect's color camera into RGB frames, using
+vectorized kernels and an optional pool of worker threads processing
+bands of rows in parallel.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/BayerDemosaicer.h>
+
+#include <Misc/ThrowStdErr.h>
+
+#define KINECT_BAYERDEMOSAICER_USE_SIMD 1
+
+#if KINECT_BAYERDEMOSAICER_USE_SIMD&&defined(__GNUC__)&&(defined(__i386__)||defined(__x86_64__))
+#define KINECT_BAYERDEMOSAICER_HAVE_X86 1
+#include <immintrin.h>
+#else
+#define KINECT_BAYERDEMOSAICER_HAVE_X86 0
+#endif
+
+namespace Kinect {
+
+namespace {
+
+/***********************************
+Helper functions for Bayer decoding:
+***********************************/
+
+typedef FrameSource::ColorComponent ColorComponent;
+
+inline ColorComponent avg(ColorComponent v1,ColorComponent v2)
+	{
+	return ColorComponent(((unsigned int)(v1)+(unsigned int)(v2)+1U)>>1);
+	}
+
+inline ColorComponent avg(ColorComponent v1,ColorComponent v2,ColorComponent v3)
+	{
+	return ColorComponent(((unsigned int)(v1)+(unsigned int)(v2)+(unsigned int)(v3)+1U)/3U);
+	}
+
+inline ColorComponent avg(ColorComponent v1,ColorComponent v2,ColorComponent v3,ColorComponent v4)
+	{
+	return ColorComponent(((unsigned int)(v1)+(unsigned int)(v2)+(unsigned int)(v3)+(unsigned int)(v4)+2U)>>2);
+	}
+
+inline ColorComponent green(const ColorComponent* rPtr,int stride,bool edgeAware) // Interpolates the green component at a red or blue pixel
+	{
+	if(edgeAware)
+		{
+		/* Interpolate along the direction of smaller gradient: */
+		unsigned int dh=rPtr[-1]>=rPtr[1]?rPtr[-1]-rPtr[1]:rPtr[1]-rPtr[-1];
+		unsigned int dv=rPtr[-stride]>=rPtr[stride]?rPtr[-stride]-rPtr[stride]:rPtr[stride]-rPtr[-stride];
+		if(dh<dv)
+			return avg(rPtr[-1],rPtr[1]);
+		if(dv<dh)
+			return avg(rPtr[-stride],rPtr[stride]);
+		}
+	
+	return avg(rPtr[-stride],rPtr[-1],rPtr[1],rPtr[stride]);
+	}
+
+void demosaicCentralPixels(const ColorComponent* rRowPtr,ColorComponent* cRowPtr,int stride,unsigned int x,unsigned int xEnd,bool oddRow,bool edgeAware) // Demosaics the given range of pixels of an interior row
+	{
+	const ColorComponent* rPtr=rRowPtr+x;
+	ColorComponent* cPtr=cRowPtr+x*3;
+	if(oddRow)
+		{
+		for(;x<xEnd;++x,++rPtr)
+			{
+			if(x&0x1U)
+				{
+				/* Convert the odd (G) pixel: */
+				*(cPtr++)=avg(rPtr[-stride],rPtr[stride]);
+				*(cPtr++)=rPtr[0];
+				*(cPtr++)=avg(rPtr[-1],rPtr[1]);
+				}
+			else
+				{
+				/* Convert the even (B) pixel: */
+				*(cPtr++)=avg(rPtr[-stride-1],rPtr[-stride+1],rPtr[stride-1],rPtr[stride+1]);
+				*(cPtr++)=green(rPtr,stride,edgeAware);
+				*(cPtr++)=rPtr[0];
+				}
+			}
+		}
+	else
+		{
+		for(;x<xEnd;++x,++rPtr)
+			{
+			if(x&0x1U)
+				{
+				/* Convert the odd (R) pixel: */
+				*(cPtr++)=rPtr[0];
+				*(cPtr++)=green(rPtr,stride,edgeAware);
+				*(cPtr++)=avg(rPtr[-stride-1],rPtr[-stride+1],rPtr[stride-1],rPtr[stride+1]);
+				}
+			else
+				{
+				/* Convert the even (G) pixel: */
+				*(cPtr++)=avg(rPtr[-1],rPtr[1]);
+				*(cPtr++)=rPtr[0];
+				*(cPtr++)=avg(rPtr[-stride],rPtr[stride]);
+				}
+			}
+		}
+	}
+
+void demosaicCentralRowScalar(const ColorComponent* rRowPtr,ColorComponent* cRowPtr,int stride,unsigned int width,bool oddRow,bool edgeAware)
+	{
+	demosaicCentralPixels(rRowPtr,cRowPtr,stride,1,width-1,oddRow,edgeAware);
+	}
+
+#if KINECT_BAYERDEMOSAICER_HAVE_X86
+
+/***********************************************************************
+The vectorized kernel computes all interpolation candidates for sixteen
+consecutive pixels starting at an even pixel index, selects the correct
+candidates for even and odd pixels via bit masks, and interleaves the
+resulting planar R, G, and B vectors into 48 bytes of RGB output using
+byte shuffles. _mm_avg_epu8 rounds exactly like avg(v1,v2); four-value
+averages are calculated in 16-bit precision.
+***********************************************************************/
+
+__attribute__((target("ssse3")))
+inline __m128i avg4(__m128i v1,__m128i v2,__m128i v3,__m128i v4)
+	{
+	const __m128i zero=_mm_setzero_si128();
+	const __m128i two=_mm_set1_epi16(2);
+	__m128i lo=_mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(v1,zero),_mm_unpacklo_epi8(v2,zero)),_mm_add_epi16(_mm_unpacklo_epi8(v3,zero),_mm_unpacklo_epi8(v4,zero)));
+	__m128i hi=_mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(v1,zero),_mm_unpackhi_epi8(v2,zero)),_mm_add_epi16(_mm_unpackhi_epi8(v3,zero),_mm_unpackhi_epi8(v4,zero)));
+	lo=_mm_srli_epi16(_mm_add_epi16(lo,two),2);
+	hi=_mm_srli_epi16(_mm_add_epi16(hi,two),2);
+	return _mm_packus_epi16(lo,hi);
+	}
+
+__attribute__((target("ssse3")))
+inline __m128i select(__m128i mask,__m128i v1,__m128i v2) // Returns v1 where mask is set, and v2 otherwise
+	{
+	return _mm_or_si128(_mm_and_si128(mask,v1),_mm_andnot_si128(mask,v2));
+	}
+
+__attribute__((target("ssse3")))
+void demosaicCentralRowSSSE3(const ColorComponent* rRowPtr,ColorComponent* cRowPtr,int stride,unsigned int width,bool oddRow,bool edgeAware)
+	{
+	const __m128i evenMask=_mm_set1_epi16(0x00ff);
+	const __m128i allOnes=_mm_set1_epi8(-1);
+	
+	/* Byte shuffle patterns to interleave planar R, G, B vectors into three RGB vectors: */
+	const __m128i r0=_mm_setr_epi8(0,-128,-128,1,-128,-128,2,-128,-128,3,-128,-128,4,-128,-128,5);
+	const __m128i g0=_mm_setr_epi8(-128,0,-128,-128,1,-128,-128,2,-128,-128,3,-128,-128,4,-128,-128);
+	const __m128i b0=_mm_setr_epi8(-128,-128,0,-128,-128,1,-128,-128,2,-128,-128,3,-128,-128,4,-128);
+	const __m128i r1=_mm_setr_epi8(-128,-128,6,-128,-128,7,-128,-128,8,-128,-128,9,-128,-128,10,-128);
+	const __m128i g1=_mm_setr_epi8(5,-128,-128,6,-128,-128,7,-128,-128,8,-128,-128,9,-128,-128,10);
+	const __m128i b1=_mm_setr_epi8(-128,5,-128,-128,6,-128,-128,7,-128,-128,8,-128,-128,9,-128,-128);
+	const __m128i r2=_mm_setr_epi8(-128,11,-128,-128,12,-128,-128,13,-128,-128,14,-128,-128,15,-128,-128);
+	const __m128i g2=_mm_setr_epi8(-128,-128,11,-128,-128,12,-128,-128,13,-128,-128,14,-128,-128,15,-128);
+	const __m128i b2=_mm_setr_epi8(10,-128,-128,11,-128,-128,12,-128,-128,13,-128,-128,14,-128,-128,15);
+	
+	/* Convert the first central pixel, which is odd: */
+	demosaicCentralPixels(rRowPtr,cRowPtr,stride,1,2,oddRow,edgeAware);
+	
+	/* Convert runs of sixteen pixels while the right neighbors stay inside the row: */
+	unsigned int x=2;
+	for(;x+17<=width;x+=16)
+		{
+		/* Load the 3x3 neighborhoods of all sixteen pixels: */
+		const ColorComponent* rPtr=rRowPtr+x;
+		__m128i c=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr));
+		__m128i l=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr-1));
+		__m128i r=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr+1));
+		__m128i u=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr-stride));
+		__m128i ul=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr-stride-1));
+		__m128i ur=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr-stride+1));
+		__m128i d=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr+stride));
+		__m128i dl=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr+stride-1));
+		__m128i dr=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr+stride+1));
+		
+		/* Calculate all interpolation candidates: */
+		__m128i horiz=_mm_avg_epu8(l,r);
+		__m128i vert=_mm_avg_epu8(u,d);
+		__m128i diag=avg4(ul,ur,dl,dr);
+		__m128i cross=avg4(u,l,r,d);
+		if(edgeAware)
+			{
+			/* Replace the green candidate by the horizontal or vertical average where the respective gradient is smaller: */
+			__m128i dh=_mm_or_si128(_mm_subs_epu8(l,r),_mm_subs_epu8(r,l));
+			__m128i dv=_mm_or_si128(_mm_subs_epu8(u,d),_mm_subs_epu8(d,u));
+			__m128i dMax=_mm_max_epu8(dh,dv);
+			__m128i hLess=_mm_xor_si128(_mm_cmpeq_epi8(dMax,dh),allOnes);
+			__m128i vLess=_mm_xor_si128(_mm_cmpeq_epi8(dMax,dv),allOnes);
+			cross=select(hLess,horiz,select(vLess,vert,cross));
+			}
+		
+		/* Select the components of even and odd pixels: */
+		__m128i red,grn,blu;
+		if(oddRow)
+			{
+			red=select(evenMask,diag,vert);
+			grn=select(evenMask,cross,c);
+			blu=select(evenMask,c,horiz);
+			}
+		else
+			{
+			red=select(evenMask,horiz,c);
+			grn=select(evenMask,c,cross);
+			blu=select(evenMask,vert,diag);
+			}
+		
+		/* Interleave and store the RGB pixels: */
+		__m128i* cPtr=reinterpret_cast<__m128i*>(cRowPtr+x*3);
+		_mm_storeu_si128(cPtr+0,_mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(red,r0),_mm_shuffle_epi8(grn,g0)),_mm_shuffle_epi8(blu,b0)));
+		_mm_storeu_si128(cPtr+1,_mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(red,r1),_mm_shuffle_epi8(grn,g1)),_mm_shuffle_epi8(blu,b1)));
+		_mm_storeu_si128(cPtr+2,_mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(red,r2),_mm_shuffle_epi8(grn,g2)),_mm_shuffle_epi8(blu,b2)));
+		}
+	
+	/* Convert the remaining central pixels: */
+	demosaicCentralPixels(rRowPtr,cRowPtr,stride,x,width-1,oddRow,edgeAware);
+	}
+
+#endif
+
+typedef void (*CentralRowFunction)(const ColorComponent*,ColorComponent*,int,unsigned int,bool,bool);
+
+}
+
+/********************************
+Methods of class BayerDemosaicer:
+********************************/
+
+void BayerDemosaicer::demosaicRows(const BayerDemosaicer::ColorComponent* rawFrame,BayerDemosaicer::ColorComponent* frame,unsigned int firstRow,unsigned int lastRow) const
+	{
+	/* Select the central row function: */
+	CentralRowFunction demosaicCentralRow=demosaicCentralRowScalar;
+	#if KINECT_BAYERDEMOSAICER_HAVE_X86
+	if(kernel==SSSE3)
+		demosaicCentralRow=demosaicCentralRowSSSE3;
+	#endif
+	bool edgeAware=mode==EDGE_AWARE;
+	
+	int width=int(frameSize[0]);
+	int height=int(frameSize[1]);
+	int stride=width;
+	for(int y=int(firstRow);y<int(lastRow);++y)
+		{
+		const ColorComponent* rPtr=rawFrame+y*stride;
+		ColorComponent* cRowPtr=frame+(height-1-y)*stride*3; // Flip the color image vertically
+		ColorComponent* cPtr=cRowPtr;
+		
+		if(y==0)
+			{
+			/* Convert the first row's first (G) pixel: */
+			*(cPtr++)=rPtr[1];
+			*(cPtr++)=rPtr[0];
+			*(cPtr++)=rPtr[stride];
+			++rPtr;
+			
+			/* Convert the first row's central pixels: */
+			for(int x=1;x<width-1;x+=2)
+				{
+				/* Convert the odd (R) pixel: */
+				*(cPtr++)=rPtr[0];
+				*(cPtr++)=avg(rPtr[-1],rPtr[1],rPtr[stride]);
+				*(cPtr++)=avg(rPtr[stride-1],rPtr[stride+1]);
+				++rPtr;
+				
+				/* Convert the even (G) pixel: */
+				*(cPtr++)=avg(rPtr[-1],rPtr[1]);
+				*(cPtr++)=rPtr[0];
+				*(cPtr++)=rPtr[stride];
+				++rPtr;
+				}
+			
+			/* Convert the first row's last (R) pixel: */
+			*(cPtr++)=rPtr[0];
+			*(cPtr++)=avg(rPtr[-1],rPtr[stride]);
+			*(cPtr++)=rPtr[stride-1];
+			}
+		else if(y==height-1)
+			{
+			/* Convert the last row's first (B) pixel: */
+			*(cPtr++)=rPtr[-stride+1];
+			*(cPtr++)=avg(rPtr[-stride],rPtr[1]);
+			*(cPtr++)=rPtr[0];
+			++rPtr;
+			
+			/* Convert the last row's central pixels: */
+			for(int x=1;x<width-1;x+=2)
+				{
+				/* Convert the odd (G) pixel: */
+				*(cPtr++)=rPtr[-stride];
+				*(cPtr++)=rPtr[0];
+				*(cPtr++)=avg(rPtr[-1],rPtr[1]);
+				++rPtr;
+				
+				/* Convert the even (B) pixel: */
+				*(cPtr++)=avg(rPtr[-stride-1],rPtr[-stride+1]);
+				*(cPtr++)=avg(rPtr[-stride],rPtr[-1],rPtr[1]);
+				*(cPtr++)=rPtr[0];
+				++rPtr;
+				}
+			
+			/* Convert the last row's last (G) pixel: */
+			*(cPtr++)=rPtr[-stride];
+			*(cPtr++)=rPtr[0];
+			*(cPtr++)=rPtr[-1];
+			}
+		else if(y&0x1)
+			{
+			/* Convert the odd row's first (B) pixel: */
+			*(cPtr++)=avg(rPtr[-stride+1],rPtr[stride+1]);
+			*(cPtr++)=avg(rPtr[-stride],rPtr[1],rPtr[stride]);
+			*(cPtr++)=rPtr[0];
+			
+			/* Convert the odd row's central pixels: */
+			demosaicCentralRow(rPtr,cRowPtr,stride,width,true,edgeAware);
+			
+			/* Convert the odd row's last (G) pixel: */
+			rPtr+=width-1;
+			cPtr=cRowPtr+(width-1)*3;
+			*(cPtr++)=avg(rPtr[-stride],rPtr[stride]);
+			*(cPtr++)=rPtr[0];
+			*(cPtr++)=rPtr[-1];
+			}
+		else
+			{
+			/* Convert the even row's first (G) pixel: */
+			*(cPtr++)=rPtr[1];
+			*(cPtr++)=rPtr[0];
+			*(cPtr++)=avg(rPtr[-stride],rPtr[stride]);
+			
+			/* Convert the even row's central pixels: */
+			demosaicCentralRow(rPtr,cRowPtr,stride,width,false,edgeAware);
+			
+			/* Convert the even row's last (R) pixel: */
+			rPtr+=width-1;
+			cPtr=cRowPtr+(width-1)*3;
+			*(cPtr++)=rPtr[0];
+			*(cPtr++)=avg(rPtr[-stride],rPtr[-1],rPtr[stride]);
+			*(cPtr++)=avg(rPtr[-stride-1],rPtr[stride-1]);
+			}
+		}
+	}
+
+void BayerDemosaicer::processBands(void)
+	{
+	while(true)
+		{
+		/* Grab the next unprocessed band of the current frame: */
+		unsigned int band;
+		const ColorComponent* rawFrame;
+		ColorComponent* frame;
+		{
+		Threads::MutexCond::Lock jobLock(jobCond);
+		if(nextBand>=numBands)
+			break;
+		band=nextBand;
+		++nextBand;
+		rawFrame=jobRawFrame;
+		frame=jobFrame;
+		}
+		
+		/* Demosaic the band: */
+		demosaicRows(rawFrame,frame,(frameSize[1]*band)/numBands,(frameSize[1]*(band+1))/numBands);
+		
+		/* Mark the band as completed: */
+		{
+		Threads::MutexCond::Lock doneLock(doneCond);
+		if(--numPendingBands==0)
+			doneCond.signal();
+		}
+		}
+	}
+
+void* BayerDemosaicer::workerThreadMethod(void)
+	{
+	unsigned int lastJobIndex=0;
+	while(true)
+		{
+		/* Wait for the next frame: */
+		{
+		Threads::MutexCond::Lock jobLock(jobCond);
+		while(!shutdown&&jobIndex==lastJobIndex)
+			jobCond.wait(jobLock);
+		if(shutdown)
+			break;
+		lastJobIndex=jobIndex;
+		}
+		
+		/* Help process the frame: */
+		processBands();
+		}
+	
+	return 0;
+	}
+
+BayerDemosaicer::BayerDemosaicer(const unsigned int sFrameSize[2],unsigned int numThreads)
+	:kernel(getBestKernel()),mode(BILINEAR),
+	 numBands(1),numWorkers(0),workers(0),
+	 shutdown(false),jobIndex(0),jobRawFrame(0),jobFrame(0),nextBand(0),
+	 numPendingBands(0)
+	{
+	/* Copy the frame size: */
+	for(int i=0;i<2;++i)
+		frameSize[i]=sFrameSize[i];
+	
+	if(numThreads>1)
+		{
+		/* Split frames into several bands per thread to balance load: */
+		numBands=numThreads*4;
+		if(numBands>frameSize[1])
+			numBands=frameSize[1];
+		
+		/* Start the worker threads: */
+		numWorkers=numThreads-1;
+		workers=new Threads::Thread[numWorkers];
+		for(unsigned int i=0;i<numWorkers;++i)
+			workers[i].start(this,&BayerDemosaicer::workerThreadMethod);
+		}
+	}
+
+BayerDemosaicer::~BayerDemosaicer(void)
+	{
+	if(numWorkers>0)
+		{
+		/* Shut down the worker threads: */
+		{
+		Threads::MutexCond::Lock jobLock(jobCond);
+		shutdown=true;
+		jobCond.broadcast();
+		}
+		for(unsigned int i=0;i<numWorkers;++i)
+			workers[i].join();
+		delete[] workers;
+		}
+	}
+
+bool BayerDemosaicer::isSupported(BayerDemosaicer::Kernel kernel)
+	{
+	switch(kernel)
+		{
+		case SCALAR:
+			return true;
+		
+		#if KINECT_BAYERDEMOSAICER_HAVE_X86
+		case SSSE3:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("ssse3");
+		#endif
+		
+		default:
+			return false;
+		}
+	}
+
+BayerDemosaicer::Kernel BayerDemosaicer::getBestKernel(void)
+	{
+	/* Return the first supported kernel, starting from the fastest: */
+	int result;
+	for(result=NUM_KERNELS-1;result>SCALAR&&!isSupported(Kernel(result));--result)
+		;
+	return Kernel(result);
+	}
+
+const char* BayerDemosaicer::getKernelName(BayerDemosaicer::Kernel kernel)
+	{
+	static const char* kernelNames[NUM_KERNELS]={"Scalar","SSSE3"};
+	return kernel>=SCALAR&&kernel<NUM_KERNELS?kernelNames[kernel]:"Invalid";
+	}
+
+void BayerDemosaicer::setKernel(BayerDemosaicer::Kernel newKernel)
+	{
+	if(!isSupported(newKernel))
+		Misc::throwStdErr("Kinect::BayerDemosaicer::setKernel: Kernel %s is not supported",getKernelName(newKernel));
+	kernel=newKernel;
+	}
+
+void BayerDemosaicer::setMode(BayerDemosaicer::Mode newMode)
+	{
+	mode=newMode;
+	}
+
+void BayerDemosaicer::demosaic(const BayerDemosaicer::ColorComponent* rawFrame,BayerDemosaicer::ColorComponent* frame)
+	{
+	if(numWorkers==0)
+		{
+		/* Demosaic the entire frame in the calling thread: */
+		demosaicRows(rawFrame,frame,0,frameSize[1]);
+		return;
+		}
+	
+	/* Submit the frame to the worker threads: */
+	{
+	Threads::MutexCond::Lock doneLock(doneCond);
+	numPendingBands=numBands;
+	}
+	{
+	Threads::MutexCond::Lock jobLock(jobCond);
+	jobRawFrame=rawFrame;
+	jobFrame=frame;
+	nextBand=0;
+	++jobIndex;
+	jobCond.broadcast();
+	}
+	
+	/* Help process the frame, and then wait until all bands are completed: */
+	processBands();
+	{
+	Threads::MutexCond::Lock doneLock(doneCond);
+	while(numPendingBands>0)
+		doneCond.wait(doneLock);
+	}
+	}
+
+}
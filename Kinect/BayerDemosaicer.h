@@ -0,0 +1,100 @@
+/***********************************************************************
+BayerDemosaicer - Class to convert raw color frames in Bayer GRBG
+pattern as streamed by the Kinect's color camera into RGB frames, using
+vectorized kernels and an optional pool of worker threads processing
+bands of rows in parallel.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_BAYERDEMOSAICER_INCLUDED
+#define KINECT_BAYERDEMOSAICER_INCLUDED
+
+#include <Threads/MutexCond.h>
+#include <Threads/Thread.h>
+#include <Kinect/FrameSource.h>
+
+namespace Kinect {
+
+class BayerDemosaicer
+	{
+	/* Embedded classes: */
+	public:
+	typedef FrameSource::ColorComponent ColorComponent; // Type for raw and demosaiced color components
+	
+	enum Kernel // Enumerated type for implementations of the demosaicing kernel
+		{
+		SCALAR=0, // Portable reference implementation
+		SSSE3, // Vectorized implementation processing 16 pixels at a time
+		NUM_KERNELS
+		};
+	
+	enum Mode // Enumerated type for interpolation modes
+		{
+		BILINEAR=0, // Bilinear interpolation of all missing color components
+		EDGE_AWARE // Interpolates missing green components along the direction of smaller gradient
+		};
+	
+	/* Elements: */
+	private:
+	unsigned int frameSize[2]; // Width and height of color frames; both must be even and at least 4
+	Kernel kernel; // Kernel used to demosaic rows
+	Mode mode; // Interpolation mode
+	unsigned int numBands; // Number of row bands into which a frame is split for parallel processing
+	unsigned int numWorkers; // Number of worker threads in addition to the calling thread
+	Threads::Thread* workers; // Array of worker threads
+	Threads::MutexCond jobCond; // Condition variable to signal a new frame to the worker threads; also protects job state
+	bool shutdown; // Flag to shut down the worker threads
+	unsigned int jobIndex; // Index of the most recently submitted frame
+	const ColorComponent* jobRawFrame; // Raw frame being demosaiced
+	ColorComponent* jobFrame; // Destination of frame being demosaiced
+	unsigned int nextBand; // Index of next unprocessed band of the current frame
+	Threads::MutexCond doneCond; // Condition variable to signal completion of the current frame
+	unsigned int numPendingBands; // Number of bands of the current frame that have not been completed yet
+	
+	/* Private methods: */
+	void demosaicRows(const ColorComponent* rawFrame,ColorComponent* frame,unsigned int firstRow,unsigned int lastRow) const; // Demosaics the given range of raw rows
+	void processBands(void); // Processes bands of the current frame until there are none left
+	void* workerThreadMethod(void); // Thread method for worker threads
+	
+	/* Constructors and destructors: */
+	public:
+	BayerDemosaicer(const unsigned int sFrameSize[2],unsigned int numThreads =1); // Creates a demosaicer for the given frame size using the fastest supported kernel, splitting work between the calling thread and numThreads-1 worker threads
+	~BayerDemosaicer(void);
+	
+	/* Methods: */
+	static bool isSupported(Kernel kernel); // Returns true if the given kernel can be used on the host CPU
+	static Kernel getBestKernel(void); // Returns the fastest kernel supported by the host CPU
+	static const char* getKernelName(Kernel kernel); // Returns a human-readable name for the given kernel
+	Kernel getKernel(void) const // Returns the kernel currently used to demosaic frames
+		{
+		return kernel;
+		}
+	void setKernel(Kernel newKernel); // Selects the kernel used to demosaic frames; throws exception if kernel is not supported by the host CPU
+	Mode getMode(void) const // Returns the current interpolation mode
+		{
+		return mode;
+		}
+	void setMode(Mode newMode); // Sets the interpolation mode
+	void demosaic(const ColorComponent* rawFrame,ColorComponent* frame); // Demosaics the given raw frame into the given RGB frame, flipping it vertically; must not be called from more than one thread at a time
+	};
+
+}
+
+#endif
@@ -28,9 +28,12 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <libusb-1.0/libusb.h>
 #include <string>
 #include <iostream>
+#include <stdexcept>
 #include <Misc/ThrowStdErr.h>
 #include <Misc/FunctionCalls.h>
 #include <Misc/FileTests.h>
+#include <Misc/Time.h>
+#include <Misc/StandardMarshallers.h>
 #include <USB/Context.h>
 #include <USB/DeviceList.h>
 #include <IO/File.h>
@@ -40,6 +43,9 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <Geometry/ProjectiveTransformation.h>
 #include <Geometry/GeometryValueCoders.h>
 #include <Kinect/FrameBuffer.h>
+#include <Kinect/BayerDemosaicer.h>
+#include <Kinect/RawDepthUnpacker.h>
+#include <Kinect/FrameTracer.h>
 
 #define KINECT_CAMERA_DUMP_INIT 0
 #define KINECT_CAMERA_STREAMER_USE_CAMERA_TIMESTAMP 0
@@ -159,48 +165,30 @@ void Camera::CalibrationParameters::write(IO::File& file) const
 Methods of class Camera::StreamingState:
 ***************************************/
 
-Camera::StreamingState::StreamingState(libusb_device_handle* handle,unsigned int endpoint,Misc::Timer& sFrameTimer,double& sFrameTimerOffset,int sPacketFlagBase,int sPacketSize,const unsigned int sFrameSize[2],size_t sRawFrameSize,Camera::StreamingCallback* sStreamingCallback)
+Camera::StreamingState::StreamingState(int sStreamIndex,unsigned int sTraceSourceId,Misc::Timer& sFrameTimer,double& sFrameTimerOffset,int sPacketFlagBase,int sPacketSize,const unsigned int sFrameSize[2],size_t sRawFrameSize,unsigned int sNumSlots,Camera::StreamingCallback* sStreamingCallback)
 	:frameTimer(sFrameTimer),frameTimerOffset(sFrameTimerOffset),
 	 packetFlagBase(sPacketFlagBase),
 	 packetSize(sPacketSize),numPackets(16),numTransfers(32),
 	 transferBuffers(0),transfers(0),numActiveTransfers(0),
-	 rawFrameSize(sRawFrameSize),rawFrameBuffer(new unsigned char[rawFrameSize*2]),
-	 activeBuffer(0),writePtr(rawFrameBuffer),bufferSpace(rawFrameSize),
-	 readyFrame(0),cancelDecoding(false),
-	 streamingCallback(sStreamingCallback)
+	 rawFrameSize(sRawFrameSize),numSlots(sNumSlots>=2?sNumSlots:2),
+	 rawFrameBuffer(new unsigned char[rawFrameSize*numSlots]),slotTimeStamps(new double[numSlots]),
+	 assemblingFrame(false),writePtr(0),bufferSpace(0),
+	 numCompletedFrames(0),numDecodedFrames(0),numDroppedFrames(0),
+	 cancelDecoding(false),
+	 streamingCallback(sStreamingCallback),
+	 streamIndex(sStreamIndex),packetDumpFile(0),packetDumpMutex(0),traceSourceId(sTraceSourceId)
 	{
 	/* Copy the frame size: */
 	frameSize[0]=sFrameSize[0];
 	frameSize[1]=sFrameSize[1];
-	
-	/* Initialize the streaming data structures: */
-	transferBuffers=new unsigned char*[numTransfers];
-	transfers=new libusb_transfer*[numTransfers];
-	for(int i=0;i<numTransfers;++i)
-		{
-		/* Allocate a transfer buffer and a transfer object: */
-		transferBuffers[i]=new unsigned char[packetSize*numPackets];
-		transfers[i]=libusb_alloc_transfer(numPackets);
-		if(transfers[i]!=0)
-			{
-			/* Initialize the transfer object: */
-			libusb_fill_iso_transfer(transfers[i],handle,endpoint,transferBuffers[i],packetSize*numPackets,numPackets,transferCallback,this,0);
-			libusb_set_iso_packet_lengths(transfers[i],packetSize);
-			if(libusb_submit_transfer(transfers[i])==0)
-				++numActiveTransfers;
-			else
-				std::cerr<<"Error submitting transfer "<<i<<std::endl;
-			}
-		else
-			std::cerr<<"Error allocating transfer "<<i<<std::endl;
-		}
 	}
 
 Camera::StreamingState::~StreamingState(void)
 	{
 	/* Cancel all transfers: */
-	for(int i=0;i<numTransfers;++i)
-		libusb_cancel_transfer(transfers[i]);
+	if(transfers!=0)
+		for(int i=0;i<numTransfers;++i)
+			libusb_cancel_transfer(transfers[i]);
 	
 	/* Stop the decoding thread: */
 	#if 0
@@ -222,22 +210,51 @@ Camera::StreamingState::~StreamingState(void)
 		}
 	
 	/* Destroy the streaming data structures: */
-	for(int i=0;i<numTransfers;++i)
+	if(transfers!=0)
 		{
-		/* Delete the transfer object and buffer: */
-		libusb_free_transfer(transfers[i]);
-		delete[] transferBuffers[i];
+		for(int i=0;i<numTransfers;++i)
+			{
+			/* Delete the transfer object and buffer: */
+			libusb_free_transfer(transfers[i]);
+			delete[] transferBuffers[i];
+			}
+		delete[] transfers;
+		delete[] transferBuffers;
 		}
-	delete[] transfers;
-	delete[] transferBuffers;
 	
-	/* Destroy the raw frame buffer: */
+	/* Destroy the raw frame ring: */
 	delete[] rawFrameBuffer;
+	delete[] slotTimeStamps;
 	
 	/* Destroy the streaming callback: */
 	delete streamingCallback;
 	}
 
+void Camera::StreamingState::startTransfers(libusb_device_handle* handle,unsigned int endpoint)
+	{
+	/* Initialize the streaming data structures: */
+	transferBuffers=new unsigned char*[numTransfers];
+	transfers=new libusb_transfer*[numTransfers];
+	for(int i=0;i<numTransfers;++i)
+		{
+		/* Allocate a transfer buffer and a transfer object: */
+		transferBuffers[i]=new unsigned char[packetSize*numPackets];
+		transfers[i]=libusb_alloc_transfer(numPackets);
+		if(transfers[i]!=0)
+			{
+			/* Initialize the transfer object: */
+			libusb_fill_iso_transfer(transfers[i],handle,endpoint,transferBuffers[i],packetSize*numPackets,numPackets,transferCallback,this,0);
+			libusb_set_iso_packet_lengths(transfers[i],packetSize);
+			if(libusb_submit_transfer(transfers[i])==0)
+				++numActiveTransfers;
+			else
+				std::cerr<<"Error submitting transfer "<<i<<std::endl;
+			}
+		else
+			std::cerr<<"Error allocating transfer "<<i<<std::endl;
+		}
+	}
+
 void Camera::StreamingState::transferCallback(libusb_transfer* transfer)
 	{
 	/* Get the object pointer: */
@@ -245,69 +262,24 @@ void Camera::StreamingState::transferCallback(libusb_transfer* transfer)
 	
 	if(transfer->status==LIBUSB_TRANSFER_COMPLETED)
 		{
+		/* Get the arrival time of all packets in the completed transfer: */
+		double arrivalTime=thisPtr->frameTimer.peekTime()+thisPtr->frameTimerOffset;
+		
 		/* Process all isochronous packets in the completed transfer: */
 		unsigned char* packetPtr=transfer->buffer;
 		for(int i=0;i<transfer->num_iso_packets;++i)
 			{
 			size_t packetSize=transfer->iso_packet_desc[i].actual_length;
-			if(packetSize>=12&&packetPtr[0]==0x52U&&packetPtr[1]==0x42U)
+			if(thisPtr->packetDumpFile!=0&&packetSize>0)
 				{
-				#if KINECT_CAMERA_DUMP_HEADERS
-				if(thisPtr->headerFile!=0)
-					thisPtr->headerFile->write(packetPtr,12);
-				#endif
-				
-				/* Parse the packet header: */
-				size_t payloadSize=packetSize-12*sizeof(unsigned char); // Each packet has a 12-byte header
-				int packetType=packetPtr[3]-thisPtr->packetFlagBase;
-				
-				/* Check if this is the beginning of a new frame: */
-				if(packetType==0x01)
-					{
-					/* Activate the next double buffer half: */
-					thisPtr->activeBuffer=1-thisPtr->activeBuffer;
-					thisPtr->writePtr=thisPtr->rawFrameBuffer+thisPtr->rawFrameSize*thisPtr->activeBuffer;
-					thisPtr->bufferSpace=thisPtr->rawFrameSize;
-					
-					/* Time-stamp the new frame: */
-					#if KINECT_CAMERA_STREAMER_USE_CAMERA_TIMESTAMP
-					unsigned int timeStamp=(unsigned int)packetPtr[11];
-					for(int j=10;j>=8;--j)
-						timeStamp=(timeStamp<<8)|(unsigned int)packetPtr[j];
-					thisPtr->activeFrameTimeStamp=double(timeStamp)/2000000.0;
-					#else
-					thisPtr->activeFrameTimeStamp=thisPtr->frameTimer.peekTime()+thisPtr->frameTimerOffset;
-					#endif
-					}
-				
-				/* Check for a data packet: */
-				if(packetType==0x01||packetType==0x02||packetType==0x05)
-					{
-					/* Append the packet data to the active raw frame buffer: */
-					if(thisPtr->bufferSpace>=payloadSize)
-						{
-						memcpy(thisPtr->writePtr,packetPtr+12,payloadSize);
-						thisPtr->writePtr+=payloadSize;
-						thisPtr->bufferSpace-=payloadSize;
-						}
-					}
-				
-				/* Check if this is the end of the current frame: */
-				if(packetType==0x05)
-					{
-					Threads::MutexCond::Lock frameReadyLock(thisPtr->frameReadyCond);
-					
-					/* Check if the frame was received intact: */
-					thisPtr->readyFrameIntact=true; // thisPtr->bufferSpace==0;
-					if(thisPtr->readyFrameIntact)
-						{
-						/* Submit the raw frame to the frame decoder: */
-						thisPtr->readyFrame=thisPtr->rawFrameBuffer+thisPtr->rawFrameSize*thisPtr->activeBuffer;
-						thisPtr->readyFrameTimeStamp=thisPtr->activeFrameTimeStamp;
-						thisPtr->frameReadyCond.signal();
-						}
-					}
+				/* Dump the raw packet and its arrival time: */
+				Threads::Mutex::Lock packetDumpLock(*thisPtr->packetDumpMutex);
+				thisPtr->packetDumpFile->write<Misc::UInt8>(thisPtr->streamIndex);
+				thisPtr->packetDumpFile->write<Misc::Float64>(arrivalTime);
+				thisPtr->packetDumpFile->write<Misc::UInt16>(Misc::UInt16(packetSize));
+				thisPtr->packetDumpFile->write(packetPtr,packetSize);
 				}
+			thisPtr->processPacket(packetPtr,packetSize,arrivalTime);
 			
 			/* Go to the next packet in the current USB transfer (even if a packet is short, the next one starts at the preset offset): */
 			packetPtr+=thisPtr->packetSize;
@@ -323,6 +295,106 @@ void Camera::StreamingState::transferCallback(libusb_transfer* transfer)
 		}
 	}
 
+void Camera::StreamingState::processPacket(const unsigned char* packet,size_t packetSize,double arrivalTime)
+	{
+	if(packetSize>=12&&packet[0]==0x52U&&packet[1]==0x42U)
+		{
+		#if KINECT_CAMERA_DUMP_HEADERS
+		if(headerFile!=0)
+			headerFile->write(packet,12);
+		#endif
+		
+		/* Parse the packet header: */
+		size_t payloadSize=packetSize-12*sizeof(unsigned char); // Each packet has a 12-byte header
+		int packetType=packet[3]-packetFlagBase;
+		
+		/* Check if this is the beginning of a new frame: */
+		if(packetType==0x01)
+			{
+			/* Check if the raw frame ring has a free slot (the decoding thread only ever frees slots, so the test can not become false in the meantime): */
+			unsigned int numUsedSlots=numCompletedFrames-numDecodedFrames;
+			__sync_synchronize(); // Do not overwrite the slot before the decoding thread is done reading it
+			assemblingFrame=numUsedSlots<numSlots;
+			if(assemblingFrame)
+				{
+				FrameTracer::trace(traceSourceId,streamIndex,numCompletedFrames,FrameTracer::FIRST_PACKET);
+				
+				/* Assemble the new frame into the next free slot: */
+				unsigned int slot=numCompletedFrames%numSlots;
+				writePtr=rawFrameBuffer+rawFrameSize*slot;
+				bufferSpace=rawFrameSize;
+				
+				/* Time-stamp the new frame: */
+				#if KINECT_CAMERA_STREAMER_USE_CAMERA_TIMESTAMP
+				unsigned int timeStamp=(unsigned int)packet[11];
+				for(int j=10;j>=8;--j)
+					timeStamp=(timeStamp<<8)|(unsigned int)packet[j];
+				slotTimeStamps[slot]=double(timeStamp)/2000000.0;
+				#else
+				slotTimeStamps[slot]=arrivalTime;
+				#endif
+				}
+			else
+				{
+				/* Drop the new frame instead of overwriting a frame the decoding thread has not yet processed: */
+				++numDroppedFrames;
+				}
+			}
+		
+		/* Check for a data packet: */
+		if(assemblingFrame&&(packetType==0x01||packetType==0x02||packetType==0x05))
+			{
+			/* Append the packet data to the receiving raw frame slot: */
+			if(bufferSpace>=payloadSize)
+				{
+				memcpy(writePtr,packet+12,payloadSize);
+				writePtr+=payloadSize;
+				bufferSpace-=payloadSize;
+				}
+			}
+		
+		/* Check if this is the end of the current frame: */
+		if(assemblingFrame&&packetType==0x05)
+			{
+			FrameTracer::trace(traceSourceId,streamIndex,numCompletedFrames,FrameTracer::FRAME_COMPLETE);
+			
+			/* Publish the completed frame to the decoding thread: */
+			__sync_synchronize(); // Make the frame's contents visible before the slot is handed over
+			++numCompletedFrames;
+			assemblingFrame=false;
+			
+			/* Wake up the decoding thread in case it is waiting on an empty ring: */
+			Threads::MutexCond::Lock frameReadyLock(frameReadyCond);
+			frameReadyCond.signal();
+			}
+		}
+	}
+
+unsigned char* Camera::StreamingState::waitForFrame(double& timeStamp)
+	{
+	/* Wait until the ring contains at least one completed frame: */
+	{
+	Threads::MutexCond::Lock frameReadyLock(frameReadyCond);
+	while(!cancelDecoding&&numDecodedFrames==numCompletedFrames)
+		frameReadyCond.wait(frameReadyLock);
+	if(cancelDecoding)
+		return 0;
+	}
+	__sync_synchronize(); // Do not read the slot before its contents are visible
+	
+	/* Return the oldest completed frame: */
+	unsigned int slot=numDecodedFrames%numSlots;
+	timeStamp=slotTimeStamps[slot];
+	return rawFrameBuffer+rawFrameSize*slot;
+	}
+
+void Camera::StreamingState::releaseFrame(void)
+	{
+	/* Hand the oldest slot back to the transfer callback: */
+	__sync_synchronize(); // Finish reading the slot before it can be overwritten
+	++numDecodedFrames;
+	}
+
 /***********************
 Methods of class Camera:
 ***********************/
@@ -415,49 +487,28 @@ void Camera::writeRegister(Camera::USBWord address,Camera::USBWord value)
 		Misc::throwStdErr("Kinect::Camera::writeRegister: Protocol error");
 	}
 
-namespace {
-
-/***********************************
-Helper functions for Bayer decoding:
-***********************************/
-
-inline FrameSource::ColorComponent avg(FrameSource::ColorComponent v1,FrameSource::ColorComponent v2)
-	{
-	return FrameSource::ColorComponent(((unsigned int)(v1)+(unsigned int)(v2)+1U)>>1);
-	}
-
-inline FrameSource::ColorComponent avg(FrameSource::ColorComponent v1,FrameSource::ColorComponent v2,FrameSource::ColorComponent v3)
-	{
-	return FrameSource::ColorComponent(((unsigned int)(v1)+(unsigned int)(v2)+(unsigned int)(v3)+1U)/3U);
-	}
-
-inline FrameSource::ColorComponent avg(FrameSource::ColorComponent v1,FrameSource::ColorComponent v2,FrameSource::ColorComponent v3,FrameSource::ColorComponent v4)
-	{
-	return FrameSource::ColorComponent(((unsigned int)(v1)+(unsigned int)(v2)+(unsigned int)(v3)+(unsigned int)(v4)+2U)>>2);
-	}
-
-}
-
 void* Camera::colorDecodingThreadMethod(void)
 	{
 	Threads::Thread::setCancelState(Threads::Thread::CANCEL_ENABLE);
 	// Threads::Thread::setCancelType(Threads::Thread::CANCEL_ASYNCHRONOUS);
 	
+	/* Create a demosaicer for raw color frames: */
+	unsigned int colorFrameSize[2];
+	for(int i=0;i<2;++i)
+		colorFrameSize[i]=streamers[COLOR]->frameSize[i];
+	BayerDemosaicer demosaicer(colorFrameSize,numColorDecodingThreads);
+	if(edgeAwareDemosaicing)
+		demosaicer.setMode(BayerDemosaicer::EDGE_AWARE);
+	
 	while(true)
 		{
 		/* Wait for the next color frame: */
-		ColorComponent* framePtr;
 		double frameTimeStamp;
-		{
-		Threads::MutexCond::Lock frameReadyLock(streamers[COLOR]->frameReadyCond);
-		while(!streamers[COLOR]->cancelDecoding&&streamers[COLOR]->readyFrame==0)
-			streamers[COLOR]->frameReadyCond.wait(frameReadyLock);
-		if(streamers[COLOR]->cancelDecoding)
+		ColorComponent* framePtr=streamers[COLOR]->waitForFrame(frameTimeStamp);
+		if(framePtr==0)
 			break;
-		framePtr=streamers[COLOR]->readyFrame;
-		frameTimeStamp=streamers[COLOR]->readyFrameTimeStamp;
-		streamers[COLOR]->readyFrame=0;
-		}
+		unsigned int frameIndex=streamers[COLOR]->numDecodedFrames;
+		FrameTracer::trace(streamers[COLOR]->traceSourceId,COLOR,frameIndex,FrameTracer::DECODE_START);
 		
 		/* Allocate a new decoded color buffer: */
 		int width=streamers[COLOR]->frameSize[0];
@@ -466,153 +517,15 @@ void* Camera::colorDecodingThreadMethod(void)
 		decodedFrame.timeStamp=frameTimeStamp;
 		
 		/* Decode the raw color buffer (which is in Bayer GRBG pattern): */
-		int stride=width;
-		const ColorComponent* rRowPtr=framePtr;
-		ColorComponent* cRowPtr=static_cast<ColorComponent*>(decodedFrame.getBuffer());
-		cRowPtr+=(height-1)*stride*3; // Flip the color image vertically
-		
-		/* Convert the first row: */
-		const ColorComponent* rPtr=rRowPtr;
-		ColorComponent* cPtr=cRowPtr;
-		
-		/* Convert the first row's first (G) pixel: */
-		*(cPtr++)=rPtr[1];
-		*(cPtr++)=rPtr[0];
-		*(cPtr++)=rPtr[stride];
-		++rPtr;
-		
-		/* Convert the first row's central pixels: */
-		for(int x=1;x<width-1;x+=2)
-			{
-			/* Convert the odd (R) pixel: */
-			*(cPtr++)=rPtr[0];
-			*(cPtr++)=avg(rPtr[-1],rPtr[1],rPtr[stride]);
-			*(cPtr++)=avg(rPtr[stride-1],rPtr[stride+1]);
-			++rPtr;
-			
-			/* Convert the even (G) pixel: */
-			*(cPtr++)=avg(rPtr[-1],rPtr[1]);
-			*(cPtr++)=rPtr[0];
-			*(cPtr++)=rPtr[stride];
-			++rPtr;
-			}
-		
-		/* Convert the first row's last (R) pixel: */
-		*(cPtr++)=rPtr[0];
-		*(cPtr++)=avg(rPtr[-1],rPtr[stride]);
-		*(cPtr++)=rPtr[stride-1];
-		++rPtr;
-		
-		rRowPtr+=stride;
-		cRowPtr-=stride*3;
-		
-		/* Convert the central rows: */
-		for(int y=1;y<height-1;y+=2)
-			{
-			/* Convert the odd row: */
-			rPtr=rRowPtr;
-			cPtr=cRowPtr;
-			
-			/* Convert the odd row's first (B) pixel: */
-			*(cPtr++)=avg(rPtr[-stride+1],rPtr[stride+1]);
-			*(cPtr++)=avg(rPtr[-stride],rPtr[1],rPtr[stride]);
-			*(cPtr++)=rPtr[0];
-			++rPtr;
-			
-			/* Convert the odd row's central pixels: */
-			for(int x=1;x<width-1;x+=2)
-				{
-				/* Convert the odd (G) pixel: */
-				*(cPtr++)=avg(rPtr[-stride],rPtr[stride]);
-				*(cPtr++)=rPtr[0];
-				*(cPtr++)=avg(rPtr[-1],rPtr[1]);
-				++rPtr;
-				
-				/* Convert the even (B) pixel: */
-				*(cPtr++)=avg(rPtr[-stride-1],rPtr[-stride+1],rPtr[stride-1],rPtr[stride+1]);
-				*(cPtr++)=avg(rPtr[-stride],rPtr[-1],rPtr[1],rPtr[stride]);
-				*(cPtr++)=rPtr[0];
-				++rPtr;
-				}
-			
-			/* Convert the odd row's last (G) pixel: */
-			*(cPtr++)=avg(rPtr[-stride],rPtr[stride]);
-			*(cPtr++)=rPtr[0];
-			*(cPtr++)=rPtr[-1];
-			++rPtr;
-			
-			rRowPtr+=stride;
-			cRowPtr-=stride*3;
-			
-			/* Convert the even row: */
-			rPtr=rRowPtr;
-			cPtr=cRowPtr;
-			
-			/* Convert the even row's first (G) pixel: */
-			*(cPtr++)=rPtr[1];
-			*(cPtr++)=rPtr[0];
-			*(cPtr++)=avg(rPtr[-stride],rPtr[stride]);
-			++rPtr;
-			
-			/* Convert the even row's central pixels: */
-			for(int x=1;x<width-1;x+=2)
-				{
-				/* Convert the odd (R) pixel: */
-				*(cPtr++)=rPtr[0];
-				*(cPtr++)=avg(rPtr[-stride],rPtr[-1],rPtr[1],rPtr[stride]);
-				*(cPtr++)=avg(rPtr[-stride-1],rPtr[-stride+1],rPtr[stride-1],rPtr[stride+1]);
-				++rPtr;
-				
-				/* Convert the even (G) pixel: */
-				*(cPtr++)=avg(rPtr[-1],rPtr[1]);
-				*(cPtr++)=rPtr[0];
-				*(cPtr++)=avg(rPtr[-stride],rPtr[stride]);
-				++rPtr;
-				}
-			
-			/* Convert the even row's last (R) pixel: */
-			*(cPtr++)=rPtr[0];
-			*(cPtr++)=avg(rPtr[-stride],rPtr[-1],rPtr[stride]);
-			*(cPtr++)=avg(rPtr[-stride-1],rPtr[stride-1]);
-			++rPtr;
-			
-			rRowPtr+=stride;
-			cRowPtr-=stride*3;
-			}
-		
-		/* Convert the last row: */
-		rPtr=rRowPtr;
-		cPtr=cRowPtr;
-		
-		/* Convert the last row's first (B) pixel: */
-		*(cPtr++)=rPtr[-stride+1];
-		*(cPtr++)=avg(rPtr[-stride],rPtr[1]);
-		*(cPtr++)=rPtr[0];
-		++rPtr;
-		
-		/* Convert the last row's central pixels: */
-		for(int x=1;x<width-1;x+=2)
-			{
-			/* Convert the odd (G) pixel: */
-			*(cPtr++)=rPtr[-stride];
-			*(cPtr++)=rPtr[0];
-			*(cPtr++)=avg(rPtr[-1],rPtr[1]);
-			++rPtr;
-			
-			/* Convert the even (B) pixel: */
-			*(cPtr++)=avg(rPtr[-stride-1],rPtr[-stride+1]);
-			*(cPtr++)=avg(rPtr[-stride],rPtr[-1],rPtr[1]);
-			*(cPtr++)=rPtr[0];
-			++rPtr;
-			}
+		demosaicer.demosaic(framePtr,static_cast<ColorComponent*>(decodedFrame.getBuffer()));
+		streamers[COLOR]->releaseFrame();
 		
-		/* Convert the last row's last (G) pixel: */
-		*(cPtr++)=rPtr[-stride];
-		*(cPtr++)=rPtr[0];
-		*(cPtr++)=rPtr[-1];
+		FrameTracer::trace(streamers[COLOR]->traceSourceId,COLOR,frameIndex,FrameTracer::DECODE_END);
 		
 		/* Pass the decoded color buffer to the streaming callback function: */
+		FrameTracer::trace(streamers[COLOR]->traceSourceId,COLOR,frameIndex,FrameTracer::CALLBACK_ENTRY);
 		(*streamers[COLOR]->streamingCallback)(decodedFrame);
+		FrameTracer::trace(streamers[COLOR]->traceSourceId,COLOR,frameIndex,FrameTracer::CALLBACK_EXIT);
 		}
 	
 	return 0;
@@ -667,21 +580,21 @@ void* Camera::depthDecodingThreadMethod(void)
 	
 	typedef Misc::UInt8 Byte;
 	
+	/* Create an unpacker for raw depth frames using the fastest kernel supported by the CPU: */
+	unsigned int depthFrameSize[2];
+	for(int i=0;i<2;++i)
+		depthFrameSize[i]=streamers[DEPTH]->frameSize[i];
+	RawDepthUnpacker depthUnpacker(depthFrameSize);
+	
 	while(true)
 		{
 		/* Wait for the next depth frame: */
-		Byte* framePtr;
 		double frameTimeStamp;
-		{
-		Threads::MutexCond::Lock frameReadyLock(streamers[DEPTH]->frameReadyCond);
-		while(!streamers[DEPTH]->cancelDecoding&&streamers[DEPTH]->readyFrame==0)
-			streamers[DEPTH]->frameReadyCond.wait(frameReadyLock);
-		if(streamers[DEPTH]->cancelDecoding)
+		Byte* framePtr=streamers[DEPTH]->waitForFrame(frameTimeStamp);
+		if(framePtr==0)
 			break;
-		framePtr=streamers[DEPTH]->readyFrame;
-		frameTimeStamp=streamers[DEPTH]->readyFrameTimeStamp;
-		streamers[DEPTH]->readyFrame=0;
-		}
+		unsigned int frameIndex=streamers[DEPTH]->numDecodedFrames;
+		FrameTracer::trace(streamers[DEPTH]->traceSourceId,DEPTH,frameIndex,FrameTracer::DECODE_START);
 		
 		/* Allocate a new decoded depth buffer: */
 		int width=streamers[DEPTH]->frameSize[0];
@@ -689,48 +602,9 @@ void* Camera::depthDecodingThreadMethod(void)
 		FrameBuffer decodedFrame(width,height,width*height*sizeof(DepthPixel));
 		decodedFrame.timeStamp=frameTimeStamp;
 		
-		/* Decode the raw depth buffer: */
-		Byte* sPtr=framePtr;
-		DepthPixel* dRowPtr=static_cast<DepthPixel*>(decodedFrame.getBuffer());
-		dRowPtr+=width*(height-1);
-		
-		/* Process rows: */
-		DepthPixel* bfPtr=backgroundFrame;
-		for(int y=0;y<height;++y,dRowPtr-=width) // Flip the depth image vertically
-			{
-			DepthPixel* dPtr=dRowPtr;
-			
-			/* Process pixels in groups of eight: */
-			for(int x=0;x<width;x+=8,sPtr+=11,dPtr+=8,bfPtr+=8)
-				{
-				/* Convert a run of 11 8-bit bytes into 8 11-bit pixels: */
-				dPtr[0]=(DepthPixel(sPtr[0])<<3)|(DepthPixel(sPtr[1])>>5);
-				dPtr[1]=((DepthPixel(sPtr[1])&0x1fU)<<6)|(DepthPixel(sPtr[2])>>2);
-				dPtr[2]=((DepthPixel(sPtr[2])&0x03U)<<9)|(DepthPixel(sPtr[3])<<1)|(DepthPixel(sPtr[4])>>7);
-				dPtr[3]=((DepthPixel(sPtr[4])&0x7fU)<<4)|(DepthPixel(sPtr[5])>>4);
-				dPtr[4]=((DepthPixel(sPtr[5])&0x0fU)<<7)|(DepthPixel(sPtr[6])>>1);
-				dPtr[5]=((DepthPixel(sPtr[6])&0x01U)<<10)|(DepthPixel(sPtr[7])<<2)|(DepthPixel(sPtr[8])>>6);
-				dPtr[6]=((DepthPixel(sPtr[8])&0x3fU)<<5)|(DepthPixel(sPtr[9])>>3);
-				dPtr[7]=((DepthPixel(sPtr[9])&0x07U)<<8)|DepthPixel(sPtr[10]);
-				
-				/* Check if we're in the middle of capturing a background frame: */
-				if(numBackgroundFrames>0)
-					{
-					/* Update the pixels' background depth values: */
-					for(int i=0;i<8;++i)
-						if(bfPtr[i]>dPtr[i])
-							bfPtr[i]=dPtr[i];
-					}
-				
-				if(removeBackground)
-					{
-					/* Remove background pixels: */
-					for(int i=0;i<8;++i)
-						if(dPtr[i]+backgroundRemovalFuzz>=bfPtr[i])
-							dPtr[i]=invalidDepth; // Mark the pixel as really far away
-					}
-				}
-			}
+		/* Decode the raw depth buffer, capturing or removing background in the same pass: */
+		depthUnpacker.unpackFrame(framePtr,static_cast<DepthPixel*>(decodedFrame.getBuffer()),backgroundFrame,numBackgroundFrames>0,removeBackground,backgroundRemovalFuzz);
+		streamers[DEPTH]->releaseFrame();
 		
 		if(numBackgroundFrames>0)
 			{
@@ -751,8 +625,12 @@ void* Camera::depthDecodingThreadMethod(void)
 				}
 			}
 		
+		FrameTracer::trace(streamers[DEPTH]->traceSourceId,DEPTH,frameIndex,FrameTracer::DECODE_END);
+		
 		/* Pass the decoded depth buffer to the streaming callback function: */
+		FrameTracer::trace(streamers[DEPTH]->traceSourceId,DEPTH,frameIndex,FrameTracer::CALLBACK_ENTRY);
 		(*streamers[DEPTH]->streamingCallback)(decodedFrame);
+		FrameTracer::trace(streamers[DEPTH]->traceSourceId,DEPTH,frameIndex,FrameTracer::CALLBACK_EXIT);
 		}
 	
 	return 0;
@@ -796,18 +674,12 @@ void* Camera::compressedDepthDecodingThreadMethod(void)
 	while(true)
 		{
 		/* Wait for the next depth frame: */
-		Byte* framePtr;
 		double frameTimeStamp;
-		{
-		Threads::MutexCond::Lock frameReadyLock(streamers[DEPTH]->frameReadyCond);
-		while(!streamers[DEPTH]->cancelDecoding&&streamers[DEPTH]->readyFrame==0)
-			streamers[DEPTH]->frameReadyCond.wait(frameReadyLock);
-		if(streamers[DEPTH]->cancelDecoding)
+		Byte* framePtr=streamers[DEPTH]->waitForFrame(frameTimeStamp);
+		if(framePtr==0)
 			break;
-		framePtr=streamers[DEPTH]->readyFrame;
-		frameTimeStamp=streamers[DEPTH]->readyFrameTimeStamp;
-		streamers[DEPTH]->readyFrame=0;
-		}
+		unsigned int frameIndex=streamers[DEPTH]->numDecodedFrames;
+		FrameTracer::trace(streamers[DEPTH]->traceSourceId,DEPTH,frameIndex,FrameTracer::DECODE_START);
 		
 		/* Allocate a new decoded depth buffer: */
 		int width=streamers[DEPTH]->frameSize[0];
@@ -882,6 +754,9 @@ void* Camera::compressedDepthDecodingThreadMethod(void)
 				}
 			}
 		
+		/* Hand the raw frame's slot back to the transfer callback: */
+		streamers[DEPTH]->releaseFrame();
+		
 		#if 0
 		
 		/* Open the depth frame to fill holes: */
@@ -970,8 +845,12 @@ void* Camera::compressedDepthDecodingThreadMethod(void)
 				}
 			}
 		
+		FrameTracer::trace(streamers[DEPTH]->traceSourceId,DEPTH,frameIndex,FrameTracer::DECODE_END);
+		
 		/* Pass the decoded depth buffer to the streaming callback function: */
+		FrameTracer::trace(streamers[DEPTH]->traceSourceId,DEPTH,frameIndex,FrameTracer::CALLBACK_ENTRY);
 		(*streamers[DEPTH]->streamingCallback)(decodedFrame);
+		FrameTracer::trace(streamers[DEPTH]->traceSourceId,DEPTH,frameIndex,FrameTracer::CALLBACK_EXIT);
 		}
 	
 	return 0;
@@ -1032,6 +911,95 @@ std::string getKinectSerialNumber(USB::Context& usbContext,libusb_device* device
 
 }
 
+void* Camera::replayThreadMethod(void)
+	{
+	Threads::Thread::setCancelState(Threads::Thread::CANCEL_ENABLE);
+	// Threads::Thread::setCancelType(Threads::Thread::CANCEL_ASYNCHRONOUS);
+	
+	/* Feed all packets from the packet dump file into the streaming states: */
+	unsigned char packet[2048];
+	bool firstPacket=true;
+	double firstArrivalTime=0.0;
+	Misc::Timer replayTimer;
+	while(!cancelReplay&&!replayFile->eof())
+		{
+		/* Read the next packet: */
+		int streamIndex;
+		double arrivalTime;
+		size_t packetSize;
+		try
+			{
+			streamIndex=replayFile->read<Misc::UInt8>();
+			arrivalTime=replayFile->read<Misc::Float64>();
+			packetSize=replayFile->read<Misc::UInt16>();
+			if(streamIndex>1||packetSize>sizeof(packet))
+				{
+				std::cerr<<"Kinect::Camera: Corrupted packet dump file "<<replayFileName<<std::endl;
+				break;
+				}
+			replayFile->read(packet,packetSize);
+			}
+		catch(std::runtime_error err)
+			{
+			/* Treat a truncated last packet, e.g., from an interrupted dump, like a corrupted one: */
+			std::cerr<<"Kinect::Camera: Truncated packet dump file "<<replayFileName<<std::endl;
+			break;
+			}
+		
+		if(replaySpeed>0.0)
+			{
+			/* Wait until the packet is due: */
+			if(firstPacket)
+				{
+				firstArrivalTime=arrivalTime;
+				firstPacket=false;
+				}
+			double dueTime=(arrivalTime-firstArrivalTime)/replaySpeed;
+			double currentTime=replayTimer.peekTime();
+			if(currentTime<dueTime)
+				Misc::sleep(dueTime-currentTime);
+			}
+		
+		/* Assemble the packet into its stream's raw frame ring: */
+		if(streamers[streamIndex]!=0)
+			streamers[streamIndex]->processPacket(packet,packetSize,arrivalTime);
+		}
+	
+	/* Wait until the decoding threads have processed all completed frames: */
+	for(int i=0;i<2;++i)
+		while(!cancelReplay&&streamers[i]!=0&&streamers[i]->numDecodedFrames!=streamers[i]->numCompletedFrames)
+			usleep(1000);
+	
+	/* Signal replay completion: */
+	{
+	Threads::MutexCond::Lock replayDoneLock(replayDoneCond);
+	replayDone=true;
+	replayDoneCond.broadcast();
+	}
+	
+	return 0;
+	}
+
+void Camera::readPacketDumpHeader(IO::File& file)
+	{
+	/* Check the file format version: */
+	unsigned int fileFormatVersion=file.read<Misc::UInt32>();
+	if(fileFormatVersion!=1)
+		Misc::throwStdErr("Kinect::Camera::readPacketDumpHeader: Unsupported packet dump file format version %u",fileFormatVersion);
+	
+	/* Read the recorded camera settings: */
+	serialNumber=Misc::Marshaller<std::string>::read(file);
+	for(int i=0;i<2;++i)
+		{
+		frameSizes[i]=FrameSize(file.read<Misc::UInt8>());
+		frameRates[i]=FrameRate(file.read<Misc::UInt8>());
+		}
+	compressDepthFrames=file.read<Misc::UInt8>()!=0;
+	
+	/* Read the factory calibration parameters: */
+	replayCalibrationParameters.read(file);
+	}
+
 void Camera::initialize(USB::Context& usbContext,USB::DeviceList* deviceList)
 	{
 	/* Determine the Kinect's model number: */
@@ -1064,9 +1032,11 @@ Camera::Camera(USB::Context& usbContext,libusb_device* sDevice)
 	 messageSequenceNumber(0x2000U),
 	 frameTimerOffset(0.0),
 	 compressDepthFrames(true),smoothDepthFrames(true),
+	 numColorDecodingThreads(1),edgeAwareDemosaicing(false),numRawFrameSlots(4),
 	 numBackgroundFrames(0),backgroundFrame(0),
 	 backgroundCaptureCallback(0),
-	 removeBackground(false),backgroundRemovalFuzz(5)
+	 removeBackground(false),backgroundRemovalFuzz(5),
+	 replaySpeed(1.0),cancelReplay(false),replayDone(false)
 	 #if KINECT_CAMERA_DUMP_HEADERS
 	 ,headerFile(0)
 	 #endif
@@ -1098,9 +1068,11 @@ Camera::Camera(USB::Context& usbContext,size_t index)
 	:messageSequenceNumber(0x2000U),
 	 frameTimerOffset(0.0),
 	 compressDepthFrames(true),smoothDepthFrames(true),
+	 numColorDecodingThreads(1),edgeAwareDemosaicing(false),numRawFrameSlots(4),
 	 numBackgroundFrames(0),backgroundFrame(0),
 	 backgroundCaptureCallback(0),
-	 removeBackground(false),backgroundRemovalFuzz(5)
+	 removeBackground(false),backgroundRemovalFuzz(5),
+	 replaySpeed(1.0),cancelReplay(false),replayDone(false)
 	 #if KINECT_CAMERA_DUMP_HEADERS
 	 ,headerFile(0)
 	 #endif
@@ -1119,9 +1091,11 @@ Camera::Camera(USB::Context& usbContext,const char* serialNumber)
 	:messageSequenceNumber(0x2000U),
 	 frameTimerOffset(0.0),
 	 compressDepthFrames(true),smoothDepthFrames(true),
+	 numColorDecodingThreads(1),edgeAwareDemosaicing(false),numRawFrameSlots(4),
 	 numBackgroundFrames(0),backgroundFrame(0),
 	 backgroundCaptureCallback(0),
-	 removeBackground(false),backgroundRemovalFuzz(5)
+	 removeBackground(false),backgroundRemovalFuzz(5),
+	 replaySpeed(1.0),cancelReplay(false),replayDone(false)
 	 #if KINECT_CAMERA_DUMP_HEADERS
 	 ,headerFile(0)
 	 #endif
@@ -1152,15 +1126,47 @@ Camera::Camera(USB::Context& usbContext,const char* serialNumber)
 	initialize(usbContext,&deviceList);
 	}
 
+Camera::Camera(const char* packetDumpFileName)
+	:messageSequenceNumber(0x2000U),
+	 frameTimerOffset(0.0),
+	 compressDepthFrames(true),smoothDepthFrames(true),
+	 numColorDecodingThreads(1),edgeAwareDemosaicing(false),numRawFrameSlots(4),
+	 numBackgroundFrames(0),backgroundFrame(0),
+	 backgroundCaptureCallback(0),
+	 removeBackground(false),backgroundRemovalFuzz(5),
+	 replayFileName(packetDumpFileName),
+	 replaySpeed(1.0),cancelReplay(false),replayDone(false)
+	 #if KINECT_CAMERA_DUMP_HEADERS
+	 ,headerFile(0)
+	 #endif
+	{
+	/* Read the recorded camera settings from the packet dump file: */
+	IO::FilePtr file(IO::openFile(replayFileName.c_str()));
+	file->setEndianness(Misc::LittleEndian);
+	readPacketDumpHeader(*file);
+	
+	/* Initialize the streamer states: */
+	streamers[0]=0;
+	streamers[1]=0;
+	}
+
 Camera::~Camera(void)
 	{
+	/* Stop the replay thread: */
+	if(replayFile!=0)
+		{
+		cancelReplay=true;
+		replayThread.join();
+		}
+	
 	delete streamers[0];
 	delete streamers[1];
 	delete[] backgroundFrame;
 	delete backgroundCaptureCallback;
 	
 	/* Release the interface and re-attach the kernel driver: */
-	device.releaseInterface(0);
+	if(!isReplaying())
+		device.releaseInterface(0);
 	// device.setConfiguration(1); // This seems to confuse the device
 	// device.reset(); // This seems to confuse the device
 	}
@@ -1286,6 +1292,43 @@ const unsigned int* Camera::getActualFrameSize(int camera) const
 
 void Camera::startStreaming(FrameSource::StreamingCallback* newColorStreamingCallback,FrameSource::StreamingCallback* newDepthStreamingCallback)
 	{
+	/* Identify this camera's frames in frame traces by its serial number: */
+	unsigned int traceSourceId=FrameTracer::registerSource(serialNumber.c_str());
+	
+	if(isReplaying())
+		{
+		/* Re-open the packet dump file and skip its header: */
+		replayFile=IO::openFile(replayFileName.c_str());
+		replayFile->setEndianness(Misc::LittleEndian);
+		readPacketDumpHeader(*replayFile);
+		
+		/* Create streaming states that are fed by the replay thread instead of USB transfers: */
+		if(newColorStreamingCallback!=0)
+			{
+			const unsigned int* colorFrameSize=getActualFrameSize(COLOR);
+			size_t rawFrameSize=colorFrameSize[0]*colorFrameSize[1]; // Bayer pattern; one byte per pixel
+			streamers[COLOR]=new StreamingState(COLOR,traceSourceId,frameTimer,frameTimerOffset,0x80U,1920,colorFrameSize,rawFrameSize,numRawFrameSlots,newColorStreamingCallback);
+			streamers[COLOR]->decodingThread.start(this,&Camera::colorDecodingThreadMethod);
+			}
+		if(newDepthStreamingCallback!=0)
+			{
+			const unsigned int* depthFrameSize=getActualFrameSize(DEPTH);
+			size_t rawFrameSize=(depthFrameSize[0]*depthFrameSize[1]*11+7)/8; // Packed bitstream; 11 bits per pixel
+			streamers[DEPTH]=new StreamingState(DEPTH,traceSourceId,frameTimer,frameTimerOffset,0x70U,1760,depthFrameSize,rawFrameSize,numRawFrameSlots,newDepthStreamingCallback);
+			if(compressDepthFrames)
+				streamers[DEPTH]->decodingThread.start(this,&Camera::compressedDepthDecodingThreadMethod);
+			else
+				streamers[DEPTH]->decodingThread.start(this,&Camera::depthDecodingThreadMethod);
+			}
+		
+		/* Start the replay thread: */
+		cancelReplay=false;
+		replayDone=false;
+		replayThread.start(this,&Camera::replayThreadMethod);
+		
+		return;
+		}
+	
 	/* Open and prepare the device: */
 	device.open();
 	// device.setConfiguration(1); // This seems to confuse the device
@@ -1315,6 +1358,24 @@ void Camera::startStreaming(FrameSource::StreamingCallback* newColorStreamingCal
 	if(!sequenceOk)
 		Misc::throwStdErr("Kinect::Camera::startStreaming: Failed to disable cameras");
 	
+	if(packetDumpFile!=0)
+		{
+		/* Write the packet dump file header: */
+		packetDumpFile->write<Misc::UInt32>(1); // File format version
+		Misc::Marshaller<std::string>::write(serialNumber,*packetDumpFile);
+		for(int i=0;i<2;++i)
+			{
+			packetDumpFile->write<Misc::UInt8>(frameSizes[i]);
+			packetDumpFile->write<Misc::UInt8>(frameRates[i]);
+			}
+		packetDumpFile->write<Misc::UInt8>(compressDepthFrames?1:0);
+		
+		/* Write the factory calibration parameters to allow replays to calculate intrinsic parameters: */
+		CalibrationParameters calib;
+		getCalibrationParameters(calib);
+		calib.write(*packetDumpFile);
+		}
+	
 	#if KINECT_CAMERA_DUMP_HEADERS
 	std::string headerFileName="Headers-";
 	headerFileName.append(getSerialNumber());
@@ -1329,12 +1390,20 @@ void Camera::startStreaming(FrameSource::StreamingCallback* newColorStreamingCal
 		/* Create the color streaming state: */
 		const unsigned int* colorFrameSize=getActualFrameSize(COLOR);
 		size_t rawFrameSize=colorFrameSize[0]*colorFrameSize[1]; // Bayer pattern; one byte per pixel
-		streamers[COLOR]=new StreamingState(device.getDeviceHandle(),0x81U,frameTimer,frameTimerOffset,0x80U,1920,colorFrameSize,rawFrameSize,newColorStreamingCallback);
+		streamers[COLOR]=new StreamingState(COLOR,traceSourceId,frameTimer,frameTimerOffset,0x80U,1920,colorFrameSize,rawFrameSize,numRawFrameSlots,newColorStreamingCallback);
+		if(packetDumpFile!=0)
+			{
+			streamers[COLOR]->packetDumpFile=packetDumpFile.getPointer();
+			streamers[COLOR]->packetDumpMutex=&packetDumpMutex;
+			}
 		
 		#if KINECT_CAMERA_DUMP_HEADERS
 		streamers[COLOR]->headerFile=headerFile;
 		#endif
 		
+		/* Start receiving color packets: */
+		streamers[COLOR]->startTransfers(device.getDeviceHandle(),0x81U);
+		
 		/* Start the color decoding thread: */
 		streamers[COLOR]->decodingThread.start(this,&Camera::colorDecodingThreadMethod);
 		}
@@ -1345,12 +1414,20 @@ void Camera::startStreaming(FrameSource::StreamingCallback* newColorStreamingCal
 		/* Create the depth streaming state: */
 		const unsigned int* depthFrameSize=getActualFrameSize(DEPTH);
 		size_t rawFrameSize=(depthFrameSize[0]*depthFrameSize[1]*11+7)/8; // Packed bitstream; 11 bits per pixel
-		streamers[DEPTH]=new StreamingState(device.getDeviceHandle(),0x82U,frameTimer,frameTimerOffset,0x70U,1760,depthFrameSize,rawFrameSize,newDepthStreamingCallback);
+		streamers[DEPTH]=new StreamingState(DEPTH,traceSourceId,frameTimer,frameTimerOffset,0x70U,1760,depthFrameSize,rawFrameSize,numRawFrameSlots,newDepthStreamingCallback);
+		if(packetDumpFile!=0)
+			{
+			streamers[DEPTH]->packetDumpFile=packetDumpFile.getPointer();
+			streamers[DEPTH]->packetDumpMutex=&packetDumpMutex;
+			}
 		
 		#if KINECT_CAMERA_DUMP_HEADERS
 		streamers[DEPTH]->headerFile=headerFile;
 		#endif
 		
+		/* Start receiving depth packets: */
+		streamers[DEPTH]->startTransfers(device.getDeviceHandle(),0x82U);
+		
 		/* Start the depth decoding thread: */
 		if(compressDepthFrames)
 			streamers[DEPTH]->decodingThread.start(this,&Camera::compressedDepthDecodingThreadMethod);
@@ -1422,9 +1499,22 @@ void Camera::startStreaming(FrameSource::StreamingCallback* newColorStreamingCal
 
 void Camera::stopStreaming(void)
 	{
-	/* Send commands to stop streaming: */
-	sendCommand(0x0005U,0x0000U); // Disable color streaming
-	sendCommand(0x0006U,0x0000U); // Disable depth streaming (and turn off IR projector)
+	if(isReplaying())
+		{
+		/* Stop the replay thread: */
+		if(replayFile!=0)
+			{
+			cancelReplay=true;
+			replayThread.join();
+			replayFile=0;
+			}
+		}
+	else
+		{
+		/* Send commands to stop streaming: */
+		sendCommand(0x0005U,0x0000U); // Disable color streaming
+		sendCommand(0x0006U,0x0000U); // Disable depth streaming (and turn off IR projector)
+		}
 	
 	/* Destroy the streaming states: */
 	for(int i=0;i<2;++i)
@@ -1439,6 +1529,9 @@ void Camera::stopStreaming(void)
 	backgroundFrame=0;
 	removeBackground=false;
 	
+	/* Close the packet dump file: */
+	packetDumpFile=0;
+	
 	#if KINECT_CAMERA_DUMP_HEADERS
 	headerFile=0;
 	#endif
@@ -1446,6 +1539,13 @@ void Camera::stopStreaming(void)
 
 void Camera::getCalibrationParameters(Camera::CalibrationParameters& calib)
 	{
+	if(isReplaying())
+		{
+		/* Return the calibration parameters stored in the packet dump file: */
+		calib=replayCalibrationParameters;
+		return;
+		}
+	
 	/* Temporarily open the device: */
 	bool tempOpen=!device.isOpen();
 	if(tempOpen)
@@ -1547,6 +1647,64 @@ void Camera::setSmoothDepthFrames(bool newSmoothDepthFrames)
 	smoothDepthFrames=newSmoothDepthFrames; 
 	}
 
+void Camera::setColorDecodingThreads(unsigned int newNumColorDecodingThreads)
+	{
+	numColorDecodingThreads=newNumColorDecodingThreads>0?newNumColorDecodingThreads:1;
+	}
+
+void Camera::setEdgeAwareDemosaicing(bool newEdgeAwareDemosaicing)
+	{
+	edgeAwareDemosaicing=newEdgeAwareDemosaicing;
+	}
+
+void Camera::setNumRawFrameSlots(unsigned int newNumRawFrameSlots)
+	{
+	/* Need at least two slots to receive a frame while the previous one is being decoded: */
+	numRawFrameSlots=newNumRawFrameSlots>=2?newNumRawFrameSlots:2;
+	}
+
+void Camera::setPacketDumpFile(const char* packetDumpFileName)
+	{
+	/* Open the new packet dump file: */
+	packetDumpFile=0;
+	if(packetDumpFileName!=0)
+		{
+		packetDumpFile=IO::openFile(packetDumpFileName,IO::File::WriteOnly);
+		packetDumpFile->setEndianness(Misc::LittleEndian);
+		}
+	}
+
+void Camera::setReplaySpeed(double newReplaySpeed)
+	{
+	replaySpeed=newReplaySpeed;
+	}
+
+void Camera::waitForReplay(void)
+	{
+	/* Bail out if the camera is not replaying: */
+	if(replayFile==0)
+		return;
+	
+	Threads::MutexCond::Lock replayDoneLock(replayDoneCond);
+	while(!replayDone)
+		replayDoneCond.wait(replayDoneLock);
+	}
+
+Camera::StreamStatistics Camera::getStreamStatistics(int camera) const
+	{
+	StreamStatistics result;
+	result.numCompletedFrames=0;
+	result.numDecodedFrames=0;
+	result.numDroppedFrames=0;
+	if(streamers[camera]!=0)
+		{
+		result.numCompletedFrames=streamers[camera]->numCompletedFrames;
+		result.numDecodedFrames=streamers[camera]->numDecodedFrames;
+		result.numDroppedFrames=streamers[camera]->numDroppedFrames;
+		}
+	return result;
+	}
+
 void Camera::captureBackground(unsigned int newNumBackgroundFrames,bool replace,Camera::BackgroundCaptureCallback* newBackgroundCaptureCallback)
 	{
 	/* Remember the background capture callback: */
@@ -30,12 +30,11 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <string>
 #include <Misc/SizedTypes.h>
 #include <Misc/Timer.h>
+#include <Threads/Mutex.h>
 #include <Threads/MutexCond.h>
 #include <Threads/Thread.h>
 #include <USB/Device.h>
-#if KINECT_CAMERA_DUMP_HEADERS
 #include <IO/File.h>
-#endif
 #include <Kinect/FrameSource.h>
 
 /* Forward declarations: */
@@ -49,9 +48,6 @@ namespace USB {
 class Context;
 class DeviceList;
 }
-namespace IO {
-class File;
-}
 
 namespace Kinect {
 
@@ -120,6 +116,15 @@ class Camera:public FrameSource
 		unsigned short operatingMode; // Bit field defining the camera's operating mode
 		};
 	
+	struct StreamStatistics // Structure reporting the fate of raw frames received by a color or depth stream
+		{
+		/* Elements: */
+		public:
+		unsigned int numCompletedFrames; // Number of frames completely received from the camera
+		unsigned int numDecodedFrames; // Number of received frames that were decoded and passed to the streaming callback
+		unsigned int numDroppedFrames; // Number of frames dropped because the decoding thread fell behind by more than the number of raw frame slots
+		};
+	
 	private:
 	typedef Misc::UInt16 USBWord; // Type for words of data exchanged at the USB library API
 	
@@ -139,32 +144,42 @@ class Camera:public FrameSource
 		
 		int frameSize[2]; // Size of streamed frames in pixels
 		size_t rawFrameSize; // Total size of encoded frames received from the camera
-		unsigned char* rawFrameBuffer; // Double buffer to assemble an encoded frame during streaming and hold a previous frame for processing
-		int activeBuffer; // Index of buffer half currently receiving frame data from the camera
-		double activeFrameTimeStamp; // Time stamp for the frame currently being received
-		unsigned char* writePtr; // Current write position in active buffer half
-		size_t bufferSpace; // Number of bytes still to be written into active buffer half
+		unsigned int numSlots; // Number of slots in the raw frame ring
+		unsigned char* rawFrameBuffer; // Ring of raw frame slots to assemble encoded frames during streaming and hold completed frames for processing
+		double* slotTimeStamps; // Time stamps of the frames in the raw frame ring's slots
+		bool assemblingFrame; // Flag whether the frame currently being received is assembled into a ring slot, or dropped
+		unsigned char* writePtr; // Current write position in the slot receiving frame data from the camera
+		size_t bufferSpace; // Number of bytes still to be written into the receiving slot
+		volatile unsigned int numCompletedFrames; // Number of frames completely received into the ring; only written by the USB transfer callback
+		volatile unsigned int numDecodedFrames; // Number of frames removed from the ring by the decoding thread; only written by the decoding thread
+		volatile unsigned int numDroppedFrames; // Number of frames dropped because all ring slots were occupied
 		
 		Threads::MutexCond frameReadyCond; // Condition variable to signal completion of a new frame to the decoding thread
-		bool readyFrameIntact; // Flag whether the completed frame was received intact
-		unsigned char* volatile readyFrame; // Pointer to buffer half containing the completed frame
-		double readyFrameTimeStamp; // Time stamp of completed frame
 		volatile bool cancelDecoding; // Flag to cancel the deocding thread
 		Threads::Thread decodingThread; // Thread to decode raw frames into user-visible format
 		
 		StreamingCallback* streamingCallback; // Callback to be called when a new frame has been decoded
 		
+		Misc::UInt8 streamIndex; // Index of this stream in packet dump files and frame traces
+		IO::File* packetDumpFile; // File to which raw isochronous packets are dumped as they arrive, or null
+		Threads::Mutex* packetDumpMutex; // Mutex serializing packet dumps from multiple streams
+		unsigned int traceSourceId; // ID of the camera in the frame tracer
+		
 		#if KINECT_CAMERA_DUMP_HEADERS
 		IO::FilePtr headerFile;
 		#endif
 		
 		/* Constructors and destructors: */
 		public:
-		StreamingState(libusb_device_handle* handle,unsigned int endpoint,Misc::Timer& sFrameTimer,double& sFrameTimerOffset,int sPacketFlagBase,int sPacketSize,const unsigned int sFrameSize[2],size_t sRawFrameSize,StreamingCallback* sStreamingCallback); // Prepares a streaming state for streaming
+		StreamingState(int sStreamIndex,unsigned int sTraceSourceId,Misc::Timer& sFrameTimer,double& sFrameTimerOffset,int sPacketFlagBase,int sPacketSize,const unsigned int sFrameSize[2],size_t sRawFrameSize,unsigned int sNumSlots,StreamingCallback* sStreamingCallback); // Prepares a streaming state for the given stream and frame tracer source ID, for streaming with the given number of raw frame slots
 		~StreamingState(void); // Cleanly stops streaming and destroys the streaming state
 		
 		/* Methods: */
+		void startTransfers(libusb_device_handle* handle,unsigned int endpoint); // Starts receiving isochronous packets from the given endpoint of the given device
 		static void transferCallback(libusb_transfer* transfer); // Callback called when a USB transfer completes or is cancelled
+		void processPacket(const unsigned char* packet,size_t packetSize,double arrivalTime); // Assembles a received or replayed isochronous packet into the raw frame ring
+		unsigned char* waitForFrame(double& timeStamp); // Blocks until the oldest completed raw frame is available and returns it and its time stamp; returns null if decoding was cancelled
+		void releaseFrame(void); // Returns the slot of the frame last returned by waitForFrame to the raw frame ring
 		};
 	
 	/* Elements: */
@@ -180,12 +195,25 @@ class Camera:public FrameSource
 	double frameTimerOffset; // Time offset to apply to cameras' timers
 	bool compressDepthFrames; // Flag whether to request RLE/differential compressed depth frames from the depth camera
 	bool smoothDepthFrames; // Flag whether to smooth depth frames inside the Kinect's processor, whatever that means
+	unsigned int numColorDecodingThreads; // Number of threads to demosaic raw color frames
+	bool edgeAwareDemosaicing; // Flag whether to interpolate missing green components along edges when demosaicing raw color frames
+	unsigned int numRawFrameSlots; // Number of raw frame slots buffering received frames for the decoding threads
 	StreamingState* streamers[2]; // Streaming states for color and depth frames
 	unsigned int numBackgroundFrames; // Number of background frames left to capture
 	DepthPixel* backgroundFrame; // Frame containing minimal depth values for a captured background
 	BackgroundCaptureCallback* backgroundCaptureCallback; // Function to call upon completion of background capture
 	bool removeBackground; // Flag whether to remove background information during frame processing
 	Misc::SInt16 backgroundRemovalFuzz; // Fuzz value for background removal (positive values: more aggressive removal)
+	IO::FilePtr packetDumpFile; // File to which raw isochronous packets are dumped during streaming, or null
+	Threads::Mutex packetDumpMutex; // Mutex serializing access to the packet dump file
+	std::string replayFileName; // Name of packet dump file replayed instead of streaming from a Kinect device; empty for live cameras
+	CalibrationParameters replayCalibrationParameters; // Factory calibration parameters stored in the replayed packet dump file
+	double replaySpeed; // Speed factor at which packets are replayed relative to their recorded arrival times; <=0.0 replays as fast as possible
+	IO::FilePtr replayFile; // Packet dump file being replayed during streaming
+	Threads::Thread replayThread; // Thread feeding replayed packets into the streaming states
+	volatile bool cancelReplay; // Flag to cancel the replay thread
+	Threads::MutexCond replayDoneCond; // Condition variable signalling that all replayed frames have been decoded
+	bool replayDone; // Flag whether all replayed frames have been decoded
 	
 	#if KINECT_CAMERA_DUMP_HEADERS
 	IO::FilePtr headerFile;
@@ -199,13 +227,16 @@ class Camera:public FrameSource
 	void* colorDecodingThreadMethod(void); // The color decoding thread method
 	void* depthDecodingThreadMethod(void); // The depth decoding thread method
 	void* compressedDepthDecodingThreadMethod(void); // The depth decoding thread method for RLE/differential-compressed frames
+	void* replayThreadMethod(void); // The thread method replaying packets from a packet dump file
 	void initialize(USB::Context& usbContext,USB::DeviceList* deviceList =0); // Initializes the Kinect camera; called from constructors
+	void readPacketDumpHeader(IO::File& file); // Reads camera settings and calibration parameters from the header of a packet dump file
 	
 	/* Constructors and destructors: */
 	public:
 	Camera(USB::Context& usbContext,libusb_device* sDevice); // Creates a Kinect camera wrapper around the given USB device, which is assumed to be a Kinect camera
 	Camera(USB::Context& usbContext,size_t index =0); // Opens the index-th Kinect camera device on the given USB context
 	Camera(USB::Context& usbContext,const char* serialNumber); // Opens the Kinect camera with the given serial number on the given USB context
+	Camera(const char* packetDumpFileName); // Creates a camera that replays the raw packets recorded in the given packet dump file instead of streaming from a Kinect device
 	virtual ~Camera(void); // Destroys the camera
 	
 	/* Methods from FrameSource: */
@@ -236,6 +267,17 @@ class Camera:public FrameSource
 	void resetFrameTimer(double newFrameTimerOffset =0.0); // Resets the frame timer to zero
 	void setCompressDepthFrames(bool newCompressDepthFrames); // Enables or disables depth frame compression for the next streaming operation
 	void setSmoothDepthFrames(bool newSmoothDepthFrames); // Enables or disables depth frame smoothing for the next streaming operation
+	void setColorDecodingThreads(unsigned int newNumColorDecodingThreads); // Sets the number of threads used to demosaic color frames for the next streaming operation
+	void setEdgeAwareDemosaicing(bool newEdgeAwareDemosaicing); // Enables or disables edge-aware demosaicing of color frames for the next streaming operation
+	void setNumRawFrameSlots(unsigned int newNumRawFrameSlots); // Sets the number of raw frames each stream can buffer while its decoding thread is busy for the next streaming operation
+	StreamStatistics getStreamStatistics(int camera) const; // Returns the frame counts of the color or depth stream since streaming was started; returns all zeros if the stream is not active
+	void setPacketDumpFile(const char* packetDumpFileName); // Dumps all raw packets received during the next streaming operation to the given file; dumping is disabled if file name is null
+	bool isReplaying(void) const // Returns true if the camera replays a packet dump file
+		{
+		return !replayFileName.empty();
+		}
+	void setReplaySpeed(double newReplaySpeed); // Sets the speed factor at which a replaying camera feeds packets relative to their recorded arrival times; <=0.0 feeds packets as fast as possible
+	void waitForReplay(void); // Blocks until a replaying camera has fed all packets and decoded all completed frames
 	void captureBackground(unsigned int newNumBackgroundFrames,bool replace,BackgroundCaptureCallback* newBackgroundCaptureCallback =0); // Captures the given number of frames to create a background removal buffer and calls optional callback upon completion
 	bool loadDefaultBackground(void); // Loads the default background removal buffer for this camera; returns true if background was loaded
 	void loadBackground(const char* fileNamePrefix); // Loads a background removal buffer from a file with the given prefix
@@ -24,9 +24,9 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 
 #include <Misc/SizedTypes.h>
 #include <IO/File.h>
-#include <Math/Constants.h>
 #include <Video/Config.h>
 #if VIDEO_CONFIG_HAVE_THEORA
+#include <theora/codec.h>
 #include <Video/Colorspaces.h>
 #include <Video/TheoraFrame.h>
 #include <Video/TheoraInfo.h>
@@ -94,15 +94,9 @@ FrameBuffer ColorFrameReader::readNextFrame(void)
 	/* Create the result frame: */
 	FrameBuffer result(size[0],size[1],size[1]*size[0]*sizeof(FrameSource::ColorPixel));
 	
-	/* Return a dummy frame if the file is over: */
-	if(source.eof())
-		{
-		result.timeStamp=Math::Constants<double>::max;
+	/* Read the frame's time stamp from the source, and return a dummy frame if the stream is over: */
+	if(!readTimeStamp(source,result.timeStamp))
 		return result;
-		}
-	
-	/* Read the frame's time stamp from the source: */
-	result.timeStamp=source.read<Misc::Float64>();
 	
 	if(sourceHasTheora)
 		{
@@ -113,6 +107,7 @@ FrameBuffer ColorFrameReader::readNextFrame(void)
 		/* Read and process the next packet: */
 		Video::TheoraPacket packet;
 		packet.read(source);
+		keyframe=th_packet_iskeyframe(&packet)>0;
 		
 		theoraDecoder.processPacket(packet);
 		}
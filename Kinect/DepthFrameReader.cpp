@@ -23,126 +23,349 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 
 #include <Kinect/DepthFrameReader.h>
 
+#include <string.h>
+#include <vector>
+#include <Misc/ThrowStdErr.h>
+#include <Misc/FunctionCalls.h>
 #include <IO/File.h>
-#include <Math/Constants.h>
 #include <Kinect/FrameBuffer.h>
-#include <Kinect/FrameSource.h>
+#include <Kinect/MappedFile.h>
 
 namespace Kinect {
 
-/*********************************
-Methods of class DepthFrameReader:
-*********************************/
+namespace {
+
+/**************
+Helper classes:
+**************/
 
-void DepthFrameReader::readHuffmanTree(unsigned int& numLeaves,DepthFrameReader::HuffmanNode*& nodes)
+class FileWordSource // Class to read 32-bit words from a file
 	{
-	/* Read the number of leaf nodes: */
-	numLeaves=source.read<Misc::UInt32>();
+	/* Elements: */
+	private:
+	IO::File& file; // The file
 	
-	/* Allocate and read the tree's node array: */
-	nodes=new HuffmanNode[numLeaves-1]; // No need to store leaves; only interior nodes
+	/* Constructors and destructors: */
+	public:
+	FileWordSource(IO::File& sFile)
+		:file(sFile)
+		{
+		}
 	
-	/* Read all nodes: */
-	for(unsigned int i=0;i<numLeaves-1;++i)
+	/* Methods: */
+	Misc::UInt32 readWord(void) // Returns the next word
 		{
-		nodes[i].left=source.read<Misc::UInt32>();
-		nodes[i].right=source.read<Misc::UInt32>();
+		return file.read<Misc::UInt32>();
 		}
-	}
+	};
 
-void DepthFrameReader::fillBitBuffer(void)
+class MemoryWordSource // Class to read 32-bit words in host byte order from a memory block without alignment requirements
 	{
-	/* Read more data: */
-	source.read(currentBits);
-	currentBitMask=0x80000000U;
-	}
+	/* Elements: */
+	private:
+	const Misc::UInt8* wordPtr; // Position of the next word in the memory block
+	const Misc::UInt8* wordEnd; // End of the memory block
+	
+	/* Constructors and destructors: */
+	public:
+	MemoryWordSource(const Misc::UInt8* sWordPtr,const Misc::UInt8* sWordEnd)
+		:wordPtr(sWordPtr),wordEnd(sWordEnd)
+		{
+		}
+	
+	/* Methods: */
+	Misc::UInt32 readWord(void) // Returns the next word, or zero if the memory block is exhausted
+		{
+		if(wordPtr==wordEnd)
+			return 0x0U;
+		
+		/* Copy the word to support unaligned words in memory-mapped files; this compiles to a single load on common architectures: */
+		Misc::UInt32 result;
+		memcpy(&result,wordPtr,sizeof(Misc::UInt32));
+		wordPtr+=sizeof(Misc::UInt32);
+		return result;
+		}
+	};
 
-void DepthFrameReader::flushBits(void)
+template <class WordSourceParam>
+class BitReader // Class to read a bit stream from a source of 32-bit words
 	{
-	/* Mark the bit buffer as empty: */
-	currentBits=0x0U;
-	currentBitMask=0x0U;
-	}
+	/* Elements: */
+	private:
+	WordSourceParam& wordSource; // Source of 32-bit words
+	Misc::UInt64 currentBits; // Buffer to extract bits from the word source; unread bits are left-aligned, and all bits after them are zero
+	unsigned int numCurrentBits; // Number of unread bits in the bit buffer
+	
+	/* Private methods: */
+	void fillBitBuffer(void) // Appends the next word from the word source to the bit buffer, which must hold at most 32 unread bits
+		{
+		currentBits|=Misc::UInt64(wordSource.readWord())<<(32-numCurrentBits);
+		numCurrentBits+=32;
+		}
+	
+	/* Constructors and destructors: */
+	public:
+	BitReader(WordSourceParam& sWordSource)
+		:wordSource(sWordSource),
+		 currentBits(0x0U),numCurrentBits(0)
+		{
+		}
+	
+	/* Methods: */
+	bool peekBit(void) // Returns the next bit without removing it from the bit stream
+		{
+		if(numCurrentBits==0)
+			fillBitBuffer();
+		return (currentBits>>63)!=0x0U;
+		}
+	void skipBits(unsigned int numBits) // Removes the given number of unread bits from the bit buffer
+		{
+		currentBits<<=numBits;
+		numCurrentBits-=numBits;
+		}
+	Misc::UInt32 getBits(unsigned int numBits) // Reads up to 32 bits and returns them
+		{
+		/* Only read words from the word source that contain requested bits, to never read beyond the end of the bit stream: */
+		while(numCurrentBits<numBits)
+			fillBitBuffer();
+		
+		/* Extract the bits from the bit buffer: */
+		Misc::UInt32 result=Misc::UInt32(currentBits>>(64-numBits));
+		skipBits(numBits);
+		
+		return result;
+		}
+	template <class HuffmanTableParam>
+	unsigned int decode(const HuffmanTableParam& table) // Reads a Huffman-encoded value and returns it
+		{
+		while(true)
+			{
+			/* Look up the next code bits; unread bits are followed by zeros if the buffer is short: */
+			typename HuffmanTableParam::Entry entry=table.entries[currentBits>>(64-table.tableBits)];
+			if(entry.subTableBits!=0)
+				{
+				/* Resolve the rest of the code in the secondary table: */
+				entry=table.entries[entry.value+((currentBits<<table.tableBits)>>(64-entry.subTableBits))];
+				}
+			
+			/*****************************************************************
+			If the code found is not longer than the number of unread bits, it
+			is the actual code, as no code can be a prefix of another one.
+			Otherwise, the code's bits are still in the word source:
+			*****************************************************************/
+			
+			if(entry.codeLength<=numCurrentBits)
+				{
+				skipBits(entry.codeLength);
+				return entry.value;
+				}
+			fillBitBuffer();
+			}
+		}
+	};
+
+}
 
-DepthFrameReader::DepthFrameReader(IO::File& sSource)
-	:source(sSource),
-	 pixelDeltaNumLeaves(0),pixelDeltaNodes(0),
-	 spanLengthNumLeaves(0),spanLengthNodes(0),
-	 currentBits(0x0U),currentBitMask(0x0U)
+/*********************************
+Methods of class DepthFrameReader:
+*********************************/
+
+void DepthFrameReader::readHuffmanTree(DepthFrameReader::HuffmanTable& table)
 	{
-	/* Read the frame size from the source: */
-	for(int i=0;i<2;++i)
-		size[i]=source.read<Misc::UInt32>();
+	/* Read the number of leaf nodes: */
+	unsigned int numLeaves=source.read<Misc::UInt32>();
+	if(numLeaves==0)
+		Misc::throwStdErr("Kinect::DepthFrameReader::readHuffmanTree: Empty Huffman tree");
 	
-	/* Create the Hilbert curve offset array: */
-	hilbertCurve.init(size);
+	/* Read the tree's interior nodes: */
+	std::vector<HuffmanNode> nodes(numLeaves-1);
+	for(unsigned int i=0;i<numLeaves-1;++i)
+		{
+		nodes[i].left=source.read<Misc::UInt32>();
+		nodes[i].right=source.read<Misc::UInt32>();
+		}
 	
-	/* Read the pixel delta and span length Huffman decoding trees from the source: */
-	readHuffmanTree(pixelDeltaNumLeaves,pixelDeltaNodes);
-	readHuffmanTree(spanLengthNumLeaves,spanLengthNodes);
+	/* Assign a code to each leaf by traversing the tree from its root: */
+	std::vector<Misc::UInt32> codes(numLeaves,0);
+	std::vector<unsigned int> codeLengths(numLeaves,0);
+	std::vector<unsigned int> nodeStack;
+	std::vector<Misc::UInt32> codeStack;
+	std::vector<unsigned int> codeLengthStack;
+	nodeStack.push_back(numLeaves+numLeaves-2);
+	codeStack.push_back(0);
+	codeLengthStack.push_back(0);
+	while(!nodeStack.empty())
+		{
+		unsigned int node=nodeStack.back();
+		Misc::UInt32 code=codeStack.back();
+		unsigned int codeLength=codeLengthStack.back();
+		nodeStack.pop_back();
+		codeStack.pop_back();
+		codeLengthStack.pop_back();
+		
+		if(node<numLeaves)
+			{
+			/* Assign the code to the leaf: */
+			codes[node]=code;
+			codeLengths[node]=codeLength;
+			}
+		else if(node<numLeaves+numLeaves-1&&codeLength<maxCodeLength)
+			{
+			/* Traverse the node's subtrees: */
+			const HuffmanNode& n=nodes[node-numLeaves];
+			nodeStack.push_back(n.left);
+			codeStack.push_back(code<<1);
+			codeLengthStack.push_back(codeLength+1);
+			nodeStack.push_back(n.right);
+			codeStack.push_back((code<<1)|0x1U);
+			codeLengthStack.push_back(codeLength+1);
+			}
+		else
+			Misc::throwStdErr("Kinect::DepthFrameReader::readHuffmanTree: Malformed Huffman tree");
+		}
+	
+	/* Build the decoding table: */
+	buildHuffmanTable(table,numLeaves,&codes[0],&codeLengths[0]);
 	}
 
-DepthFrameReader::~DepthFrameReader(void)
+void DepthFrameReader::readCanonicalCode(DepthFrameReader::HuffmanTable& table)
 	{
-	delete[] pixelDeltaNodes;
-	delete[] spanLengthNodes;
+	/* Read the code lengths of all coded values: */
+	std::vector<unsigned int> codeLengths(table.numCodes);
+	Misc::UInt32 kraftSum=0x0U;
+	for(unsigned int i=0;i<table.numCodes;++i)
+		{
+		codeLengths[i]=source.read<Misc::UInt8>();
+		if(codeLengths[i]<1||codeLengths[i]>maxCodeLength)
+			Misc::throwStdErr("Kinect::DepthFrameReader::readCanonicalCode: Invalid code length %u",codeLengths[i]);
+		kraftSum+=0x1U<<(maxCodeLength-codeLengths[i]);
+		}
+	
+	/* Check that the code lengths describe a complete prefix code: */
+	if(kraftSum!=0x1U<<maxCodeLength)
+		Misc::throwStdErr("Kinect::DepthFrameReader::readCanonicalCode: Malformed Huffman code");
+	
+	/* Assign consecutive codes to values in order of increasing code length, and of increasing value for equal lengths: */
+	std::vector<Misc::UInt32> codes(table.numCodes,0);
+	Misc::UInt32 code=0x0U;
+	unsigned int codeLength=0;
+	for(unsigned int length=1;length<=maxCodeLength;++length)
+		for(unsigned int i=0;i<table.numCodes;++i)
+			if(codeLengths[i]==length)
+				{
+				code<<=length-codeLength;
+				codeLength=length;
+				codes[i]=code;
+				++code;
+				}
+	
+	/* Build the decoding table: */
+	buildHuffmanTable(table,table.numCodes,&codes[0],&codeLengths[0]);
 	}
 
-FrameBuffer DepthFrameReader::readNextFrame(void)
+void DepthFrameReader::buildHuffmanTable(DepthFrameReader::HuffmanTable& table,unsigned int numCodes,const Misc::UInt32* codes,const unsigned int* codeLengths)
 	{
-	/* Create the result frame: */
-	FrameBuffer result(size[0],size[1],size[0]*size[1]*sizeof(FrameSource::DepthPixel));
+	/* Find the longest code: */
+	unsigned int maxLength=0;
+	for(unsigned int i=0;i<numCodes;++i)
+		if(maxLength<codeLengths[i])
+			maxLength=codeLengths[i];
+	
+	/* Resolve as many code bits in the primary table as the longest code needs, up to the maximum: */
+	table.tableBits=maxLength;
+	if(table.tableBits>maxTableBits)
+		table.tableBits=maxTableBits;
+	if(table.tableBits<1)
+		table.tableBits=1;
+	unsigned int tableSize=1U<<table.tableBits;
 	
-	/* Return a dummy frame if the file is over: */
-	if(source.eof())
+	/* Size a secondary table for each primary table entry that is a prefix of longer codes: */
+	std::vector<unsigned int> subTableBits(tableSize,0);
+	for(unsigned int i=0;i<numCodes;++i)
+		if(codeLengths[i]>table.tableBits)
+			{
+			unsigned int prefix=codes[i]>>(codeLengths[i]-table.tableBits);
+			if(subTableBits[prefix]<codeLengths[i]-table.tableBits)
+				subTableBits[prefix]=codeLengths[i]-table.tableBits;
+			}
+	std::vector<unsigned int> subTableOffsets(tableSize,0);
+	unsigned int numEntries=tableSize;
+	for(unsigned int i=0;i<tableSize;++i)
+		if(subTableBits[i]!=0)
+			{
+			subTableOffsets[i]=numEntries;
+			numEntries+=1U<<subTableBits[i];
+			}
+	
+	/* Create the decoding table: */
+	table.numCodes=numCodes;
+	delete[] table.entries;
+	table.entries=new HuffmanTableEntry[numEntries];
+	for(unsigned int i=0;i<numEntries;++i)
 		{
-		result.timeStamp=Math::Constants<double>::max;
-		return result;
+		table.entries[i].value=0;
+		table.entries[i].codeLength=0;
+		table.entries[i].subTableBits=0;
 		}
+	for(unsigned int i=0;i<tableSize;++i)
+		if(subTableBits[i]!=0)
+			{
+			table.entries[i].value=subTableOffsets[i];
+			table.entries[i].subTableBits=subTableBits[i];
+			}
 	
-	/* Read the frame's time stamp from the source: */
-	result.timeStamp=source.read<Misc::Float64>();
-	
-	/* Process all spans: */
-	FrameSource::DepthPixel* resultBuffer=static_cast<FrameSource::DepthPixel*>(result.getBuffer());
-	unsigned int numPixels=size[0]*size[1];
-	const unsigned int* hcPtr=hilbertCurve.getOffsets();
+	/* Enter each leaf into all table entries whose index starts with the leaf's code: */
+	for(unsigned int i=0;i<numCodes;++i)
+		{
+		HuffmanTableEntry* entryPtr;
+		unsigned int numEntryBits;
+		if(codeLengths[i]<=table.tableBits)
+			{
+			numEntryBits=table.tableBits-codeLengths[i];
+			entryPtr=table.entries+(codes[i]<<numEntryBits);
+			}
+		else
+			{
+			unsigned int suffixLength=codeLengths[i]-table.tableBits;
+			unsigned int prefix=codes[i]>>suffixLength;
+			numEntryBits=subTableBits[prefix]-suffixLength;
+			entryPtr=table.entries+subTableOffsets[prefix]+((codes[i]&((0x1U<<suffixLength)-0x1U))<<numEntryBits);
+			}
+		for(unsigned int j=0;j<(1U<<numEntryBits);++j,++entryPtr)
+			{
+			entryPtr->value=i;
+			entryPtr->codeLength=codeLengths[i];
+			}
+		}
+	}
+
+template <class BitReaderParam,class PixelIteratorParam>
+void DepthFrameReader::readKeyTile(BitReaderParam& bitReader,PixelIteratorParam pixelIt,unsigned int numPixels,FrameSource::DepthPixel* frameBuffer) const
+	{
+	/* Process all spans of the tile: */
 	while(numPixels>0)
 		{
 		/* Detect the type of the next span: */
-		if(getBit())
+		if(bitReader.peekBit())
 			{
 			/******************************
 			Process a span of valid pixels:
 			******************************/
 			
-			/* Read the 11-bit unencoded value of the initial pixel: */
-			unsigned int pixelValue=getBit();
-			for(int i=1;i<11;++i)
-				{
-				pixelValue<<=1;
-				pixelValue|=getBit();
-				}
+			/* Read the span header and the 11-bit unencoded value of the initial pixel: */
+			unsigned int pixelValue=bitReader.getBits(12)&0x7ffU;
 			
 			/* Process the span's pixels: */
 			while(true)
 				{
 				/* Store the current pixel: */
-				resultBuffer[*hcPtr]=FrameSource::DepthPixel(pixelValue);
-				++hcPtr;
+				frameBuffer[*pixelIt]=FrameSource::DepthPixel(pixelValue);
+				++pixelIt;
 				--numPixels;
 				
 				/* Read the Huffman-encoded pixel value delta for the next pixel: */
-				unsigned int delta=pixelDeltaNumLeaves+pixelDeltaNumLeaves-2; // Start at the Huffman tree's root node
-				while(delta>=pixelDeltaNumLeaves)
-					{
-					/* Select the next node based on the next bit: */
-					if(getBit())
-						delta=pixelDeltaNodes[delta-pixelDeltaNumLeaves].right;
-					else
-						delta=pixelDeltaNodes[delta-pixelDeltaNumLeaves].left;
-					}
-				if(delta==0) // Zero is span-ending code
+				unsigned int delta=bitReader.decode(pixelDeltaTable);
+				if(delta==0||numPixels==0) // Zero is span-ending code; spans never extend past the end of a tile
 					break;
 				
 				/* Adjust the current pixel value: */
@@ -155,30 +378,308 @@ FrameBuffer DepthFrameReader::readNextFrame(void)
 			Process a span of invalid pixels:
 			********************************/
 			
-			/* Read the Huffman-encoded span length: */
-			unsigned int spanLength=spanLengthNumLeaves+spanLengthNumLeaves-2; // Start at the Huffman tree's root node
-			while(spanLength>=spanLengthNumLeaves)
+			/* Skip the span header and read the Huffman-encoded span length: */
+			bitReader.skipBits(1);
+			unsigned int spanLength=bitReader.decode(spanLengthTable);
+			++spanLength; // Compressor encoded spanLength-1, since 0 is impossible
+			if(spanLength>numPixels) // Spans never extend past the end of a tile
+				spanLength=numPixels;
+			while(spanLength>0)
 				{
-				/* Select the next node based on the next bit: */
-				if(getBit())
-					spanLength=spanLengthNodes[spanLength-spanLengthNumLeaves].right;
+				/* Set the current pixel to invalid: */
+				frameBuffer[*pixelIt]=FrameSource::invalidDepth;
+				++pixelIt;
+				--numPixels;
+				--spanLength;
+				}
+			}
+		}
+	
+	/* The rest of the bit buffer is padding; tiles start at word boundaries */
+	}
+
+template <class BitReaderParam,class PixelIteratorParam>
+void DepthFrameReader::readInterTile(BitReaderParam& bitReader,PixelIteratorParam pixelIt,unsigned int numPixels,FrameSource::DepthPixel* frameBuffer) const
+	{
+	/* Process all spans of the tile: */
+	const FrameSource::DepthPixel* previousBuffer=previousFrame;
+	while(numPixels>0)
+		{
+		/* Detect the type of the next span: */
+		if(bitReader.peekBit())
+			{
+			/********************************
+			Process a span of changed pixels:
+			********************************/
+			
+			/* Skip the span header: */
+			bitReader.skipBits(1);
+			
+			/* Process the span's pixels: */
+			while(true)
+				{
+				/* Read the Huffman-encoded residual of the current pixel: */
+				unsigned int residual=bitReader.decode(pixelResidualTable);
+				if(residual==0||numPixels==0) // Zero is span-ending code; spans never extend past the end of a tile
+					break;
+				
+				/* Store the current pixel: */
+				if(residual==32) // 32 is the escape code for out-of-range residuals
+					frameBuffer[*pixelIt]=FrameSource::DepthPixel(bitReader.getBits(11));
 				else
-					spanLength=spanLengthNodes[spanLength-spanLengthNumLeaves].left;
+					frameBuffer[*pixelIt]=FrameSource::DepthPixel(previousBuffer[*pixelIt]+residual-16U);
+				++pixelIt;
+				--numPixels;
 				}
+			}
+		else
+			{
+			/**********************************
+			Process a span of unchanged pixels:
+			**********************************/
+			
+			/* Skip the span header and read the Huffman-encoded span length: */
+			bitReader.skipBits(1);
+			unsigned int spanLength=bitReader.decode(unchangedSpanLengthTable);
 			++spanLength; // Compressor encoded spanLength-1, since 0 is impossible
+			if(spanLength>numPixels) // Spans never extend past the end of a tile
+				spanLength=numPixels;
 			while(spanLength>0)
 				{
-				/* Set the current pixel to invalid: */
-				resultBuffer[*hcPtr]=FrameSource::invalidDepth;
-				++hcPtr;
+				/* Copy the current pixel from the previous frame: */
+				frameBuffer[*pixelIt]=previousBuffer[*pixelIt];
+				++pixelIt;
 				--numPixels;
 				--spanLength;
 				}
 			}
 		}
 	
-	/* Flush the bit buffer; frames start at byte-boundaries: */
-	flushBits();
+	/* The rest of the bit buffer is padding; tiles start at word boundaries */
+	}
+
+template <class BitReaderParam,class PixelIteratorParam>
+void DepthFrameReader::readTile(BitReaderParam& bitReader,PixelIteratorParam pixelIt,unsigned int numPixels,FrameSource::DepthPixel* frameBuffer) const
+	{
+	/* Tiles of inter frames start with a bit indicating whether they are coded as residuals against the previous frame: */
+	if(jobInterFrame&&bitReader.getBits(1)!=0x0U)
+		readInterTile(bitReader,pixelIt,numPixels,frameBuffer);
+	else
+		readKeyTile(bitReader,pixelIt,numPixels,frameBuffer);
+	}
+
+void DepthFrameReader::readTileFromBlock(unsigned int tileIndex)
+	{
+	MemoryWordSource wordSource(jobTiles+tileBlockOffsets[tileIndex]*sizeof(Misc::UInt32),jobTiles+tileBlockOffsets[tileIndex+1]*sizeof(Misc::UInt32));
+	BitReader<MemoryWordSource> bitReader(wordSource);
+	
+	if(backgroundMask==0||backgroundMask->empty())
+		{
+		/* Decompress all pixels of the tile in Hilbert curve order: */
+		readTile(bitReader,hilbertCurve.getIterator(tileFirstPixels[tileIndex]),tileFirstPixels[tileIndex+1]-tileFirstPixels[tileIndex],jobFrame);
+		}
+	else
+		{
+		/* Decompress the tile's unmasked pixels, which precede its masked pixels in the mask partition: */
+		const unsigned int* pixelOffsets=maskPixelOffsets+tileFirstPixels[tileIndex];
+		readTile(bitReader,pixelOffsets,tileNumUnmaskedPixels[tileIndex],jobFrame);
+		
+		/* Set the tile's masked pixels to invalid: */
+		const unsigned int* maskedEnd=maskPixelOffsets+tileFirstPixels[tileIndex+1];
+		for(const unsigned int* mpIt=pixelOffsets+tileNumUnmaskedPixels[tileIndex];mpIt!=maskedEnd;++mpIt)
+			jobFrame[*mpIt]=FrameSource::invalidDepth;
+		}
+	}
+
+DepthFrameReader::DepthFrameReader(IO::File& sSource,unsigned int sFormatVersion,unsigned int numThreads)
+	:source(sSource),mappedSource(dynamic_cast<MappedFile*>(&sSource)),formatVersion(sFormatVersion),
+	 numTiles(1),tileFirstPixels(0),tileSizes(0),tileBlockOffsets(0),
+	 tileBlockSize(0),tileBlock(0),
+	 previousFrame(0),haveKeyframe(false),
+	 backgroundMask(0),maskPixelOffsets(0),tileNumUnmaskedPixels(0),
+	 jobTiles(0),jobFrame(0),jobInterFrame(false),workerPool(0),tileJob(0)
+	{
+	/* Read the frame size from the source: */
+	for(int i=0;i<2;++i)
+		size[i]=source.read<Misc::UInt32>();
+	
+	/* Create the Hilbert curve offset array: */
+	hilbertCurve.init(size);
+	
+	/* Read the pixel delta and span length Huffman decoding trees from the source: */
+	readHuffmanTree(pixelDeltaTable);
+	readHuffmanTree(spanLengthTable);
+	
+	/* Read the number of tiles per frame from the source; older streams compress each frame as a single tile: */
+	unsigned int numPixels=size[0]*size[1];
+	if(formatVersion>=5)
+		{
+		numTiles=source.read<Misc::UInt32>();
+		if(numTiles==0||numTiles>numPixels)
+			Misc::throwStdErr("Kinect::DepthFrameReader::DepthFrameReader: Invalid number of tiles %u",numTiles);
+		}
+	
+	/* Read the pixel residual and unchanged span length Huffman decoding trees from the source, and allocate the previous frame buffer: */
+	if(formatVersion>=6)
+		{
+		readHuffmanTree(pixelResidualTable);
+		readHuffmanTree(unchangedSpanLengthTable);
+		previousFrame=new FrameSource::DepthPixel[numPixels];
+		}
+	
+	/* Split the Hilbert curve into tiles of approximately equal size: */
+	tileFirstPixels=new unsigned int[numTiles+1];
+	for(unsigned int i=0;i<=numTiles;++i)
+		tileFirstPixels[i]=(unsigned int)((size_t(numPixels)*size_t(i))/size_t(numTiles));
+	tileSizes=new Misc::UInt32[numTiles];
+	tileBlockOffsets=new size_t[numTiles+1];
+	
+	/* Create an empty background mask: */
+	if(formatVersion>=8)
+		{
+		backgroundMask=new BackgroundMask(numPixels);
+		tileNumUnmaskedPixels=new unsigned int[numTiles];
+		}
+	
+	/* Create the tile decompression job and the worker threads: */
+	tileJob=Misc::createFunctionCall(this,&DepthFrameReader::readTileFromBlock);
+	setNumThreads(numThreads);
+	}
+
+DepthFrameReader::~DepthFrameReader(void)
+	{
+	delete workerPool;
+	delete tileJob;
+	delete[] tileFirstPixels;
+	delete[] tileSizes;
+	delete[] tileBlockOffsets;
+	delete[] tileBlock;
+	delete[] previousFrame;
+	delete backgroundMask;
+	delete[] maskPixelOffsets;
+	delete[] tileNumUnmaskedPixels;
+	}
+
+void DepthFrameReader::setNumThreads(unsigned int newNumThreads)
+	{
+	/* Shut down the current worker threads: */
+	delete workerPool;
+	workerPool=0;
+	
+	/* Start new worker threads if there are tiles to process in parallel: */
+	if(newNumThreads>1&&numTiles>1)
+		workerPool=new WorkerPool(newNumThreads);
+	}
+
+FrameBuffer DepthFrameReader::readNextFrame(void)
+	{
+	/* Create the result frame: */
+	FrameBuffer result(size[0],size[1],size[0]*size[1]*sizeof(FrameSource::DepthPixel));
+	
+	/* Read the frame's time stamp from the source, and return a dummy frame if the stream is over: */
+	if(!readTimeStamp(source,result.timeStamp))
+		return result;
+	
+	/* Read the frame's type from the source; older streams only contain keyframes: */
+	bool interFrame=false;
+	if(formatVersion>=6)
+		{
+		unsigned int frameFlags=source.read<Misc::UInt8>();
+		interFrame=(frameFlags&0x1U)!=0x0U;
+		
+		/* Read new Huffman codes if the frame carries them: */
+		if(formatVersion>=7&&(frameFlags&0x2U)!=0x0U)
+			{
+			readCanonicalCode(pixelDeltaTable);
+			readCanonicalCode(spanLengthTable);
+			readCanonicalCode(pixelResidualTable);
+			readCanonicalCode(unchangedSpanLengthTable);
+			}
+		
+		/* Read a new background mask if the frame carries one: */
+		if(formatVersion>=8&&(frameFlags&0x4U)!=0x0U)
+			{
+			backgroundMask->read(source);
+			if(!backgroundMask->empty())
+				{
+				/* Separate each tile's unmasked from its masked pixels: */
+				if(maskPixelOffsets==0)
+					maskPixelOffsets=new unsigned int[size_t(size[0])*size_t(size[1])];
+				for(unsigned int i=0;i<numTiles;++i)
+					tileNumUnmaskedPixels[i]=backgroundMask->partition(hilbertCurve,tileFirstPixels[i],tileFirstPixels[i+1],maskPixelOffsets+tileFirstPixels[i]);
+				}
+			}
+		}
+	keyframe=!interFrame;
+	
+	FrameSource::DepthPixel* resultBuffer=static_cast<FrameSource::DepthPixel*>(result.getBuffer());
+	size_t numPixels=size_t(size[0])*size_t(size[1]);
+	if(formatVersion>=5)
+		{
+		/* Read the tile size table: */
+		source.read(tileSizes,numTiles);
+		tileBlockOffsets[0]=0;
+		for(unsigned int i=0;i<numTiles;++i)
+			{
+			/* Check the tile size against one 32-bit word per pixel plus one, which bounds the writer's worst case of DepthFrameWriter::maxKeyPixelBits per pixel; the writer only keeps an inter-frame tile if it is smaller than its keyframe encoding: */
+			if(tileSizes[i]>tileFirstPixels[i+1]-tileFirstPixels[i]+1)
+				Misc::throwStdErr("Kinect::DepthFrameReader::readNextFrame: Corrupted tile size table");
+			tileBlockOffsets[i+1]=tileBlockOffsets[i]+tileSizes[i];
+			}
+		
+		/* Access the compressed tiles in place if the source is a memory-mapped file in host byte order: */
+		jobTiles=0;
+		if(mappedSource!=0&&!source.mustSwapOnRead())
+			jobTiles=mappedSource->readInPlace(tileBlockOffsets[numTiles]*sizeof(Misc::UInt32));
+		
+		if(jobTiles==0)
+			{
+			/* Read all compressed tiles into the tile block: */
+			if(tileBlockSize<tileBlockOffsets[numTiles])
+				{
+				delete[] tileBlock;
+				tileBlockSize=tileBlockOffsets[numTiles];
+				tileBlock=new Misc::UInt32[tileBlockSize];
+				}
+			source.read(tileBlock,tileBlockOffsets[numTiles]);
+			jobTiles=reinterpret_cast<const Misc::UInt8*>(tileBlock);
+			}
+		
+		if(interFrame&&!haveKeyframe)
+			{
+			/* Return an invalid frame until the first keyframe arrives, e.g., after joining a stream midway: */
+			for(size_t i=0;i<numPixels;++i)
+				resultBuffer[i]=FrameSource::invalidDepth;
+			return result;
+			}
+		
+		/* Decompress all tiles: */
+		jobFrame=resultBuffer;
+		jobInterFrame=interFrame;
+		if(workerPool!=0)
+			workerPool->run(numTiles,*tileJob);
+		else
+			{
+			for(unsigned int i=0;i<numTiles;++i)
+				readTileFromBlock(i);
+			}
+		jobTiles=0;
+		jobFrame=0;
+		
+		/* Retain the frame to predict the next frame: */
+		if(previousFrame!=0)
+			{
+			memcpy(previousFrame,resultBuffer,numPixels*sizeof(FrameSource::DepthPixel));
+			haveKeyframe=true;
+			}
+		}
+	else
+		{
+		/* Decompress the frame's single tile directly from the source: */
+		FileWordSource wordSource(source);
+		BitReader<FileWordSource> bitReader(wordSource);
+		readKeyTile(bitReader,hilbertCurve.getIterator(0),size[0]*size[1],resultBuffer);
+		}
 	
 	return result;
 	}
@@ -27,12 +27,18 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <stddef.h>
 #include <Misc/SizedTypes.h>
 #include <Kinect/HilbertCurve.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/BackgroundMask.h>
+#include <Kinect/WorkerPool.h>
 #include <Kinect/FrameReader.h>
 
 /* Forward declarations: */
 namespace IO {
 class File;
 }
+namespace Kinect {
+class MappedFile;
+}
 
 namespace Kinect {
 
@@ -48,41 +54,85 @@ class DepthFrameReader:public FrameReader
 		unsigned int right; // Index of right subtree
 		};
 	
+	struct HuffmanTableEntry // Structure for an entry in a table-driven Huffman decoder
+		{
+		/* Elements: */
+		public:
+		Misc::UInt32 value:20; // Decoded value for leaf entries, or index of the first entry of a secondary table
+		Misc::UInt32 codeLength:6; // Length of the decoded value's code in bits for leaf entries
+		Misc::UInt32 subTableBits:6; // Number of code bits resolved by the secondary table, or 0 for leaf entries
+		};
+	
+	struct HuffmanTable // Structure for a table-driven Huffman decoder
+		{
+		/* Elements: */
+		public:
+		typedef HuffmanTableEntry Entry; // Type for table entries
+		
+		unsigned int numCodes; // Number of values coded by the table
+		unsigned int tableBits; // Number of code bits resolved by the primary table
+		HuffmanTableEntry* entries; // Primary table, followed by the secondary tables for codes longer than the primary table's index
+		
+		/* Constructors and destructors: */
+		HuffmanTable(void)
+			:numCodes(0),tableBits(0),entries(0)
+			{
+			}
+		~HuffmanTable(void)
+			{
+			delete[] entries;
+			}
+		};
+	
 	/* Elements: */
 	private:
+	static const unsigned int maxTableBits=11; // Maximum number of code bits resolved by a primary decoding table
+	static const unsigned int maxCodeLength=19; // Maximum supported length of a Huffman code in bits
 	IO::File& source; // Data source for compressed depth frames
+	MappedFile* mappedSource; // Data source as a memory-mapped file from which compressed tiles are decompressed in place, or null
+	unsigned int formatVersion; // Format version of the compressed depth stream
 	HilbertCurve hilbertCurve; // Object to traverse depth frames in Hilbert curve order
-	unsigned int pixelDeltaNumLeaves; // Number of leaves in the pixel delta Huffman tree
-	HuffmanNode* pixelDeltaNodes; // Node array of the pixel delta Huffman tree
-	unsigned int spanLengthNumLeaves; // Number of leaves in the span length Huffman tree
-	HuffmanNode* spanLengthNodes; // Node array of the span length Huffman tree
-	Misc::UInt32 currentBits; // Buffer to extract bits from the source buffer
-	Misc::UInt32 currentBitMask; // Mask to extract the next bit from the bit buffer
+	HuffmanTable pixelDeltaTable; // Decoding table for pixel deltas
+	HuffmanTable spanLengthTable; // Decoding table for span lengths
+	HuffmanTable pixelResidualTable; // Decoding table for pixel residuals against the previous frame
+	HuffmanTable unchangedSpanLengthTable; // Decoding table for lengths of spans of pixels unchanged from the previous frame
+	unsigned int numTiles; // Number of independently compressed tiles per frame, each a contiguous section of the Hilbert curve
+	unsigned int* tileFirstPixels; // Hilbert curve index of the first pixel of each tile, plus one past the last pixel of the last tile
+	Misc::UInt32* tileSizes; // Sizes of the current frame's compressed tiles in 32-bit words
+	size_t* tileBlockOffsets; // Offsets of the current frame's compressed tiles in the tile block, plus the total size of all tiles
+	size_t tileBlockSize; // Allocated size of the tile block in 32-bit words
+	Misc::UInt32* tileBlock; // Memory block holding the current frame's compressed tiles
+	FrameSource::DepthPixel* previousFrame; // Previously read depth frame, against which inter frames are predicted
+	bool haveKeyframe; // Flag whether a keyframe has been read, i.e., whether the previous frame is valid
+	BackgroundMask* backgroundMask; // Mask of static background pixels, which are not compressed and decompress as invalid, or null for older streams
+	unsigned int* maskPixelOffsets; // Array offsets of each tile's unmasked pixels in Hilbert curve order, followed by those of its masked pixels
+	unsigned int* tileNumUnmaskedPixels; // Number of unmasked pixels in each tile
+	const Misc::UInt8* jobTiles; // Compressed tiles of the current frame, either in the tile block or in the mapped data source
+	FrameSource::DepthPixel* jobFrame; // Depth frame currently being decompressed
+	bool jobInterFrame; // Flag whether the current frame is an inter frame
+	WorkerPool* workerPool; // Pool of worker threads decompressing tiles in parallel, or null
+	WorkerPool::Job* tileJob; // Job decompressing a single tile of the current frame from the tile block
 	
 	/* Private methods: */
-	void readHuffmanTree(unsigned int& numLeaves,HuffmanNode*& nodes); // Reads a Huffman decoding tree from the source
-	void fillBitBuffer(void); // Fills the bit buffer from the source
-	Misc::UInt32 getBit(void) // Reads a single bit from the source and returns its state
-		{
-		/* Fill the bit buffer if it is empty: */
-		if(currentBitMask==0x0U)
-			fillBitBuffer();
-		
-		/* Extract one bit from the bit buffer: */
-		Misc::UInt32 result=0x0U;
-		if(currentBits&currentBitMask)
-			result=0x1U;
-		currentBitMask>>=1;
-		
-		return result;
-		}
-	void flushBits(void); // Clears the bit buffer at the end of a frame
+	static void buildHuffmanTable(HuffmanTable& table,unsigned int numCodes,const Misc::UInt32* codes,const unsigned int* codeLengths); // Builds a decoding table for the given Huffman codes
+	void readHuffmanTree(HuffmanTable& table); // Reads a Huffman decoding tree from the source and converts it into a decoding table
+	void readCanonicalCode(HuffmanTable& table); // Reads the code lengths of a canonical Huffman code for the same values as the given decoding table from the source and replaces the table
+	template <class BitReaderParam,class PixelIteratorParam>
+	void readKeyTile(BitReaderParam& bitReader,PixelIteratorParam pixelIt,unsigned int numPixels,FrameSource::DepthPixel* frameBuffer) const; // Decompresses the given pixels of a tile, coded independently of previous frames, from the given bit reader
+	template <class BitReaderParam,class PixelIteratorParam>
+	void readInterTile(BitReaderParam& bitReader,PixelIteratorParam pixelIt,unsigned int numPixels,FrameSource::DepthPixel* frameBuffer) const; // Decompresses the given pixels of a tile, coded as residuals against the previous frame, from the given bit reader
+	template <class BitReaderParam,class PixelIteratorParam>
+	void readTile(BitReaderParam& bitReader,PixelIteratorParam pixelIt,unsigned int numPixels,FrameSource::DepthPixel* frameBuffer) const; // Decompresses the given pixels of a tile of the current frame, starting with its tile type bit in inter frames
+	void readTileFromBlock(unsigned int tileIndex); // Decompresses the tile of the given index of the current frame from its compressed tiles
 	
 	/* Constructors and destructors: */
 	public:
-	DepthFrameReader(IO::File& sSource); // Creates a depth frame reader associated with the given data source
+	DepthFrameReader(IO::File& sSource,unsigned int sFormatVersion,unsigned int numThreads =1); // Creates a depth frame reader associated with the given data source in the given stream format version (0 for unversioned streams), decompressing tiles in numThreads threads including the calling thread
 	virtual ~DepthFrameReader(void);
 	
+	/* Methods: */
+	void setNumThreads(unsigned int newNumThreads); // Sets the number of threads decompressing tiles, including the calling thread; must not be called while a frame is being read
+	
 	/* Methods from FrameReader: */
 	virtual FrameBuffer readNextFrame(void);
 	};
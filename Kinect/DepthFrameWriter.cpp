@@ -22,17 +22,101 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 
 #include <Kinect/DepthFrameWriter.h>
 
+#include <string.h>
+#include <vector>
+#include <Misc/FunctionCalls.h>
 #include <IO/File.h>
 #include <Kinect/FrameBuffer.h>
-#include <Kinect/FrameSource.h>
 
 namespace Kinect {
 
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+void sumCounts(const size_t* tileCounts,unsigned int numTiles,unsigned int numCodes,size_t* counts)
+	{
+	for(unsigned int i=0;i<numCodes;++i)
+		counts[i]=0;
+	for(unsigned int tile=0;tile<numTiles;++tile,tileCounts+=numCodes)
+		for(unsigned int i=0;i<numCodes;++i)
+			counts[i]+=tileCounts[i];
+	}
+
+void buildCanonicalCode(unsigned int numCodes,const size_t* counts,unsigned int maxCodeLength,Misc::UInt32 codes[][2])
+	{
+	/* Give every value a non-zero frequency, as every value must remain codable: */
+	std::vector<size_t> frequencies(numCodes);
+	for(unsigned int i=0;i<numCodes;++i)
+		frequencies[i]=counts[i]+1;
+	
+	/* Build Huffman trees until no code is longer than the maximum length: */
+	std::vector<unsigned int> codeLengths(numCodes);
+	while(true)
+		{
+		/* Merge the two least frequent active nodes until there is a single tree: */
+		std::vector<size_t> nodeFrequencies(frequencies);
+		std::vector<unsigned int> parents(numCodes*2-1,0);
+		std::vector<bool> active(numCodes*2-1,true);
+		for(unsigned int interior=numCodes;interior<numCodes*2-1;++interior)
+			{
+			unsigned int children[2];
+			for(int c=0;c<2;++c)
+				{
+				children[c]=interior;
+				for(unsigned int i=0;i<interior;++i)
+					if(active[i]&&(children[c]==interior||nodeFrequencies[i]<nodeFrequencies[children[c]]))
+						children[c]=i;
+				active[children[c]]=false;
+				parents[children[c]]=interior;
+				}
+			nodeFrequencies.push_back(nodeFrequencies[children[0]]+nodeFrequencies[children[1]]);
+			}
+		
+		/* Calculate each value's code length as the depth of its leaf: */
+		unsigned int maxLength=0;
+		for(unsigned int i=0;i<numCodes;++i)
+			{
+			codeLengths[i]=0;
+			for(unsigned int node=i;node!=numCodes*2-2;node=parents[node])
+				++codeLengths[i];
+			if(maxLength<codeLengths[i])
+				maxLength=codeLengths[i];
+			}
+		if(maxLength<=maxCodeLength)
+			break;
+		
+		/* Flatten the frequency distribution and try again: */
+		for(unsigned int i=0;i<numCodes;++i)
+			frequencies[i]=(frequencies[i]+1)/2;
+		}
+	
+	/* Assign consecutive codes to values in order of increasing code length, and of increasing value for equal lengths: */
+	Misc::UInt32 code=0x0U;
+	unsigned int codeLength=0;
+	for(unsigned int length=1;length<=maxCodeLength;++length)
+		for(unsigned int i=0;i<numCodes;++i)
+			if(codeLengths[i]==length)
+				{
+				code<<=length-codeLength;
+				codeLength=length;
+				codes[i][0]=code;
+				codes[i][1]=length;
+				++code;
+				}
+	}
+
+}
+
 /*****************************************
 Static elements of class DepthFrameWriter:
 *****************************************/
 
-const Misc::UInt32 DepthFrameWriter::pixelDeltaCodes[32][2]=
+const unsigned int DepthFrameWriter::encodingVersion;
+
+const Misc::UInt32 DepthFrameWriter::defaultPixelDeltaCodes[32][2]=
 	{
 	{0xbU,5},{0x23bU,11},{0x229U,11},{0x222U,11},{0x226U,11},{0x239U,11},{0x224U,11},{0x47fU,12},
 	{0x22bU,11},{0x23dU,11},{0x23eU,11},{0x116U,10},{0x8cU,9},{0x20U,7},{0x9U,5},{0x0U,2},
@@ -48,7 +132,7 @@ const Misc::UInt32 DepthFrameWriter::pixelDeltaNodes[31][2]=
 	{54,55},{56,14},{18,0},{57,58},{59,17},{15,60},{61,16}
 	};
 
-const Misc::UInt32 DepthFrameWriter::spanLengthCodes[256][2]=
+const Misc::UInt32 DepthFrameWriter::defaultSpanLengthCodes[256][2]=
 	{
 	{0x2U,3},{0x0U,3},{0xeU,5},{0x1fU,6},{0x18U,6},{0x9U,6},{0x1bU,7},{0x3dU,7},
 	{0x33U,7},{0xbU,6},{0x3bU,8},{0x36U,7},{0x3dU,8},{0x65U,8},{0x6bU,8},{0x3eU,8},
@@ -120,66 +204,415 @@ const Misc::UInt32 DepthFrameWriter::spanLengthNodes[255][2]=
 	{2,500},{501,502},{503,504},{1,505},{0,506},{507,508},{509,255},
 	};
 
+const Misc::UInt32 DepthFrameWriter::defaultPixelResidualCodes[33][2]=
+	{
+	{0x5U,3},{0x1ea8U,13},{0x1ea9U,13},{0x1eaaU,13},{0xeaaU,12},{0x72bU,11},{0x7abU,11},{0x3abU,10},
+	{0x1cbU,9},{0x1ebU,9},{0xebU,8},{0x73U,7},{0x7bU,7},{0x3bU,6},{0x1fU,5},{0x0U,2},
+	{0x6U,3},{0x1U,2},{0x8U,4},{0x3cU,6},{0x38U,6},{0x74U,7},{0xf4U,8},{0xe4U,8},
+	{0x1d4U,9},{0x3d4U,10},{0x394U,10},{0x754U,11},{0xeabU,12},{0x1eabU,13},{0xe54U,12},{0xe55U,12},
+	{0x9U,4}
+	};
+
+const Misc::UInt32 DepthFrameWriter::pixelResidualNodes[32][2]=
+	{
+	{1,2},{3,29},{30,31},{4,28},{33,34},{35,5},{27,36},{37,6},
+	{26,38},{39,7},{25,40},{41,8},{24,42},{43,9},{23,44},{45,10},
+	{22,46},{47,11},{21,48},{49,12},{20,50},{51,13},{19,52},{53,54},
+	{55,14},{18,32},{56,57},{58,0},{16,59},{15,17},{60,61},{62,63}
+	};
+
+const Misc::UInt32 DepthFrameWriter::defaultUnchangedSpanLengthCodes[256][2]=
+	{
+	{0x1U,2},{0x0U,3},{0x8U,4},{0x15U,5},{0x7U,5},{0x2fU,6},{0x29U,6},{0x24U,6},
+	{0xaU,6},{0x5cU,7},{0x58U,7},{0x4dU,7},{0x1bU,7},{0x18U,7},{0x12U,7},{0xbbU,8},
+	{0xb5U,8},{0xb2U,8},{0x9dU,8},{0x99U,8},{0x95U,8},{0x34U,8},{0x32U,8},{0x26U,8},
+	{0x21U,8},{0x175U,9},{0x16cU,9},{0x169U,9},{0x166U,9},{0x146U,9},{0x13cU,9},{0x138U,9},
+	{0x12fU,9},{0x12cU,9},{0x128U,9},{0x6aU,9},{0x66U,9},{0x58U,9},{0x4eU,9},{0x44U,9},
+	{0x45U,9},{0x41U,9},{0x2dbU,10},{0x2dcU,10},{0x2daU,10},{0x2ceU,10},{0x2cfU,10},{0x28bU,10},
+	{0x28eU,10},{0x273U,10},{0x27aU,10},{0x261U,10},{0x262U,10},{0x263U,10},{0x253U,10},{0x25aU,10},
+	{0xcfU,10},{0xd6U,10},{0xd7U,10},{0x9fU,10},{0xb2U,10},{0xb3U,10},{0xb4U,10},{0x8cU,10},
+	{0x8dU,10},{0x8eU,10},{0x8fU,10},{0x5baU,11},{0x5bbU,11},{0x5bcU,11},{0x5bdU,11},{0x5beU,11},
+	{0x51fU,11},{0x5a0U,11},{0x5a1U,11},{0x5a2U,11},{0x5a3U,11},{0x4e5U,11},{0x4f6U,11},{0x4f7U,11},
+	{0x4f8U,11},{0x4f9U,11},{0x4faU,11},{0x4fbU,11},{0x4a5U,11},{0x4b6U,11},{0x4b7U,11},{0x4b8U,11},
+	{0x4b9U,11},{0x4baU,11},{0x4bbU,11},{0x4c0U,11},{0x4c1U,11},{0x13dU,11},{0x16aU,11},{0x16bU,11},
+	{0x16cU,11},{0x16dU,11},{0x16eU,11},{0x16fU,11},{0x170U,11},{0x171U,11},{0x172U,11},{0x173U,11},
+	{0xb7eU,12},{0xb7fU,12},{0xba0U,12},{0xba1U,12},{0xba2U,12},{0xba3U,12},{0xba4U,12},{0xba5U,12},
+	{0xba6U,12},{0xba7U,12},{0x100U,11},{0x101U,11},{0x102U,11},{0x103U,11},{0x9c9U,12},{0x9f8U,12},
+	{0x9f9U,12},{0x9faU,12},{0x9fbU,12},{0x9fcU,12},{0x9fdU,12},{0x9feU,12},{0x9ffU,12},{0xa00U,12},
+	{0xa01U,12},{0xa02U,12},{0xa03U,12},{0xa04U,12},{0xa05U,12},{0xa06U,12},{0xa07U,12},{0xa08U,12},
+	{0xa09U,12},{0xa0aU,12},{0x279U,12},{0x2e8U,12},{0x2e9U,12},{0x2eaU,12},{0x2ebU,12},{0x2ecU,12},
+	{0x2edU,12},{0x2eeU,12},{0x2efU,12},{0x2f0U,12},{0x2f1U,12},{0x2f2U,12},{0x2f3U,12},{0x2f4U,12},
+	{0x2f5U,12},{0x2f6U,12},{0x2f7U,12},{0x2f8U,12},{0x2f9U,12},{0x2faU,12},{0x2fbU,12},{0x2fcU,12},
+	{0x2fdU,12},{0x2feU,12},{0x2ffU,12},{0x338U,12},{0x339U,12},{0x33aU,12},{0x33bU,12},{0x948U,12},
+	{0x949U,12},{0x9c8U,12},{0x1416U,13},{0x1417U,13},{0x1418U,13},{0x1419U,13},{0x141aU,13},{0x141bU,13},
+	{0x141cU,13},{0x141dU,13},{0x141eU,13},{0x141fU,13},{0x1420U,13},{0x1421U,13},{0x1422U,13},{0x1423U,13},
+	{0x1424U,13},{0x1425U,13},{0x1426U,13},{0x1427U,13},{0x1428U,13},{0x1429U,13},{0x142aU,13},{0x142bU,13},
+	{0x142cU,13},{0x142dU,13},{0x142eU,13},{0x142fU,13},{0x1430U,13},{0x1431U,13},{0x1432U,13},{0x1433U,13},
+	{0x1434U,13},{0x1435U,13},{0x1436U,13},{0x1437U,13},{0x1438U,13},{0x1439U,13},{0x143aU,13},{0x143bU,13},
+	{0x143cU,13},{0x143dU,13},{0x143eU,13},{0x143fU,13},{0x1440U,13},{0x1441U,13},{0x1442U,13},{0x1443U,13},
+	{0x1444U,13},{0x1445U,13},{0x1446U,13},{0x1447U,13},{0x1448U,13},{0x1449U,13},{0x144aU,13},{0x144bU,13},
+	{0x144cU,13},{0x144dU,13},{0x144eU,13},{0x289eU,14},{0x289fU,14},{0x28a0U,14},{0x28a1U,14},{0x28a2U,14},
+	{0x28a3U,14},{0x28a4U,14},{0x28a5U,14},{0x28a6U,14},{0x28a7U,14},{0x28a8U,14},{0x28a9U,14},{0x28aaU,14},
+	{0x28abU,14},{0x28acU,14},{0x28adU,14},{0x28aeU,14},{0x28afU,14},{0x28f0U,14},{0x28f1U,14},{0x28f2U,14},
+	{0x28f3U,14},{0x28f4U,14},{0x28f5U,14},{0x28f6U,14},{0x28f7U,14},{0x4f0U,13},{0x4f1U,13},{0x3U,2}
+	};
+
+const Misc::UInt32 DepthFrameWriter::unchangedSpanLengthNodes[255][2]=
+	{
+	{227,228},{229,230},{231,232},{233,234},{235,236},{237,238},{239,240},{241,242},
+	{243,244},{245,246},{247,248},{249,250},{251,252},{253,254},{170,171},{172,173},
+	{174,175},{176,177},{178,179},{180,181},{182,183},{184,185},{186,187},{188,189},
+	{190,191},{192,193},{194,195},{196,197},{198,199},{200,201},{202,203},{204,205},
+	{206,207},{208,209},{210,211},{212,213},{214,215},{216,217},{218,219},{220,221},
+	{222,223},{224,225},{226,256},{257,258},{259,260},{261,262},{263,264},{265,266},
+	{267,268},{269,138},{139,140},{141,142},{143,144},{145,146},{147,148},{149,150},
+	{151,152},{153,154},{155,156},{157,158},{159,160},{161,162},{163,164},{165,166},
+	{167,168},{169,118},{119,120},{121,122},{123,124},{125,126},{127,128},{129,130},
+	{131,132},{133,134},{135,136},{137,270},{271,272},{273,274},{275,276},{277,278},
+	{279,280},{281,282},{283,284},{285,286},{287,288},{289,290},{291,292},{293,294},
+	{295,296},{297,298},{299,300},{301,302},{303,304},{104,105},{106,107},{108,109},
+	{110,111},{112,113},{114,115},{116,117},{305,93},{94,95},{96,97},{98,99},
+	{100,101},{102,103},{306,307},{308,309},{310,311},{312,313},{314,315},{316,317},
+	{318,319},{320,84},{85,86},{87,88},{89,90},{91,92},{321,77},{78,79},
+	{80,81},{82,83},{322,323},{324,325},{326,327},{328,329},{330,331},{332,333},
+	{334,335},{336,337},{338,339},{340,341},{342,343},{344,345},{346,347},{348,72},
+	{73,74},{75,76},{67,68},{69,70},{71,349},{350,351},{352,353},{354,355},
+	{63,64},{65,66},{356,59},{60,61},{62,357},{358,359},{360,361},{362,363},
+	{364,365},{366,367},{368,56},{57,58},{369,54},{55,370},{371,372},{373,51},
+	{52,53},{374,49},{50,375},{376,377},{378,379},{380,381},{382,383},{384,385},
+	{386,387},{388,389},{390,47},{48,391},{45,46},{392,393},{44,42},{43,394},
+	{395,396},{397,398},{399,41},{39,40},{400,401},{38,402},{37,403},{404,405},
+	{406,407},{408,409},{36,410},{35,411},{34,412},{33,413},{414,32},{415,416},
+	{31,417},{30,418},{419,420},{421,422},{423,424},{425,426},{29,427},{28,428},
+	{429,27},{26,430},{431,432},{433,25},{434,24},{435,436},{23,437},{438,439},
+	{440,441},{22,442},{21,443},{444,20},{445,446},{447,19},{448,18},{449,450},
+	{451,452},{453,454},{17,455},{456,16},{457,458},{459,15},{460,461},{14,462},
+	{463,464},{13,465},{466,12},{467,468},{469,11},{470,471},{472,473},{10,474},
+	{475,476},{9,477},{478,479},{8,480},{481,482},{7,483},{484,485},{486,6},
+	{487,488},{489,5},{490,491},{492,4},{493,494},{495,3},{496,497},{498,499},
+	{2,500},{501,502},{1,503},{504,505},{506,0},{507,255},{508,509}
+	};
+
 /*********************************
 Methods of class DepthFrameWriter:
 *********************************/
 
-void DepthFrameWriter::writeManyBits(Misc::UInt32 bits,unsigned int numBits)
+template <class PixelIteratorParam>
+void DepthFrameWriter::writeKeyTile(unsigned int tileIndex,PixelIteratorParam pixelIt,unsigned int numPixels,DepthFrameWriter::BitWriter& bitWriter)
 	{
-	while(numBits>0)
+	/* Compress the tile's pixels: */
+	const FrameSource::DepthPixel* frameBuffer=jobFrame;
+	FrameSource::DepthPixel* reconstruction=keyReconstruction; // Receives the reconstructed pixels if compression is not lossless
+	size_t* deltaCounts=collectStatistics?pixelDeltaCounts[tileIndex]:0;
+	size_t* lengthCounts=collectStatistics?spanLengthCounts[tileIndex]:0;
+	while(numPixels>0)
 		{
-		/* Figure out how many bits can be copied in one go: */
-		unsigned int numCopyBits=numBits;
-		if(numCopyBits>currentBitsLeft)
-			numCopyBits=currentBitsLeft;
-		
-		/* Copy the determined number of bits: */
-		currentBits=(currentBits<<numCopyBits)|(bits>>(numBits-numCopyBits));
-		currentBitsLeft-=numCopyBits;
-		if(currentBitsLeft==0)
+		/* Check if the next span is valid or invalid: */
+		if(frameBuffer[*pixelIt]!=FrameSource::invalidDepth)
 			{
-			/* Write the bit buffer to the sink: */
-			sink.write(currentBits);
-			compressedSize+=sizeof(Misc::UInt32);
+			/******************************
+			Process a span of valid pixels:
+			******************************/
+			
+			/* Write the span header and the initial pixel value: */
+			int pixelValue=frameBuffer[*pixelIt];
+			bitWriter.writeBits(0x800U|Misc::UInt32(pixelValue),12); // 1 bit span header, 11 bits initial pixel value
+			if(reconstruction!=0)
+				reconstruction[*pixelIt]=FrameSource::DepthPixel(pixelValue);
 			
-			/* Clear the bit buffer: */
-			currentBits=0x0U;
-			currentBitsLeft=32;
+			/* Write the rest of pixels in the span: */
+			++pixelIt;
+			--numPixels;
+			while(numPixels>0)
+				{
+				/* Calculate the smallest pixel value delta that reconstructs the pixel within its maximum error; invalid pixels inside spans only predict exactly: */
+				int delta=quantizeResidual(int(frameBuffer[*pixelIt])-pixelValue,pixelValue!=FrameSource::invalidDepth?maxErrors[frameBuffer[*pixelIt]]:0U);
+				if(delta<-15||delta>15)
+					break;
+				
+				/* Write the Huffman-encoded pixel value delta: */
+				bitWriter.writeBits(pixelDeltaCodes[delta+16][0],pixelDeltaCodes[delta+16][1]);
+				if(deltaCounts!=0)
+					++deltaCounts[delta+16];
+				
+				pixelValue+=delta;
+				if(reconstruction!=0)
+					reconstruction[*pixelIt]=FrameSource::DepthPixel(pixelValue);
+				++pixelIt;
+				--numPixels;
+				}
+			
+			/* Write the span terminator: */
+			bitWriter.writeBits(pixelDeltaCodes[0][0],pixelDeltaCodes[0][1]);
+			if(deltaCounts!=0)
+				++deltaCounts[0];
+			}
+		else
+			{
+			/********************************
+			Process a span of invalid pixels:
+			********************************/
+			
+			/* Skip all following invalid pixels: */
+			if(reconstruction!=0)
+				reconstruction[*pixelIt]=FrameSource::invalidDepth;
+			++pixelIt;
+			--numPixels;
+			unsigned int spanLength=1;
+			while(numPixels>0&&frameBuffer[*pixelIt]==FrameSource::invalidDepth&&spanLength<256)
+				{
+				if(reconstruction!=0)
+					reconstruction[*pixelIt]=FrameSource::invalidDepth;
+				++pixelIt;
+				--numPixels;
+				++spanLength;
+				}
+			
+			/* Write the span header and the Huffman-encoded span length minus 1: */
+			bitWriter.writeBits(spanLengthCodes[spanLength-1][0],spanLengthCodes[spanLength-1][1]+1); // Write one extra zero bit for the span header
+			if(lengthCounts!=0)
+				++lengthCounts[spanLength-1];
 			}
-		
-		/* Prepare to write the rest of bits: */
-		numBits-=numCopyBits;
-		if(numBits>0)
-			bits=bits&((0x1U<<numBits)-0x1U);
 		}
 	}
 
-void DepthFrameWriter::flush(void)
+template <class PixelIteratorParam>
+void DepthFrameWriter::writeInterTile(unsigned int tileIndex,PixelIteratorParam pixelIt,unsigned int numPixels,DepthFrameWriter::BitWriter& bitWriter)
 	{
-	/* Check if there are bits in the bit buffer: */
-	if(currentBitsLeft<32)
+	/* Compress the tile's pixels as residuals against the same pixels in the previous frame: */
+	const FrameSource::DepthPixel* frameBuffer=jobFrame;
+	FrameSource::DepthPixel* previousBuffer=previousFrame; // Receives the reconstructed pixels if compression is not lossless
+	bool storeReconstruction=keyReconstruction!=0;
+	size_t* residualCounts=collectStatistics?pixelResidualCounts[tileIndex]:0;
+	size_t* lengthCounts=collectStatistics?unchangedSpanLengthCounts[tileIndex]:0;
+	while(numPixels>0)
 		{
-		/* Push the leftover bits to the left: */
-		currentBits<<=currentBitsLeft;
+		/* Check if the next span is changed or unchanged: */
+		if(!isUnchanged(frameBuffer[*pixelIt],previousBuffer[*pixelIt]))
+			{
+			/********************************
+			Process a span of changed pixels:
+			********************************/
+			
+			/* Write the span header: */
+			bitWriter.writeBits(0x1U,1);
+			
+			/* Write pixel residuals until the next run of unchanged pixels that is long enough to be coded as its own span: */
+			while(numPixels>0)
+				{
+				/* Check if a long enough run of unchanged pixels starts here: */
+				unsigned int runLength=0;
+				PixelIteratorParam runIt=pixelIt;
+				while(runLength<minUnchangedSpanLength&&runLength<numPixels&&isUnchanged(frameBuffer[*runIt],previousBuffer[*runIt]))
+					{
+					++runIt;
+					++runLength;
+					}
+				if(runLength==minUnchangedSpanLength)
+					break;
+				
+				/* Write the Huffman-encoded pixel residual, or an escape code and the unencoded pixel value if the residual is out of range: */
+				int pixelValue=frameBuffer[*pixelIt];
+				int previousValue=previousBuffer[*pixelIt];
+				int residual=quantizeResidual(pixelValue-previousValue,previousValue!=FrameSource::invalidDepth?maxErrors[pixelValue]:0U);
+				if(residual>=-15&&residual<=15)
+					{
+					bitWriter.writeBits(pixelResidualCodes[residual+16][0],pixelResidualCodes[residual+16][1]);
+					if(residualCounts!=0)
+						++residualCounts[residual+16];
+					if(storeReconstruction)
+						previousBuffer[*pixelIt]=FrameSource::DepthPixel(previousValue+residual);
+					}
+				else
+					{
+					bitWriter.writeBits(pixelResidualCodes[32][0],pixelResidualCodes[32][1]);
+					bitWriter.writeBits(Misc::UInt32(pixelValue),11);
+					if(residualCounts!=0)
+						++residualCounts[32];
+					if(storeReconstruction)
+						previousBuffer[*pixelIt]=FrameSource::DepthPixel(pixelValue);
+					}
+				
+				++pixelIt;
+				--numPixels;
+				}
+			
+			/* Write the span terminator: */
+			bitWriter.writeBits(pixelResidualCodes[0][0],pixelResidualCodes[0][1]);
+			if(residualCounts!=0)
+				++residualCounts[0];
+			}
+		else
+			{
+			/**********************************
+			Process a span of unchanged pixels:
+			**********************************/
+			
+			/* Skip all following unchanged pixels: */
+			++pixelIt;
+			--numPixels;
+			unsigned int spanLength=1;
+			while(numPixels>0&&isUnchanged(frameBuffer[*pixelIt],previousBuffer[*pixelIt])&&spanLength<256)
+				{
+				++pixelIt;
+				--numPixels;
+				++spanLength;
+				}
+			
+			/* Write the span header and the Huffman-encoded span length minus 1: */
+			bitWriter.writeBits(unchangedSpanLengthCodes[spanLength-1][0],unchangedSpanLengthCodes[spanLength-1][1]+1); // Write one extra zero bit for the span header
+			if(lengthCounts!=0)
+				++lengthCounts[spanLength-1];
+			}
+		}
+	}
+
+template <class PixelIteratorParam>
+void DepthFrameWriter::writeTilePixels(unsigned int tileIndex,PixelIteratorParam pixelIt,unsigned int numPixels)
+	{
+	/* Compress the tile's pixels independently into the tile's first section of the frame block: */
+	Misc::UInt32* keyTileBlock=frameBlock+tileBlockOffsets[tileIndex];
+	BitWriter keyBitWriter(keyTileBlock);
+	if(jobInterFrame)
+		keyBitWriter.writeBits(0x0U,1); // Tiles of inter frames start with a tile type bit
+	writeKeyTile(tileIndex,pixelIt,numPixels,keyBitWriter);
+	
+	/* Flush the bit buffer; tiles start at word boundaries: */
+	tileBlocks[tileIndex]=keyTileBlock;
+	tileSizes[tileIndex]=Misc::UInt32(keyBitWriter.flush()-keyTileBlock);
+	
+	if(jobInterFrame)
+		{
+		/* Compress the tile's pixels as residuals into the tile's second section of the frame block: */
+		Misc::UInt32* interTileBlock=frameBlock+interTileBlockOffsets[tileIndex];
+		BitWriter interBitWriter(interTileBlock);
+		interBitWriter.writeBits(0x1U,1);
+		writeInterTile(tileIndex,pixelIt,numPixels,interBitWriter);
+		Misc::UInt32 interTileSize=Misc::UInt32(interBitWriter.flush()-interTileBlock);
 		
-		/* Write the bit buffer to the sink: */
-		sink.write(currentBits);
-		compressedSize+=sizeof(Misc::UInt32);
+		/* Keep the smaller of the two representations, to not penalize tiles with a lot of motion: */
+		if(tileSizes[tileIndex]>interTileSize)
+			{
+			tileBlocks[tileIndex]=interTileBlock;
+			tileSizes[tileIndex]=interTileSize;
+			return;
+			}
+		}
+	
+	if(keyReconstruction!=0)
+		{
+		/* Retain the tile's pixels as reconstructed by readers from the independent representation to predict the next frame: */
+		for(;numPixels>0;++pixelIt,--numPixels)
+			previousFrame[*pixelIt]=keyReconstruction[*pixelIt];
+		}
+	}
+
+void DepthFrameWriter::writeTile(unsigned int tileIndex)
+	{
+	if(backgroundMask->empty())
+		{
+		/* Compress all pixels of the tile in Hilbert curve order: */
+		writeTilePixels(tileIndex,hilbertCurve.getIterator(tileFirstPixels[tileIndex]),tileFirstPixels[tileIndex+1]-tileFirstPixels[tileIndex]);
+		}
+	else
+		{
+		/* Compress only the tile's unmasked pixels, which precede its masked pixels in the mask partition: */
+		const unsigned int* pixelOffsets=maskPixelOffsets+tileFirstPixels[tileIndex];
+		writeTilePixels(tileIndex,pixelOffsets,tileNumUnmaskedPixels[tileIndex]);
 		
-		/* Clear the bit buffer: */
-		currentBits=0x0U;
-		currentBitsLeft=32;
+		if(keyReconstruction!=0)
+			{
+			/* Retain the tile's masked pixels as invalid, as reconstructed by readers: */
+			const unsigned int* maskedEnd=maskPixelOffsets+tileFirstPixels[tileIndex+1];
+			for(const unsigned int* mpIt=pixelOffsets+tileNumUnmaskedPixels[tileIndex];mpIt!=maskedEnd;++mpIt)
+				previousFrame[*mpIt]=FrameSource::invalidDepth;
+			}
+		}
+	}
+
+void DepthFrameWriter::compressFrame(const FrameBuffer& frame)
+	{
+	/* Compress all tiles into the frame block: */
+	jobFrame=static_cast<const FrameSource::DepthPixel*>(frame.getBuffer());
+	if(workerPool!=0)
+		workerPool->run(numTiles,*tileJob);
+	else
+		{
+		for(unsigned int i=0;i<numTiles;++i)
+			writeTile(i);
 		}
+	
+	/* Retain the frame to predict the next frame; tiles already retained their reconstructions if compression is not lossless: */
+	if(keyReconstruction==0)
+		memcpy(previousFrame,jobFrame,size_t(size[0])*size_t(size[1])*sizeof(FrameSource::DepthPixel));
+	havePreviousFrame=true;
+	jobFrame=0;
 	}
 
-DepthFrameWriter::DepthFrameWriter(IO::File& sSink,const unsigned int sSize[2])
+void DepthFrameWriter::partitionTiles(void)
+	{
+	for(unsigned int i=0;i<numTiles;++i)
+		tileNumUnmaskedPixels[i]=backgroundMask->partition(hilbertCurve,tileFirstPixels[i],tileFirstPixels[i+1],maskPixelOffsets+tileFirstPixels[i]);
+	}
+
+void DepthFrameWriter::resetStatistics(void)
+	{
+	memset(pixelDeltaCounts,0,sizeof(pixelDeltaCounts));
+	memset(spanLengthCounts,0,sizeof(spanLengthCounts));
+	memset(pixelResidualCounts,0,sizeof(pixelResidualCounts));
+	memset(unchangedSpanLengthCounts,0,sizeof(unchangedSpanLengthCounts));
+	}
+
+DepthFrameWriter::DepthFrameWriter(IO::File& sSink,const unsigned int sSize[2],unsigned int numThreads)
 	:FrameWriter(sSize),
 	 sink(sSink),
-	 currentBits(0x0U),currentBitsLeft(32)
+	 haveTrainedCodes(false),collectStatistics(false),numTrainingFrames(0),
+	 frameBlock(0),
+	 previousFrame(0),havePreviousFrame(false),keyframeInterval(30),numFramesSinceKeyframe(0),keyframeRequested(true),
+	 keyReconstruction(0),
+	 backgroundMask(new BackgroundMask(sSize[0]*sSize[1])),learningMask(0),numBackgroundMaskFrames(0),backgroundMaskChanged(false),keyframesCarryMask(false),
+	 maskPixelOffsets(0),
+	 jobFrame(0),jobInterFrame(false),
+	 workerPool(0),tileJob(0)
 	{
+	/* Start with the default Huffman codes: */
+	memcpy(pixelDeltaCodes,defaultPixelDeltaCodes,sizeof(pixelDeltaCodes));
+	memcpy(spanLengthCodes,defaultSpanLengthCodes,sizeof(spanLengthCodes));
+	memcpy(pixelResidualCodes,defaultPixelResidualCodes,sizeof(pixelResidualCodes));
+	memcpy(unchangedSpanLengthCodes,defaultUnchangedSpanLengthCodes,sizeof(unchangedSpanLengthCodes));
+	resetStatistics();
+	
+	/* Start out compressing losslessly: */
+	memset(maxErrors,0,sizeof(maxErrors));
+	
+	/* Split the Hilbert curve into tiles of approximately equal size: */
+	unsigned int numPixels=size[0]*size[1];
+	for(unsigned int i=0;i<=numTiles;++i)
+		tileFirstPixels[i]=(unsigned int)((size_t(numPixels)*size_t(i))/size_t(numTiles));
+	
+	/* Allocate a frame block large enough for two compressed representations of each tile in the worst case, plus their tile type bits: */
+	size_t frameBlockSize=0;
+	for(unsigned int i=0;i<numTiles;++i)
+		{
+		size_t numTilePixels=tileFirstPixels[i+1]-tileFirstPixels[i];
+		tileBlockOffsets[i]=frameBlockSize;
+		frameBlockSize+=(numTilePixels*maxKeyPixelBits+1+31)/32;
+		interTileBlockOffsets[i]=frameBlockSize;
+		frameBlockSize+=(numTilePixels*maxInterPixelBits+1+31)/32;
+		}
+	frameBlock=new Misc::UInt32[frameBlockSize];
+	
+	/* Allocate the previous frame buffer: */
+	previousFrame=new FrameSource::DepthPixel[numPixels];
+	
 	/* Create the Hilbert curve offset array: */
 	hilbertCurve.init(size);
 	
+	/* Create the tile compression job and the worker threads: */
+	tileJob=Misc::createFunctionCall(this,&DepthFrameWriter::writeTile);
+	if(numThreads>1)
+		workerPool=new WorkerPool(numThreads);
+	
 	/* Write the frame size to the sink: */
 	for(int i=0;i<2;++i)
 		sink.write<Misc::UInt32>(size[i]);
@@ -193,80 +626,247 @@ DepthFrameWriter::DepthFrameWriter(IO::File& sSink,const unsigned int sSize[2])
 	unsigned int slnc=spanLengthNumCodes;
 	sink.write<Misc::UInt32>(slnc);
 	sink.write(&spanLengthNodes[0][0],(spanLengthNumCodes-1)*2);
+	
+	/* Write the number of tiles per frame to the sink: */
+	unsigned int nt=numTiles;
+	sink.write<Misc::UInt32>(nt);
+	
+	/* Write the pixel residual Huffman decoding tree to the sink: */
+	unsigned int prnc=pixelResidualNumCodes;
+	sink.write<Misc::UInt32>(prnc);
+	sink.write(&pixelResidualNodes[0][0],(pixelResidualNumCodes-1)*2);
+	
+	/* Write the unchanged span length Huffman decoding tree to the sink: */
+	unsigned int uslnc=unchangedSpanLengthNumCodes;
+	sink.write<Misc::UInt32>(uslnc);
+	sink.write(&unchangedSpanLengthNodes[0][0],(unchangedSpanLengthNumCodes-1)*2);
 	}
 
 DepthFrameWriter::~DepthFrameWriter(void)
 	{
+	delete workerPool;
+	delete tileJob;
+	delete[] frameBlock;
+	delete[] previousFrame;
+	delete[] keyReconstruction;
+	delete backgroundMask;
+	delete learningMask;
+	delete[] maskPixelOffsets;
 	}
 
 size_t DepthFrameWriter::writeFrame(const FrameBuffer& frame)
 	{
-	compressedSize=0;
+	size_t compressedSize=0;
 	
 	/* Write the frame's time stamp: */
 	sink.write<Misc::Float64>(frame.timeStamp);
 	compressedSize+=sizeof(Misc::Float64);
 	
-	/* Process all pixels: */
-	const FrameSource::DepthPixel* frameBuffer=static_cast<const FrameSource::DepthPixel*>(frame.getBuffer());
-	unsigned int numPixels=size[0]*size[1];
-	const unsigned int* hcPtr=hilbertCurve.getOffsets();
-	while(numPixels>0)
+	/* Write a keyframe if one was requested or the keyframe interval ran out, and an inter frame otherwise: */
+	jobInterFrame=true;
+	if(keyframeRequested||(keyframeInterval!=0&&numFramesSinceKeyframe+1>=keyframeInterval))
 		{
-		/* Check if the next span is valid or invalid: */
-		if(frameBuffer[*hcPtr]!=FrameSource::invalidDepth)
+		keyframeRequested=false;
+		jobInterFrame=false;
+		numFramesSinceKeyframe=0;
+		}
+	else
+		++numFramesSinceKeyframe;
+	keyframe=!jobInterFrame;
+	
+	/* Update the background mask from the frame: */
+	const FrameSource::DepthPixel* framePixels=static_cast<const FrameSource::DepthPixel*>(frame.getBuffer());
+	bool learnedMask=false;
+	if(learningMask!=0)
+		{
+		/* Remove the frame's valid pixels from the background mask being learned: */
+		learningMask->unmaskValidPixels(hilbertCurve,framePixels);
+		if(--numBackgroundMaskFrames==0)
 			{
-			/******************************
-			Process a span of valid pixels:
-			******************************/
-			
-			/* Write the span header and the initial pixel value: */
-			Misc::UInt32 pixelValue=frameBuffer[*hcPtr];
-			writeBits(0x800U|pixelValue,12); // 1 bit span header, 11 bits initial pixel value
-			
-			/* Write the rest of pixels in the span: */
-			++hcPtr;
-			--numPixels;
-			while(numPixels>0&&frameBuffer[*hcPtr]>=pixelValue-15&&frameBuffer[*hcPtr]<=pixelValue+15)
-				{
-				/* Write the Huffman-encoded pixel value delta: */
-				unsigned int delta=frameBuffer[*hcPtr]+16-pixelValue;
-				writeBits(pixelDeltaCodes[delta][0],pixelDeltaCodes[delta][1]);
-				
-				pixelValue=frameBuffer[*hcPtr];
-				++hcPtr;
-				--numPixels;
-				}
-			
-			/* Write the span terminator: */
-			writeBits(pixelDeltaCodes[0][0],pixelDeltaCodes[0][1]);
+			/* Replace the current background mask with the learned one: */
+			delete backgroundMask;
+			backgroundMask=learningMask;
+			learningMask=0;
+			learnedMask=true;
 			}
-		else
+		}
+	if(learnedMask||(!backgroundMask->empty()&&backgroundMask->unmaskValidPixels(hilbertCurve,framePixels)))
+		{
+		/* Remove the unmasked pixels' segments from the mask to keep compression lossless, and separate the tiles' pixels again: */
+		backgroundMaskChanged=true;
+		if(!backgroundMask->empty())
 			{
-			/********************************
-			Process a span of invalid pixels:
-			********************************/
-			
-			/* Skip all following invalid pixels: */
-			++hcPtr;
-			--numPixels;
-			unsigned int spanLength=1;
-			while(numPixels>0&&frameBuffer[*hcPtr]==FrameSource::invalidDepth&&spanLength<256)
-				{
-				++hcPtr;
-				--numPixels;
-				++spanLength;
-				}
-			
-			/* Write the span header and the Huffman-encoded span length minus 1: */
-			writeBits(spanLengthCodes[spanLength-1][0],spanLengthCodes[spanLength-1][1]+1); // Write one extra zero bit for the span header
+			if(maskPixelOffsets==0)
+				maskPixelOffsets=new unsigned int[size_t(size[0])*size_t(size[1])];
+			partitionTiles();
 			}
 		}
 	
-	/* Flush the bit buffer: */
-	flush();
+	/* Write the frame's type; keyframes carry trained Huffman codes and the background mask so that readers can start decoding at any keyframe: */
+	bool writeCodes=!jobInterFrame&&haveTrainedCodes;
+	bool writeMask=backgroundMaskChanged||(!jobInterFrame&&(keyframesCarryMask||!backgroundMask->empty()));
+	sink.write<Misc::UInt8>((jobInterFrame?0x1U:0x0U)|(writeCodes?0x2U:0x0U)|(writeMask?0x4U:0x0U));
+	compressedSize+=sizeof(Misc::UInt8);
+	
+	if(writeCodes)
+		{
+		/* Write the lengths of all canonical Huffman codes: */
+		for(unsigned int i=0;i<pixelDeltaNumCodes;++i)
+			sink.write<Misc::UInt8>(pixelDeltaCodes[i][1]);
+		for(unsigned int i=0;i<spanLengthNumCodes;++i)
+			sink.write<Misc::UInt8>(spanLengthCodes[i][1]);
+		for(unsigned int i=0;i<pixelResidualNumCodes;++i)
+			sink.write<Misc::UInt8>(pixelResidualCodes[i][1]);
+		for(unsigned int i=0;i<unchangedSpanLengthNumCodes;++i)
+			sink.write<Misc::UInt8>(unchangedSpanLengthCodes[i][1]);
+		compressedSize+=pixelDeltaNumCodes+spanLengthNumCodes+pixelResidualNumCodes+unchangedSpanLengthNumCodes;
+		}
+	
+	if(writeMask)
+		{
+		/* Write the background mask: */
+		compressedSize+=backgroundMask->write(sink);
+		backgroundMaskChanged=false;
+		}
+	
+	/* Compress all tiles into the frame block, collecting statistics while training: */
+	collectStatistics=numTrainingFrames>0;
+	compressFrame(frame);
+	collectStatistics=false;
+	
+	/* Write the tile size table and the compressed tiles to the sink: */
+	sink.write(tileSizes,numTiles);
+	compressedSize+=numTiles*sizeof(Misc::UInt32);
+	for(unsigned int i=0;i<numTiles;++i)
+		{
+		sink.write(tileBlocks[i],tileSizes[i]);
+		compressedSize+=tileSizes[i]*sizeof(Misc::UInt32);
+		}
+	
+	/* Train new Huffman codes once enough frames have been written: */
+	if(numTrainingFrames>0)
+		{
+		--numTrainingFrames;
+		if(numTrainingFrames==0)
+			trainCodes();
+		}
 	
 	return compressedSize;
 	}
 
+void DepthFrameWriter::requestKeyframe(void)
+	{
+	keyframeRequested=true;
+	}
+
+void DepthFrameWriter::setKeyframeInterval(unsigned int newKeyframeInterval)
+	{
+	keyframeInterval=newKeyframeInterval;
+	}
+
+void DepthFrameWriter::setMaxError(unsigned int newMaxError)
+	{
+	setMaxError(newMaxError,newMaxError);
+	}
+
+void DepthFrameWriter::setMaxError(unsigned int nearMaxError,unsigned int farMaxError)
+	{
+	/* Interpolate the maximum error linearly across the range of valid raw depth values: */
+	bool lossless=true;
+	for(unsigned int value=0;value<FrameSource::invalidDepth;++value)
+		{
+		unsigned int maxError=(nearMaxError*(FrameSource::invalidDepth-1-value)+farMaxError*value+(FrameSource::invalidDepth-1)/2)/(FrameSource::invalidDepth-1);
+		if(maxError>255)
+			maxError=255;
+		maxErrors[value]=Misc::UInt8(maxError);
+		if(maxError!=0)
+			lossless=false;
+		}
+	
+	/* Invalid pixels are always reproduced exactly: */
+	maxErrors[FrameSource::invalidDepth]=0;
+	
+	if(lossless)
+		{
+		/* Release the reconstruction buffer: */
+		delete[] keyReconstruction;
+		keyReconstruction=0;
+		}
+	else if(keyReconstruction==0)
+		{
+		/* Allocate the reconstruction buffer: */
+		keyReconstruction=new FrameSource::DepthPixel[size_t(size[0])*size_t(size[1])];
+		}
+	
+	/* The previous frame no longer matches what readers reconstruct if the error changed, so the next frame must be a keyframe: */
+	keyframeRequested=true;
+	}
+
+void DepthFrameWriter::setNumBackgroundMaskFrames(unsigned int newNumBackgroundMaskFrames)
+	{
+	/* Cancel learning a background mask: */
+	delete learningMask;
+	learningMask=0;
+	
+	/* Once background masks are used, keyframes always reset the readers' masks: */
+	keyframesCarryMask=true;
+	
+	numBackgroundMaskFrames=newNumBackgroundMaskFrames;
+	if(numBackgroundMaskFrames>0)
+		{
+		/* Start with a mask covering the entire frame, and remove the valid pixels of each following frame: */
+		learningMask=new BackgroundMask(size[0]*size[1]);
+		learningMask->setAll(true);
+		}
+	else if(!backgroundMask->empty())
+		{
+		/* Remove the current background mask and tell readers: */
+		backgroundMask->setAll(false);
+		backgroundMaskChanged=true;
+		}
+	}
+
+void DepthFrameWriter::setNumTrainingFrames(unsigned int newNumTrainingFrames)
+	{
+	numTrainingFrames=newNumTrainingFrames;
+	}
+
+void DepthFrameWriter::addTrainingFrame(const FrameBuffer& frame)
+	{
+	/* Compress the frame as an inter frame if possible, which codes each tile in both representations, and only keep its statistics: */
+	jobInterFrame=havePreviousFrame;
+	collectStatistics=true;
+	compressFrame(frame);
+	collectStatistics=false;
+	
+	/* The next written frame can not be predicted from the training frame: */
+	keyframeRequested=true;
+	}
+
+void DepthFrameWriter::trainCodes(void)
+	{
+	/* Sum up the statistics of all tiles: */
+	size_t pdc[pixelDeltaNumCodes];
+	size_t slc[spanLengthNumCodes];
+	size_t prc[pixelResidualNumCodes];
+	size_t uslc[unchangedSpanLengthNumCodes];
+	sumCounts(pixelDeltaCounts[0],numTiles,pixelDeltaNumCodes,pdc);
+	sumCounts(spanLengthCounts[0],numTiles,spanLengthNumCodes,slc);
+	sumCounts(pixelResidualCounts[0],numTiles,pixelResidualNumCodes,prc);
+	sumCounts(unchangedSpanLengthCounts[0],numTiles,unchangedSpanLengthNumCodes,uslc);
+	
+	/* Build optimal canonical Huffman codes: */
+	buildCanonicalCode(pixelDeltaNumCodes,pdc,maxTrainedCodeLength,pixelDeltaCodes);
+	buildCanonicalCode(spanLengthNumCodes,slc,maxTrainedCodeLength,spanLengthCodes);
+	buildCanonicalCode(pixelResidualNumCodes,prc,maxTrainedCodeLength,pixelResidualCodes);
+	buildCanonicalCode(unchangedSpanLengthNumCodes,uslc,maxTrainedCodeLength,unchangedSpanLengthCodes);
+	haveTrainedCodes=true;
+	
+	/* Start a new training set: */
+	resetStatistics();
+	
+	/* Send the new codes to readers with the next frame: */
+	keyframeRequested=true;
+	}
+
 }
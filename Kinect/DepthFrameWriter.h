@@ -26,6 +26,9 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <stddef.h>
 #include <Misc/SizedTypes.h>
 #include <Kinect/HilbertCurve.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/BackgroundMask.h>
+#include <Kinect/WorkerPool.h>
 #include <Kinect/FrameWriter.h>
 
 /* Forward declarations: */
@@ -37,44 +40,162 @@ namespace Kinect {
 
 class DepthFrameWriter:public FrameWriter
 	{
+	/* Embedded classes: */
+	private:
+	class BitWriter // Class to write a bit stream into a memory block
+		{
+		/* Elements: */
+		private:
+		Misc::UInt32* blockPtr; // Position of the next word to be written into the memory block
+		Misc::UInt64 currentBits; // Buffer to collect bits before they are written into the memory block; the lowest numCurrentBits bits are pending
+		unsigned int numCurrentBits; // Number of pending bits in the bit buffer; always less than 32 between calls
+		
+		/* Constructors and destructors: */
+		public:
+		BitWriter(Misc::UInt32* sBlockPtr) // Creates a bit writer writing into the given memory block
+			:blockPtr(sBlockPtr),currentBits(0x0U),numCurrentBits(0)
+			{
+			}
+		
+		/* Methods: */
+		void writeBits(Misc::UInt32 bits,unsigned int numBits) // Writes the given number of bits, up to 32, to the memory block
+			{
+			/* Append the bits to the bit buffer: */
+			currentBits=(currentBits<<numBits)|bits;
+			numCurrentBits+=numBits;
+			
+			/* Move a full word into the memory block: */
+			if(numCurrentBits>=32)
+				{
+				numCurrentBits-=32;
+				*blockPtr=Misc::UInt32(currentBits>>numCurrentBits);
+				++blockPtr;
+				}
+			}
+		Misc::UInt32* flush(void) // Moves the pending bits into the memory block, padded to a full word, and returns the end of the written bit stream
+			{
+			if(numCurrentBits>0)
+				{
+				/* Push the leftover bits to the left and move them into the memory block: */
+				*blockPtr=Misc::UInt32(currentBits<<(32-numCurrentBits));
+				++blockPtr;
+				numCurrentBits=0;
+				}
+			return blockPtr;
+			}
+		};
+	
 	/* Elements: */
+	public:
+	static const unsigned int encodingVersion=8; // Format version of the depth frame encoding written by this class, to be passed to DepthFrameReader
+	
 	private:
 	IO::File& sink; // Data sink for the compressed depth frame stream
 	HilbertCurve hilbertCurve; // Object to traverse depth frames in Hilbert curve order
 	static const unsigned int pixelDeltaNumCodes=32; // Number of codes for pixel deltas
-	static const Misc::UInt32 pixelDeltaCodes[pixelDeltaNumCodes][2]; // Huffman code array for pixel deltas
+	static const Misc::UInt32 defaultPixelDeltaCodes[pixelDeltaNumCodes][2]; // Default Huffman code array for pixel deltas
 	static const Misc::UInt32 pixelDeltaNodes[pixelDeltaNumCodes-1][2]; // Huffman decoding tree nodes for pixel deltas
 	static const unsigned int spanLengthNumCodes=256; // Number of codes for span lengths
-	static const Misc::UInt32 spanLengthCodes[spanLengthNumCodes][2]; // Huffman code array for span lengths
+	static const Misc::UInt32 defaultSpanLengthCodes[spanLengthNumCodes][2]; // Default Huffman code array for span lengths
 	static const Misc::UInt32 spanLengthNodes[spanLengthNumCodes-1][2]; // Huffman decoding tree nodes for span lengths
-	Misc::UInt32 currentBits; // Buffer to push bits into the sink buffer
-	unsigned int currentBitsLeft; // Number of available bits left in the bit buffer
-	size_t compressedSize; // Aggregated size of compressed frame during writing
+	static const unsigned int pixelResidualNumCodes=33; // Number of codes for pixel residuals against the previous frame
+	static const Misc::UInt32 defaultPixelResidualCodes[pixelResidualNumCodes][2]; // Default Huffman code array for pixel residuals
+	static const Misc::UInt32 pixelResidualNodes[pixelResidualNumCodes-1][2]; // Huffman decoding tree nodes for pixel residuals
+	static const unsigned int unchangedSpanLengthNumCodes=256; // Number of codes for lengths of spans of pixels unchanged from the previous frame
+	static const Misc::UInt32 defaultUnchangedSpanLengthCodes[unchangedSpanLengthNumCodes][2]; // Default Huffman code array for unchanged span lengths
+	static const Misc::UInt32 unchangedSpanLengthNodes[unchangedSpanLengthNumCodes-1][2]; // Huffman decoding tree nodes for unchanged span lengths
+	static const unsigned int minUnchangedSpanLength=4; // Minimum number of unchanged pixels that end a span of changed pixels
+	static const unsigned int maxTrainedCodeLength=16; // Maximum length of a trained Huffman code in bits; no default Huffman code is longer
+	static const unsigned int maxKeyPixelBits=12+maxTrainedCodeLength; // Largest number of bits per pixel in an independently compressed tile, i.e., a valid span of a single pixel and its span terminator
+	static const unsigned int maxInterPixelBits=1+maxTrainedCodeLength+11+maxTrainedCodeLength; // Largest number of bits per pixel in a tile compressed as residuals, i.e., a changed span of a single escaped pixel and its span terminator
+	Misc::UInt32 pixelDeltaCodes[pixelDeltaNumCodes][2]; // Current Huffman code array for pixel deltas
+	Misc::UInt32 spanLengthCodes[spanLengthNumCodes][2]; // Current Huffman code array for span lengths
+	Misc::UInt32 pixelResidualCodes[pixelResidualNumCodes][2]; // Current Huffman code array for pixel residuals
+	Misc::UInt32 unchangedSpanLengthCodes[unchangedSpanLengthNumCodes][2]; // Current Huffman code array for unchanged span lengths
+	bool haveTrainedCodes; // Flag whether the current Huffman codes were trained on previous frames; if true, keyframes carry the codes
+	bool collectStatistics; // Flag whether to count coded values while compressing tiles
+	unsigned int numTrainingFrames; // Number of frames still to be written before Huffman codes are trained automatically
+	static const unsigned int numTiles=16; // Number of independently compressed tiles per frame, each a contiguous section of the Hilbert curve
+	unsigned int tileFirstPixels[numTiles+1]; // Hilbert curve index of the first pixel of each tile, plus one past the last pixel of the last tile
+	Misc::UInt32* frameBlock; // Memory block receiving the compressed tiles of a frame before they are written to the sink
+	size_t tileBlockOffsets[numTiles]; // Offsets of each tile's independently compressed representation in the frame block, large enough for the worst case
+	size_t interTileBlockOffsets[numTiles]; // Offsets of each tile's representation compressed as residuals in the frame block, large enough for the worst case
+	Misc::UInt32* tileBlocks[numTiles]; // Start of the current frame's chosen compressed representation of each tile in the frame block
+	Misc::UInt32 tileSizes[numTiles]; // Sizes of the current frame's compressed tiles in 32-bit words
+	size_t pixelDeltaCounts[numTiles][pixelDeltaNumCodes]; // Number of times each pixel delta code was used in each tile since statistics were last reset
+	size_t spanLengthCounts[numTiles][spanLengthNumCodes]; // Number of times each span length code was used in each tile
+	size_t pixelResidualCounts[numTiles][pixelResidualNumCodes]; // Number of times each pixel residual code was used in each tile
+	size_t unchangedSpanLengthCounts[numTiles][unchangedSpanLengthNumCodes]; // Number of times each unchanged span length code was used in each tile
+	FrameSource::DepthPixel* previousFrame; // Previously written depth frame, against which inter frames are predicted
+	bool havePreviousFrame; // Flag whether a frame was compressed into the previous frame buffer
+	unsigned int keyframeInterval; // Maximum number of frames from one keyframe to the next, or 0 to only write keyframes on request
+	unsigned int numFramesSinceKeyframe; // Number of frames written since the most recent keyframe
+	volatile bool keyframeRequested; // Flag whether the next frame must be written as a keyframe
+	Misc::UInt8 maxErrors[FrameSource::invalidDepth+1]; // Maximum reconstruction error for each raw depth value; always zero for invalid pixels
+	FrameSource::DepthPixel* keyReconstruction; // Current frame as reconstructed from independently compressed tiles, or null if compression is lossless
+	BackgroundMask* backgroundMask; // Mask of static background pixels, which are invalid in every frame and are not compressed
+	BackgroundMask* learningMask; // Background mask being learned from the frames written next, or null
+	unsigned int numBackgroundMaskFrames; // Number of frames still to be written before the learned background mask replaces the current one
+	bool backgroundMaskChanged; // Flag whether the background mask changed since it was last sent to readers
+	bool keyframesCarryMask; // Flag whether keyframes carry the background mask even if it is empty, so that readers never keep a mask from an earlier part of the stream, e.g., one written by a different parallel writer
+	unsigned int* maskPixelOffsets; // Array offsets of each tile's unmasked pixels in Hilbert curve order, followed by those of its masked pixels
+	unsigned int tileNumUnmaskedPixels[numTiles]; // Number of unmasked pixels in each tile
+	const FrameSource::DepthPixel* jobFrame; // Depth frame currently being compressed
+	bool jobInterFrame; // Flag whether the current frame is compressed as an inter frame
+	WorkerPool* workerPool; // Pool of worker threads compressing tiles in parallel, or null
+	WorkerPool::Job* tileJob; // Job compressing a single tile of the current frame
 	
 	/* Private methods: */
-	void writeManyBits(Misc::UInt32 bits,unsigned int numBits); // Writes the given number of bits to the sink
-	void writeBits(Misc::UInt32 bits,unsigned int numBits) // Writes the given number of bits to the sink
+	static int quantizeResidual(int residual,unsigned int maxError) // Returns the residual of smallest magnitude that reconstructs a value within the given maximum error
 		{
-		if(numBits<=currentBitsLeft)
-			{
-			currentBits=(currentBits<<numBits)|bits;
-			currentBitsLeft-=numBits;
-			}
+		if(residual>int(maxError))
+			return residual-int(maxError);
+		else if(residual<-int(maxError))
+			return residual+int(maxError);
 		else
-			{
-			/* Fall back to slower default method: */
-			writeManyBits(bits,numBits);
-			}
+			return 0;
 		}
-	void flush(void); // Flushes the bit buffer
+	bool isUnchanged(FrameSource::DepthPixel pixel,FrameSource::DepthPixel previousPixel) const // Returns true if the given pixel can be reconstructed from the given previous pixel
+		{
+		if(pixel==previousPixel)
+			return true;
+		if(previousPixel==FrameSource::invalidDepth)
+			return false;
+		int residual=int(pixel)-int(previousPixel);
+		return residual>=-int(maxErrors[pixel])&&residual<=int(maxErrors[pixel]);
+		}
+	template <class PixelIteratorParam>
+	void writeKeyTile(unsigned int tileIndex,PixelIteratorParam pixelIt,unsigned int numPixels,BitWriter& bitWriter); // Compresses the given pixels of the tile of the given index of the current frame independently of previous frames
+	template <class PixelIteratorParam>
+	void writeInterTile(unsigned int tileIndex,PixelIteratorParam pixelIt,unsigned int numPixels,BitWriter& bitWriter); // Compresses the given pixels of the tile of the given index of the current frame as residuals against the previous frame
+	template <class PixelIteratorParam>
+	void writeTilePixels(unsigned int tileIndex,PixelIteratorParam pixelIt,unsigned int numPixels); // Compresses the given pixels of the tile of the given index of the current frame into the frame block
+	void writeTile(unsigned int tileIndex); // Compresses the unmasked pixels of the tile of the given index of the current frame into the frame block
+	void partitionTiles(void); // Separates each tile's unmasked from its masked pixels after the background mask changed
+	void compressFrame(const FrameBuffer& frame); // Compresses all tiles of the given frame into the frame block and retains the frame for prediction
+	void resetStatistics(void); // Resets all code counters
 	
 	/* Constructors and destructors: */
 	public:
-	DepthFrameWriter(IO::File& sSink,const unsigned int sSize[2]); // Creates a depth frame writer for the given sink and frame size
+	DepthFrameWriter(IO::File& sSink,const unsigned int sSize[2],unsigned int numThreads =1); // Creates a depth frame writer for the given sink and frame size, compressing tiles in numThreads threads including the calling thread
 	virtual ~DepthFrameWriter(void);
 	
 	/* Methods from FrameWriter: */
 	virtual size_t writeFrame(const FrameBuffer& frame);
+	virtual void requestKeyframe(void);
+	
+	/* New methods: */
+	unsigned int getKeyframeInterval(void) const // Returns the maximum number of frames between keyframes
+		{
+		return keyframeInterval;
+		}
+	void setKeyframeInterval(unsigned int newKeyframeInterval); // Sets the maximum number of frames between keyframes; 0 only writes keyframes on request
+	void setMaxError(unsigned int newMaxError); // Sets the maximum reconstruction error for all valid raw depth values; 0 compresses losslessly
+	void setMaxError(unsigned int nearMaxError,unsigned int farMaxError); // Sets the maximum reconstruction error to interpolate linearly from the smallest to the largest valid raw depth value
+	void setNumBackgroundMaskFrames(unsigned int newNumBackgroundMaskFrames); // Learns a background mask of the pixels that are invalid in all of the given number of frames written next; 0 removes the current background mask
+	void setNumTrainingFrames(unsigned int newNumTrainingFrames); // Trains Huffman codes on the statistics of the given number of frames written next, unless 0
+	void addTrainingFrame(const FrameBuffer& frame); // Adds the statistics of the given frame, e.g., from a calibration recording, to the training set without writing it
+	void trainCodes(void); // Replaces the current Huffman codes by optimal codes for the training set and starts a new training set; new codes take effect with the next frame, which will be a keyframe
 	};
 
 }
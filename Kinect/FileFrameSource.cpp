@@ -23,27 +23,68 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 
 #include <Kinect/FileFrameSource.h>
 
+#include <string.h>
+#include <stdexcept>
 #include <Misc/SizedTypes.h>
 #include <Misc/Time.h>
 #include <Misc/FunctionCalls.h>
 #include <Misc/ThrowStdErr.h>
+#include <Misc/FileNameExtensions.h>
+#include <IO/SeekableFile.h>
 #include <IO/OpenFile.h>
+#include <Math/Math.h>
 #include <Math/Constants.h>
 #include <Geometry/GeometryMarshallers.h>
 #include <Video/Config.h>
 #include <Kinect/FrameBuffer.h>
+#include <Kinect/MappedFile.h>
 #include <Kinect/ColorFrameReader.h>
 #include <Kinect/DepthFrameReader.h>
+#include <Kinect/RansDepthFrameReader.h>
 #include <Kinect/LossyDepthFrameReader.h>
 
 namespace Kinect {
 
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+IO::FilePtr openDepthFrameFile(const char* fileName) // Opens a depth frame file, mapped into memory if possible
+	{
+	/* Map uncompressed regular files into memory to decompress depth frames in place: */
+	if(strcasecmp(Misc::getExtension(fileName),".gz")!=0)
+		{
+		try
+			{
+			return IO::FilePtr(new MappedFile(fileName));
+			}
+		catch(std::runtime_error)
+			{
+			/* Fall back to opening the file regularly: */
+			}
+		}
+	
+	return IO::openFile(fileName);
+	}
+
+}
+
 /********************************
 Methods of class FileFrameSource:
 ********************************/
 
 void FileFrameSource::initialize(void)
 	{
+	/* Frame indices are loaded on demand: */
+	for(int i=0;i<2;++i)
+		{
+		readerOffsets[i]=0;
+		firstFrameOffsets[i]=0;
+		frameIndices[i]=0;
+		}
+	
 	/* Read the file's format version numbers: */
 	fileFormatVersions[0]=colorFrameFile->read<Misc::UInt32>();
 	fileFormatVersions[1]=depthFrameFile->read<Misc::UInt32>();
@@ -69,8 +110,14 @@ void FileFrameSource::initialize(void)
 		depthCorrection=new DepthCorrection(0,numSegments);
 		}
 	
-	/* Check if the depth stream uses lossy compression: */
-	bool depthIsLossy=fileFormatVersions[1]>=3&&depthFrameFile->read<Misc::UInt8>()!=0;
+	/* Check which compression method the depth stream uses: */
+	depthCompression=fileFormatVersions[1]>=3?depthFrameFile->read<Misc::UInt8>():FrameSource::LOSSLESS_HUFFMAN;
+	if(depthCompression>FrameSource::LOSSLESS_RANS)
+		Misc::throwStdErr("Kinect::FileFrameSource::FileFrameSource: Unknown depth compression method %u",depthCompression);
+	#if !VIDEO_CONFIG_HAVE_THEORA
+	if(depthCompression==FrameSource::LOSSY_THEORA)
+		Misc::throwStdErr("Kinect::FileFrameSource::FileFrameSource: Lossy depth compression not supported due to lack of Theora library");
+	#endif
 	
 	/* Read the color and depth projections from their respective files: */
 	intrinsicParameters.colorProjection=Misc::Marshaller<FrameSource::IntrinsicParameters::PTransform>::read(*colorFrameFile);
@@ -80,24 +127,228 @@ void FileFrameSource::initialize(void)
 	extrinsicParameters=Misc::Marshaller<FrameSource::ExtrinsicParameters>::read(*depthFrameFile);
 	
 	/* Create the color and depth frame readers: */
-	colorFrameReader=new ColorFrameReader(*colorFrameFile);
-	if(depthIsLossy)
-		{
-		#if VIDEO_CONFIG_HAVE_THEORA
-		depthFrameReader=new LossyDepthFrameReader(*depthFrameFile);
-		#else
-		delete colorFrameReader;
-		Misc::throwStdErr("Kinect::FileFrameSource::FileFrameSource: Lossy depth compression not supported due to lack of Theora library");
-		#endif
-		}
-	else
-		depthFrameReader=new DepthFrameReader(*depthFrameFile);
+	colorFrameReader=createFrameReader(COLOR);
+	depthFrameReader=createFrameReader(DEPTH);
 	
 	/* Get the depth reader's frame size: */
 	for(int i=0;i<2;++i)
 		depthSize[i]=depthFrameReader->getSize()[i];
 	}
 
+FrameReader* FileFrameSource::createFrameReader(int sensor)
+	{
+	IO::File& file=sensor==COLOR?*colorFrameFile:*depthFrameFile;
+	
+	/* Remember the position of the stream header if the file supports random access: */
+	IO::SeekableFile* seekableFile=dynamic_cast<IO::SeekableFile*>(&file);
+	if(seekableFile!=0)
+		readerOffsets[sensor]=seekableFile->getReadPos();
+	
+	/* Create a frame reader for the stream's compression method: */
+	FrameReader* result;
+	if(sensor==COLOR)
+		result=new ColorFrameReader(file);
+	#if VIDEO_CONFIG_HAVE_THEORA
+	else if(depthCompression==FrameSource::LOSSY_THEORA)
+		result=new LossyDepthFrameReader(file);
+	#endif
+	else if(depthCompression==FrameSource::LOSSLESS_RANS)
+		result=new RansDepthFrameReader(file);
+	else
+		result=new DepthFrameReader(file,fileFormatVersions[1],numDepthDecodingThreads);
+	
+	/* Remember the position of the stream's first frame: */
+	if(seekableFile!=0)
+		firstFrameOffsets[sensor]=seekableFile->getReadPos();
+	
+	return result;
+	}
+
+IO::SeekableFile& FileFrameSource::getSeekableFile(int sensor)
+	{
+	IO::SeekableFile* result=dynamic_cast<IO::SeekableFile*>(sensor==COLOR?colorFrameFile.getPointer():depthFrameFile.getPointer());
+	if(result==0)
+		Misc::throwStdErr("Kinect::FileFrameSource: %s file does not support random access",sensor==COLOR?"Color":"Depth");
+	return *result;
+	}
+
+FrameIndex* FileFrameSource::loadFrameIndex(int sensor)
+	{
+	IO::SeekableFile& file=getSeekableFile(sensor);
+	IO::SeekableFile::Offset readPos=file.getReadPos();
+	FrameIndex* result=new FrameIndex;
+	
+	/* Read the index footer appended to the stream by newer frame savers: */
+	bool haveIndex=fileFormatVersions[sensor]>=(sensor==COLOR?2U:FrameIndex::depthFooterFormatVersion)&&result->readFooter(file);
+	
+	/* Otherwise, read the index from a cache file next to the stream file if the stream file did not change since: */
+	std::string cacheFileName;
+	if(!frameFileNames[sensor].empty())
+		cacheFileName=frameFileNames[sensor]+".index";
+	if(!haveIndex&&!cacheFileName.empty())
+		{
+		try
+			{
+			IO::FilePtr cacheFile=IO::openFile(cacheFileName.c_str());
+			cacheFile->setEndianness(Misc::LittleEndian);
+			if(cacheFile->read<Misc::UInt32>()==FrameIndex::footerMagic&&cacheFile->read<Misc::UInt64>()==Misc::UInt64(file.getSize()))
+				{
+				result->read(*cacheFile);
+				haveIndex=true;
+				}
+			}
+		catch(std::runtime_error)
+			{
+			/* Ignore missing or corrupted cache files */
+			}
+		}
+	
+	if(!haveIndex)
+		{
+		/* Create the index by reading the entire stream with a temporary frame reader: */
+		*result=FrameIndex();
+		file.setReadPosAbs(readerOffsets[sensor]);
+		FrameReader* reader=createFrameReader(sensor);
+		try
+			{
+			while(true)
+				{
+				IO::SeekableFile::Offset frameOffset=file.getReadPos();
+				FrameBuffer frame=reader->readNextFrame();
+				if(frame.timeStamp>=Math::Constants<double>::max)
+					break;
+				result->addFrame(frame.timeStamp,size_t(file.getReadPos()-frameOffset),reader->isKeyframe());
+				}
+			}
+		catch(std::runtime_error)
+			{
+			/* Ignore a truncated last frame, e.g., from an interrupted recording */
+			}
+		delete reader;
+		
+		/* Cache the index next to the stream file: */
+		if(!cacheFileName.empty())
+			{
+			try
+				{
+				IO::FilePtr cacheFile=IO::openFile(cacheFileName.c_str(),IO::File::WriteOnly);
+				cacheFile->setEndianness(Misc::LittleEndian);
+				cacheFile->write<Misc::UInt32>(FrameIndex::footerMagic);
+				cacheFile->write<Misc::UInt64>(Misc::UInt64(file.getSize()));
+				result->write(*cacheFile);
+				}
+			catch(std::runtime_error)
+				{
+				/* Keep the index in memory if the cache file can not be written */
+				}
+			}
+		}
+	
+	/* Return to the stream's current position: */
+	file.setReadPosAbs(readPos);
+	
+	return result;
+	}
+
+void* FileFrameSource::decodingThreadMethod(int sensor)
+	{
+	FrameReader* reader=sensor==COLOR?colorFrameReader:depthFrameReader;
+	while(true)
+		{
+		/* Decode the next frame: */
+		FrameBuffer frame=reader->readNextFrame();
+		
+		/* Wait until there is room in the stream's decoded frame queue, not counting the frame currently being played back: */
+		Threads::MutexCond::Lock decodedFramesLock(decodedFramesCond);
+		while(!stopDecoding&&decodedFrames[sensor].size()>maxNumDecodedFrames)
+			decodedFramesCond.wait(decodedFramesLock);
+		
+		/* Queue the decoded frame, even if playback is stopping, to keep it for the next playback or read: */
+		decodedFrames[sensor].push_back(frame);
+		decodedFramesCond.broadcast();
+		
+		/* Stop at the end of the stream or if playback is stopping: */
+		if(frame.timeStamp>=Math::Constants<double>::max||stopDecoding)
+			break;
+		}
+	
+	return 0;
+	}
+
+FrameBuffer FileFrameSource::peekDecodedFrame(int sensor,size_t queueIndex)
+	{
+	/* Wait until the stream's frame decoding thread has decoded the requested frame: */
+	Threads::MutexCond::Lock decodedFramesLock(decodedFramesCond);
+	while(decodedFrames[sensor].size()<=queueIndex)
+		decodedFramesCond.wait(decodedFramesLock);
+	
+	return decodedFrames[sensor][queueIndex];
+	}
+
+void FileFrameSource::popDecodedFrame(int sensor)
+	{
+	/* Remove the first frame from the queue and wake up the frame decoding thread: */
+	Threads::MutexCond::Lock decodedFramesLock(decodedFramesCond);
+	decodedFrames[sensor].pop_front();
+	decodedFramesCond.broadcast();
+	}
+
+void FileFrameSource::startDecoding(void)
+	{
+	/* Start the frame decoding threads unless a stream's end was already queued during a previous playback: */
+	stopDecoding=false;
+	for(int i=0;i<2;++i)
+		if(decodedFrames[i].empty()||decodedFrames[i].back().timeStamp<Math::Constants<double>::max)
+			decodingThreads[i].start(this,&FileFrameSource::decodingThreadMethod,i);
+	}
+
+void FileFrameSource::stopPlayback(void)
+	{
+	/* Stop the playback thread: */
+	if(!playbackThread.isJoined())
+		{
+		playbackThread.cancel();
+		playbackThread.join();
+		}
+	
+	/* Shut down the frame decoding threads, keeping the frames that were not played back queued for the next playback or read: */
+	{
+	Threads::MutexCond::Lock decodedFramesLock(decodedFramesCond);
+	stopDecoding=true;
+	decodedFramesCond.broadcast();
+	}
+	for(int i=0;i<2;++i)
+		if(!decodingThreads[i].isJoined())
+			decodingThreads[i].join();
+	}
+
+void FileFrameSource::processBackground(FrameBuffer& depthFrame)
+	{
+	if(numBackgroundFrames>0)
+		{
+		/* Add the depth frame to the background frame: */
+		DepthPixel* bfPtr=backgroundFrame;
+		const DepthPixel* dPtr=static_cast<const DepthPixel*>(depthFrame.getBuffer());
+		for(unsigned int y=0;y<depthSize[1];++y)
+			for(unsigned int x=0;x<depthSize[0];++x,++bfPtr,++dPtr)
+				if(*bfPtr>*dPtr-1)
+					*bfPtr=*dPtr-1;
+		
+		--numBackgroundFrames;
+		}
+	
+	if(removeBackground&&backgroundFrame!=0&&numBackgroundFrames==0)
+		{
+		/* Remove background pixels from the depth frame: */
+		DepthPixel* dPtr=static_cast<DepthPixel*>(depthFrame.getBuffer());
+		const DepthPixel* bfPtr=backgroundFrame;
+		for(unsigned int y=0;y<depthSize[1];++y)
+			for(unsigned int x=0;x<depthSize[0];++x,++dPtr,++bfPtr)
+				if(*dPtr>=*bfPtr)
+					*dPtr=0x07ffU;
+		}
+	}
+
 void* FileFrameSource::playbackThreadMethod(void)
 	{
 	Threads::Thread::setCancelState(Threads::Thread::CANCEL_ENABLE);
@@ -108,20 +359,22 @@ void* FileFrameSource::playbackThreadMethod(void)
 	int currentDepthFrame=2;
 	unsigned int numDepthFrames=0;
 	
-	/* Load the first color frame: */
-	FrameBuffer colorFrame=colorFrameReader->readNextFrame();
+	/* Get the first decoded color frame, which stays queued until it is played back: */
+	FrameBuffer colorFrame=peekDecodedFrame(COLOR,0);
 	
-	/* Load the first depth frame: */
+	/* Get the first decoded depth frame: */
 	currentDepthFrame=(currentDepthFrame+1)%3;
-	depthFrames[currentDepthFrame]=depthFrameReader->readNextFrame();
+	depthFrames[currentDepthFrame]=peekDecodedFrame(DEPTH,0);
 	++numDepthFrames;
 	
 	while(true)
 		{
-		/* Wait until the next frame is due: */
+		/* Wait until the next frame is due, or stop at the end of both streams: */
 		double dueTime=colorFrame.timeStamp;
 		if(dueTime>depthFrames[currentDepthFrame].timeStamp)
 			dueTime=depthFrames[currentDepthFrame].timeStamp;
+		if(dueTime>=Math::Constants<double>::max)
+			break;
 		double currentTime=frameTimer.peekTime();
 		if(currentTime<dueTime)
 			{
@@ -132,18 +385,33 @@ void* FileFrameSource::playbackThreadMethod(void)
 		/* Check which frame has become active: */
 		if(currentTime>=colorFrame.timeStamp)
 			{
+			/* Don't stop playback between posting the color frame and removing it from its queue: */
+			Threads::Thread::setCancelState(Threads::Thread::CANCEL_DISABLE);
+			
 			if(colorStreamingCallback!=0)
 				{
 				/* Post the next color frame to the consumer: */
 				(*colorStreamingCallback)(colorFrame);
 				}
 			
-			/* Read the next color frame: */
-			colorFrame=colorFrameReader->readNextFrame();
+			popDecodedFrame(COLOR);
+			Threads::Thread::setCancelState(Threads::Thread::CANCEL_ENABLE);
+			
+			/* Get the next decoded color frame: */
+			colorFrame=peekDecodedFrame(COLOR,0);
 			}
 		if(currentTime>=depthFrames[currentDepthFrame].timeStamp)
 			{
+			/* Don't stop playback between posting the depth frame and removing it from its queue: */
+			Threads::Thread::setCancelState(Threads::Thread::CANCEL_DISABLE);
+			
+			#if 0
+			/* Wait until the median filter has three depth frames: */
 			if(depthStreamingCallback!=0&&numDepthFrames>=3)
+			#else
+			/* Post every depth frame, so that restarting playback does not skip any: */
+			if(depthStreamingCallback!=0)
+			#endif
 				{
 				#if 0
 				
@@ -183,37 +451,19 @@ void* FileFrameSource::playbackThreadMethod(void)
 				
 				#endif
 				
-				if(numBackgroundFrames>0)
-					{
-					/* Add the median-filtered depth frame to the background frame: */
-					DepthPixel* bfPtr=backgroundFrame;
-					const DepthPixel* mPtr=static_cast<const DepthPixel*>(median.getBuffer());
-					for(unsigned int y=0;y<depthSize[1];++y)
-						for(unsigned int x=0;x<depthSize[0];++x,++bfPtr,++mPtr)
-							if(*bfPtr>*mPtr-1)
-								*bfPtr=*mPtr-1;
-					
-					--numBackgroundFrames;
-					}
-				
-				if(removeBackground&&backgroundFrame!=0&&numBackgroundFrames==0)
-					{
-					/* Remove background pixels from the median-filtered depth frame: */
-					DepthPixel* mPtr=static_cast<DepthPixel*>(median.getBuffer());
-					const DepthPixel* bfPtr=backgroundFrame;
-					for(unsigned int y=0;y<depthSize[1];++y)
-						for(unsigned int x=0;x<depthSize[0];++x,++mPtr,++bfPtr)
-							if(*mPtr>=*bfPtr)
-								*mPtr=0x07ffU;
-					}
+				/* Capture or remove background in the median-filtered depth frame: */
+				processBackground(median);
 				
 				/* Post the median-filtered depth frame to the consumer: */
 				(*depthStreamingCallback)(median);
 				}
 			
-			/* Read the next depth frame: */
+			popDecodedFrame(DEPTH);
+			Threads::Thread::setCancelState(Threads::Thread::CANCEL_ENABLE);
+			
+			/* Get the next decoded depth frame: */
 			currentDepthFrame=(currentDepthFrame+1)%3;
-			depthFrames[currentDepthFrame]=depthFrameReader->readNextFrame();
+			depthFrames[currentDepthFrame]=peekDecodedFrame(DEPTH,0);
 			++numDepthFrames;
 			}
 		}
@@ -221,14 +471,70 @@ void* FileFrameSource::playbackThreadMethod(void)
 	return 0;
 	}
 
+void* FileFrameSource::batchThreadMethod(void)
+	{
+	Threads::Thread::setCancelState(Threads::Thread::CANCEL_ENABLE);
+	
+	/* Get the first two decoded color frames to find the color frame closest to each depth frame; the first stays queued as it can be paired again: */
+	FrameBuffer colorFrame=peekDecodedFrame(COLOR,0);
+	FrameBuffer nextColorFrame;
+	if(colorFrame.timeStamp<Math::Constants<double>::max)
+		nextColorFrame=peekDecodedFrame(COLOR,1);
+	else
+		nextColorFrame=colorFrame;
+	
+	while(true)
+		{
+		/* Get the next decoded depth frame, and stop at the end of the depth stream: */
+		FramePair pair;
+		pair.depth=peekDecodedFrame(DEPTH,0);
+		if(pair.depth.timeStamp>=Math::Constants<double>::max)
+			break;
+		
+		/* Skip color frames until the next color frame is not closer to the depth frame than the current one: */
+		double depthTime=pair.depth.timeStamp;
+		while(nextColorFrame.timeStamp<Math::Constants<double>::max&&Math::abs(nextColorFrame.timeStamp-depthTime)<Math::abs(colorFrame.timeStamp-depthTime))
+			{
+			popDecodedFrame(COLOR);
+			colorFrame=nextColorFrame;
+			nextColorFrame=peekDecodedFrame(COLOR,1);
+			}
+		pair.color=colorFrame;
+		
+		/* Don't stop batch processing between delivering the depth frame and removing it from its queue: */
+		Threads::Thread::setCancelState(Threads::Thread::CANCEL_DISABLE);
+		
+		/* Capture or remove background in the depth frame: */
+		processBackground(pair.depth);
+		
+		/* Deliver the frame pair: */
+		(*framePairCallback)(pair);
+		
+		popDecodedFrame(DEPTH);
+		Threads::Thread::setCancelState(Threads::Thread::CANCEL_ENABLE);
+		}
+	
+	/* Signal the end of batch processing: */
+	if(batchCompletionCallback!=0)
+		(*batchCompletionCallback)(*this);
+	
+	return 0;
+	}
+
 FileFrameSource::FileFrameSource(const char* colorFrameFileName,const char* depthFrameFileName)
 	:colorFrameFile(IO::openFile(colorFrameFileName)),
-	 depthFrameFile(IO::openFile(depthFrameFileName)),
-	 colorFrameReader(0),depthFrameReader(0),
+	 depthFrameFile(openDepthFrameFile(depthFrameFileName)),
+	 colorFrameReader(0),depthFrameReader(0),numDepthDecodingThreads(1),
 	 depthCorrection(0),
 	 colorStreamingCallback(0),depthStreamingCallback(0),
+	 maxNumDecodedFrames(4),stopDecoding(false),
+	 framePairCallback(0),batchCompletionCallback(0),
 	 numBackgroundFrames(0),backgroundFrame(0),removeBackground(false)
 	{
+	/* Remember the frame files' names to cache frame indices: */
+	frameFileNames[0]=colorFrameFileName;
+	frameFileNames[1]=depthFrameFileName;
+	
 	/* Initialize the frame files: */
 	colorFrameFile->setEndianness(Misc::LittleEndian);
 	depthFrameFile->setEndianness(Misc::LittleEndian);
@@ -240,9 +546,11 @@ FileFrameSource::FileFrameSource(const char* colorFrameFileName,const char* dept
 FileFrameSource::FileFrameSource(IO::FilePtr sColorFrameFile,IO::FilePtr sDepthFrameFile)
 	:colorFrameFile(sColorFrameFile),
 	 depthFrameFile(sDepthFrameFile),
-	 colorFrameReader(0),depthFrameReader(0),
+	 colorFrameReader(0),depthFrameReader(0),numDepthDecodingThreads(1),
 	 depthCorrection(0),
 	 colorStreamingCallback(0),depthStreamingCallback(0),
+	 maxNumDecodedFrames(4),stopDecoding(false),
+	 framePairCallback(0),batchCompletionCallback(0),
 	 numBackgroundFrames(0),backgroundFrame(0),removeBackground(false)
 	{
 	/* Initialize the file frame source: */
@@ -251,16 +559,14 @@ FileFrameSource::FileFrameSource(IO::FilePtr sColorFrameFile,IO::FilePtr sDepthF
 
 FileFrameSource::~FileFrameSource(void)
 	{
-	/* Stop the playback thread: */
-	if(!playbackThread.isJoined())
-		{
-		playbackThread.cancel();
-		playbackThread.join();
-		}
+	/* Stop the playback and frame decoding threads: */
+	stopPlayback();
 	
 	/* Delete the callbacks: */
 	delete colorStreamingCallback;
 	delete depthStreamingCallback;
+	delete framePairCallback;
+	delete batchCompletionCallback;
 	
 	/* Delete the depth correction object: */
 	delete depthCorrection;
@@ -269,6 +575,10 @@ FileFrameSource::~FileFrameSource(void)
 	delete colorFrameReader;
 	delete depthFrameReader;
 	
+	/* Delete the frame indices: */
+	for(int i=0;i<2;++i)
+		delete frameIndices[i];
+	
 	/* Delete allocated frame buffers: */
 	delete[] backgroundFrame;
 	}
@@ -314,34 +624,70 @@ void FileFrameSource::startStreaming(FrameSource::StreamingCallback* newColorStr
 	delete depthStreamingCallback;
 	depthStreamingCallback=newDepthStreamingCallback;
 	
-	/* Start the playback thread: */
+	/* Start the frame decoding and playback threads: */
+	startDecoding();
 	playbackThread.start(this,&FileFrameSource::playbackThreadMethod);
 	}
 
 void FileFrameSource::stopStreaming(void)
 	{
-	/* Stop the playback thread: */
-	if(!playbackThread.isJoined())
-		{
-		playbackThread.cancel();
-		playbackThread.join();
-		}
+	/* Stop the playback and frame decoding threads: */
+	stopPlayback();
 	
 	/* Delete the callbacks: */
 	delete colorStreamingCallback;
 	colorStreamingCallback=0;
 	delete depthStreamingCallback;
 	depthStreamingCallback=0;
+	delete framePairCallback;
+	framePairCallback=0;
+	delete batchCompletionCallback;
+	batchCompletionCallback=0;
+	}
+
+void FileFrameSource::startBatchProcessing(FileFrameSource::FramePairCallback* newFramePairCallback,FileFrameSource::BatchCompletionCallback* newBatchCompletionCallback)
+	{
+	/* Set the batch processing callbacks: */
+	delete framePairCallback;
+	framePairCallback=newFramePairCallback;
+	delete batchCompletionCallback;
+	batchCompletionCallback=newBatchCompletionCallback;
+	
+	/* Start the frame decoding and batch processing threads: */
+	startDecoding();
+	playbackThread.start(this,&FileFrameSource::batchThreadMethod);
 	}
 
 FrameBuffer FileFrameSource::readNextColorFrame(void)
 	{
+	/* Return frames decoded ahead during a previous playback first: */
+	if(!decodedFrames[COLOR].empty())
+		{
+		FrameBuffer result=decodedFrames[COLOR].front();
+		decodedFrames[COLOR].pop_front();
+		return result;
+		}
+	
 	return colorFrameReader->readNextFrame();
 	}
 
 FrameBuffer FileFrameSource::readNextDepthFrame(void)
 	{
-	return depthFrameReader->readNextFrame();
+	/* Return frames decoded ahead during a previous playback first: */
+	FrameBuffer result;
+	if(!decodedFrames[DEPTH].empty())
+		{
+		result=decodedFrames[DEPTH].front();
+		decodedFrames[DEPTH].pop_front();
+		}
+	else
+		result=depthFrameReader->readNextFrame();
+	
+	/* Capture or remove background unless the end of the stream was reached: */
+	if(result.timeStamp<Math::Constants<double>::max)
+		processBackground(result);
+	
+	return result;
 	}
 
 void FileFrameSource::resetFrameTimer(void)
@@ -372,4 +718,89 @@ void FileFrameSource::setRemoveBackground(bool newRemoveBackground)
 	removeBackground=newRemoveBackground;
 	}
 
+void FileFrameSource::setNumDepthDecodingThreads(unsigned int newNumDepthDecodingThreads)
+	{
+	numDepthDecodingThreads=newNumDepthDecodingThreads;
+	
+	/* Only losslessly compressed depth frames can be decompressed in parallel: */
+	DepthFrameReader* dfr=dynamic_cast<DepthFrameReader*>(depthFrameReader);
+	if(dfr!=0)
+		dfr->setNumThreads(newNumDepthDecodingThreads);
+	}
+
+void FileFrameSource::setMaxNumDecodedFrames(unsigned int newMaxNumDecodedFrames)
+	{
+	/* Queue at least one decoded frame per stream: */
+	maxNumDecodedFrames=newMaxNumDecodedFrames>0?newMaxNumDecodedFrames:1;
+	}
+
+const FrameIndex& FileFrameSource::getFrameIndex(int sensor)
+	{
+	/* Load the frame index on first use: */
+	if(frameIndices[sensor]==0)
+		frameIndices[sensor]=loadFrameIndex(sensor);
+	
+	return *frameIndices[sensor];
+	}
+
+void FileFrameSource::seekToFrame(int sensor,size_t frameIndex)
+	{
+	const FrameIndex& index=getFrameIndex(sensor);
+	IO::SeekableFile& file=getSeekableFile(sensor);
+	FrameReader*& reader=sensor==COLOR?colorFrameReader:depthFrameReader;
+	
+	/* Discard frames decoded ahead during a previous playback, and replace the stream's frame reader to discard its decoding state: */
+	decodedFrames[sensor].clear();
+	file.setReadPosAbs(readerOffsets[sensor]);
+	delete reader;
+	reader=0;
+	reader=createFrameReader(sensor);
+	
+	if(frameIndex<index.getNumFrames())
+		{
+		/* Go to the closest keyframe preceding the requested frame, and decode the frames in between: */
+		size_t keyframeIndex=index.findKeyframe(frameIndex);
+		file.setReadPosAbs(firstFrameOffsets[sensor]+IO::SeekableFile::Offset(index.getFrame(keyframeIndex).offset));
+		for(size_t i=keyframeIndex;i<frameIndex;++i)
+			reader->readNextFrame();
+		}
+	else
+		{
+		/* Go to the end of the stream: */
+		file.setReadPosAbs(firstFrameOffsets[sensor]+IO::SeekableFile::Offset(index.getDataSize()));
+		}
+	}
+
+void FileFrameSource::seekToTime(double timeStamp)
+	{
+	/* Go to the most recent color and depth frames at the given time: */
+	seekToFrame(COLOR,getFrameIndex(COLOR).findFrame(timeStamp));
+	seekToFrame(DEPTH,getFrameIndex(DEPTH).findFrame(timeStamp));
+	}
+
+void FileFrameSource::copyStream(int sensor,IO::File& sink)
+	{
+	const FrameIndex& index=getFrameIndex(sensor);
+	IO::SeekableFile& file=getSeekableFile(sensor);
+	IO::SeekableFile::Offset readPos=file.getReadPos();
+	
+	/* Copy the file's headers and all complete compressed frames: */
+	file.setReadPosAbs(0);
+	IO::SeekableFile::Offset numBytes=firstFrameOffsets[sensor]+IO::SeekableFile::Offset(index.getDataSize());
+	Misc::UInt8 buffer[65536];
+	while(numBytes>0)
+		{
+		size_t chunkSize=numBytes>IO::SeekableFile::Offset(sizeof(buffer))?sizeof(buffer):size_t(numBytes);
+		file.read(buffer,chunkSize);
+		sink.write(buffer,chunkSize);
+		numBytes-=IO::SeekableFile::Offset(chunkSize);
+		}
+	
+	/* Append the stream's index, whose frame offsets are unchanged in the copy: */
+	index.writeFooter(sink);
+	
+	/* Continue reading frames where the stream left off: */
+	file.setReadPosAbs(readPos);
+	}
+
 }
@@ -24,12 +24,17 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #ifndef KINECT_FILEFRAMESOURCE_INCLUDED
 #define KINECT_FILEFRAMESOURCE_INCLUDED
 
+#include <string>
+#include <deque>
 #include <Misc/Timer.h>
 #include <IO/File.h>
+#include <IO/SeekableFile.h>
+#include <Threads/MutexCond.h>
 #include <Threads/Thread.h>
 #include <Geometry/OrthogonalTransformation.h>
 #include <Kinect/FrameBuffer.h>
 #include <Kinect/FrameSource.h>
+#include <Kinect/FrameIndex.h>
 
 /* Forward declarations: */
 namespace Kinect {
@@ -40,28 +45,64 @@ namespace Kinect {
 
 class FileFrameSource:public FrameSource
 	{
+	/* Embedded classes: */
+	public:
+	struct FramePair // Structure for a depth frame and the color frame closest to it in time
+		{
+		/* Elements: */
+		public:
+		FrameBuffer color; // Color frame
+		FrameBuffer depth; // Depth frame
+		};
+	
+	typedef Misc::FunctionCall<const FramePair&> FramePairCallback; // Function call type for batch processing callbacks receiving pairs of color and depth frames
+	typedef Misc::FunctionCall<FileFrameSource&> BatchCompletionCallback; // Function call type for completion of batch processing callback
+	
 	/* Elements: */
 	private:
 	Misc::Timer frameTimer; // Free-running timer to synchronize playback of depth and color frames
 	IO::FilePtr colorFrameFile; // File containing color frames
 	IO::FilePtr depthFrameFile; // File containing depth frames
+	std::string frameFileNames[2]; // Names of the color and depth files to store frame index caches, or empty if the files were opened by the caller
 	unsigned int fileFormatVersions[2]; // Format version numbers of the color and depth files, respectively
+	unsigned int depthCompression; // Compression method of the depth stream
 	FrameReader* colorFrameReader; // Reader for color frames
 	FrameReader* depthFrameReader; // Reader for depth frames
+	unsigned int numDepthDecodingThreads; // Number of threads decompressing each losslessly compressed depth frame
+	IO::SeekableFile::Offset readerOffsets[2]; // Positions of the color and depth stream headers from which frame readers are created
+	IO::SeekableFile::Offset firstFrameOffsets[2]; // Positions of the first color and depth frames
+	FrameIndex* frameIndices[2]; // Indices of all color and depth frames, or null if not yet loaded
 	unsigned int depthSize[2]; // Size of depth frames in pixels
 	DepthCorrection* depthCorrection; // Depth correction parameters read from the depth file
 	IntrinsicParameters intrinsicParameters; // Intrinsic parameters read from the color and depth files
 	ExtrinsicParameters extrinsicParameters; // Extrinsic parameters read from the color and depth files
 	StreamingCallback* colorStreamingCallback; // Callback to be called when a new color frame has been loaded
 	StreamingCallback* depthStreamingCallback; // Callback to be called when a new depth frame has been loaded
-	Threads::Thread playbackThread; // Thread playing back depth and color frames
+	unsigned int maxNumDecodedFrames; // Maximum number of frames per stream decoded ahead of the frame being played back
+	Threads::MutexCond decodedFramesCond; // Condition variable to signal newly decoded or dispatched frames; also protects the decoded frame queues
+	std::deque<FrameBuffer> decodedFrames[2]; // Queues of decoded color and depth frames waiting to be played back; kept across playbacks and drained by the readNext...Frame methods
+	volatile bool stopDecoding; // Flag to shut down the frame decoding threads
+	Threads::Thread decodingThreads[2]; // Threads decoding color and depth frames ahead of playback
+	Threads::Thread playbackThread; // Thread playing back depth and color frames, or processing frame pairs in batch mode
+	FramePairCallback* framePairCallback; // Callback to be called with each pair of color and depth frames in batch mode
+	BatchCompletionCallback* batchCompletionCallback; // Callback to be called when batch processing reaches the end of the depth stream
 	unsigned int numBackgroundFrames; // Number of background frames left to capture
 	DepthPixel* backgroundFrame; // Frame containing minimal depth values for a captured background
 	bool removeBackground; // Flag whether to remove background information during frame processing
 	
 	/* Private methods: */
 	void initialize(void);
+	FrameReader* createFrameReader(int sensor); // Returns a new frame reader for the color or depth stream, reading the stream header from the stream file's current position
+	IO::SeekableFile& getSeekableFile(int sensor); // Returns the color or depth file for random access; throws exception if the file is not seekable
+	FrameIndex* loadFrameIndex(int sensor); // Loads the color or depth stream's frame index from the stream's footer or a cache file, or creates it by scanning the stream
+	void* decodingThreadMethod(int sensor); // Thread method decoding color or depth frames ahead of playback
+	FrameBuffer peekDecodedFrame(int sensor,size_t queueIndex); // Returns the color or depth frame at the given position in its decoded frame queue, waiting for its frame decoding thread if necessary
+	void popDecodedFrame(int sensor); // Removes the first frame from the color or depth stream's decoded frame queue after it was played back
+	void startDecoding(void); // Starts the frame decoding threads
+	void stopPlayback(void); // Shuts down the playback and frame decoding threads
+	void processBackground(FrameBuffer& depthFrame); // Adds the given depth frame to the background frame while capturing background, or removes background from it
 	void* playbackThreadMethod(void); // Thread method playing back depth and color frames
+	void* batchThreadMethod(void); // Thread method delivering pairs of color and depth frames as fast as they are decoded
 	
 	/* Constructors and destructors: */
 	public:
@@ -79,7 +120,8 @@ class FileFrameSource:public FrameSource
 	
 	/* New methods: */
 	FrameBuffer readNextColorFrame(void); // Immediately reads, decompresses, and returns the next frame from the color file
-	FrameBuffer readNextDepthFrame(void); // Immediately reads, decompresses, and returns the next frame from the depth file
+	FrameBuffer readNextDepthFrame(void); // Immediately reads, decompresses, and returns the next frame from the depth file, capturing or removing background if requested
+	void startBatchProcessing(FramePairCallback* newFramePairCallback,BatchCompletionCallback* newBatchCompletionCallback =0); // Starts delivering each remaining depth frame, paired with the color frame closest to it in time, to the given callback as fast as frames can be decoded, and calls the optional completion callback at the end of the depth stream; stopped by stopStreaming
 	void resetFrameTimer(void); // Resets the internal frame timer
 	void captureBackground(unsigned int newNumBackgroundFrames); // Captures the given number of frames to create a background removal buffer
 	void setRemoveBackground(bool newRemoveBackground); // Enables or disables background removal
@@ -87,6 +129,16 @@ class FileFrameSource:public FrameSource
 		{
 		return removeBackground;
 		}
+	void setNumDepthDecodingThreads(unsigned int newNumDepthDecodingThreads); // Sets the number of threads decompressing each losslessly compressed depth frame; must not be called while streaming
+	void setMaxNumDecodedFrames(unsigned int newMaxNumDecodedFrames); // Sets the maximum number of frames per stream decoded ahead of playback; must not be called while streaming
+	const FrameIndex& getFrameIndex(int sensor); // Returns the index of all frames in the color or depth stream, loading or creating it on first use; must not be called while streaming
+	size_t getNumFrames(int sensor) // Returns the number of frames in the color or depth stream; must not be called while streaming
+		{
+		return getFrameIndex(sensor).getNumFrames();
+		}
+	void seekToFrame(int sensor,size_t frameIndex); // Positions the color or depth stream such that the next read frame is the frame of the given index; must not be called while streaming
+	void seekToTime(double timeStamp); // Positions both streams such that the next read frames are the most recent frames at the given time stamp; must not be called while streaming
+	void copyStream(int sensor,IO::File& sink); // Copies the color or depth stream's headers and compressed frames unchanged to the given little-endian sink, followed by an index footer; must not be called while streaming
 	};
 
 }
@@ -0,0 +1,228 @@
+/***********************************************************************
+FrameBuffer - Class for reference-counted decoded color or depth frame
+buffers, recycled through a lock-free pool of cache line-aligned
+buffers.
+Copyright (c) 2010-2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/FrameBuffer.h>
+
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <new>
+
+#define KINECT_FRAMEBUFFER_USE_POOL 1
+
+namespace Kinect {
+
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+const int numBufferPools=16; // Maximum number of distinct buffer sizes that can be recycled
+const int numPoolSlots=16; // Maximum number of orphaned buffers held for recycling per buffer size
+const size_t hugePageSize=size_t(2)*1024*1024; // Size of a transparent huge page
+
+struct BufferPool // Structure holding orphaned buffers of the same size for recycling
+	{
+	/* Elements: */
+	public:
+	volatile size_t bufferSize; // Size of buffers held in this pool, or 0 if the pool has not been claimed yet
+	void* volatile slots[numPoolSlots]; // Orphaned buffers; empty slots are null; slots are filled and emptied by atomic compare-and-swap
+	};
+
+/****************
+Helper variables:
+****************/
+
+BufferPool bufferPools[numBufferPools]; // Buffer pools; zero-initialized before any static constructor runs
+volatile bool useHugePages=false; // Flag whether to back large buffers with transparent huge pages
+
+/****************
+Helper functions:
+****************/
+
+#if KINECT_FRAMEBUFFER_USE_POOL
+
+int findBufferPool(size_t bufferSize)
+	{
+	/* Search for the pool holding buffers of the given size, claiming an unused pool if there is none: */
+	for(int i=0;i<numBufferPools;++i)
+		{
+		size_t poolBufferSize=bufferPools[i].bufferSize;
+		if(poolBufferSize==0)
+			{
+			/* Try to claim the unused pool; another thread might claim it for the same or a different size at the same time: */
+			if(__sync_bool_compare_and_swap(&bufferPools[i].bufferSize,size_t(0),bufferSize))
+				return i;
+			poolBufferSize=bufferPools[i].bufferSize;
+			}
+		if(poolBufferSize==bufferSize)
+			return i;
+		}
+	
+	/* All pools are taken by other buffer sizes: */
+	return -1;
+	}
+
+#endif
+
+}
+
+/************************************
+Static elements of class FrameBuffer:
+************************************/
+
+const size_t FrameBuffer::headerSize;
+
+/****************************
+Methods of class FrameBuffer:
+****************************/
+
+void* FrameBuffer::allocateBuffer(size_t bufferSize)
+	{
+	/* Round the buffer size up to a multiple of the cache line size: */
+	bufferSize=(bufferSize+headerSize-1)&~(headerSize-1);
+	
+	#if KINECT_FRAMEBUFFER_USE_POOL
+	
+	/* Try recycling an orphaned buffer of the same size: */
+	int poolIndex=findBufferPool(bufferSize);
+	if(poolIndex>=0)
+		{
+		BufferPool& pool=bufferPools[poolIndex];
+		for(int i=0;i<numPoolSlots;++i)
+			{
+			void* buffer=pool.slots[i];
+			if(buffer!=0&&__sync_bool_compare_and_swap(&pool.slots[i],buffer,static_cast<void*>(0)))
+				{
+				/* Re-initialize the buffer's header: */
+				BufferHeader& header=getHeader(buffer);
+				size_t blockSize=header.blockSize;
+				bool mapped=header.mapped;
+				header.~BufferHeader();
+				new(&header) BufferHeader(poolIndex,blockSize,mapped);
+				
+				return buffer;
+				}
+			}
+		}
+	
+	#else
+	
+	int poolIndex=-1;
+	
+	#endif
+	
+	/* Allocate a new memory block: */
+	size_t blockSize=headerSize+bufferSize;
+	void* block=0;
+	bool mapped=false;
+	if(useHugePages&&blockSize>=hugePageSize)
+		{
+		/* Map the memory block directly and advise the kernel to back it with huge pages: */
+		blockSize=(blockSize+hugePageSize-1)&~(hugePageSize-1);
+		block=mmap(0,blockSize,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+		if(block!=MAP_FAILED)
+			{
+			#ifdef MADV_HUGEPAGE
+			madvise(block,blockSize,MADV_HUGEPAGE);
+			#endif
+			mapped=true;
+			}
+		else
+			{
+			/* Fall back to heap allocation: */
+			blockSize=headerSize+bufferSize;
+			block=0;
+			}
+		}
+	if(!mapped&&posix_memalign(&block,headerSize,blockSize)!=0)
+		throw std::bad_alloc();
+	
+	/* Initialize the buffer header: */
+	unsigned char* buffer=static_cast<unsigned char*>(block)+headerSize;
+	new(&getHeader(buffer)) BufferHeader(poolIndex,blockSize,mapped);
+	
+	return buffer;
+	}
+
+void FrameBuffer::releaseBuffer(void* buffer)
+	{
+	#if KINECT_FRAMEBUFFER_USE_POOL
+	
+	/* Try returning the buffer to its pool: */
+	int poolIndex=getHeader(buffer).poolIndex;
+	if(poolIndex>=0)
+		{
+		BufferPool& pool=bufferPools[poolIndex];
+		for(int i=0;i<numPoolSlots;++i)
+			if(pool.slots[i]==0&&__sync_bool_compare_and_swap(&pool.slots[i],static_cast<void*>(0),buffer))
+				return;
+		}
+	
+	#endif
+	
+	/* Release the buffer's memory block: */
+	deleteBuffer(buffer);
+	}
+
+void FrameBuffer::deleteBuffer(void* buffer)
+	{
+	/* Destroy the buffer header: */
+	BufferHeader& header=getHeader(buffer);
+	size_t blockSize=header.blockSize;
+	bool mapped=header.mapped;
+	header.~BufferHeader();
+	
+	/* Release the memory block: */
+	void* block=static_cast<unsigned char*>(buffer)-headerSize;
+	if(mapped)
+		munmap(block,blockSize);
+	else
+		free(block);
+	}
+
+void FrameBuffer::setUseHugePages(bool newUseHugePages)
+	{
+	useHugePages=newUseHugePages;
+	}
+
+void FrameBuffer::releasePooledBuffers(void)
+	{
+	/* Empty all pool slots: */
+	for(int poolIndex=0;poolIndex<numBufferPools;++poolIndex)
+		{
+		BufferPool& pool=bufferPools[poolIndex];
+		for(int i=0;i<numPoolSlots;++i)
+			{
+			void* buffer=pool.slots[i];
+			if(buffer!=0&&__sync_bool_compare_and_swap(&pool.slots[i],buffer,static_cast<void*>(0)))
+				{
+				/* Release the buffer's memory block: */
+				deleteBuffer(buffer);
+				}
+			}
+		}
+	}
+
+}
@@ -1,7 +1,8 @@
 /***********************************************************************
 FrameBuffer - Class for reference-counted decoded color or depth frame
+buffers, recycled through a lock-free pool of cache line-aligned
 buffers.
-Copyright (c) 2010-2012 Oliver Kreylos
+Copyright (c) 2010-2013 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -29,6 +30,7 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #if KINECT_FRAMEBUFFER_DEBUGLOCK
 #include <assert.h>
 #endif
+#include <stddef.h>
 #include <new>
 #if KINECT_FRAMEBUFFER_DEBUGLOCK
 #include <iostream>
@@ -46,13 +48,17 @@ class FrameBuffer
 		/* Elements: */
 		public:
 		Threads::Atomic<unsigned int> refCount; // Reference counter
+		int poolIndex; // Index of the buffer pool to which the buffer is returned when it becomes orphaned, or -1 if the buffer is not pooled
+		size_t blockSize; // Size of the memory block containing the header and the buffer
+		bool mapped; // Flag whether the memory block was mapped from the operating system instead of allocated from the heap
 		#if KINECT_FRAMEBUFFER_DEBUGLOCK
 		int destroyed;
 		#endif
 		
 		/* Constructors and destructors: */
-		BufferHeader(void)
-			:refCount(1)
+		BufferHeader(int sPoolIndex,size_t sBlockSize,bool sMapped)
+			:refCount(1),
+			 poolIndex(sPoolIndex),blockSize(sBlockSize),mapped(sMapped)
 			#if KINECT_FRAMEBUFFER_DEBUGLOCK
 			 ,destroyed(0)
 			#endif
@@ -84,6 +90,17 @@ class FrameBuffer
 			}
 		};
 	
+	static const size_t headerSize=64; // Space reserved for the buffer header in front of each buffer; keeps buffers aligned to cache lines
+	
+	/* Private methods: */
+	static BufferHeader& getHeader(void* buffer) // Returns the header of the given buffer
+		{
+		return *reinterpret_cast<BufferHeader*>(static_cast<unsigned char*>(buffer)-headerSize);
+		}
+	static void* allocateBuffer(size_t bufferSize); // Returns a 64-byte aligned buffer of at least the given size with a freshly referenced header, recycling an orphaned buffer of the same size if possible
+	static void releaseBuffer(void* buffer); // Returns an orphaned buffer to its buffer pool, or releases its memory if the pool is full
+	static void deleteBuffer(void* buffer); // Destroys the header of the given buffer and releases its memory block
+	
 	/* Elements: */
 	private:
 	int size[2]; // Width and height of the frame
@@ -105,12 +122,8 @@ class FrameBuffer
 		size[0]=sizeX;
 		size[1]=sizeY;
 		
-		/* Allocate the enlarged frame buffer: */
-		unsigned char* paddedBuffer=new unsigned char[bufferSize+sizeof(BufferHeader)];
-		new(paddedBuffer) BufferHeader;
-		
-		/* Store the actual buffer pointer: */
-		buffer=paddedBuffer+sizeof(BufferHeader);
+		/* Allocate or recycle the frame buffer: */
+		buffer=allocateBuffer(bufferSize);
 		}
 	FrameBuffer(const FrameBuffer& source) // Copy constructor
 		:buffer(source.buffer),timeStamp(source.timeStamp)
@@ -121,7 +134,7 @@ class FrameBuffer
 		
 		/* Reference the source's buffer: */
 		if(buffer!=0)
-			static_cast<BufferHeader*>(buffer)[-1].ref();
+			getHeader(buffer).ref();
 		}
 	FrameBuffer& operator=(const FrameBuffer& source) // Assignment operator
 		{
@@ -134,11 +147,10 @@ class FrameBuffer
 			/* Unreference the current buffer: */
 			if(buffer!=0)
 				{
-				if(static_cast<BufferHeader*>(buffer)[-1].unref())
+				if(getHeader(buffer).unref())
 					{
-					/* Delete the unused buffer: */
-					static_cast<BufferHeader*>(buffer)[-1].~BufferHeader();
-					delete[] (static_cast<unsigned char*>(buffer)-sizeof(BufferHeader));
+					/* Recycle or delete the unused buffer: */
+					releaseBuffer(buffer);
 					}
 				}
 			
@@ -149,7 +161,7 @@ class FrameBuffer
 			/* Reference the source's buffer: */
 			buffer=source.buffer;
 			if(buffer!=0)
-				static_cast<BufferHeader*>(buffer)[-1].ref();
+				getHeader(buffer).ref();
 			
 			/* Copy the time stamp: */
 			timeStamp=source.timeStamp;
@@ -161,16 +173,17 @@ class FrameBuffer
 		/* Unreference the current buffer: */
 		if(buffer!=0)
 			{
-			if(static_cast<BufferHeader*>(buffer)[-1].unref())
+			if(getHeader(buffer).unref())
 				{
-				/* Delete the unused buffer: */
-				static_cast<BufferHeader*>(buffer)[-1].~BufferHeader();
-				delete[] (static_cast<unsigned char*>(buffer)-sizeof(BufferHeader));
+				/* Recycle or delete the unused buffer: */
+				releaseBuffer(buffer);
 				}
 			}
 		}
 	
 	/* Methods: */
+	static void setUseHugePages(bool newUseHugePages); // Enables or disables backing newly allocated buffers of at least 2MB with transparent huge pages
+	static void releasePooledBuffers(void); // Releases the memory of all orphaned buffers currently held for recycling
 	const int* getSize(void) const // Returns the frame size
 		{
 		return size;
@@ -0,0 +1,162 @@
+/***********************************************************************
+FrameIndex - Class to represent the time stamps, positions, and sizes of
+all frames in a recorded color or depth stream to support random access.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/FrameIndex.h>
+
+#include <IO/File.h>
+#include <IO/SeekableFile.h>
+#include <Math/Constants.h>
+
+namespace Kinect {
+
+namespace {
+
+const size_t entrySize=sizeof(Misc::Float64)+sizeof(Misc::UInt64)+sizeof(Misc::UInt32)+sizeof(Misc::UInt8); // Size of a frame entry in a written index
+const size_t footerOverhead=sizeof(Misc::Float64)+sizeof(Misc::UInt32)+sizeof(Misc::UInt64)+sizeof(Misc::UInt32); // Size of an index footer without its frame entries
+
+}
+
+/***********************************
+Static elements of class FrameIndex:
+***********************************/
+
+const Misc::UInt32 FrameIndex::footerMagic;
+const unsigned int FrameIndex::depthFooterFormatVersion;
+
+/***************************
+Methods of class FrameIndex:
+***************************/
+
+FrameIndex::FrameIndex(void)
+	:dataSize(0)
+	{
+	}
+
+void FrameIndex::addFrame(double timeStamp,size_t size,bool keyframe)
+	{
+	Entry entry;
+	entry.timeStamp=timeStamp;
+	entry.offset=dataSize;
+	entry.size=Misc::UInt32(size);
+	entry.keyframe=keyframe;
+	entries.push_back(entry);
+	dataSize+=size;
+	}
+
+size_t FrameIndex::findFrame(double timeStamp) const
+	{
+	/* Binary search for the first frame whose time stamp is larger than the given time stamp: */
+	size_t l=0;
+	size_t r=entries.size();
+	while(l<r)
+		{
+		size_t m=(l+r)/2;
+		if(entries[m].timeStamp<=timeStamp)
+			l=m+1;
+		else
+			r=m;
+		}
+	
+	/* Return the frame before it: */
+	return l>0?l-1:0;
+	}
+
+size_t FrameIndex::findKeyframe(size_t frameIndex) const
+	{
+	/* Search backwards for the closest keyframe: */
+	while(frameIndex>0&&!entries[frameIndex].keyframe)
+		--frameIndex;
+	return frameIndex;
+	}
+
+void FrameIndex::write(IO::File& sink) const
+	{
+	/* Write the number of frames and all frame entries: */
+	sink.write<Misc::UInt32>(Misc::UInt32(entries.size()));
+	for(std::vector<Entry>::const_iterator eIt=entries.begin();eIt!=entries.end();++eIt)
+		{
+		sink.write<Misc::Float64>(eIt->timeStamp);
+		sink.write<Misc::UInt64>(eIt->offset);
+		sink.write<Misc::UInt32>(eIt->size);
+		sink.write<Misc::UInt8>(eIt->keyframe?1:0);
+		}
+	}
+
+void FrameIndex::read(IO::File& source)
+	{
+	/* Read the number of frames and all frame entries: */
+	entries.clear();
+	dataSize=0;
+	size_t numFrames=source.read<Misc::UInt32>();
+	for(size_t i=0;i<numFrames;++i)
+		{
+		Entry entry;
+		entry.timeStamp=source.read<Misc::Float64>();
+		entry.offset=source.read<Misc::UInt64>();
+		entry.size=source.read<Misc::UInt32>();
+		entry.keyframe=source.read<Misc::UInt8>()!=0;
+		entries.push_back(entry);
+		if(dataSize<entry.offset+entry.size)
+			dataSize=entry.offset+entry.size;
+		}
+	}
+
+void FrameIndex::writeFooter(IO::File& sink) const
+	{
+	/* Write an invalid time stamp to signal the end of the stream to frame readers: */
+	sink.write<Misc::Float64>(Math::Constants<double>::max);
+	
+	/* Write the index: */
+	write(sink);
+	
+	/* Write the footer's total size and the magic number, so that readers can find the footer from the end of the file: */
+	sink.write<Misc::UInt64>(Misc::UInt64(footerOverhead+entries.size()*entrySize));
+	sink.write<Misc::UInt32>(footerMagic);
+	}
+
+bool FrameIndex::readFooter(IO::SeekableFile& file)
+	{
+	/* Read the footer's size and magic number from the end of the file: */
+	IO::SeekableFile::Offset fileSize=file.getSize();
+	if(fileSize<IO::SeekableFile::Offset(footerOverhead))
+		return false;
+	file.setReadPosAbs(fileSize-IO::SeekableFile::Offset(sizeof(Misc::UInt64)+sizeof(Misc::UInt32)));
+	Misc::UInt64 footerSize=file.read<Misc::UInt64>();
+	if(file.read<Misc::UInt32>()!=footerMagic||footerSize<footerOverhead||footerSize>Misc::UInt64(fileSize)||(footerSize-footerOverhead)%entrySize!=0)
+		return false;
+	
+	/* Check the footer's end-of-stream marker and number of frames: */
+	file.setReadPosAbs(fileSize-IO::SeekableFile::Offset(footerSize));
+	if(file.read<Misc::Float64>()<Math::Constants<double>::max)
+		return false;
+	if(file.read<Misc::UInt32>()!=(footerSize-footerOverhead)/entrySize)
+		return false;
+	
+	/* Read the index: */
+	file.setReadPosAbs(fileSize-IO::SeekableFile::Offset(footerSize)+IO::SeekableFile::Offset(sizeof(Misc::Float64)));
+	read(file);
+	
+	return true;
+	}
+
+}
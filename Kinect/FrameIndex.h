@@ -0,0 +1,88 @@
+/***********************************************************************
+FrameIndex - Class to represent the time stamps, positions, and sizes of
+all frames in a recorded color or depth stream to support random access.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_FRAMEINDEX_INCLUDED
+#define KINECT_FRAMEINDEX_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+#include <Misc/SizedTypes.h>
+
+/* Forward declarations: */
+namespace IO {
+class File;
+class SeekableFile;
+}
+
+namespace Kinect {
+
+class FrameIndex
+	{
+	/* Embedded classes: */
+	public:
+	struct Entry // Structure describing a single frame
+		{
+		/* Elements: */
+		public:
+		double timeStamp; // Frame's time stamp
+		Misc::UInt64 offset; // Position of the frame's first byte relative to the stream's first frame
+		Misc::UInt32 size; // Size of the compressed frame in bytes
+		bool keyframe; // Flag whether the frame can be decoded without any previous frames
+		};
+	
+	/* Elements: */
+	static const Misc::UInt32 footerMagic=0x58444e49U; // Magic number identifying index footers at the end of stream files
+	static const unsigned int depthFooterFormatVersion=9; // Depth file format version from which frame savers append index footers; the depth frame encoding is unchanged from version 8
+	private:
+	std::vector<Entry> entries; // List of frames in stream order
+	Misc::UInt64 dataSize; // Total size of all frames in bytes
+	
+	/* Constructors and destructors: */
+	public:
+	FrameIndex(void); // Creates an empty frame index
+	
+	/* Methods: */
+	size_t getNumFrames(void) const // Returns the number of indexed frames
+		{
+		return entries.size();
+		}
+	const Entry& getFrame(size_t frameIndex) const // Returns the frame of the given index
+		{
+		return entries[frameIndex];
+		}
+	Misc::UInt64 getDataSize(void) const // Returns the total size of all frames, i.e., the position of the end of the stream relative to its first frame
+		{
+		return dataSize;
+		}
+	void addFrame(double timeStamp,size_t size,bool keyframe); // Appends a frame of the given size directly following the previous frame
+	size_t findFrame(double timeStamp) const; // Returns the index of the last frame whose time stamp is not larger than the given time stamp, or 0
+	size_t findKeyframe(size_t frameIndex) const; // Returns the index of the last keyframe at or before the frame of the given index, or 0
+	void write(IO::File& sink) const; // Writes the index to the given sink
+	void read(IO::File& source); // Replaces the index with one read from the given source
+	void writeFooter(IO::File& sink) const; // Writes the index as a footer following the last frame of a stream
+	bool readFooter(IO::SeekableFile& file); // Replaces the index with the footer at the end of the given stream file; returns false and leaves the index unchanged if the file has no valid footer
+	};
+
+}
+
+#endif
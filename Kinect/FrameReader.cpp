@@ -23,12 +23,40 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 
 #include <Kinect/FrameReader.h>
 
+#include <Misc/SizedTypes.h>
+#include <IO/File.h>
+#include <Math/Constants.h>
+
 namespace Kinect {
 
 /****************************
 Methods of class FrameReader:
 ****************************/
 
+bool FrameReader::readTimeStamp(IO::File& source,double& timeStamp)
+	{
+	/* Check for the end of the file: */
+	if(!endOfStream&&source.eof())
+		endOfStream=true;
+	
+	if(!endOfStream)
+		{
+		/* Read the time stamp, and check whether it is the invalid time stamp starting a frame index footer: */
+		timeStamp=source.read<Misc::Float64>();
+		if(timeStamp>=Math::Constants<double>::max)
+			endOfStream=true;
+		}
+	
+	if(endOfStream)
+		timeStamp=Math::Constants<double>::max;
+	return !endOfStream;
+	}
+
+FrameReader::FrameReader(void)
+	:keyframe(true),endOfStream(false)
+	{
+	}
+
 FrameReader::~FrameReader(void)
 	{
 	}
@@ -25,6 +25,9 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #define KINECT_FRAMEREADER_INCLUDED
 
 /* Forward declarations: */
+namespace IO {
+class File;
+}
 namespace Kinect {
 class FrameBuffer;
 }
@@ -36,9 +39,15 @@ class FrameReader
 	/* Elements: */
 	protected:
 	unsigned int size[2]; // Width and height of returned frames
+	bool keyframe; // Flag whether the most recently read frame could be decoded without any previously read frames
+	bool endOfStream; // Flag whether the end of the stream has been reached
+	
+	/* Protected methods: */
+	bool readTimeStamp(IO::File& source,double& timeStamp); // Reads the next frame's time stamp from the given source; returns false and sets the time stamp to infinity at the end of the stream or at a frame index footer
 	
 	/* Constructors and destructors: */
 	public:
+	FrameReader(void);
 	virtual ~FrameReader(void);
 	
 	/* Methods: */
@@ -50,6 +59,10 @@ class FrameReader
 		{
 		return size[dimension];
 		}
+	bool isKeyframe(void) const // Returns true if the most recently read frame could be decoded without any previously read frames
+		{
+		return keyframe;
+		}
 	virtual FrameBuffer readNextFrame(void) =0; // Returns the next color or depth frame
 	};
 
@@ -24,56 +24,224 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 
 #include <Kinect/FrameSaver.h>
 
+#include <stdexcept>
+#include <iostream>
+#include <string>
 #include <Misc/SizedTypes.h>
+#include <Misc/ThrowStdErr.h>
 #include <IO/File.h>
-#include <IO/OpenFile.h>
 #include <Geometry/GeometryMarshallers.h>
 #include <Video/Config.h>
 #include <Kinect/FrameSource.h>
 #include <Kinect/DepthFrameWriter.h>
+#include <Kinect/RansDepthFrameWriter.h>
 #include <Kinect/LossyDepthFrameWriter.h>
 #include <Kinect/ColorFrameWriter.h>
-
-#if VIDEO_CONFIG_HAVE_THEORA
-#define KINECT_FRAMESAVER_LOSSY 0 // Disabled until I figure out a codec that works
-#else
-#define KINECT_FRAMESAVER_LOSSY 0
-#endif
+#include <Kinect/RecordingFile.h>
 
 namespace Kinect {
 
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+void finishFrameFile(IO::File& file) // Writes all buffered data to the given frame file, and closes it if it is a recording file
+	{
+	RecordingFile* recordingFile=dynamic_cast<RecordingFile*>(&file);
+	if(recordingFile!=0)
+		recordingFile->close();
+	else
+		file.flush();
+	}
+
+}
+
+/*****************************************
+Methods of class FrameSaver::DepthEncoder:
+*****************************************/
+
+FrameSaver::DepthEncoder::~DepthEncoder(void)
+	{
+	/* Delete all compressed frames that were not written: */
+	for(std::deque<CompressedFrame>::iterator cfIt=compressedFrames.begin();cfIt!=compressedFrames.end();++cfIt)
+		delete cfIt->data;
+	
+	/* Delete the frame writer: */
+	delete writer;
+	}
+
 /***************************
 Methods of class FrameSaver:
 ***************************/
 
-void FrameSaver::initialize(FrameSource& frameSource)
+FrameWriter* FrameSaver::createDepthFrameWriter(FrameSource& frameSource,FrameSource::DepthCompression depthCompression,IO::File& sink)
+	{
+	switch(depthCompression)
+		{
+		case FrameSource::LOSSY_THEORA:
+			#if VIDEO_CONFIG_HAVE_THEORA
+			return new LossyDepthFrameWriter(sink,frameSource.getActualFrameSize(FrameSource::DEPTH));
+			#else
+			return 0;
+			#endif
+		
+		case FrameSource::LOSSLESS_RANS:
+			return new RansDepthFrameWriter(sink,frameSource.getActualFrameSize(FrameSource::DEPTH));
+		
+		default:
+			return new DepthFrameWriter(sink,frameSource.getActualFrameSize(FrameSource::DEPTH));
+		}
+	}
+
+size_t FrameSaver::getFrameSize(const FrameBuffer& frame,int sensor)
+	{
+	size_t pixelSize=sensor==FrameSource::COLOR?sizeof(FrameSource::ColorPixel):sizeof(FrameSource::DepthPixel);
+	return size_t(frame.getSize(0))*size_t(frame.getSize(1))*pixelSize;
+	}
+
+void FrameSaver::allocateMemory(size_t size)
+	{
+	/* Update the queue statistics: */
+	queueStatistics.queuedBytes+=size;
+	if(queueStatistics.maxQueuedBytes<queueStatistics.queuedBytes)
+		queueStatistics.maxQueuedBytes=queueStatistics.queuedBytes;
+	}
+
+void FrameSaver::waitForMemory(size_t frameSize)
+	{
+	/* Wait until enough queued frames have been written: */
+	Threads::MutexCond::Lock memoryLock(memoryCond);
+	while(isOverBudget(frameSize))
+		memoryCond.wait(memoryLock);
+	
+	allocateMemory(frameSize);
+	}
+
+void FrameSaver::releaseMemory(size_t size)
+	{
+	Threads::MutexCond::Lock memoryLock(memoryCond);
+	queueStatistics.queuedBytes-=size;
+	
+	/* Wake up all callers waiting for memory: */
+	memoryCond.broadcast();
+	}
+
+void FrameSaver::dropColorFrames(size_t frameSize)
+	{
+	while(isOverBudget(frameSize)&&!colorFrames.empty())
+		{
+		/* Drop the oldest queued color frame: */
+		queueStatistics.queuedBytes-=getFrameSize(colorFrames.front(),FrameSource::COLOR);
+		colorFrames.pop_front();
+		++queueStatistics.numDroppedColorFrames;
+		}
+	}
+
+bool FrameSaver::reserveColorMemory(size_t frameSize)
+	{
+	Threads::MutexCond::Lock memoryLock(memoryCond);
+	
+	/* Drop queued color frames until the new frame fits: */
+	dropColorFrames(frameSize);
+	
+	/* Drop the new frame if it still does not fit: */
+	if(isOverBudget(frameSize))
+		{
+		++queueStatistics.numDroppedColorFrames;
+		return false;
+		}
+	
+	allocateMemory(frameSize);
+	return true;
+	}
+
+size_t FrameSaver::dropOldestDepthFrame(void)
+	{
+	if(depthEncoders!=0)
+		{
+		/* Find the oldest queued depth frame that was not already dropped: */
+		FrameBuffer* oldest=0;
+		for(unsigned int i=0;i<numDepthEncoders;++i)
+			for(std::deque<FrameBuffer>::iterator fIt=depthEncoders[i].frames.begin();fIt!=depthEncoders[i].frames.end();++fIt)
+				if(fIt->getBuffer()!=0)
+					{
+					if(oldest==0||oldest->timeStamp>fIt->timeStamp)
+						oldest=&*fIt;
+					break;
+					}
+		if(oldest==0)
+			return 0;
+		
+		/* Replace the frame with an invalid frame to retain the assignment of frames to depth encoders: */
+		size_t frameSize=getFrameSize(*oldest,FrameSource::DEPTH);
+		*oldest=FrameBuffer();
+		return frameSize;
+		}
+	else
+		{
+		if(depthFrames.empty())
+			return 0;
+		
+		/* Drop the oldest queued depth frame: */
+		size_t frameSize=getFrameSize(depthFrames.front(),FrameSource::DEPTH);
+		depthFrames.pop_front();
+		return frameSize;
+		}
+	}
+
+bool FrameSaver::reserveDepthMemory(size_t frameSize)
+	{
+	Threads::MutexCond::Lock memoryLock(memoryCond);
+	
+	/* Drop queued depth frames until the new frame fits: */
+	while(isOverBudget(frameSize))
+		{
+		size_t droppedSize=dropOldestDepthFrame();
+		if(droppedSize==0)
+			break;
+		queueStatistics.queuedBytes-=droppedSize;
+		++queueStatistics.numDroppedDepthFrames;
+		}
+	
+	/* Drop the new frame if it still does not fit: */
+	if(isOverBudget(frameSize))
+		{
+		++queueStatistics.numDroppedDepthFrames;
+		return false;
+		}
+	
+	allocateMemory(frameSize);
+	return true;
+	}
+
+void FrameSaver::initialize(FrameSource& frameSource,FrameSource::DepthCompression depthCompression,unsigned int sNumDepthEncoders)
 	{
 	/* Write the file formats' version numbers to the depth and color files: */
-	colorFrameFile->write<Misc::UInt32>(1);
-	depthFrameFile->write<Misc::UInt32>(4);
+	if(colorFrameFile!=0)
+		colorFrameFile->write<Misc::UInt32>(2);
+	depthFrameFile->write<Misc::UInt32>(FrameIndex::depthFooterFormatVersion);
 	
 	/* Write the frame source's depth correction parameters: */
 	FrameSource::DepthCorrection* dc=frameSource.getDepthCorrectionParameters();
 	dc->write(*depthFrameFile);
 	delete dc;
 	
-	#if KINECT_FRAMESAVER_LOSSY
-	
-	/* Signal whether the depth stream will contain losslessly compressed frames (lossy compression disabled for now): */
-	depthFrameFile->write<Misc::UInt8>(1);
-	
-	#else
-	
-	/* Signal that the depth stream will contain losslessly compressed frames: */
-	depthFrameFile->write<Misc::UInt8>(0);
-	
+	/* Signal the depth stream's compression method: */
+	#if !VIDEO_CONFIG_HAVE_THEORA
+	if(depthCompression==FrameSource::LOSSY_THEORA)
+		Misc::throwStdErr("Kinect::FrameSaver: Lossy depth compression not supported due to lack of Theora library");
 	#endif
+	depthFrameFile->write<Misc::UInt8>(depthCompression);
+	
 	
 	/* Get the frame source's intrinsic calibration parameters: */
 	FrameSource::IntrinsicParameters ips=frameSource.getIntrinsicParameters();
 	
 	/* Write the color and depth projections to their respective files: */
-	Misc::Marshaller<FrameSource::IntrinsicParameters::PTransform>::write(ips.colorProjection,*colorFrameFile);
+	if(colorFrameFile!=0)
+		Misc::Marshaller<FrameSource::IntrinsicParameters::PTransform>::write(ips.colorProjection,*colorFrameFile);
 	Misc::Marshaller<FrameSource::IntrinsicParameters::PTransform>::write(ips.depthProjection,*depthFrameFile);
 	
 	/* Get the frame source's extrinsic calibration parameters: */
@@ -82,13 +250,41 @@ void FrameSaver::initialize(FrameSource& frameSource)
 	/* Write the camera transformation to the depth file: */
 	Misc::Marshaller<FrameSource::ExtrinsicParameters>::write(eps,*depthFrameFile);
 	
-	/* Create the color and depth frame writers: */
-	colorFrameWriter=new ColorFrameWriter(*colorFrameFile,frameSource.getActualFrameSize(FrameSource::COLOR));
-	#if KINECT_FRAMESAVER_LOSSY
-	depthFrameWriter=new LossyDepthFrameWriter(*depthFrameFile,frameSource.getActualFrameSize(FrameSource::DEPTH));
-	#else
-	depthFrameWriter=new DepthFrameWriter(*depthFrameFile,frameSource.getActualFrameSize(FrameSource::DEPTH));
-	#endif
+	/* Create the color frame writer unless only depth frames are saved: */
+	if(colorFrameFile!=0)
+		colorFrameWriter=new ColorFrameWriter(*colorFrameFile,frameSource.getActualFrameSize(FrameSource::COLOR));
+	
+	/* Lossy depth compression carries state across the entire stream and can not be split between parallel encoders: */
+	if(sNumDepthEncoders>1&&depthCompression!=FrameSource::LOSSY_THEORA)
+		{
+		/* Create the depth encoders, each writing into its own in-memory file: */
+		numDepthEncoders=sNumDepthEncoders;
+		depthEncoders=new DepthEncoder[numDepthEncoders];
+		for(unsigned int i=0;i<numDepthEncoders;++i)
+			{
+			depthEncoders[i].writer=createDepthFrameWriter(frameSource,depthCompression,depthEncoders[i].file);
+			
+			/* Write the first encoder's stream header to the depth file, and discard the others' identical headers: */
+			IO::VariableMemoryFile::BufferChain headers;
+			depthEncoders[i].file.storeBuffers(headers);
+			if(i==0)
+				headers.writeToSink(*depthFrameFile);
+			}
+		
+		/* Assign groups of frames from one keyframe to the next to the same encoder to retain inter-frame compression: */
+		DepthFrameWriter* dfw=dynamic_cast<DepthFrameWriter*>(depthEncoders[0].writer);
+		if(dfw!=0&&dfw->getKeyframeInterval()!=0)
+			depthGroupSize=dfw->getKeyframeInterval();
+		
+		/* Start the depth encoding threads: */
+		for(unsigned int i=0;i<numDepthEncoders;++i)
+			depthEncoders[i].thread.start(this,&FrameSaver::depthEncoderThreadMethod,i);
+		}
+	else
+		{
+		/* Create the depth frame writer: */
+		depthFrameWriter=createDepthFrameWriter(frameSource,depthCompression,*depthFrameFile);
+		}
 	
 	/* Start the frame writing threads: */
 	colorFrameWritingThread.start(this,&FrameSaver::colorFrameWritingThreadMethod);
@@ -114,9 +310,22 @@ void* FrameSaver::colorFrameWritingThreadMethod(void)
 		fb=colorFrames.front();
 		colorFrames.pop_front();
 		}
+		releaseMemory(getFrameSize(fb,FrameSource::COLOR));
 		
-		/* Write the next frame to the color frame file: */
-		colorFrameWriter->writeFrame(fb);
+		/* Write the next frame to the color frame file and add it to the color frame index, unless an earlier write failed: */
+		if(writeErrors[FrameSource::COLOR].empty())
+			{
+			try
+				{
+				size_t frameSize=colorFrameWriter->writeFrame(fb);
+				colorFrameIndex.addFrame(fb.timeStamp,frameSize,colorFrameWriter->isKeyframe());
+				}
+			catch(std::runtime_error err)
+				{
+				/* Discard all following frames; the error is reported by close: */
+				writeErrors[FrameSource::COLOR]=err.what();
+				}
+			}
 		}
 	
 	return 0;
@@ -124,6 +333,55 @@ void* FrameSaver::colorFrameWritingThreadMethod(void)
 
 void* FrameSaver::depthFrameWritingThreadMethod(void)
 	{
+	if(depthEncoders!=0)
+		{
+		/* Append the depth encoders' compressed frames to the depth frame file in the order in which they were queued: */
+		unsigned int frameIndex=0;
+		while(true)
+			{
+			CompressedFrame compressedFrame;
+			{
+			/* Wait until the encoder responsible for the next frame has compressed it: */
+			Threads::MutexCond::Lock depthFramesLock(depthFramesCond);
+			DepthEncoder& de=depthEncoders[(frameIndex/depthGroupSize)%numDepthEncoders];
+			while(de.compressedFrames.empty()&&!(done&&frameIndex==numQueuedDepthFrames))
+				depthFramesCond.wait(depthFramesLock);
+			
+			/* Bail out if there are no more frames: */
+			if(de.compressedFrames.empty())
+				break;
+			
+			/* Grab the next compressed frame: */
+			compressedFrame=de.compressedFrames.front();
+			de.compressedFrames.pop_front();
+			}
+			
+			/* Write the next compressed frame to the depth frame file and add it to the depth frame index unless it was dropped or an earlier write failed: */
+			if(compressedFrame.data!=0)
+				{
+				size_t frameSize=compressedFrame.data->getDataSize();
+				if(writeErrors[FrameSource::DEPTH].empty())
+					{
+					try
+						{
+						compressedFrame.data->writeToSink(*depthFrameFile);
+						depthFrameIndex.addFrame(compressedFrame.timeStamp,frameSize,compressedFrame.keyframe);
+						}
+					catch(std::runtime_error err)
+						{
+						/* Discard all following frames; the error is reported by close: */
+						writeErrors[FrameSource::DEPTH]=err.what();
+						}
+					}
+				releaseMemory(frameSize);
+				delete compressedFrame.data;
+				}
+			++frameIndex;
+			}
+		
+		return 0;
+		}
+	
 	while(true)
 		{
 		FrameBuffer fb;
@@ -141,56 +399,196 @@ void* FrameSaver::depthFrameWritingThreadMethod(void)
 		fb=depthFrames.front();
 		depthFrames.pop_front();
 		}
+		releaseMemory(getFrameSize(fb,FrameSource::DEPTH));
+		
+		/* Write the next frame to the depth frame file and add it to the depth frame index, unless an earlier write failed: */
+		if(writeErrors[FrameSource::DEPTH].empty())
+			{
+			try
+				{
+				size_t frameSize=depthFrameWriter->writeFrame(fb);
+				depthFrameIndex.addFrame(fb.timeStamp,frameSize,depthFrameWriter->isKeyframe());
+				}
+			catch(std::runtime_error err)
+				{
+				/* Discard all following frames; the error is reported by close: */
+				writeErrors[FrameSource::DEPTH]=err.what();
+				}
+			}
+		}
+	
+	return 0;
+	}
+
+void* FrameSaver::depthEncoderThreadMethod(unsigned int encoderIndex)
+	{
+	DepthEncoder& de=depthEncoders[encoderIndex];
+	unsigned int numGroupFrames=0;
+	bool keyframePending=false;
+	while(true)
+		{
+		FrameBuffer fb;
+		{
+		/* Wait until there is an uncompressed frame in the encoder's queue: */
+		Threads::MutexCond::Lock depthFramesLock(depthFramesCond);
+		while(!done&&de.frames.empty())
+			depthFramesCond.wait(depthFramesLock);
+		
+		/* Bail out if there are no more frames: */
+		if(de.frames.empty())
+			break;
+		
+		/* Grab the next frame: */
+		fb=de.frames.front();
+		de.frames.pop_front();
+		}
 		
-		/* Write the next frame to the depth frame file: */
-		depthFrameWriter->writeFrame(fb);
+		/* Start each group with a keyframe so that readers do not depend on frames compressed by other encoders: */
+		if(numGroupFrames==0)
+			keyframePending=true;
+		if(++numGroupFrames==depthGroupSize)
+			numGroupFrames=0;
+		
+		CompressedFrame compressedFrame;
+		compressedFrame.timeStamp=fb.timeStamp;
+		compressedFrame.keyframe=false;
+		compressedFrame.data=0;
+		if(fb.getBuffer()!=0)
+			{
+			releaseMemory(getFrameSize(fb,FrameSource::DEPTH));
+			
+			/* Compress the frame into the encoder's in-memory file: */
+			if(keyframePending)
+				{
+				de.writer->requestKeyframe();
+				keyframePending=false;
+				}
+			de.writer->writeFrame(fb);
+			compressedFrame.keyframe=de.writer->isKeyframe();
+			compressedFrame.data=new IO::VariableMemoryFile::BufferChain;
+			de.file.storeBuffers(*compressedFrame.data);
+			}
+		
+		/* Hand the compressed frame, or a null frame if the frame was dropped, to the depth frame writing thread: */
+		Threads::MutexCond::Lock depthFramesLock(depthFramesCond);
+		de.compressedFrames.push_back(compressedFrame);
+		if(compressedFrame.data!=0)
+			{
+			Threads::MutexCond::Lock memoryLock(memoryCond);
+			allocateMemory(compressedFrame.data->getDataSize());
+			}
+		depthFramesCond.broadcast();
 		}
 	
 	return 0;
 	}
 
-FrameSaver::FrameSaver(FrameSource& frameSource,const char* colorFrameFileName,const char* depthFrameFileName)
+FrameSaver::FrameSaver(FrameSource& frameSource,const char* colorFrameFileName,const char* depthFrameFileName,FrameSource::DepthCompression depthCompression,unsigned int sNumDepthEncoders)
 	:timeStampOffset(0.0),
-	 done(false),
-	 colorFrameFile(IO::openFile(colorFrameFileName,IO::File::WriteOnly)),
+	 done(false),closed(false),
+	 colorFrameFile(colorFrameFileName!=0?new RecordingFile(colorFrameFileName):0),
 	 colorFrameWriter(0),
-	 depthFrameFile(IO::openFile(depthFrameFileName,IO::File::WriteOnly)),
-	 depthFrameWriter(0)
+	 depthFrameFile(new RecordingFile(depthFrameFileName)),
+	 depthFrameWriter(0),
+	 numDepthEncoders(0),depthEncoders(0),depthGroupSize(1),numQueuedDepthFrames(0),
+	 memoryBudget(0),overflowPolicy(BLOCK)
 	{
 	/* Initialize the frame files: */
-	colorFrameFile->setEndianness(Misc::LittleEndian);
+	if(colorFrameFile!=0)
+		colorFrameFile->setEndianness(Misc::LittleEndian);
 	depthFrameFile->setEndianness(Misc::LittleEndian);
 	
 	/* Initialize the frame saver: */
-	initialize(frameSource);
+	initialize(frameSource,depthCompression,sNumDepthEncoders);
 	}
 
-FrameSaver::FrameSaver(FrameSource& frameSource,IO::FilePtr sColorFrameFile,IO::FilePtr sDepthFrameFile)
+FrameSaver::FrameSaver(FrameSource& frameSource,IO::FilePtr sColorFrameFile,IO::FilePtr sDepthFrameFile,FrameSource::DepthCompression depthCompression,unsigned int sNumDepthEncoders)
 	:timeStampOffset(0.0),
-	 done(false),
+	 done(false),closed(false),
 	 colorFrameFile(sColorFrameFile),
 	 colorFrameWriter(0),
 	 depthFrameFile(sDepthFrameFile),
-	 depthFrameWriter(0)
+	 depthFrameWriter(0),
+	 numDepthEncoders(0),depthEncoders(0),depthGroupSize(1),numQueuedDepthFrames(0),
+	 memoryBudget(0),overflowPolicy(BLOCK)
 	{
 	/* Initialize the frame saver: */
-	initialize(frameSource);
+	initialize(frameSource,depthCompression,sNumDepthEncoders);
 	}
 
 FrameSaver::~FrameSaver(void)
 	{
-	/* Tell the frame writing threads to shut down once their queues are empty: */
+	/* Write all queued frames and the frame indices if the frame saver was not closed explicitly: */
+	if(!closed)
+		{
+		try
+			{
+			close();
+			}
+		catch(std::runtime_error err)
+			{
+			std::cerr<<"Kinect::FrameSaver: "<<err.what()<<std::endl;
+			}
+		}
+	
+	/* Delete the frame writers: */
+	delete colorFrameWriter;
+	delete depthFrameWriter;
+	delete[] depthEncoders;
+	}
+
+void FrameSaver::close(void)
+	{
+	if(closed)
+		return;
+	closed=true;
+	
+	/* Tell the frame writing and depth encoding threads to shut down once their queues are empty: */
+	{
+	Threads::MutexCond::Lock colorFramesLock(colorFramesCond);
+	Threads::MutexCond::Lock depthFramesLock(depthFramesCond);
 	done=true;
 	colorFramesCond.signal();
-	depthFramesCond.signal();
+	depthFramesCond.broadcast();
+	}
 	
-	/* Wait for the frame writing threads to finish: */
+	/* Wait for the frame writing and depth encoding threads to finish: */
 	colorFrameWritingThread.join();
+	for(unsigned int i=0;i<numDepthEncoders;++i)
+		depthEncoders[i].thread.join();
 	depthFrameWritingThread.join();
 	
-	/* Delete the frame writers: */
-	delete colorFrameWriter;
-	delete depthFrameWriter;
+	/* Append the frame indices to the frame files to support random access during playback, and write all remaining data to both frame files, even if the first one fails: */
+	const FrameIndex* frameIndices[2]={&colorFrameIndex,&depthFrameIndex};
+	IO::File* frameFiles[2]={colorFrameFile.getPointer(),depthFrameFile.getPointer()};
+	std::string errors;
+	for(int i=0;i<2;++i)
+		{
+		/* Skip the color file if only depth frames are saved: */
+		if(frameFiles[i]==0)
+			continue;
+		
+		if(writeErrors[i].empty())
+			{
+			try
+				{
+				frameIndices[i]->writeFooter(*frameFiles[i]);
+				finishFrameFile(*frameFiles[i]);
+				}
+			catch(std::runtime_error err)
+				{
+				writeErrors[i]=err.what();
+				}
+			}
+		if(!writeErrors[i].empty())
+			{
+			if(!errors.empty())
+				errors.append("; ");
+			errors.append(writeErrors[i]);
+			}
+		}
+	if(!errors.empty())
+		Misc::throwStdErr("Kinect::FrameSaver::close: %s",errors.c_str());
 	}
 
 void FrameSaver::setTimeStampOffset(double newTimeStampOffset)
@@ -199,10 +597,52 @@ void FrameSaver::setTimeStampOffset(double newTimeStampOffset)
 	timeStampOffset=newTimeStampOffset;
 	}
 
+void FrameSaver::setNumBackgroundMaskFrames(unsigned int newNumBackgroundMaskFrames)
+	{
+	/* Forward the request to the depth frame writer or to each depth encoder's writer, which learn their masks independently: */
+	if(depthFrameWriter!=0)
+		{
+		DepthFrameWriter* dfw=dynamic_cast<DepthFrameWriter*>(depthFrameWriter);
+		if(dfw!=0)
+			dfw->setNumBackgroundMaskFrames(newNumBackgroundMaskFrames);
+		}
+	for(unsigned int i=0;i<numDepthEncoders;++i)
+		{
+		DepthFrameWriter* dfw=dynamic_cast<DepthFrameWriter*>(depthEncoders[i].writer);
+		if(dfw!=0)
+			dfw->setNumBackgroundMaskFrames(newNumBackgroundMaskFrames);
+		}
+	}
+
+void FrameSaver::setMemoryBudget(size_t newMemoryBudget,FrameSaver::OverflowPolicy newOverflowPolicy)
+	{
+	Threads::MutexCond::Lock memoryLock(memoryCond);
+	memoryBudget=newMemoryBudget;
+	overflowPolicy=newOverflowPolicy;
+	
+	/* Wake up all callers waiting for memory in case the budget grew: */
+	memoryCond.broadcast();
+	}
+
+FrameSaver::QueueStatistics FrameSaver::getQueueStatistics(void)
+	{
+	Threads::MutexCond::Lock memoryLock(memoryCond);
+	return queueStatistics;
+	}
+
 void FrameSaver::saveColorFrame(const FrameBuffer& newFrame)
 	{
-	/* Enqueue the color frame: */
+	/* Wait until the frame fits into the memory budget if the overflow policy blocks: */
+	size_t frameSize=getFrameSize(newFrame,FrameSource::COLOR);
+	if(overflowPolicy==BLOCK)
+		waitForMemory(frameSize);
+	
+	/* Make room for the frame by dropping queued frames, or drop the frame itself: */
 	Threads::MutexCond::Lock colorFramesLock(colorFramesCond);
+	if(overflowPolicy!=BLOCK&&!reserveColorMemory(frameSize))
+		return;
+	
+	/* Enqueue the color frame: */
 	colorFrames.push_back(newFrame);
 	
 	/* Offset the new frame's time stamp: */
@@ -214,15 +654,47 @@ void FrameSaver::saveColorFrame(const FrameBuffer& newFrame)
 
 void FrameSaver::saveDepthFrame(const FrameBuffer& newFrame)
 	{
-	/* Enqueue the depth frame: */
-	Threads::MutexCond::Lock depthFramesLock(depthFramesCond);
-	depthFrames.push_back(newFrame);
+	/* Wait until the frame fits into the memory budget if the overflow policy blocks: */
+	size_t frameSize=getFrameSize(newFrame,FrameSource::DEPTH);
+	if(overflowPolicy==BLOCK)
+		waitForMemory(frameSize);
+	else if(overflowPolicy==DROP_COLOR_FIRST)
+		{
+		/* Make room for the frame by dropping queued color frames first: */
+		Threads::MutexCond::Lock colorFramesLock(colorFramesCond);
+		Threads::MutexCond::Lock memoryLock(memoryCond);
+		dropColorFrames(frameSize);
+		}
 	
-	/* Offset the new frame's time stamp: */
-	depthFrames.back().timeStamp-=timeStampOffset;
+	/* Make room for the frame by dropping queued depth frames, or drop the frame itself: */
+	Threads::MutexCond::Lock depthFramesLock(depthFramesCond);
+	if(overflowPolicy!=BLOCK&&!reserveDepthMemory(frameSize))
+		return;
 	
-	/* Wake up the depth frame saver: */
-	depthFramesCond.signal();
+	if(depthEncoders!=0)
+		{
+		/* Enqueue the depth frame with the encoder responsible for the frame's group: */
+		std::deque<FrameBuffer>& frames=depthEncoders[(numQueuedDepthFrames/depthGroupSize)%numDepthEncoders].frames;
+		frames.push_back(newFrame);
+		++numQueuedDepthFrames;
+		
+		/* Offset the new frame's time stamp: */
+		frames.back().timeStamp-=timeStampOffset;
+		
+		/* Wake up the depth encoders: */
+		depthFramesCond.broadcast();
+		}
+	else
+		{
+		/* Enqueue the depth frame: */
+		depthFrames.push_back(newFrame);
+		
+		/* Offset the new frame's time stamp: */
+		depthFrames.back().timeStamp-=timeStampOffset;
+		
+		/* Wake up the depth frame saver: */
+		depthFramesCond.signal();
+		}
 	}
 
 }
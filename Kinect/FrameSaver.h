@@ -26,15 +26,18 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #define KINECT_FRAMESAVER_INCLUDED
 
 #include <deque>
+#include <string>
 #include <Misc/Timer.h>
 #include <IO/File.h>
+#include <IO/VariableMemoryFile.h>
 #include <Threads/MutexCond.h>
 #include <Threads/Thread.h>
 #include <Kinect/FrameBuffer.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/FrameIndex.h>
 
 /* Forward declarations: */
 namespace Kinect {
-class FrameSource;
 class FrameWriter;
 }
 
@@ -42,36 +45,119 @@ namespace Kinect {
 
 class FrameSaver
 	{
-	/* Elements: */
+	/* Embedded classes: */
+	public:
+	enum OverflowPolicy // Enumerated type for policies to handle new frames that would exceed the memory budget
+		{
+		BLOCK, // Block the caller until enough queued frames have been written
+		DROP_OLDEST, // Drop the oldest queued frames of the new frame's stream, or the new frame itself if there are none
+		DROP_COLOR_FIRST // Drop the oldest queued color frames first, and then proceed as DROP_OLDEST
+		};
+	
+	struct QueueStatistics // Structure reporting the memory use of the frame queues
+		{
+		/* Elements: */
+		public:
+		size_t queuedBytes; // Current total size of all queued uncompressed and compressed frames in bytes
+		size_t maxQueuedBytes; // Largest total size of queued frames since recording started
+		unsigned int numDroppedColorFrames; // Number of color frames dropped due to the memory budget
+		unsigned int numDroppedDepthFrames; // Number of depth frames dropped due to the memory budget
+		
+		/* Constructors and destructors: */
+		QueueStatistics(void)
+			:queuedBytes(0),maxQueuedBytes(0),
+			 numDroppedColorFrames(0),numDroppedDepthFrames(0)
+			{
+			}
+		};
+	
 	private:
+	struct CompressedFrame // Structure for a depth frame compressed by a depth encoder
+		{
+		/* Elements: */
+		public:
+		double timeStamp; // Frame's time stamp
+		bool keyframe; // Flag whether the frame was compressed as a keyframe
+		IO::VariableMemoryFile::BufferChain* data; // Compressed frame data, or null if the frame was dropped due to the memory budget
+		};
+	
+	struct DepthEncoder // Structure for a thread compressing groups of consecutive depth frames into memory
+		{
+		/* Elements: */
+		public:
+		std::deque<FrameBuffer> frames; // Queue of depth frames still to be compressed by this encoder; frames dropped due to the memory budget remain as invalid frames
+		IO::VariableMemoryFile file; // In-memory file receiving compressed depth frames
+		FrameWriter* writer; // Helper object to compress depth frames
+		std::deque<CompressedFrame> compressedFrames; // Queue of compressed depth frames still to be appended to the depth frame file
+		Threads::Thread thread; // Thread compressing depth frames
+		
+		/* Constructors and destructors: */
+		DepthEncoder(void)
+			:writer(0)
+			{
+			}
+		~DepthEncoder(void);
+		};
+	
+	/* Elements: */
 	double timeStampOffset; // Offset value subtracted from the time stamps of all incoming color and depth frames
 	volatile bool done; // Flag set when all frames have been queued for saving
+	bool closed; // Flag whether the frame saver was closed
 	Threads::MutexCond colorFramesCond; // Condition variable to signal new frames in the depth queue
 	std::deque<FrameBuffer> colorFrames; // Queue of color frames still to be saved
 	IO::FilePtr colorFrameFile; // File receiving color frames
 	FrameWriter* colorFrameWriter; // Helper object to compress and write color frames
+	FrameIndex colorFrameIndex; // Index of all color frames written to the color frame file
 	Threads::Thread colorFrameWritingThread; // Thread saving color frames
-	Threads::MutexCond depthFramesCond; // Condition variable to signal new frames in the depth queue
+	Threads::MutexCond depthFramesCond; // Condition variable to signal new frames in the depth queue or new compressed frames from the depth encoders; also protects the depth encoders' queues
 	std::deque<FrameBuffer> depthFrames; // Queue of depth frames still to be saved
 	IO::FilePtr depthFrameFile; // File receiving depth frames
-	FrameWriter* depthFrameWriter; // Helper object to compress and write depth frames
+	FrameWriter* depthFrameWriter; // Helper object to compress and write depth frames, or null if depth frames are compressed by depth encoders
+	unsigned int numDepthEncoders; // Number of depth encoders compressing depth frames in parallel, or 0
+	DepthEncoder* depthEncoders; // Array of depth encoders
+	unsigned int depthGroupSize; // Number of consecutive depth frames compressed by the same depth encoder, starting with a keyframe
+	unsigned int numQueuedDepthFrames; // Number of depth frames queued for saving so far
+	FrameIndex depthFrameIndex; // Index of all depth frames written to the depth frame file
 	Threads::Thread depthFrameWritingThread; // Thread saving depth frames
+	Threads::MutexCond memoryCond; // Condition variable to signal that queued frames were released; also protects the memory budget and queue statistics
+	size_t memoryBudget; // Maximum total size of all queued frames in bytes, or 0 for no limit
+	OverflowPolicy overflowPolicy; // Policy to handle new frames that would exceed the memory budget
+	QueueStatistics queueStatistics; // Current memory use of the frame queues
+	std::string writeErrors[2]; // Messages of the first failed writes to the color and depth frame files, or empty; each is only accessed by its frame writing thread until the thread finishes
 	
 	/* Private methods: */
-	void initialize(FrameSource& frameSource); // Initializes the frame files and writers
+	static size_t getFrameSize(const FrameBuffer& frame,int sensor); // Returns the size of the given uncompressed color or depth frame in bytes
+	bool isOverBudget(size_t frameSize) const // Returns true if queueing a frame of the given size would exceed the memory budget; memory mutex must be locked
+		{
+		return memoryBudget!=0&&queueStatistics.queuedBytes!=0&&queueStatistics.queuedBytes+frameSize>memoryBudget;
+		}
+	void allocateMemory(size_t size); // Adds the given number of bytes to the queued frames; memory mutex must be locked
+	void waitForMemory(size_t frameSize); // Blocks until a frame of the given size can be queued within the memory budget, and allocates its memory
+	void releaseMemory(size_t size); // Removes the given number of bytes from the queued frames and wakes up callers waiting for memory
+	void dropColorFrames(size_t frameSize); // Drops the oldest queued color frames until a frame of the given size fits into the memory budget; color frame and memory mutexes must be locked
+	bool reserveColorMemory(size_t frameSize); // Drops queued color frames to fit a new color frame of the given size into the memory budget; returns false if the new frame must be dropped; color frame mutex must be locked
+	size_t dropOldestDepthFrame(void); // Drops the oldest queued depth frame; returns the size of the dropped frame, or 0 if there were no queued depth frames; depth frame mutex must be locked
+	bool reserveDepthMemory(size_t frameSize); // Drops queued depth frames to fit a new depth frame of the given size into the memory budget; returns false if the new frame must be dropped; depth frame mutex must be locked
+	FrameWriter* createDepthFrameWriter(FrameSource& frameSource,FrameSource::DepthCompression depthCompression,IO::File& sink); // Returns a new depth frame writer using the given compression method writing to the given sink
+	void initialize(FrameSource& frameSource,FrameSource::DepthCompression depthCompression,unsigned int sNumDepthEncoders); // Initializes the frame files and writers, compressing depth frames with the given method in the given number of parallel depth encoders
 	void* colorFrameWritingThreadMethod(void); // Thread method saving color frames
 	void* depthFrameWritingThreadMethod(void); // Thread method saving depth frames
+	void* depthEncoderThreadMethod(unsigned int encoderIndex); // Thread method compressing depth frames in the depth encoder of the given index
 	
 	/* Constructors and destructors: */
 	public:
-	FrameSaver(FrameSource& frameSource,const char* colorFrameFileName,const char* depthFrameFileName); // Creates frame saver for the given frame source, writing to two files of the given names
-	FrameSaver(FrameSource& frameSource,IO::FilePtr sColorFrameFile,IO::FilePtr sDepthFrameFile); // Ditto, to the two already opened files
-	~FrameSaver(void);
+	FrameSaver(FrameSource& frameSource,const char* colorFrameFileName,const char* depthFrameFileName,FrameSource::DepthCompression depthCompression =FrameSource::LOSSLESS_HUFFMAN,unsigned int sNumDepthEncoders =1); // Creates frame saver for the given frame source, writing to two new recording files of the given names and compressing depth frames with the given method in the given number of parallel threads; only saves depth frames if the color file name is null
+	FrameSaver(FrameSource& frameSource,IO::FilePtr sColorFrameFile,IO::FilePtr sDepthFrameFile,FrameSource::DepthCompression depthCompression =FrameSource::LOSSLESS_HUFFMAN,unsigned int sNumDepthEncoders =1); // Ditto, to the two already opened files; only saves depth frames if the color file is null
+	~FrameSaver(void); // Closes the frame saver if it was not closed explicitly, and reports errors to std::cerr
 	
 	/* Methods: */
 	void setTimeStampOffset(double newTimeStampOffset); // Sets the time stamp offset for all subsequent frames
-	void saveColorFrame(const FrameBuffer& newFrame); // Queues a new color frame for writing
+	void setNumBackgroundMaskFrames(unsigned int newNumBackgroundMaskFrames); // Losslessly masks background pixels that are invalid in all of the given number of depth frames saved next; only supported by the default lossless depth compression; must be called before any depth frames are saved
+	void setMemoryBudget(size_t newMemoryBudget,OverflowPolicy newOverflowPolicy); // Limits the total size of all queued frames to the given number of bytes, or 0 for no limit, and handles new frames exceeding the limit with the given policy
+	QueueStatistics getQueueStatistics(void); // Returns the current memory use of the frame queues
+	void saveColorFrame(const FrameBuffer& newFrame); // Queues a new color frame for writing; must not be called if the frame saver only saves depth frames
 	void saveDepthFrame(const FrameBuffer& newFrame); // Queues a new depth frame for writing
+	void close(void); // Writes all queued frames, appends frame indices to the frame files, and closes them; throws an exception if any data could not be written; no frames must be saved afterwards
 	};
 
 }
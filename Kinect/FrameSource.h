@@ -60,6 +60,11 @@ class FrameSource
 		COLOR=0,DEPTH
 		};
 	
+	enum DepthCompression // Enumerated type for depth stream compression methods, as identified in stream headers
+		{
+		LOSSLESS_HUFFMAN=0,LOSSY_THEORA,LOSSLESS_RANS
+		};
+	
 	typedef Misc::UInt16 DepthPixel; // Type for raw depth pixels
 	typedef Misc::UInt8 ColorComponent; // Type for color pixel components
 	
@@ -0,0 +1,367 @@
+/***********************************************************************
+FrameTracer - Class to record per-frame time stamps at the stages of the
+frame processing pipeline, from a frame's first USB packet to the exit
+from the consumer's streaming callback, in per-thread event rings, and
+to report latency histograms or export Chrome trace files.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/FrameTracer.h>
+
+#include <time.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <Threads/Mutex.h>
+
+namespace Kinect {
+
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+const unsigned int eventRingSize=16384; // Number of most recent events retained per thread
+
+struct EventRing // Structure for a ring of events recorded by a single thread
+	{
+	/* Elements: */
+	public:
+	FrameTracer::Event events[eventRingSize]; // The event ring
+	volatile unsigned int numEvents; // Total number of events recorded into the ring; only written by the owning thread
+	volatile bool owned; // Flag whether the ring is owned by a running thread
+	
+	/* Constructors and destructors: */
+	EventRing(void)
+		:numEvents(0),owned(true)
+		{
+		}
+	};
+
+struct FrameStages // Structure holding the times at which a frame passed each processing stage
+	{
+	/* Elements: */
+	public:
+	Misc::UInt64 times[FrameTracer::NUM_STAGES]; // Stage times in nanoseconds, or 0 if the stage was not recorded
+	
+	/* Constructors and destructors: */
+	FrameStages(void)
+		{
+		for(int i=0;i<FrameTracer::NUM_STAGES;++i)
+			times[i]=0;
+		}
+	};
+
+typedef std::map<Misc::UInt64,FrameStages> FrameMap; // Map from combined source ID, stream index, and frame index to frame stage times
+
+struct Interval // Structure describing a reported latency between two processing stages
+	{
+	/* Elements: */
+	public:
+	FrameTracer::Stage begin,end; // Processing stages delimiting the interval
+	const char* name; // Name of the interval
+	};
+
+const Interval intervals[]=
+	{
+	{FrameTracer::FIRST_PACKET,FrameTracer::FRAME_COMPLETE,"Transfer"},
+	{FrameTracer::FRAME_COMPLETE,FrameTracer::DECODE_START,"Queue"},
+	{FrameTracer::DECODE_START,FrameTracer::DECODE_END,"Decode"},
+	{FrameTracer::DECODE_END,FrameTracer::CALLBACK_ENTRY,"Hand-off"},
+	{FrameTracer::CALLBACK_ENTRY,FrameTracer::CALLBACK_EXIT,"Callback"},
+	{FrameTracer::FIRST_PACKET,FrameTracer::CALLBACK_EXIT,"Total"}
+	};
+const int numIntervals=sizeof(intervals)/sizeof(Interval);
+const int numHistogramBuckets=24; // Number of power-of-two microsecond histogram buckets
+const char* streamNames[2]={"Color","Depth"};
+
+/****************
+Helper variables:
+****************/
+
+Threads::Mutex tracerMutex; // Mutex protecting the lists of event rings and frame sources
+std::vector<EventRing*> eventRings; // List of all event rings ever created
+std::vector<std::string> sourceNames; // Names of all registered frame sources, indexed by source ID
+pthread_once_t ringKeyOnce=PTHREAD_ONCE_INIT; // Guard to create the thread-specific ring key exactly once
+pthread_key_t ringKey; // Thread-specific key to release a thread's event ring when the thread terminates
+__thread EventRing* threadEventRing=0; // The calling thread's event ring
+
+/****************
+Helper functions:
+****************/
+
+void releaseEventRing(void* ring)
+	{
+	/* Mark the ring as available for another thread; its events are kept until they are overwritten: */
+	static_cast<EventRing*>(ring)->owned=false;
+	}
+
+void createRingKey(void)
+	{
+	pthread_key_create(&ringKey,releaseEventRing);
+	}
+
+EventRing* acquireEventRing(void)
+	{
+	pthread_once(&ringKeyOnce,createRingKey);
+	
+	EventRing* result=0;
+	{
+	Threads::Mutex::Lock tracerLock(tracerMutex);
+	
+	/* Adopt the ring of a terminated thread, or create a new ring: */
+	for(std::vector<EventRing*>::iterator erIt=eventRings.begin();result==0&&erIt!=eventRings.end();++erIt)
+		if(!(*erIt)->owned)
+			{
+			result=*erIt;
+			result->owned=true;
+			}
+	if(result==0)
+		{
+		result=new EventRing;
+		eventRings.push_back(result);
+		}
+	}
+	
+	/* Release the ring when the calling thread terminates: */
+	pthread_setspecific(ringKey,result);
+	
+	return result;
+	}
+
+inline Misc::UInt64 getTime(void)
+	{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return Misc::UInt64(now.tv_sec)*Misc::UInt64(1000000000)+Misc::UInt64(now.tv_nsec);
+	}
+
+inline Misc::UInt64 getFrameKey(unsigned int sourceId,unsigned int stream,unsigned int frameIndex)
+	{
+	return (Misc::UInt64(sourceId)<<33)|(Misc::UInt64(stream)<<32)|Misc::UInt64(frameIndex);
+	}
+
+Misc::UInt64 collectFrames(FrameMap& frames)
+	{
+	/* Gather the retained events from all event rings: */
+	Misc::UInt64 firstTime=~Misc::UInt64(0);
+	Threads::Mutex::Lock tracerLock(tracerMutex);
+	for(std::vector<EventRing*>::iterator erIt=eventRings.begin();erIt!=eventRings.end();++erIt)
+		{
+		/* Skip events that might be overwritten while they are being read: */
+		unsigned int numEvents=(*erIt)->numEvents;
+		unsigned int firstEvent=numEvents>eventRingSize/2?numEvents-eventRingSize/2:0;
+		for(unsigned int i=firstEvent;i<numEvents;++i)
+			{
+			const FrameTracer::Event& e=(*erIt)->events[i%eventRingSize];
+			frames[getFrameKey(e.sourceId,e.stream,e.frameIndex)].times[e.stage]=e.time;
+			if(firstTime>e.time)
+				firstTime=e.time;
+			}
+		}
+	
+	return firstTime;
+	}
+
+}
+
+/************************************
+Static elements of class FrameTracer:
+************************************/
+
+volatile bool FrameTracer::enabled=false;
+
+/****************************
+Methods of class FrameTracer:
+****************************/
+
+void FrameTracer::recordEvent(unsigned int sourceId,int stream,unsigned int frameIndex,FrameTracer::Stage stage)
+	{
+	/* Get the calling thread's event ring: */
+	EventRing* ring=threadEventRing;
+	if(ring==0)
+		ring=threadEventRing=acquireEventRing();
+	
+	/* Write the event into the next ring slot: */
+	Event& e=ring->events[ring->numEvents%eventRingSize];
+	e.time=getTime();
+	e.frameIndex=Misc::UInt32(frameIndex);
+	e.sourceId=Misc::UInt16(sourceId);
+	e.stream=Misc::UInt8(stream);
+	e.stage=Misc::UInt8(stage);
+	__sync_synchronize(); // Complete the event before publishing it
+	++ring->numEvents;
+	}
+
+void FrameTracer::setEnabled(bool newEnabled)
+	{
+	enabled=newEnabled;
+	}
+
+unsigned int FrameTracer::registerSource(const char* sourceName)
+	{
+	Threads::Mutex::Lock tracerLock(tracerMutex);
+	
+	/* Return the ID of an already registered source of the same name: */
+	unsigned int result;
+	for(result=0;result<sourceNames.size();++result)
+		if(sourceNames[result]==sourceName)
+			return result;
+	
+	/* Register a new source: */
+	sourceNames.push_back(sourceName);
+	return result;
+	}
+
+void FrameTracer::reset(void)
+	{
+	Threads::Mutex::Lock tracerLock(tracerMutex);
+	for(std::vector<EventRing*>::iterator erIt=eventRings.begin();erIt!=eventRings.end();++erIt)
+		(*erIt)->numEvents=0;
+	}
+
+void FrameTracer::printHistograms(std::ostream& os)
+	{
+	/* Collect all recorded frames: */
+	FrameMap frames;
+	collectFrames(frames);
+	
+	/* Accumulate latency histograms for each source, stream, and interval: */
+	typedef std::map<Misc::UInt64,std::vector<unsigned int> > HistogramMap;
+	HistogramMap histograms;
+	std::map<Misc::UInt64,Misc::UInt64> sums,mins,maxs;
+	for(FrameMap::iterator fIt=frames.begin();fIt!=frames.end();++fIt)
+		{
+		Misc::UInt64 streamKey=fIt->first>>32;
+		for(int i=0;i<numIntervals;++i)
+			{
+			Misc::UInt64 begin=fIt->second.times[intervals[i].begin];
+			Misc::UInt64 end=fIt->second.times[intervals[i].end];
+			if(begin!=0&&end>=begin)
+				{
+				Misc::UInt64 key=streamKey*numIntervals+i;
+				std::vector<unsigned int>& histogram=histograms[key];
+				if(histogram.empty())
+					{
+					histogram.resize(numHistogramBuckets,0);
+					mins[key]=~Misc::UInt64(0);
+					}
+				
+				/* Sort the latency into its power-of-two microsecond bucket: */
+				Misc::UInt64 latency=end-begin;
+				Misc::UInt64 micros=latency/1000;
+				int bucket=0;
+				while(micros>0&&bucket<numHistogramBuckets-1)
+					{
+					micros>>=1;
+					++bucket;
+					}
+				++histogram[bucket];
+				sums[key]+=latency;
+				if(mins[key]>latency)
+					mins[key]=latency;
+				if(maxs[key]<latency)
+					maxs[key]=latency;
+				}
+			}
+		}
+	
+	/* Print the histograms: */
+	for(HistogramMap::iterator hIt=histograms.begin();hIt!=histograms.end();++hIt)
+		{
+		unsigned int sourceId=(unsigned int)((hIt->first/numIntervals)>>1);
+		int stream=int((hIt->first/numIntervals)&0x1U);
+		const Interval& interval=intervals[hIt->first%numIntervals];
+		unsigned int numFrames=0;
+		for(int i=0;i<numHistogramBuckets;++i)
+			numFrames+=hIt->second[i];
+		
+		{
+		Threads::Mutex::Lock tracerLock(tracerMutex);
+		os<<(sourceId<sourceNames.size()?sourceNames[sourceId]:std::string("Unknown"));
+		}
+		os<<' '<<streamNames[stream]<<' '<<interval.name<<": "<<numFrames<<" frames, min "<<double(mins[hIt->first])*1.0e-6<<" ms, mean "<<double(sums[hIt->first])*1.0e-6/double(numFrames)<<" ms, max "<<double(maxs[hIt->first])*1.0e-6<<" ms"<<std::endl;
+		for(int i=0;i<numHistogramBuckets;++i)
+			if(hIt->second[i]!=0)
+				{
+				if(i==0)
+					os<<"         <1 us: ";
+				else
+					{
+					os.width(9);
+					os<<(1U<<(i-1));
+					os<<"+ us: ";
+					}
+				os<<hIt->second[i]<<std::endl;
+				}
+		}
+	}
+
+void FrameTracer::writeChromeTrace(std::ostream& os)
+	{
+	/* Collect all recorded frames: */
+	FrameMap frames;
+	Misc::UInt64 firstTime=collectFrames(frames);
+	
+	os<<"{\"traceEvents\":["<<std::endl;
+	bool first=true;
+	
+	/* Name processes after frame sources and threads after streams and intervals: */
+	{
+	Threads::Mutex::Lock tracerLock(tracerMutex);
+	for(unsigned int sourceId=0;sourceId<sourceNames.size();++sourceId)
+		{
+		if(!first)
+			os<<','<<std::endl;
+		first=false;
+		os<<"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":"<<sourceId<<",\"args\":{\"name\":\""<<sourceNames[sourceId]<<"\"}}";
+		for(int stream=0;stream<2;++stream)
+			for(int i=0;i<numIntervals;++i)
+				os<<','<<std::endl<<"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":"<<sourceId<<",\"tid\":"<<stream*numIntervals+i<<",\"args\":{\"name\":\""<<streamNames[stream]<<' '<<intervals[i].name<<"\"}}";
+		}
+	}
+	
+	/* Write one complete event per recorded interval of each frame: */
+	for(FrameMap::iterator fIt=frames.begin();fIt!=frames.end();++fIt)
+		{
+		unsigned int sourceId=(unsigned int)(fIt->first>>33);
+		int stream=int((fIt->first>>32)&0x1U);
+		unsigned int frameIndex=(unsigned int)(fIt->first&0xffffffffU);
+		for(int i=0;i<numIntervals;++i)
+			{
+			Misc::UInt64 begin=fIt->second.times[intervals[i].begin];
+			Misc::UInt64 end=fIt->second.times[intervals[i].end];
+			if(begin!=0&&end>=begin)
+				{
+				if(!first)
+					os<<','<<std::endl;
+				first=false;
+				os<<"{\"name\":\""<<intervals[i].name<<"\",\"cat\":\""<<streamNames[stream]<<"\",\"ph\":\"X\",\"pid\":"<<sourceId<<",\"tid\":"<<stream*numIntervals+i;
+				os<<",\"ts\":"<<double(begin-firstTime)*1.0e-3<<",\"dur\":"<<double(end-begin)*1.0e-3<<",\"args\":{\"frame\":"<<frameIndex<<"}}";
+				}
+			}
+		}
+	
+	os<<std::endl<<"]}"<<std::endl;
+	}
+
+}
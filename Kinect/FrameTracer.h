@@ -0,0 +1,87 @@
+/***********************************************************************
+FrameTracer - Class to record per-frame time stamps at the stages of the
+frame processing pipeline, from a frame's first USB packet to the exit
+from the consumer's streaming callback, in per-thread event rings, and
+to report latency histograms or export Chrome trace files.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_FRAMETRACER_INCLUDED
+#define KINECT_FRAMETRACER_INCLUDED
+
+#include <iostream>
+#include <Misc/SizedTypes.h>
+
+namespace Kinect {
+
+class FrameTracer
+	{
+	/* Embedded classes: */
+	public:
+	enum Stage // Enumerated type for traced frame processing stages
+		{
+		FIRST_PACKET=0, // First packet of a frame was received from the camera
+		FRAME_COMPLETE, // Last packet of a frame was received from the camera
+		DECODE_START, // Decoding thread picked up the raw frame
+		DECODE_END, // Decoding thread finished decoding the raw frame
+		CALLBACK_ENTRY, // Decoded frame was passed to the streaming callback
+		CALLBACK_EXIT, // Streaming callback returned
+		NUM_STAGES
+		};
+	
+	struct Event // Structure for a single recorded event
+		{
+		/* Elements: */
+		public:
+		Misc::UInt64 time; // Time at which the event occurred in nanoseconds of the system's monotonic clock
+		Misc::UInt32 frameIndex; // Index of the frame in its stream
+		Misc::UInt16 sourceId; // ID of the frame source that produced the frame
+		Misc::UInt8 stream; // Index of the frame's stream in its source, i.e., color or depth
+		Misc::UInt8 stage; // Frame processing stage
+		};
+	
+	/* Elements: */
+	private:
+	static volatile bool enabled; // Flag whether events are recorded
+	
+	/* Private methods: */
+	static void recordEvent(unsigned int sourceId,int stream,unsigned int frameIndex,Stage stage); // Records an event in the calling thread's event ring
+	
+	/* Methods: */
+	public:
+	static void setEnabled(bool newEnabled); // Enables or disables event recording
+	static bool isEnabled(void) // Returns true if events are recorded
+		{
+		return enabled;
+		}
+	static unsigned int registerSource(const char* sourceName); // Returns the ID for the frame source of the given name, registering a new source if necessary
+	static void trace(unsigned int sourceId,int stream,unsigned int frameIndex,Stage stage) // Records an event if event recording is enabled
+		{
+		if(enabled)
+			recordEvent(sourceId,stream,frameIndex,stage);
+		}
+	static void reset(void); // Discards all recorded events; must not be called while events are being recorded
+	static void printHistograms(std::ostream& os); // Prints histograms of the latencies between processing stages of all recorded frames
+	static void writeChromeTrace(std::ostream& os); // Writes all recorded frames' processing stages in Chrome trace event JSON format
+	};
+
+}
+
+#endif
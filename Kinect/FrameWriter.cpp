@@ -30,6 +30,7 @@ Methods of class FrameWriter:
 ****************************/
 
 FrameWriter::FrameWriter(const unsigned int sSize[2])
+	:keyframe(true)
 	{
 	size[0]=sSize[0];
 	size[1]=sSize[1];
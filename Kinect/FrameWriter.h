@@ -38,6 +38,7 @@ class FrameWriter
 	/* Elements: */
 	protected:
 	unsigned int size[2]; // Width and height of provided frames
+	bool keyframe; // Flag whether the most recently written frame can be decoded without any previously written frames
 	
 	/* Constructors and destructors: */
 	public:
@@ -54,6 +55,14 @@ class FrameWriter
 		return size[dimension];
 		}
 	virtual size_t writeFrame(const FrameBuffer& frame) =0; // Writes the given color or depth frame; returns size of written data in bytes
+	bool isKeyframe(void) const // Returns true if the most recently written frame can be decoded without any previously written frames
+		{
+		return keyframe;
+		}
+	virtual void requestKeyframe(void) // Requests that the next written frame can be decoded without any previously written frames; can be called from any thread
+		{
+		/* Frames are independent of each other by default */
+		}
 	};
 
 }
@@ -1,7 +1,7 @@
 /***********************************************************************
-HilbertCurve - Helper class to create an index array to traverse a 2D
-array in the order of a space-filling Hilbert curve.
-Copyright (c) 2010-2011 Oliver Kreylos
+HilbertCurve - Helper class to traverse a 2D array in the order of a
+space-filling Hilbert curve, one cache-sized block of pixels at a time.
+Copyright (c) 2010-2013 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -23,36 +23,187 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 
 #include <Kinect/HilbertCurve.h>
 
+#include <vector>
+#include <algorithm>
+#include <Threads/Mutex.h>
+
 namespace Kinect {
 
-/*****************************
-Methods of class HilbertCurve:
-*****************************/
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+struct BlockFirstIndexComp // Functor to compare element indices with the first indices of blocks
+	{
+	/* Methods: */
+	public:
+	bool operator()(unsigned int index,const HilbertCurve::Block& block) const
+		{
+		return index<block.firstIndex;
+		}
+	};
+
+/****************
+Helper variables:
+****************/
+
+Threads::Mutex layoutsMutex; // Mutex serializing access to the list of shared layouts
+const int childStateTemplate[2][4][3]= // Traversal order, entry corners, and main flip bits of the children of a Hilbert curve node
+	{
+	{{0,0,1},{2,0,0},{3,0,0},{1,3,1}},
+	{{0,0,0},{1,0,1},{3,0,1},{2,3,0}}
+	};
+
+/****************
+Helper functions:
+****************/
 
-void HilbertCurve::createCurve(const unsigned int arraySize[2],const unsigned int pos[2],unsigned int size,int entryCorner,int mainFlipBit,unsigned int*& hcPtr)
+void createCurve(unsigned int size,const unsigned int pos[2],int entryCorner,int mainFlipBit,std::vector<unsigned int>& positions)
 	{
 	if(size==1)
 		{
-		/* Check if the leaf node is valid: */
-		if(pos[0]<arraySize[0]&&pos[1]<arraySize[1])
-			{
-			/* Store the offset of the leaf node: */
-			*hcPtr=pos[1]*arraySize[0]+pos[0];
-			++hcPtr;
-			}
+		/* Store the position of the leaf node: */
+		positions.push_back((pos[1]<<16)|pos[0]);
 		}
 	else
 		{
-		static const int childStateTemplate[2][4][3]=
+		/* Recurse into the children of this node: */
+		unsigned int childSize=size>>1;
+		for(int i=0;i<4;++i)
 			{
-			{{0,0,1},{2,0,0},{3,0,0},{1,3,1}},
-			{{0,0,0},{1,0,1},{3,0,1},{2,3,0}}
-			};
-		
-		/**************************************
-		Recurse into the children of this node:
-		**************************************/
+			/* Find the index of the child to recurse into: */
+			int child=childStateTemplate[mainFlipBit][i][0]^entryCorner;
+			unsigned int childPos[2];
+			for(int j=0;j<2;++j)
+				{
+				childPos[j]=pos[j];
+				if(child&(1<<j))
+					childPos[j]+=childSize;
+				}
+			
+			/* Recurse: */
+			int childEntryCorner=childStateTemplate[mainFlipBit][i][1]^entryCorner;
+			int childMainFlipBit=childStateTemplate[mainFlipBit][i][2];
+			createCurve(childSize,childPos,childEntryCorner,childMainFlipBit,positions);
+			}
+		}
+	}
+
+}
+
+/*****************************************
+Declaration of class HilbertCurve::Layout:
+*****************************************/
+
+struct HilbertCurve::Layout
+	{
+	/* Elements: */
+	public:
+	unsigned int arraySize[2]; // Array size for which the layout was created
+	unsigned int refCount; // Number of Hilbert curves using the layout
+	Layout* succ; // Next layout in the list of shared layouts
+	std::vector<unsigned int> blockPositions[8]; // Block-relative positions of a block's elements in Hilbert curve order for each combination of entry corner and main flip bit, as y<<16 | x
+	std::vector<unsigned int> offsets; // Block-relative array offsets of all blocks' elements; the offsets for full blocks of each combination of entry corner and main flip bit come first, followed by the offsets of partial blocks at the array's edges
+	std::vector<Block> blocks; // Blocks of the array in Hilbert curve order, followed by a sentinel block
+	
+	/* Constructors and destructors: */
+	Layout(const unsigned int sArraySize[2]);
+	
+	/* Methods: */
+	void createBlocks(unsigned int blockSize,unsigned int size,const unsigned int pos[2],int entryCorner,int mainFlipBit,std::vector<size_t>& blockOffsetIndices,unsigned int& nextIndex); // Creates the list of blocks recursively, and the begin and end indices of each block's offsets in the offset array
+	};
+
+/*************************************
+Methods of class HilbertCurve::Layout:
+*************************************/
+
+HilbertCurve::Layout::Layout(const unsigned int sArraySize[2])
+	:refCount(0),succ(0)
+	{
+	for(int i=0;i<2;++i)
+		arraySize[i]=sArraySize[i];
+	
+	/* Calculate the size of the Hilbert curve's root node and the size of blocks: */
+	unsigned int size;
+	for(size=1;size<arraySize[0]||size<arraySize[1];size<<=1)
+		;
+	unsigned int bs=HilbertCurve::blockSize;
+	if(bs>size)
+		bs=size;
+	
+	/* Create the element orders and array offsets of full blocks for all combinations of entry corner and main flip bit: */
+	unsigned int origin[2]={0,0};
+	for(int state=0;state<8;++state)
+		{
+		createCurve(bs,origin,state>>1,state&0x1,blockPositions[state]);
+		for(std::vector<unsigned int>::iterator bpIt=blockPositions[state].begin();bpIt!=blockPositions[state].end();++bpIt)
+			offsets.push_back((*bpIt>>16)*arraySize[0]+(*bpIt&0xffffU));
+		}
+	
+	/* Create the list of blocks in Hilbert curve order: */
+	std::vector<size_t> blockOffsetIndices;
+	unsigned int nextIndex=0;
+	createBlocks(bs,size,origin,0,0,blockOffsetIndices,nextIndex);
+	
+	/* Add the sentinel block, which points to a valid offset: */
+	Block sentinel;
+	sentinel.firstIndex=arraySize[0]*arraySize[1];
+	sentinel.baseOffset=0;
+	blocks.push_back(sentinel);
+	blockOffsetIndices.push_back(0);
+	blockOffsetIndices.push_back(1);
+	
+	/* Point the blocks to their offset arrays now that the offset array will not be reallocated anymore: */
+	for(size_t i=0;i<blocks.size();++i)
+		{
+		blocks[i].offsets=&offsets[0]+blockOffsetIndices[i*2+0];
+		blocks[i].offsetsEnd=&offsets[0]+blockOffsetIndices[i*2+1];
+		}
+	}
+
+void HilbertCurve::Layout::createBlocks(unsigned int blockSize,unsigned int size,const unsigned int pos[2],int entryCorner,int mainFlipBit,std::vector<size_t>& blockOffsetIndices,unsigned int& nextIndex)
+	{
+	/* Ignore nodes that lie entirely outside the array: */
+	if(pos[0]>=arraySize[0]||pos[1]>=arraySize[1])
+		return;
+	
+	if(size==blockSize)
+		{
+		/* Create a block for this node: */
+		Block block;
+		block.firstIndex=nextIndex;
+		block.baseOffset=pos[1]*arraySize[0]+pos[0];
+		blocks.push_back(block);
 		
+		int state=entryCorner*2+mainFlipBit;
+		size_t numBlockElements=blockPositions[state].size();
+		if(pos[0]+blockSize<=arraySize[0]&&pos[1]+blockSize<=arraySize[1])
+			{
+			/* Use the shared offsets of full blocks of this block's state: */
+			blockOffsetIndices.push_back(numBlockElements*state);
+			blockOffsetIndices.push_back(numBlockElements*(state+1));
+			nextIndex+=(unsigned int)numBlockElements;
+			}
+		else
+			{
+			/* Create the offsets of the elements of this partial block that lie inside the array: */
+			blockOffsetIndices.push_back(offsets.size());
+			for(std::vector<unsigned int>::iterator bpIt=blockPositions[state].begin();bpIt!=blockPositions[state].end();++bpIt)
+				{
+				unsigned int x=*bpIt&0xffffU;
+				unsigned int y=*bpIt>>16;
+				if(pos[0]+x<arraySize[0]&&pos[1]+y<arraySize[1])
+					offsets.push_back(y*arraySize[0]+x);
+				}
+			nextIndex+=(unsigned int)(offsets.size()-blockOffsetIndices.back());
+			blockOffsetIndices.push_back(offsets.size());
+			}
+		}
+	else
+		{
+		/* Recurse into the children of this node: */
 		unsigned int childSize=size>>1;
 		for(int i=0;i<4;++i)
 			{
@@ -69,35 +220,86 @@ void HilbertCurve::createCurve(const unsigned int arraySize[2],const unsigned in
 			/* Recurse: */
 			int childEntryCorner=childStateTemplate[mainFlipBit][i][1]^entryCorner;
 			int childMainFlipBit=childStateTemplate[mainFlipBit][i][2];
-			createCurve(arraySize,childPos,childSize,childEntryCorner,childMainFlipBit,hcPtr);
+			createBlocks(blockSize,childSize,childPos,childEntryCorner,childMainFlipBit,blockOffsetIndices,nextIndex);
 			}
 		}
 	}
 
+/*************************************
+Static elements of class HilbertCurve:
+*************************************/
+
+HilbertCurve::Layout* HilbertCurve::layouts=0;
+
+/*****************************
+Methods of class HilbertCurve:
+*****************************/
+
+HilbertCurve::Layout* HilbertCurve::acquireLayout(const unsigned int arraySize[2])
+	{
+	Threads::Mutex::Lock layoutsLock(layoutsMutex);
+	
+	/* Find an existing layout for the given array size: */
+	Layout* result;
+	for(result=layouts;result!=0&&(result->arraySize[0]!=arraySize[0]||result->arraySize[1]!=arraySize[1]);result=result->succ)
+		;
+	
+	if(result==0)
+		{
+		/* Create a new layout and add it to the list: */
+		result=new Layout(arraySize);
+		result->succ=layouts;
+		layouts=result;
+		}
+	
+	++result->refCount;
+	return result;
+	}
+
+void HilbertCurve::releaseLayout(HilbertCurve::Layout* layout)
+	{
+	Threads::Mutex::Lock layoutsLock(layoutsMutex);
+	
+	if(--layout->refCount==0)
+		{
+		/* Remove the layout from the list and destroy it: */
+		Layout** lPtr;
+		for(lPtr=&layouts;*lPtr!=layout;lPtr=&(*lPtr)->succ)
+			;
+		*lPtr=layout->succ;
+		delete layout;
+		}
+	}
+
 HilbertCurve::HilbertCurve(void)
-	:offsets(0)
+	:layout(0)
 	{
 	}
 
 HilbertCurve::~HilbertCurve(void)
 	{
-	delete[] offsets;
+	if(layout!=0)
+		releaseLayout(layout);
 	}
 
 void HilbertCurve::init(const unsigned int arraySize[2])
 	{
-	/* Allocate the offsets array: */
-	offsets=new unsigned int[arraySize[1]*arraySize[0]];
+	/* Release the current layout and acquire the shared layout for the new array size: */
+	if(layout!=0)
+		releaseLayout(layout);
+	layout=acquireLayout(arraySize);
+	}
+
+HilbertCurve::Iterator HilbertCurve::getIterator(unsigned int index) const
+	{
+	/* Find the block containing the element of the given index; an index one past the last element finds the sentinel block: */
+	const Block* blockPtr=std::upper_bound(&layout->blocks.front(),&layout->blocks.back()+1,index,BlockFirstIndexComp())-1;
 	
-	/* Call the recursive method: */
-	unsigned int pos[2];
-	for(int i=0;i<2;++i)
-		pos[i]=0;
-	unsigned int size;
-	for(size=1;size<arraySize[0]||size<arraySize[1];size<<=1)
-		;
-	unsigned int* hcPtr=offsets;
-	createCurve(arraySize,pos,size,0,0,hcPtr);
+	/* Position the iterator inside the block: */
+	Iterator result;
+	result.enterBlock(blockPtr);
+	result.offsetPtr+=index-blockPtr->firstIndex;
+	return result;
 	}
 
 }
@@ -1,7 +1,7 @@
 /***********************************************************************
-HilbertCurve - Helper class to create an index array to traverse a 2D
-array in the order of a space-filling Hilbert curve.
-Copyright (c) 2010-2011 Oliver Kreylos
+HilbertCurve - Helper class to traverse a 2D array in the order of a
+space-filling Hilbert curve, one cache-sized block of pixels at a time.
+Copyright (c) 2010-2013 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -28,12 +28,64 @@ namespace Kinect {
 
 class HilbertCurve
 	{
-	/* Elements: */
+	/* Embedded classes: */
+	public:
+	struct Block // Structure for a square block of array elements, which the Hilbert curve traverses contiguously
+		{
+		/* Elements: */
+		public:
+		unsigned int firstIndex; // Index of the block's first element along the Hilbert curve
+		unsigned int baseOffset; // Array offset of the block's lower-left corner
+		const unsigned int* offsets; // Array offsets of the block's elements in Hilbert curve order, relative to the block's lower-left corner
+		const unsigned int* offsetsEnd; // End of the block's offset array
+		};
+	
+	class Iterator // Class to step through array offsets along the Hilbert curve
+		{
+		friend class HilbertCurve;
+		
+		/* Elements: */
+		private:
+		const Block* blockPtr; // Block containing the current element
+		unsigned int baseOffset; // Array offset of the current block
+		const unsigned int* offsetPtr; // Relative offset of the current element in the current block
+		const unsigned int* offsetsEnd; // End of the current block's offset array
+		
+		/* Private methods: */
+		void enterBlock(const Block* newBlockPtr) // Moves the iterator to the first element of the given block
+			{
+			blockPtr=newBlockPtr;
+			baseOffset=blockPtr->baseOffset;
+			offsetPtr=blockPtr->offsets;
+			offsetsEnd=blockPtr->offsetsEnd;
+			}
+		
+		/* Methods: */
+		public:
+		unsigned int operator*(void) const // Returns the array offset of the current element
+			{
+			return baseOffset+*offsetPtr;
+			}
+		Iterator& operator++(void) // Moves to the next element along the Hilbert curve
+			{
+			++offsetPtr;
+			if(offsetPtr==offsetsEnd)
+				enterBlock(blockPtr+1);
+			return *this;
+			}
+		};
+	
 	private:
-	unsigned int* offsets; // Array of pixel offsets
+	struct Layout; // Structure holding the traversal tables for one array size, shared between all Hilbert curves of that size
+	
+	/* Elements: */
+	static const unsigned int blockSize=16; // Width and height of blocks traversed from shared block-relative offset tables
+	static Layout* layouts; // List of all shared traversal table layouts
+	Layout* layout; // Traversal table layout used by this Hilbert curve
 	
 	/* Private methods: */
-	void createCurve(const unsigned int arraySize[2],const unsigned int pos[2],unsigned int size,int entryCorner,int mainFlipBit,unsigned int*& hcPtr); // Creates the Hilbert curve recursively
+	static Layout* acquireLayout(const unsigned int arraySize[2]); // Returns the shared layout for the given array size, creating it if necessary
+	static void releaseLayout(Layout* layout); // Releases a shared layout, destroying it when no longer used
 	
 	/* Constructors and destructors: */
 	public:
@@ -42,14 +94,7 @@ class HilbertCurve
 	
 	/* Methods: */
 	void init(const unsigned int arraySize[2]); // Initializes the Hilbert curve for the given array size
-	const unsigned int* getOffsets(void) const // Returns the array offset array
-		{
-		return offsets;
-		}
-	unsigned int operator()(unsigned int index) const // Returns the array offset of the given point along the Hilbert curve
-		{
-		return offsets[index];
-		}
+	Iterator getIterator(unsigned int index) const; // Returns an iterator to the element of the given index along the Hilbert curve
 	};
 
 }
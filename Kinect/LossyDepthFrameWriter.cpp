@@ -29,6 +29,7 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <IO/VariableMemoryFile.h>
 #include <Video/Config.h>
 #if VIDEO_CONFIG_HAVE_THEORA
+#include <theora/codec.h>
 #include <Video/FrameBuffer.h>
 #include <Video/OggPage.h>
 #include <Video/TheoraInfo.h>
@@ -148,12 +149,15 @@ size_t LossyDepthFrameWriter::writeFrame(const FrameBuffer& frame)
 	theoraEncoder.encodeFrame(theoraFrame);
 	
 	/* Write all encoded Theora packets to the sink: */
+	keyframe=false;
 	Video::TheoraPacket packet;
 	while(theoraEncoder.emitPacket(packet))
 		{
 		/* Write the packet to the sink: */
 		packet.write(sink);
 		result+=packet.getWireSize();
+		if(th_packet_iskeyframe(&packet)>0)
+			keyframe=true;
 		}
 	
 	#endif
@@ -0,0 +1,144 @@
+/***********************************************************************
+MappedFile - Class for read-only files mapped into memory, which serve
+buffered reads without system calls and let decoders access file data
+in place.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/MappedFile.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <Misc/ThrowStdErr.h>
+
+namespace Kinect {
+
+/***************************
+Methods of class MappedFile:
+***************************/
+
+void MappedFile::readAhead(IO::SeekableFile::Offset pos)
+	{
+	if(readAheadSize==0||pos>=Offset(dataSize))
+		return;
+	
+	/* Only request a new window once the read position has consumed half of the current one or has left it, to keep system calls rare: */
+	if(pos+Offset(readAheadSize/2)<readAheadEnd&&pos+Offset(readAheadSize)>=readAheadEnd)
+		return;
+	
+	/* Request the page-aligned window following the read position: */
+	Offset pageSize=Offset(sysconf(_SC_PAGESIZE));
+	Offset windowStart=pos&~(pageSize-1);
+	Offset windowEnd=pos+Offset(readAheadSize);
+	if(windowEnd>Offset(dataSize))
+		windowEnd=Offset(dataSize);
+	madvise(data+windowStart,size_t(windowEnd-windowStart),MADV_WILLNEED);
+	readAheadEnd=windowEnd;
+	}
+
+size_t MappedFile::readData(IO::File::Byte* buffer,size_t bufferSize)
+	{
+	/* Copy data from the mapped file at the current read position: */
+	if(readPos>=Offset(dataSize))
+		return 0;
+	size_t readSize=dataSize-size_t(readPos);
+	if(readSize>bufferSize)
+		readSize=bufferSize;
+	memcpy(buffer,data+readPos,readSize);
+	readPos+=Offset(readSize);
+	readAhead(readPos);
+	
+	return readSize;
+	}
+
+MappedFile::MappedFile(const char* fileName,size_t sReadAheadSize)
+	:IO::SeekableFile(),
+	 data(0),dataSize(0),
+	 readAheadSize(sReadAheadSize),readAheadEnd(0)
+	{
+	/* Open the file and check that it can be mapped: */
+	int fd=open(fileName,O_RDONLY);
+	if(fd<0)
+		Misc::throwStdErr("Kinect::MappedFile: Unable to open file %s due to error %s",fileName,strerror(errno));
+	struct stat fileStats;
+	if(fstat(fd,&fileStats)!=0||!S_ISREG(fileStats.st_mode))
+		{
+		close(fd);
+		Misc::throwStdErr("Kinect::MappedFile: File %s is not a regular file",fileName);
+		}
+	dataSize=size_t(fileStats.st_size);
+	
+	/* Map the entire file; the mapping stays valid after the file is closed: */
+	if(dataSize>0)
+		{
+		void* mapping=mmap(0,dataSize,PROT_READ,MAP_PRIVATE,fd,0);
+		if(mapping==MAP_FAILED)
+			{
+			int mapErrno=errno;
+			close(fd);
+			Misc::throwStdErr("Kinect::MappedFile: Unable to map file %s due to error %s",fileName,strerror(mapErrno));
+			}
+		data=static_cast<Byte*>(mapping);
+		
+		/* Let the kernel read ahead aggressively and drop pages behind the read position: */
+		madvise(data,dataSize,MADV_SEQUENTIAL);
+		}
+	close(fd);
+	
+	/* Request the beginning of the file: */
+	readAhead(0);
+	}
+
+MappedFile::~MappedFile(void)
+	{
+	if(data!=0)
+		munmap(data,dataSize);
+	}
+
+IO::SeekableFile::Offset MappedFile::getSize(void) const
+	{
+	return Offset(dataSize);
+	}
+
+void MappedFile::setReadAheadSize(size_t newReadAheadSize)
+	{
+	readAheadSize=newReadAheadSize;
+	readAheadEnd=0;
+	}
+
+const IO::File::Byte* MappedFile::readInPlace(size_t size)
+	{
+	/* Check that the file contains the requested data: */
+	Offset pos=getReadPos();
+	if(pos+Offset(size)>Offset(dataSize))
+		return 0;
+	
+	/* Skip the data in the file; this only discards the read buffer if the data extends past it: */
+	setReadPosAbs(pos+Offset(size));
+	readAhead(pos+Offset(size));
+	
+	return data+pos;
+	}
+
+}
@@ -0,0 +1,64 @@
+/***********************************************************************
+MappedFile - Class for read-only files mapped into memory, which serve
+buffered reads without system calls and let decoders access file data
+in place.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_MAPPEDFILE_INCLUDED
+#define KINECT_MAPPEDFILE_INCLUDED
+
+#include <stddef.h>
+#include <IO/SeekableFile.h>
+
+namespace Kinect {
+
+class MappedFile:public IO::SeekableFile
+	{
+	/* Elements: */
+	private:
+	Byte* data; // Memory region into which the file is mapped
+	size_t dataSize; // Size of the mapped file in bytes
+	size_t readAheadSize; // Amount of data ahead of the read position to request from the page cache, or 0 to rely on the kernel's readahead
+	Offset readAheadEnd; // End of the most recently requested readahead window
+	
+	/* Private methods: */
+	void readAhead(Offset pos); // Requests the data following the given position from the page cache if it leaves the current readahead window
+	
+	/* Protected methods from IO::File: */
+	protected:
+	virtual size_t readData(Byte* buffer,size_t bufferSize);
+	
+	/* Constructors and destructors: */
+	public:
+	MappedFile(const char* fileName,size_t sReadAheadSize =size_t(4)*1024*1024); // Maps the existing regular file of the given name for sequential reading with the given readahead size
+	virtual ~MappedFile(void); // Unmaps the file
+	
+	/* Methods from IO::SeekableFile: */
+	virtual Offset getSize(void) const;
+	
+	/* New methods: */
+	void setReadAheadSize(size_t newReadAheadSize); // Sets the amount of data to request ahead of the read position; 0 disables explicit readahead
+	const Byte* readInPlace(size_t size); // Returns a pointer to the given amount of data at the current read position inside the mapped file and advances the read position past it; returns null and leaves the read position unchanged if the file ends too early
+	};
+
+}
+
+#endif
@@ -30,6 +30,7 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <Geometry/GeometryMarshallers.h>
 #include <Kinect/ColorFrameReader.h>
 #include <Kinect/DepthFrameReader.h>
+#include <Kinect/RansDepthFrameReader.h>
 #include <Kinect/LossyDepthFrameReader.h>
 
 namespace Kinect {
@@ -74,8 +75,10 @@ MultiplexedFrameSource::Stream::Stream(MultiplexedFrameSource* sOwner,unsigned i
 		depthCorrection=new DepthCorrection(0,numSegments);
 		}
 	
-	/* Check if the depth stream uses lossy compression: */
-	bool depthIsLossy=streamFormatVersions[1]>=3&&source.read<Misc::UInt8>()!=0;
+	/* Check which compression method the depth stream uses: */
+	unsigned int depthCompression=streamFormatVersions[1]>=3?source.read<Misc::UInt8>():LOSSLESS_HUFFMAN;
+	if(depthCompression>LOSSLESS_RANS)
+		Misc::throwStdErr("Kinect::MultiplexedFrameSource::Stream::Stream: Unknown depth compression method %u",depthCompression);
 	
 	/* Read the intrinsic and extrinsic camera parameters from the source: */
 	ips.colorProjection=Misc::Marshaller<IntrinsicParameters::PTransform>::read(source);
@@ -84,7 +87,7 @@ MultiplexedFrameSource::Stream::Stream(MultiplexedFrameSource* sOwner,unsigned i
 	
 	/* Create the frame readers: */
 	owner->colorFrameReaders[index]=new ColorFrameReader(source);
-	if(depthIsLossy)
+	if(depthCompression==LOSSY_THEORA)
 		{
 		#if VIDEO_CONFIG_HAVE_THEORA
 		owner->depthFrameReaders[index]=new LossyDepthFrameReader(source);
@@ -92,8 +95,10 @@ MultiplexedFrameSource::Stream::Stream(MultiplexedFrameSource* sOwner,unsigned i
 		Misc::throwStdErr("Kinect::MultiplexedFrameSource::Stream::Stream: Lossy depth compression not supported due to lack of Theora library");
 		#endif
 		}
+	else if(depthCompression==LOSSLESS_RANS)
+		owner->depthFrameReaders[index]=new RansDepthFrameReader(source);
 	else
-		owner->depthFrameReaders[index]=new DepthFrameReader(source);
+		owner->depthFrameReaders[index]=new DepthFrameReader(source,streamFormatVersions[1],owner->numDepthDecodingThreads);
 	}
 
 MultiplexedFrameSource::Stream::~Stream(void)
@@ -258,8 +263,8 @@ void* MultiplexedFrameSource::receivingThreadMethod(void)
 	return 0;
 	}
 
-MultiplexedFrameSource::MultiplexedFrameSource(Comm::PipePtr sPipe)
-	:pipe(sPipe),
+MultiplexedFrameSource::MultiplexedFrameSource(Comm::PipePtr sPipe,unsigned int sNumDepthDecodingThreads)
+	:pipe(sPipe),numDepthDecodingThreads(sNumDepthDecodingThreads),
 	 numStreams(0),
 	 colorFrameReaders(0),
 	 depthFrameReaders(0),
@@ -365,9 +370,9 @@ MultiplexedFrameSource::~MultiplexedFrameSource(void)
 		}
 	}
 
-MultiplexedFrameSource* MultiplexedFrameSource::create(Comm::PipePtr sPipe)
+MultiplexedFrameSource* MultiplexedFrameSource::create(Comm::PipePtr sPipe,unsigned int sNumDepthDecodingThreads)
 	{
-	return new MultiplexedFrameSource(sPipe);
+	return new MultiplexedFrameSource(sPipe,sNumDepthDecodingThreads);
 	}
 
 }
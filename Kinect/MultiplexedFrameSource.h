@@ -79,6 +79,7 @@ class MultiplexedFrameSource
 	/* Elements: */
 	private:
 	Comm::PipePtr pipe; // The multiplexed source stream
+	unsigned int numDepthDecodingThreads; // Number of threads decompressing each losslessly compressed depth frame
 	unsigned int numStreams; // Number of streams in the multiplexer
 	FrameReader** colorFrameReaders; // Array of color stream readers for the component streams
 	FrameReader** depthFrameReaders; // Array of depth stream readers for the component streams
@@ -93,12 +94,12 @@ class MultiplexedFrameSource
 	
 	/* Constructors and destructors: */
 	private:
-	MultiplexedFrameSource(Comm::PipePtr sPipe); // Creates a multiplexed source for the given stream source
+	MultiplexedFrameSource(Comm::PipePtr sPipe,unsigned int sNumDepthDecodingThreads); // Creates a multiplexed source for the given stream source
 	~MultiplexedFrameSource(void); // Shuts down the multiplexed source
 	
 	/* Methods: */
 	public:
-	static MultiplexedFrameSource* create(Comm::PipePtr sPipe); // Returns a new multiplexed frame source that will self-destruct after the last stream has been destroyed
+	static MultiplexedFrameSource* create(Comm::PipePtr sPipe,unsigned int sNumDepthDecodingThreads =1); // Returns a new multiplexed frame source that will self-destruct after the last stream has been destroyed, decompressing each lossless depth frame in the given number of threads
 	unsigned int getNumStreams(void) const // Returns the number of streams in the multiplexed source
 		{
 		return numStreams;
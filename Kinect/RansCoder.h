@@ -0,0 +1,151 @@
+/***********************************************************************
+RansCoder - Classes to encode and decode symbols using several
+interleaved range asymmetric numeral system (rANS) coders sharing a
+single byte stream.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_RANSCODER_INCLUDED
+#define KINECT_RANSCODER_INCLUDED
+
+#include <stddef.h>
+#include <Misc/SizedTypes.h>
+
+namespace Kinect {
+
+class RansCoder // Base class defining the parameters shared by rANS encoders and decoders
+	{
+	/* Elements: */
+	public:
+	static const unsigned int numLanes=4; // Number of interleaved coders; the i-th symbol of a stream is coded by coder i%numLanes
+	static const Misc::UInt32 lowerBound=1U<<23; // Lower bound of the normalized coder state interval; states are renormalized one byte at a time
+	static const unsigned int maxScaleBits=16; // Maximum number of bits of a symbol frequency scale
+	};
+
+class RansEncoder:public RansCoder // Class to encode symbols into a memory block; symbols are encoded in reverse order, and the block is filled back to front
+	{
+	/* Elements: */
+	private:
+	Misc::UInt8* blockPtr; // Position of the most recently written byte in the memory block
+	Misc::UInt32 states[numLanes]; // States of the interleaved coders
+	unsigned int lane; // Index of the coder encoding the next symbol
+	
+	/* Constructors and destructors: */
+	public:
+	RansEncoder(Misc::UInt8* blockEnd,size_t numSymbols) // Creates an encoder writing backwards from the given end of a memory block, to encode a stream of the given number of symbols
+		:blockPtr(blockEnd),lane((unsigned int)((numSymbols+numLanes-1)%numLanes))
+		{
+		for(unsigned int i=0;i<numLanes;++i)
+			states[i]=lowerBound;
+		}
+	
+	/* Methods: */
+	void encode(unsigned int start,unsigned int frequency,unsigned int scaleBits) // Encodes a symbol of the given cumulative frequency start and non-zero frequency on a scale of 2^scaleBits
+		{
+		Misc::UInt32& x=states[lane];
+		
+		/* Renormalize the coder state such that it stays in the normalized interval after encoding: */
+		Misc::UInt32 xMax=((lowerBound>>scaleBits)<<8)*frequency;
+		while(x>=xMax)
+			{
+			--blockPtr;
+			*blockPtr=Misc::UInt8(x);
+			x>>=8;
+			}
+		
+		/* Encode the symbol: */
+		x=((x/frequency)<<scaleBits)+(x%frequency)+start;
+		
+		/* Go to the coder encoding the previous symbol: */
+		lane=(lane+numLanes-1)%numLanes;
+		}
+	void encodeBits(unsigned int bits,unsigned int numBits) // Encodes the given number of raw bits, up to maxScaleBits, as a symbol of uniform probability
+		{
+		encode(bits,1,numBits);
+		}
+	Misc::UInt8* flush(void) // Writes the final coder states into the memory block and returns the beginning of the encoded byte stream
+		{
+		/* Write the coder states in little-endian order such that the first coder's state starts the byte stream: */
+		for(int i=numLanes-1;i>=0;--i)
+			{
+			blockPtr-=4;
+			for(int j=0;j<4;++j)
+				blockPtr[j]=Misc::UInt8(states[i]>>(j*8));
+			}
+		return blockPtr;
+		}
+	};
+
+class RansDecoder:public RansCoder // Class to decode symbols from a memory block written by a RansEncoder
+	{
+	/* Elements: */
+	private:
+	const Misc::UInt8* blockPtr; // Position of the next byte to be read from the memory block
+	const Misc::UInt8* blockEnd; // End of the encoded byte stream
+	Misc::UInt32 states[numLanes]; // States of the interleaved coders
+	unsigned int lane; // Index of the coder decoding the next symbol
+	
+	/* Constructors and destructors: */
+	public:
+	RansDecoder(const Misc::UInt8* blockStart,const Misc::UInt8* sBlockEnd) // Creates a decoder reading the encoded byte stream in the given memory block
+		:blockPtr(blockStart),blockEnd(sBlockEnd),lane(0)
+		{
+		/* Read the initial coder states; a truncated stream is padded with zeros: */
+		for(unsigned int i=0;i<numLanes;++i)
+			{
+			states[i]=0x0U;
+			for(int j=0;j<4&&blockPtr!=blockEnd;++j,++blockPtr)
+				states[i]|=Misc::UInt32(*blockPtr)<<(j*8);
+			}
+		}
+	
+	/* Methods: */
+	unsigned int peek(unsigned int scaleBits) const // Returns the cumulative frequency slot of the next symbol on a scale of 2^scaleBits
+		{
+		return states[lane]&((1U<<scaleBits)-1U);
+		}
+	void advance(unsigned int start,unsigned int frequency,unsigned int scaleBits) // Removes the next symbol, of the given cumulative frequency start and frequency, from the stream
+		{
+		Misc::UInt32& x=states[lane];
+		
+		/* Decode the symbol: */
+		x=frequency*(x>>scaleBits)+(x&((1U<<scaleBits)-1U))-start;
+		
+		/* Renormalize the coder state; stop at the end of the stream to survive corrupted data: */
+		while(x<lowerBound&&blockPtr!=blockEnd)
+			{
+			x=(x<<8)|Misc::UInt32(*blockPtr);
+			++blockPtr;
+			}
+		
+		/* Go to the coder decoding the next symbol: */
+		lane=(lane+1)%numLanes;
+		}
+	unsigned int decodeBits(unsigned int numBits) // Decodes the given number of raw bits encoded by RansEncoder::encodeBits
+		{
+		unsigned int result=peek(numBits);
+		advance(result,1,numBits);
+		return result;
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,203 @@
+/***********************************************************************
+RansDepthFrameReader - Class to read depth frames compressed with
+interleaved rANS entropy coding from a source, and pass decompressed
+time-stamped depth frames to a client.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/RansDepthFrameReader.h>
+
+#include <Misc/ThrowStdErr.h>
+#include <IO/File.h>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/RansCoder.h>
+#include <Kinect/MappedFile.h>
+
+namespace Kinect {
+
+/*************************************
+Methods of class RansDepthFrameReader:
+*************************************/
+
+void RansDepthFrameReader::initSymbolTable(RansDepthFrameReader::SymbolTable& table,unsigned int numSymbols)
+	{
+	table.numSymbols=numSymbols;
+	table.frequencies=new unsigned int[numSymbols];
+	table.starts=new unsigned int[numSymbols];
+	table.slotSymbols=new Misc::UInt16[1U<<scaleBits];
+	}
+
+void RansDepthFrameReader::readFrequencies(RansDepthFrameReader::SymbolTable& table)
+	{
+	/* Read the normalized symbol frequencies: */
+	unsigned int scale=1U<<scaleBits;
+	unsigned int start=0;
+	for(unsigned int i=0;i<table.numSymbols;++i)
+		{
+		unsigned int frequency=source.read<Misc::UInt8>();
+		if(frequency&0x80U)
+			frequency=((frequency&0x7fU)<<8)|source.read<Misc::UInt8>();
+		if(frequency>scale-start)
+			Misc::throwStdErr("Kinect::RansDepthFrameReader::readNextFrame: Corrupted symbol frequency table");
+		table.frequencies[i]=frequency;
+		table.starts[i]=start;
+		
+		/* Assign the symbol's slots of the frequency scale: */
+		for(unsigned int j=0;j<frequency;++j)
+			table.slotSymbols[start+j]=Misc::UInt16(i);
+		start+=frequency;
+		}
+	
+	/* Check that the frequencies fill the entire scale: */
+	if(start!=scale)
+		Misc::throwStdErr("Kinect::RansDepthFrameReader::readNextFrame: Corrupted symbol frequency table");
+	}
+
+RansDepthFrameReader::RansDepthFrameReader(IO::File& sSource)
+	:source(sSource),mappedSource(dynamic_cast<MappedFile*>(&sSource)),
+	 scaleBits(0),
+	 maxStreamSize(0),byteBlockSize(0),byteBlock(0)
+	{
+	/* Read the frame size from the source: */
+	for(int i=0;i<2;++i)
+		size[i]=source.read<Misc::UInt32>();
+	
+	/* Read the coding parameters from the source: */
+	scaleBits=source.read<Misc::UInt32>();
+	if(scaleBits<1||scaleBits>RansCoder::maxScaleBits)
+		Misc::throwStdErr("Kinect::RansDepthFrameReader::RansDepthFrameReader: Unsupported frequency scale of %u bits",scaleBits);
+	unsigned int numLanes=source.read<Misc::UInt32>();
+	if(numLanes!=RansCoder::numLanes)
+		Misc::throwStdErr("Kinect::RansDepthFrameReader::RansDepthFrameReader: Unsupported number of interleaved coders %u",numLanes);
+	
+	/* Create the Hilbert curve offset array: */
+	hilbertCurve.init(size);
+	
+	/* Create the symbol decoding tables: */
+	initSymbolTable(spanTable,257);
+	initSymbolTable(pixelDeltaTable,32);
+	
+	/* Calculate the worst-case size of a frame's byte stream of three symbols per pixel and two bytes per symbol: */
+	maxStreamSize=size_t(size[0])*size_t(size[1])*3*2+RansCoder::numLanes*4;
+	}
+
+RansDepthFrameReader::~RansDepthFrameReader(void)
+	{
+	delete[] byteBlock;
+	}
+
+FrameBuffer RansDepthFrameReader::readNextFrame(void)
+	{
+	/* Create the result frame: */
+	FrameBuffer result(size[0],size[1],size[0]*size[1]*sizeof(FrameSource::DepthPixel));
+	
+	/* Read the frame's time stamp from the source, and return a dummy frame if the stream is over: */
+	if(!readTimeStamp(source,result.timeStamp))
+		return result;
+	
+	/* Read the frame's symbol statistics: */
+	readFrequencies(spanTable);
+	readFrequencies(pixelDeltaTable);
+	
+	/* Read the frame's encoded byte stream: */
+	size_t streamSize=source.read<Misc::UInt32>();
+	if(streamSize>maxStreamSize)
+		Misc::throwStdErr("Kinect::RansDepthFrameReader::readNextFrame: Corrupted byte stream size");
+	const Misc::UInt8* stream=0;
+	if(mappedSource!=0)
+		{
+		/* Decode the byte stream in place: */
+		stream=mappedSource->readInPlace(streamSize);
+		}
+	if(stream==0)
+		{
+		/* Read the byte stream into the byte block: */
+		if(byteBlockSize<streamSize)
+			{
+			delete[] byteBlock;
+			byteBlockSize=streamSize;
+			byteBlock=new Misc::UInt8[byteBlockSize];
+			}
+		source.read(byteBlock,streamSize);
+		stream=byteBlock;
+		}
+	
+	/* Process all spans of the frame: */
+	RansDecoder decoder(stream,stream+streamSize);
+	FrameSource::DepthPixel* frameBuffer=static_cast<FrameSource::DepthPixel*>(result.getBuffer());
+	unsigned int numPixels=size[0]*size[1];
+	HilbertCurve::Iterator hcIt=hilbertCurve.getIterator(0);
+	while(numPixels>0)
+		{
+		/* Decode the next span symbol: */
+		unsigned int span=spanTable.slotSymbols[decoder.peek(scaleBits)];
+		decoder.advance(spanTable.starts[span],spanTable.frequencies[span],scaleBits);
+		if(span==256)
+			{
+			/******************************
+			Process a span of valid pixels:
+			******************************/
+			
+			/* Read the 11-bit raw value of the initial pixel: */
+			unsigned int pixelValue=decoder.decodeBits(11);
+			
+			/* Process the span's pixels: */
+			while(true)
+				{
+				/* Store the current pixel: */
+				frameBuffer[*hcIt]=FrameSource::DepthPixel(pixelValue);
+				++hcIt;
+				--numPixels;
+				
+				/* Decode the pixel value delta for the next pixel: */
+				unsigned int delta=pixelDeltaTable.slotSymbols[decoder.peek(scaleBits)];
+				decoder.advance(pixelDeltaTable.starts[delta],pixelDeltaTable.frequencies[delta],scaleBits);
+				if(delta==0||numPixels==0) // Zero is span-ending code; spans never extend past the end of a frame
+					break;
+				
+				/* Adjust the current pixel value: */
+				pixelValue=pixelValue+delta-16U;
+				}
+			}
+		else
+			{
+			/********************************
+			Process a span of invalid pixels:
+			********************************/
+			
+			unsigned int spanLength=span+1; // Compressor encoded spanLength-1, since 0 is impossible
+			if(spanLength>numPixels) // Spans never extend past the end of a frame
+				spanLength=numPixels;
+			while(spanLength>0)
+				{
+				/* Set the current pixel to invalid: */
+				frameBuffer[*hcIt]=FrameSource::invalidDepth;
+				++hcIt;
+				--numPixels;
+				--spanLength;
+				}
+			}
+		}
+	
+	return result;
+	}
+
+}
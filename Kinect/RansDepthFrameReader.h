@@ -0,0 +1,96 @@
+/***********************************************************************
+RansDepthFrameReader - Class to read depth frames compressed with
+interleaved rANS entropy coding from a source, and pass decompressed
+time-stamped depth frames to a client.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_RANSDEPTHFRAMEREADER_INCLUDED
+#define KINECT_RANSDEPTHFRAMEREADER_INCLUDED
+
+#include <stddef.h>
+#include <Misc/SizedTypes.h>
+#include <Kinect/HilbertCurve.h>
+#include <Kinect/FrameReader.h>
+
+/* Forward declarations: */
+namespace IO {
+class File;
+}
+namespace Kinect {
+class MappedFile;
+}
+
+namespace Kinect {
+
+class RansDepthFrameReader:public FrameReader
+	{
+	/* Embedded classes: */
+	private:
+	struct SymbolTable // Structure for a table-driven rANS symbol decoder
+		{
+		/* Elements: */
+		public:
+		unsigned int numSymbols; // Number of symbols in the table's alphabet
+		unsigned int* frequencies; // Normalized frequency of each symbol
+		unsigned int* starts; // Cumulative frequency start of each symbol
+		Misc::UInt16* slotSymbols; // Symbol owning each slot of the frequency scale
+		
+		/* Constructors and destructors: */
+		SymbolTable(void)
+			:numSymbols(0),frequencies(0),starts(0),slotSymbols(0)
+			{
+			}
+		~SymbolTable(void)
+			{
+			delete[] frequencies;
+			delete[] starts;
+			delete[] slotSymbols;
+			}
+		};
+	
+	/* Elements: */
+	private:
+	IO::File& source; // Data source for compressed depth frames
+	MappedFile* mappedSource; // Data source as a memory-mapped file from which byte streams are decoded in place, or null
+	HilbertCurve hilbertCurve; // Object to traverse depth frames in Hilbert curve order
+	unsigned int scaleBits; // Number of bits of the symbol frequency scale
+	SymbolTable spanTable; // Decoding table for span symbols
+	SymbolTable pixelDeltaTable; // Decoding table for pixel delta symbols
+	size_t maxStreamSize; // Maximum size of a frame's encoded byte stream
+	size_t byteBlockSize; // Allocated size of the byte block in bytes
+	Misc::UInt8* byteBlock; // Memory block holding the current frame's encoded byte stream
+	
+	/* Private methods: */
+	void initSymbolTable(SymbolTable& table,unsigned int numSymbols); // Allocates a decoding table for the given number of symbols
+	void readFrequencies(SymbolTable& table); // Reads normalized symbol frequencies from the source and updates the given decoding table
+	
+	/* Constructors and destructors: */
+	public:
+	RansDepthFrameReader(IO::File& sSource); // Creates a depth frame reader associated with the given data source
+	virtual ~RansDepthFrameReader(void);
+	
+	/* Methods from FrameReader: */
+	virtual FrameBuffer readNextFrame(void);
+	};
+
+}
+
+#endif
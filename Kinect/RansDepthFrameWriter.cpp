@@ -0,0 +1,287 @@
+/***********************************************************************
+RansDepthFrameWriter - Class to write depth frames to a sink, losslessly
+compressed with interleaved rANS entropy coding using per-frame symbol
+statistics.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/RansDepthFrameWriter.h>
+
+#include <IO/File.h>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/RansCoder.h>
+
+namespace Kinect {
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+void normalizeFrequencies(const size_t* counts,unsigned int numSymbols,unsigned int scaleBits,unsigned int* frequencies,unsigned int* starts)
+	{
+	/* Calculate the total number of symbol occurrences: */
+	size_t total=0;
+	for(unsigned int i=0;i<numSymbols;++i)
+		total+=counts[i];
+	
+	unsigned int scale=1U<<scaleBits;
+	if(total==0)
+		{
+		/* Assign the entire scale to the first symbol; the alphabet will not be used: */
+		frequencies[0]=scale;
+		for(unsigned int i=1;i<numSymbols;++i)
+			frequencies[i]=0;
+		}
+	else
+		{
+		/* Scale the counts to the frequency scale, keeping every occurring symbol representable: */
+		unsigned int sum=0;
+		unsigned int maxSymbol=0;
+		for(unsigned int i=0;i<numSymbols;++i)
+			{
+			frequencies[i]=(unsigned int)((counts[i]*size_t(scale))/total);
+			if(frequencies[i]==0&&counts[i]>0)
+				frequencies[i]=1;
+			sum+=frequencies[i];
+			if(frequencies[maxSymbol]<frequencies[i])
+				maxSymbol=i;
+			}
+		
+		/* Distribute the rounding error, taking frequency away from the most frequent symbols if the scale was overrun: */
+		if(sum<scale)
+			frequencies[maxSymbol]+=scale-sum;
+		while(sum>scale)
+			{
+			for(unsigned int i=0;i<numSymbols;++i)
+				if(frequencies[maxSymbol]<frequencies[i])
+					maxSymbol=i;
+			unsigned int excess=sum-scale;
+			unsigned int reduction=frequencies[maxSymbol]/2;
+			if(reduction>excess)
+				reduction=excess;
+			frequencies[maxSymbol]-=reduction;
+			sum-=reduction;
+			}
+		}
+	
+	/* Calculate cumulative frequency starts: */
+	unsigned int start=0;
+	for(unsigned int i=0;i<numSymbols;++i)
+		{
+		starts[i]=start;
+		start+=frequencies[i];
+		}
+	}
+
+}
+
+/*************************************
+Methods of class RansDepthFrameWriter:
+*************************************/
+
+size_t RansDepthFrameWriter::modelFrame(const FrameSource::DepthPixel* frameBuffer)
+	{
+	/* Reset the symbol counters: */
+	for(unsigned int i=0;i<spanNumSymbols;++i)
+		spanCounts[i]=0;
+	for(unsigned int i=0;i<pixelDeltaNumSymbols;++i)
+		pixelDeltaCounts[i]=0;
+	
+	/* Traverse the frame in Hilbert curve order: */
+	Symbol* sPtr=symbols;
+	unsigned int numPixels=size[0]*size[1];
+	HilbertCurve::Iterator hcIt=hilbertCurve.getIterator(0);
+	while(numPixels>0)
+		{
+		/* Check if the next span is valid or invalid: */
+		if(frameBuffer[*hcIt]!=FrameSource::invalidDepth)
+			{
+			/******************************
+			Process a span of valid pixels:
+			******************************/
+			
+			/* Emit the span header and the raw initial pixel value: */
+			Misc::UInt32 pixelValue=frameBuffer[*hcIt];
+			sPtr->alphabet=0;
+			sPtr->value=spanNumSymbols-1;
+			++sPtr;
+			++spanCounts[spanNumSymbols-1];
+			sPtr->alphabet=1;
+			sPtr->value=Misc::UInt16(pixelValue);
+			++sPtr;
+			
+			/* Emit the rest of pixels in the span: */
+			++hcIt;
+			--numPixels;
+			while(numPixels>0&&int(frameBuffer[*hcIt])>=int(pixelValue)-15&&int(frameBuffer[*hcIt])<=int(pixelValue)+15)
+				{
+				/* Emit the pixel value delta: */
+				unsigned int delta=(unsigned int)(int(frameBuffer[*hcIt])+16-int(pixelValue));
+				sPtr->alphabet=2;
+				sPtr->value=Misc::UInt16(delta);
+				++sPtr;
+				++pixelDeltaCounts[delta];
+				
+				pixelValue=frameBuffer[*hcIt];
+				++hcIt;
+				--numPixels;
+				}
+			
+			/* Emit the span terminator: */
+			sPtr->alphabet=2;
+			sPtr->value=0;
+			++sPtr;
+			++pixelDeltaCounts[0];
+			}
+		else
+			{
+			/********************************
+			Process a span of invalid pixels:
+			********************************/
+			
+			/* Skip all following invalid pixels: */
+			++hcIt;
+			--numPixels;
+			unsigned int spanLength=1;
+			while(numPixels>0&&frameBuffer[*hcIt]==FrameSource::invalidDepth&&spanLength<256)
+				{
+				++hcIt;
+				--numPixels;
+				++spanLength;
+				}
+			
+			/* Emit the span length minus 1: */
+			sPtr->alphabet=0;
+			sPtr->value=Misc::UInt16(spanLength-1);
+			++sPtr;
+			++spanCounts[spanLength-1];
+			}
+		}
+	
+	return size_t(sPtr-symbols);
+	}
+
+size_t RansDepthFrameWriter::writeFrequencies(const unsigned int* frequencies,unsigned int numSymbols)
+	{
+	/* Write each frequency as one byte if it is less than 128, and as two bytes otherwise: */
+	size_t writtenSize=0;
+	for(unsigned int i=0;i<numSymbols;++i)
+		{
+		if(frequencies[i]<0x80U)
+			{
+			sink.write<Misc::UInt8>(frequencies[i]);
+			writtenSize+=1;
+			}
+		else
+			{
+			sink.write<Misc::UInt8>(0x80U|(frequencies[i]>>8));
+			sink.write<Misc::UInt8>(frequencies[i]&0xffU);
+			writtenSize+=2;
+			}
+		}
+	
+	return writtenSize;
+	}
+
+RansDepthFrameWriter::RansDepthFrameWriter(IO::File& sSink,const unsigned int sSize[2])
+	:FrameWriter(sSize),
+	 sink(sSink),
+	 symbols(0),
+	 byteBlockSize(0),byteBlock(0)
+	{
+	/* Allocate the symbol stream for the worst case of three symbols per pixel: */
+	size_t numPixels=size_t(size[0])*size_t(size[1]);
+	symbols=new Symbol[numPixels*3];
+	
+	/* Allocate the byte block for the worst case of two bytes per symbol, plus the final coder states: */
+	byteBlockSize=numPixels*3*2+RansCoder::numLanes*4;
+	byteBlock=new Misc::UInt8[byteBlockSize];
+	
+	/* Create the Hilbert curve offset array: */
+	hilbertCurve.init(size);
+	
+	/* Write the frame size to the sink: */
+	for(int i=0;i<2;++i)
+		sink.write<Misc::UInt32>(size[i]);
+	
+	/* Write the coding parameters to the sink: */
+	unsigned int sb=scaleBits;
+	sink.write<Misc::UInt32>(sb);
+	unsigned int nl=RansCoder::numLanes;
+	sink.write<Misc::UInt32>(nl);
+	}
+
+RansDepthFrameWriter::~RansDepthFrameWriter(void)
+	{
+	delete[] symbols;
+	delete[] byteBlock;
+	}
+
+size_t RansDepthFrameWriter::writeFrame(const FrameBuffer& frame)
+	{
+	size_t compressedSize=0;
+	
+	/* Write the frame's time stamp: */
+	sink.write<Misc::Float64>(frame.timeStamp);
+	compressedSize+=sizeof(Misc::Float64);
+	
+	/* Convert the frame into a symbol stream and build the frame's symbol statistics: */
+	size_t numSymbols=modelFrame(static_cast<const FrameSource::DepthPixel*>(frame.getBuffer()));
+	normalizeFrequencies(spanCounts,spanNumSymbols,scaleBits,spanFrequencies,spanStarts);
+	normalizeFrequencies(pixelDeltaCounts,pixelDeltaNumSymbols,scaleBits,pixelDeltaFrequencies,pixelDeltaStarts);
+	
+	/* Write the symbol statistics: */
+	compressedSize+=writeFrequencies(spanFrequencies,spanNumSymbols);
+	compressedSize+=writeFrequencies(pixelDeltaFrequencies,pixelDeltaNumSymbols);
+	
+	/* Encode the symbol stream back to front: */
+	RansEncoder encoder(byteBlock+byteBlockSize,numSymbols);
+	for(const Symbol* sPtr=symbols+numSymbols;sPtr!=symbols;)
+		{
+		--sPtr;
+		switch(sPtr->alphabet)
+			{
+			case 0:
+				encoder.encode(spanStarts[sPtr->value],spanFrequencies[sPtr->value],scaleBits);
+				break;
+			
+			case 1:
+				encoder.encodeBits(sPtr->value,pixelValueBits);
+				break;
+			
+			case 2:
+				encoder.encode(pixelDeltaStarts[sPtr->value],pixelDeltaFrequencies[sPtr->value],scaleBits);
+				break;
+			}
+		}
+	Misc::UInt8* streamStart=encoder.flush();
+	
+	/* Write the encoded byte stream: */
+	Misc::UInt32 streamSize=Misc::UInt32((byteBlock+byteBlockSize)-streamStart);
+	sink.write<Misc::UInt32>(streamSize);
+	sink.write(streamStart,streamSize);
+	compressedSize+=sizeof(Misc::UInt32)+streamSize;
+	
+	return compressedSize;
+	}
+
+}
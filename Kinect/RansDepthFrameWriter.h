@@ -0,0 +1,87 @@
+/***********************************************************************
+RansDepthFrameWriter - Class to write depth frames to a sink, losslessly
+compressed with interleaved rANS entropy coding using per-frame symbol
+statistics.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_RANSDEPTHFRAMEWRITER_INCLUDED
+#define KINECT_RANSDEPTHFRAMEWRITER_INCLUDED
+
+#include <stddef.h>
+#include <Misc/SizedTypes.h>
+#include <Kinect/HilbertCurve.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/FrameWriter.h>
+
+/* Forward declarations: */
+namespace IO {
+class File;
+}
+
+namespace Kinect {
+
+class RansDepthFrameWriter:public FrameWriter
+	{
+	/* Embedded classes: */
+	private:
+	struct Symbol // Structure for a symbol in a frame's symbol stream
+		{
+		/* Elements: */
+		public:
+		Misc::UInt16 alphabet; // Alphabet from which the symbol was drawn
+		Misc::UInt16 value; // Symbol value
+		};
+	
+	/* Elements: */
+	public:
+	static const unsigned int scaleBits=12; // Number of bits of the symbol frequency scale
+	static const unsigned int spanNumSymbols=257; // Number of span symbols; 0-255 start invalid spans of length 1-256, 256 starts a valid span
+	static const unsigned int pixelDeltaNumSymbols=32; // Number of pixel delta symbols; 0 ends a valid span, 1-31 are deltas from -15 to 15 plus 16
+	static const unsigned int pixelValueBits=11; // Number of bits of the raw initial pixel value of a valid span
+	private:
+	IO::File& sink; // Data sink for the compressed depth frame stream
+	HilbertCurve hilbertCurve; // Object to traverse depth frames in Hilbert curve order
+	Symbol* symbols; // Symbol stream of the current frame
+	size_t spanCounts[spanNumSymbols]; // Number of occurrences of each span symbol in the current frame
+	size_t pixelDeltaCounts[pixelDeltaNumSymbols]; // Number of occurrences of each pixel delta symbol in the current frame
+	unsigned int spanFrequencies[spanNumSymbols]; // Normalized frequencies of the span symbols in the current frame
+	unsigned int spanStarts[spanNumSymbols]; // Cumulative frequency starts of the span symbols
+	unsigned int pixelDeltaFrequencies[pixelDeltaNumSymbols]; // Normalized frequencies of the pixel delta symbols in the current frame
+	unsigned int pixelDeltaStarts[pixelDeltaNumSymbols]; // Cumulative frequency starts of the pixel delta symbols
+	size_t byteBlockSize; // Size of the byte block in bytes
+	Misc::UInt8* byteBlock; // Memory block receiving the encoded byte stream of a frame
+	
+	/* Private methods: */
+	size_t modelFrame(const FrameSource::DepthPixel* frameBuffer); // Converts the given frame into a symbol stream and counts symbol occurrences; returns the number of symbols
+	size_t writeFrequencies(const unsigned int* frequencies,unsigned int numSymbols); // Writes the given normalized symbol frequencies to the sink; returns size of written data in bytes
+	
+	/* Constructors and destructors: */
+	public:
+	RansDepthFrameWriter(IO::File& sSink,const unsigned int sSize[2]); // Creates a depth frame writer for the given sink and frame size
+	virtual ~RansDepthFrameWriter(void);
+	
+	/* Methods from FrameWriter: */
+	virtual size_t writeFrame(const FrameBuffer& frame);
+	};
+
+}
+
+#endif
@@ -0,0 +1,322 @@
+/***********************************************************************
+RawDepthUnpacker - Class to convert raw 11-bit packed depth frames as
+streamed by the Kinect's depth camera into 16-bit depth frames, while
+flipping them vertically and optionally capturing or removing a
+background frame in the same pass.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/RawDepthUnpacker.h>
+
+#include <string.h>
+#include <Misc/ThrowStdErr.h>
+
+#define KINECT_RAWDEPTHUNPACKER_USE_SIMD 1
+
+#if KINECT_RAWDEPTHUNPACKER_USE_SIMD&&defined(__GNUC__)&&(defined(__i386__)||defined(__x86_64__))
+#define KINECT_RAWDEPTHUNPACKER_HAVE_X86 1
+#include <immintrin.h>
+#else
+#define KINECT_RAWDEPTHUNPACKER_HAVE_X86 0
+#endif
+
+namespace Kinect {
+
+namespace {
+
+/***********************************************************************
+Helper functions to unpack one row of raw depth pixels. All functions
+read width*11/8 bytes from the source row, write width pixels to the
+destination row, and access width background pixels. If the source row
+is not the last in its frame, the vectorized functions may read up to
+16 bytes past the end of the row, which is why they receive the end of
+the entire raw frame.
+***********************************************************************/
+
+typedef Misc::UInt8 Byte;
+typedef FrameSource::DepthPixel DepthPixel;
+
+void unpackRowScalar(const Byte* sPtr,const Byte* sEnd,DepthPixel* dPtr,DepthPixel* bfPtr,unsigned int width,bool captureBackground,bool removeBackground,int backgroundRemovalFuzz)
+	{
+	/* Process pixels in groups of eight: */
+	for(unsigned int x=0;x<width;x+=8,sPtr+=11,dPtr+=8,bfPtr+=8)
+		{
+		/* Convert a run of 11 8-bit bytes into 8 11-bit pixels: */
+		dPtr[0]=(DepthPixel(sPtr[0])<<3)|(DepthPixel(sPtr[1])>>5);
+		dPtr[1]=((DepthPixel(sPtr[1])&0x1fU)<<6)|(DepthPixel(sPtr[2])>>2);
+		dPtr[2]=((DepthPixel(sPtr[2])&0x03U)<<9)|(DepthPixel(sPtr[3])<<1)|(DepthPixel(sPtr[4])>>7);
+		dPtr[3]=((DepthPixel(sPtr[4])&0x7fU)<<4)|(DepthPixel(sPtr[5])>>4);
+		dPtr[4]=((DepthPixel(sPtr[5])&0x0fU)<<7)|(DepthPixel(sPtr[6])>>1);
+		dPtr[5]=((DepthPixel(sPtr[6])&0x01U)<<10)|(DepthPixel(sPtr[7])<<2)|(DepthPixel(sPtr[8])>>6);
+		dPtr[6]=((DepthPixel(sPtr[8])&0x3fU)<<5)|(DepthPixel(sPtr[9])>>3);
+		dPtr[7]=((DepthPixel(sPtr[9])&0x07U)<<8)|DepthPixel(sPtr[10]);
+		
+		/* Check if we're in the middle of capturing a background frame: */
+		if(captureBackground)
+			{
+			/* Update the pixels' background depth values: */
+			for(int i=0;i<8;++i)
+				if(bfPtr[i]>dPtr[i])
+					bfPtr[i]=dPtr[i];
+			}
+		
+		if(removeBackground)
+			{
+			/* Remove background pixels: */
+			for(int i=0;i<8;++i)
+				if(dPtr[i]+backgroundRemovalFuzz>=bfPtr[i])
+					dPtr[i]=FrameSource::invalidDepth; // Mark the pixel as really far away
+			}
+		}
+	}
+
+#if KINECT_RAWDEPTHUNPACKER_HAVE_X86
+
+/***********************************************************************
+The background removal test d+fuzz>=bf is evaluated on unsigned 16-bit
+lanes without overflow by moving the fuzz value to whichever side of the
+comparison keeps it non-negative, and by using saturating arithmetic.
+Since unpacked depth values are at most 2047, d+fuzz never saturates,
+and if bf-fuzz saturates, the test correctly fails. Unsigned a>=b is
+then equivalent to subs_epu16(b,a)==0.
+***********************************************************************/
+
+inline void splitFuzz(int backgroundRemovalFuzz,unsigned int& depthFuzz,unsigned int& backgroundFuzz)
+	{
+	if(backgroundRemovalFuzz>=0)
+		{
+		depthFuzz=(unsigned int)backgroundRemovalFuzz;
+		backgroundFuzz=0U;
+		}
+	else
+		{
+		depthFuzz=0U;
+		backgroundFuzz=(unsigned int)(-backgroundRemovalFuzz);
+		}
+	}
+
+inline Misc::UInt64 loadBigEndian64(const Byte* sPtr)
+	{
+	Misc::UInt64 result;
+	memcpy(&result,sPtr,sizeof(Misc::UInt64));
+	return __builtin_bswap64(result);
+	}
+
+__attribute__((target("sse2")))
+void unpackRowSSE2(const Byte* sPtr,const Byte* sEnd,DepthPixel* dPtr,DepthPixel* bfPtr,unsigned int width,bool captureBackground,bool removeBackground,int backgroundRemovalFuzz)
+	{
+	unsigned int depthFuzz,backgroundFuzz;
+	splitFuzz(backgroundRemovalFuzz,depthFuzz,backgroundFuzz);
+	const __m128i zero=_mm_setzero_si128();
+	const __m128i invalid=_mm_set1_epi16(short(FrameSource::invalidDepth));
+	const __m128i dFuzz=_mm_set1_epi16(short(depthFuzz));
+	const __m128i bFuzz=_mm_set1_epi16(short(backgroundFuzz));
+	
+	/* Process pixels in groups of eight: */
+	for(unsigned int x=0;x<width;x+=8,sPtr+=11,dPtr+=8,bfPtr+=8)
+		{
+		/* Extract pixels 0-4 from the first eight bytes, and pixels 5-7 from the last eight bytes of the group: */
+		Misc::UInt64 b0=loadBigEndian64(sPtr);
+		Misc::UInt64 b1=loadBigEndian64(sPtr+3);
+		Misc::UInt64 lo=((b0>>53)&0x7ffU)|(((b0>>42)&0x7ffU)<<16)|(((b0>>31)&0x7ffU)<<32)|(((b0>>20)&0x7ffU)<<48);
+		Misc::UInt64 hi=((b0>>9)&0x7ffU)|(((b1>>22)&0x7ffU)<<16)|(((b1>>11)&0x7ffU)<<32)|((b1&0x7ffU)<<48);
+		__m128i d=_mm_set_epi64x((long long)hi,(long long)lo);
+		
+		if(captureBackground||removeBackground)
+			{
+			__m128i bf=_mm_loadu_si128(reinterpret_cast<const __m128i*>(bfPtr));
+			
+			if(captureBackground)
+				{
+				/* Update the pixels' background depth values using unsigned minimum: */
+				bf=_mm_sub_epi16(bf,_mm_subs_epu16(bf,d));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(bfPtr),bf);
+				}
+			
+			if(removeBackground)
+				{
+				/* Remove background pixels: */
+				__m128i mask=_mm_cmpeq_epi16(_mm_subs_epu16(_mm_adds_epu16(bf,bFuzz),_mm_adds_epu16(d,dFuzz)),zero);
+				d=_mm_or_si128(_mm_andnot_si128(mask,d),_mm_and_si128(mask,invalid));
+				}
+			}
+		
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dPtr),d);
+		}
+	}
+
+__attribute__((target("avx2")))
+void unpackRowAVX2(const Byte* sPtr,const Byte* sEnd,DepthPixel* dPtr,DepthPixel* bfPtr,unsigned int width,bool captureBackground,bool removeBackground,int backgroundRemovalFuzz)
+	{
+	unsigned int depthFuzz,backgroundFuzz;
+	splitFuzz(backgroundRemovalFuzz,depthFuzz,backgroundFuzz);
+	const __m256i zero=_mm256_setzero_si256();
+	const __m256i invalid=_mm256_set1_epi16(short(FrameSource::invalidDepth));
+	const __m256i dFuzz=_mm256_set1_epi16(short(depthFuzz));
+	const __m256i bFuzz=_mm256_set1_epi16(short(backgroundFuzz));
+	
+	/* Shuffle pattern moving the three bytes containing each pixel of a group into one little-endian 32-bit lane: */
+	const __m256i gather=_mm256_setr_epi8(2,1,0,-128,3,2,1,-128,4,3,2,-128,6,5,4,-128,
+	                                      7,6,5,-128,8,7,6,-128,10,9,8,-128,11,10,9,-128);
+	const __m256i shifts=_mm256_setr_epi32(13,10,7,12,9,6,11,8);
+	const __m256i pixelMask=_mm256_set1_epi32(0x7ff);
+	
+	/* Process pixels in groups of sixteen while the 16-byte loads stay inside the raw frame: */
+	unsigned int x=0;
+	for(;x+16<=width&&sPtr+27<=sEnd;x+=16,sPtr+=22,dPtr+=16,bfPtr+=16)
+		{
+		/* Unpack two groups of eight pixels into 32-bit lanes: */
+		__m256i g0=_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sPtr)));
+		__m256i g1=_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sPtr+11)));
+		g0=_mm256_and_si256(_mm256_srlv_epi32(_mm256_shuffle_epi8(g0,gather),shifts),pixelMask);
+		g1=_mm256_and_si256(_mm256_srlv_epi32(_mm256_shuffle_epi8(g1,gather),shifts),pixelMask);
+		
+		/* Pack the 32-bit lanes into sixteen 16-bit pixels and restore pixel order across 128-bit lanes: */
+		__m256i d=_mm256_permute4x64_epi64(_mm256_packus_epi32(g0,g1),0xd8);
+		
+		if(captureBackground||removeBackground)
+			{
+			__m256i bf=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bfPtr));
+			
+			if(captureBackground)
+				{
+				/* Update the pixels' background depth values: */
+				bf=_mm256_min_epu16(bf,d);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(bfPtr),bf);
+				}
+			
+			if(removeBackground)
+				{
+				/* Remove background pixels: */
+				__m256i mask=_mm256_cmpeq_epi16(_mm256_subs_epu16(_mm256_adds_epu16(bf,bFuzz),_mm256_adds_epu16(d,dFuzz)),zero);
+				d=_mm256_blendv_epi8(d,invalid,mask);
+				}
+			}
+		
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dPtr),d);
+		}
+	
+	/* Process the remaining groups with the SSE2 kernel, which does not read past its groups: */
+	if(x<width)
+		unpackRowSSE2(sPtr,sEnd,dPtr,bfPtr,width-x,captureBackground,removeBackground,backgroundRemovalFuzz);
+	}
+
+#endif
+
+typedef void (*RowUnpacker)(const Byte*,const Byte*,DepthPixel*,DepthPixel*,unsigned int,bool,bool,int);
+
+RowUnpacker getRowUnpacker(RawDepthUnpacker::Kernel kernel)
+	{
+	switch(kernel)
+		{
+		#if KINECT_RAWDEPTHUNPACKER_HAVE_X86
+		case RawDepthUnpacker::SSE2:
+			return unpackRowSSE2;
+		
+		case RawDepthUnpacker::AVX2:
+			return unpackRowAVX2;
+		#endif
+		
+		default:
+			return unpackRowScalar;
+		}
+	}
+
+}
+
+/*********************************
+Methods of class RawDepthUnpacker:
+*********************************/
+
+RawDepthUnpacker::RawDepthUnpacker(const unsigned int sFrameSize[2])
+	:kernel(getBestKernel())
+	{
+	/* Copy the frame size: */
+	for(int i=0;i<2;++i)
+		frameSize[i]=sFrameSize[i];
+	}
+
+bool RawDepthUnpacker::isSupported(RawDepthUnpacker::Kernel kernel)
+	{
+	switch(kernel)
+		{
+		case SCALAR:
+			return true;
+		
+		#if KINECT_RAWDEPTHUNPACKER_HAVE_X86
+		case SSE2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse2");
+		
+		case AVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+		#endif
+		
+		default:
+			return false;
+		}
+	}
+
+RawDepthUnpacker::Kernel RawDepthUnpacker::getBestKernel(void)
+	{
+	/* Return the first supported kernel, starting from the fastest: */
+	int result;
+	for(result=NUM_KERNELS-1;result>SCALAR&&!isSupported(Kernel(result));--result)
+		;
+	return Kernel(result);
+	}
+
+const char* RawDepthUnpacker::getKernelName(RawDepthUnpacker::Kernel kernel)
+	{
+	static const char* kernelNames[NUM_KERNELS]={"Scalar","SSE2","AVX2"};
+	return kernel>=SCALAR&&kernel<NUM_KERNELS?kernelNames[kernel]:"Invalid";
+	}
+
+void RawDepthUnpacker::setKernel(RawDepthUnpacker::Kernel newKernel)
+	{
+	if(!isSupported(newKernel))
+		Misc::throwStdErr("Kinect::RawDepthUnpacker::setKernel: Kernel %s is not supported",getKernelName(newKernel));
+	kernel=newKernel;
+	}
+
+void RawDepthUnpacker::unpackFrame(const Misc::UInt8* rawFrame,RawDepthUnpacker::DepthPixel* frame,RawDepthUnpacker::DepthPixel* backgroundFrame,bool captureBackground,bool removeBackground,int backgroundRemovalFuzz) const
+	{
+	RowUnpacker unpackRow=getRowUnpacker(kernel);
+	
+	/* Background processing requires a background frame: */
+	if(backgroundFrame==0)
+		captureBackground=removeBackground=false;
+	
+	/* Process rows: */
+	size_t rawRowSize=(frameSize[0]*11)/8;
+	const Byte* sPtr=rawFrame;
+	const Byte* sEnd=rawFrame+rawRowSize*frameSize[1];
+	DepthPixel* dRowPtr=frame+frameSize[0]*(frameSize[1]-1);
+	DepthPixel* bfPtr=backgroundFrame;
+	for(unsigned int y=0;y<frameSize[1];++y,sPtr+=rawRowSize,dRowPtr-=frameSize[0]) // Flip the depth image vertically
+		{
+		unpackRow(sPtr,sEnd,dRowPtr,bfPtr,frameSize[0],captureBackground,removeBackground,backgroundRemovalFuzz);
+		if(bfPtr!=0)
+			bfPtr+=frameSize[0];
+		}
+	}
+
+}
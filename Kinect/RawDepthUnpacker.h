@@ -0,0 +1,71 @@
+/***********************************************************************
+RawDepthUnpacker - Class to convert raw 11-bit packed depth frames as
+streamed by the Kinect's depth camera into 16-bit depth frames, while
+flipping them vertically and optionally capturing or removing a
+background frame in the same pass.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_RAWDEPTHUNPACKER_INCLUDED
+#define KINECT_RAWDEPTHUNPACKER_INCLUDED
+
+#include <Misc/SizedTypes.h>
+#include <Kinect/FrameSource.h>
+
+namespace Kinect {
+
+class RawDepthUnpacker
+	{
+	/* Embedded classes: */
+	public:
+	typedef FrameSource::DepthPixel DepthPixel; // Type for unpacked depth pixels
+	
+	enum Kernel // Enumerated type for implementations of the unpacking kernel
+		{
+		SCALAR=0, // Portable reference implementation
+		SSE2, // 64-bit bit extraction with SSE2 background processing
+		AVX2, // Fully vectorized AVX2 implementation processing 16 pixels at a time
+		NUM_KERNELS
+		};
+	
+	/* Elements: */
+	private:
+	unsigned int frameSize[2]; // Width and height of unpacked depth frames; width must be a multiple of 8
+	Kernel kernel; // Kernel used to unpack frames
+	
+	/* Constructors and destructors: */
+	public:
+	RawDepthUnpacker(const unsigned int sFrameSize[2]); // Creates an unpacker for the given frame size using the fastest kernel supported by the host CPU
+	
+	/* Methods: */
+	static bool isSupported(Kernel kernel); // Returns true if the given kernel can be used on the host CPU
+	static Kernel getBestKernel(void); // Returns the fastest kernel supported by the host CPU
+	static const char* getKernelName(Kernel kernel); // Returns a human-readable name for the given kernel
+	Kernel getKernel(void) const // Returns the kernel currently used to unpack frames
+		{
+		return kernel;
+		}
+	void setKernel(Kernel newKernel); // Selects the kernel used to unpack frames; throws exception if kernel is not supported by the host CPU
+	void unpackFrame(const Misc::UInt8* rawFrame,DepthPixel* frame,DepthPixel* backgroundFrame,bool captureBackground,bool removeBackground,int backgroundRemovalFuzz) const; // Unpacks the given raw frame into the given depth frame, flipping it vertically; updates the given background frame with per-pixel minima if captureBackground is true, and invalidates background pixels if removeBackground is true
+	};
+
+}
+
+#endif
@@ -0,0 +1,270 @@
+/***********************************************************************
+RecordingFile - Class for write-only files receiving recorded color or
+depth streams, which collect written data in large aligned blocks and
+write them to disk asynchronously, bypassing the page cache.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/RecordingFile.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <new>
+#include <stdexcept>
+#include <Misc/ThrowStdErr.h>
+
+namespace Kinect {
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+int writeFully(int fd,const void* data,size_t size,off_t offset) // Writes the given data at the given file offset; returns 0 or an error code
+	{
+	const char* dataPtr=static_cast<const char*>(data);
+	while(size>0)
+		{
+		ssize_t written=pwrite(fd,dataPtr,size,offset);
+		if(written<0)
+			{
+			if(errno==EINTR)
+				continue;
+			return errno;
+			}
+		dataPtr+=written;
+		size-=size_t(written);
+		offset+=off_t(written);
+		}
+	return 0;
+	}
+
+}
+
+/******************************
+Methods of class RecordingFile:
+******************************/
+
+void* RecordingFile::blockWritingThreadMethod(void)
+	{
+	unsigned int writeBlock=0;
+	while(true)
+		{
+		/* Wait until the next block is full: */
+		{
+		Threads::MutexCond::Lock blockLock(blockCond);
+		while(!shutdown&&!blocks[writeBlock].full)
+			blockCond.wait(blockLock);
+		
+		/* Bail out if there are no more blocks: */
+		if(!blocks[writeBlock].full)
+			break;
+		}
+		
+		/* Extend the file's allocated disk space ahead of the written data to keep it contiguous: */
+		Block& block=blocks[writeBlock];
+		if(writeOffset+off_t(block.size)>preallocatedSize)
+			{
+			#ifdef FALLOC_FL_KEEP_SIZE
+			fallocate(fd,FALLOC_FL_KEEP_SIZE,preallocatedSize,preallocationSize);
+			#endif
+			preallocatedSize+=preallocationSize;
+			}
+		
+		/* Write the block unless an earlier write failed: */
+		if(writeErrno==0)
+			{
+			writeErrno=writeFully(fd,block.data,block.size,writeOffset);
+			
+			/* Drop the written data from the page cache if the file does not bypass it, which only works once the data is on disk: */
+			if(!direct&&writeErrno==0)
+				{
+				if(fdatasync(fd)==0)
+					posix_fadvise(fd,writeOffset,off_t(block.size),POSIX_FADV_DONTNEED);
+				else
+					writeErrno=errno;
+				}
+			}
+		writeOffset+=off_t(block.size);
+		
+		/* Return the block to the writer: */
+		{
+		Threads::MutexCond::Lock blockLock(blockCond);
+		block.size=0;
+		block.full=false;
+		blockCond.broadcast();
+		}
+		
+		writeBlock=(writeBlock+1)%numBlocks;
+		}
+	
+	return 0;
+	}
+
+void RecordingFile::submitFillBlock(void)
+	{
+	Threads::MutexCond::Lock blockLock(blockCond);
+	
+	/* Hand the fill block to the block writing thread: */
+	blocks[fillBlock].full=true;
+	blockCond.broadcast();
+	
+	/* Wait until the next block has been written: */
+	fillBlock=(fillBlock+1)%numBlocks;
+	while(blocks[fillBlock].full)
+		blockCond.wait(blockLock);
+	
+	/* Report errors from the block writing thread: */
+	if(writeErrno!=0)
+		Misc::throwStdErr("Kinect::RecordingFile: Error %s while writing to file",strerror(writeErrno));
+	}
+
+void RecordingFile::finishWriting(void)
+	{
+	/* Wait until all full blocks have been written, and shut down the block writing thread: */
+	{
+	Threads::MutexCond::Lock blockLock(blockCond);
+	shutdown=true;
+	blockCond.broadcast();
+	}
+	blockWritingThread.join();
+	
+	/* Write the partial fill block without direct I/O, since its size is not aligned: */
+	Block& block=blocks[fillBlock];
+	if(block.size>0&&writeErrno==0)
+		{
+		if(direct)
+			fcntl(fd,F_SETFL,fcntl(fd,F_GETFL)&~O_DIRECT);
+		writeErrno=writeFully(fd,block.data,block.size,writeOffset);
+		writeOffset+=off_t(block.size);
+		}
+	block.size=0;
+	
+	/* Release disk space allocated beyond the end of the written data, and wait until all data is on disk to catch delayed write errors: */
+	if(ftruncate(fd,writeOffset)!=0&&writeErrno==0)
+		writeErrno=errno;
+	if(fdatasync(fd)!=0&&writeErrno==0)
+		writeErrno=errno;
+	if(::close(fd)!=0&&writeErrno==0)
+		writeErrno=errno;
+	fd=-1;
+	}
+
+void RecordingFile::writeData(const IO::File::Byte* buffer,size_t bufferSize)
+	{
+	if(fd<0)
+		Misc::throwStdErr("Kinect::RecordingFile: Attempt to write to closed file");
+	
+	while(bufferSize>0)
+		{
+		/* Copy as much data as fits into the fill block: */
+		Block& block=blocks[fillBlock];
+		size_t copySize=blockSize-block.size;
+		if(copySize>bufferSize)
+			copySize=bufferSize;
+		memcpy(block.data+block.size,buffer,copySize);
+		block.size+=copySize;
+		buffer+=copySize;
+		bufferSize-=copySize;
+		
+		/* Write the fill block once it is full: */
+		if(block.size==blockSize)
+			submitFillBlock();
+		}
+	}
+
+RecordingFile::RecordingFile(const char* fileName,size_t sBlockSize)
+	:IO::File(),
+	 fd(-1),direct(true),
+	 blockSize((sBlockSize+alignment-1)&~(alignment-1)),
+	 preallocationSize(off_t(blockSize)*16),
+	 fillBlock(0),
+	 shutdown(false),writeErrno(0),
+	 writeOffset(0),preallocatedSize(0)
+	{
+	/* Open the file for direct I/O, and fall back to regular I/O if the file system does not support it: */
+	fd=open(fileName,O_WRONLY|O_CREAT|O_TRUNC|O_DIRECT,0666);
+	if(fd<0&&errno==EINVAL)
+		{
+		fd=open(fileName,O_WRONLY|O_CREAT|O_TRUNC,0666);
+		direct=false;
+		}
+	if(fd<0)
+		Misc::throwStdErr("Kinect::RecordingFile: Unable to open file %s due to error %s",fileName,strerror(errno));
+	
+	/* Allocate the aligned blocks: */
+	for(unsigned int i=0;i<numBlocks;++i)
+		{
+		void* data=0;
+		if(posix_memalign(&data,alignment,blockSize)!=0)
+			{
+			for(unsigned int j=0;j<i;++j)
+				free(blocks[j].data);
+			::close(fd);
+			throw std::bad_alloc();
+			}
+		blocks[i].data=static_cast<Byte*>(data);
+		blocks[i].size=0;
+		blocks[i].full=false;
+		}
+	
+	/* Start the block writing thread: */
+	blockWritingThread.start(this,&RecordingFile::blockWritingThreadMethod);
+	}
+
+RecordingFile::~RecordingFile(void)
+	{
+	if(fd>=0)
+		{
+		/* Write all remaining data; errors can only be reported by an explicit close: */
+		try
+			{
+			flush();
+			}
+		catch(std::runtime_error)
+			{
+			}
+		finishWriting();
+		}
+	
+	/* Release the blocks: */
+	for(unsigned int i=0;i<numBlocks;++i)
+		free(blocks[i].data);
+	}
+
+void RecordingFile::close(void)
+	{
+	if(fd<0)
+		return;
+	
+	/* Move all buffered data into the fill block, and write all remaining data: */
+	flush();
+	finishWriting();
+	
+	/* Report errors from writing the final blocks or closing the file: */
+	if(writeErrno!=0)
+		Misc::throwStdErr("Kinect::RecordingFile::close: Error %s while writing to file",strerror(writeErrno));
+	}
+
+}
@@ -0,0 +1,91 @@
+/***********************************************************************
+RecordingFile - Class for write-only files receiving recorded color or
+depth streams, which collect written data in large aligned blocks and
+write them to disk asynchronously, bypassing the page cache.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_RECORDINGFILE_INCLUDED
+#define KINECT_RECORDINGFILE_INCLUDED
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <IO/File.h>
+#include <Threads/MutexCond.h>
+#include <Threads/Thread.h>
+
+namespace Kinect {
+
+class RecordingFile:public IO::File
+	{
+	/* Embedded classes: */
+	private:
+	struct Block // Structure for an aligned memory block collecting written data
+		{
+		/* Elements: */
+		public:
+		Byte* data; // Aligned memory block
+		size_t size; // Amount of data in the block
+		bool full; // Flag whether the block is waiting to be written to disk
+		};
+	
+	/* Elements: */
+	public:
+	static const size_t alignment=4096; // Alignment of block addresses, sizes, and file offsets required for direct I/O
+	private:
+	static const unsigned int numBlocks=2; // Number of blocks; one is filled while the others are written to disk
+	int fd; // File descriptor of the opened file, or -1 once the file is closed
+	bool direct; // Flag whether the file was opened for direct I/O
+	size_t blockSize; // Size of each block in bytes, a multiple of the alignment
+	off_t preallocationSize; // Amount by which to extend the file's allocated disk space ahead of the written data
+	Block blocks[numBlocks]; // Ring of blocks
+	unsigned int fillBlock; // Index of the block currently receiving written data
+	Threads::MutexCond blockCond; // Condition variable to signal full or emptied blocks; also protects the block states
+	bool shutdown; // Flag to shut down the block writing thread
+	int writeErrno; // Error code of the first failed write in the block writing thread, or 0
+	off_t writeOffset; // File offset of the next block to be written
+	off_t preallocatedSize; // Size of the disk space allocated for the file so far
+	Threads::Thread blockWritingThread; // Thread writing full blocks to disk
+	
+	/* Private methods: */
+	void* blockWritingThreadMethod(void); // Thread method writing full blocks to disk in order
+	void submitFillBlock(void); // Queues the current fill block for writing and waits for the next block to become available
+	void finishWriting(void); // Writes all full blocks and the partial fill block, shuts down the block writing thread, and closes the file; records errors in writeErrno
+	
+	/* Protected methods from IO::File: */
+	protected:
+	virtual void writeData(const Byte* buffer,size_t bufferSize);
+	
+	/* Constructors and destructors: */
+	public:
+	RecordingFile(const char* fileName,size_t sBlockSize =size_t(8)*1024*1024); // Creates a new file of the given name, or truncates an existing one, which writes data in blocks of the given size
+	virtual ~RecordingFile(void); // Writes all remaining data and closes the file if it was not closed explicitly; ignores write errors
+	
+	/* Methods: */
+	bool isDirect(void) const // Returns true if data bypasses the page cache
+		{
+		return direct;
+		}
+	void close(void); // Writes all remaining data to disk and closes the file; throws an exception if any data could not be written
+	};
+
+}
+
+#endif
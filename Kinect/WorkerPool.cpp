@@ -0,0 +1,154 @@
+/***********************************************************************
+WorkerPool - Class for a pool of worker threads that help the calling
+thread process a set of independent tasks in parallel.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/WorkerPool.h>
+
+#include <pthread.h>
+
+namespace Kinect {
+
+/***************************
+Methods of class WorkerPool:
+***************************/
+
+void WorkerPool::processTasks(void)
+	{
+	while(true)
+		{
+		/* Grab the next unprocessed task of the current job: */
+		unsigned int task;
+		Job* taskJob;
+		{
+		Threads::MutexCond::Lock jobLock(jobCond);
+		if(nextTask>=numTasks)
+			break;
+		task=nextTask;
+		++nextTask;
+		taskJob=job;
+		}
+		
+		/* Process the task: */
+		(*taskJob)(task);
+		
+		/* Mark the task as completed: */
+		{
+		Threads::MutexCond::Lock doneLock(doneCond);
+		if(--numPendingTasks==0)
+			doneCond.signal();
+		}
+		}
+	}
+
+void* WorkerPool::workerThreadMethod(void)
+	{
+	unsigned int lastJobIndex=0;
+	while(true)
+		{
+		/* Wait for the next job: */
+		{
+		Threads::MutexCond::Lock jobLock(jobCond);
+		while(!shutdown&&jobIndex==lastJobIndex)
+			jobCond.wait(jobLock);
+		if(shutdown)
+			break;
+		lastJobIndex=jobIndex;
+		}
+		
+		/* Help process the job: */
+		processTasks();
+		}
+	
+	return 0;
+	}
+
+WorkerPool::WorkerPool(unsigned int numThreads)
+	:numWorkers(0),workers(0),
+	 shutdown(false),jobIndex(0),job(0),numTasks(0),nextTask(0),
+	 numPendingTasks(0)
+	{
+	if(numThreads>1)
+		{
+		/* Start the worker threads: */
+		numWorkers=numThreads-1;
+		workers=new Threads::Thread[numWorkers];
+		for(unsigned int i=0;i<numWorkers;++i)
+			workers[i].start(this,&WorkerPool::workerThreadMethod);
+		}
+	}
+
+WorkerPool::~WorkerPool(void)
+	{
+	if(numWorkers>0)
+		{
+		/* Shut down the worker threads: */
+		{
+		Threads::MutexCond::Lock jobLock(jobCond);
+		shutdown=true;
+		jobCond.broadcast();
+		}
+		for(unsigned int i=0;i<numWorkers;++i)
+			workers[i].join();
+		delete[] workers;
+		}
+	}
+
+void WorkerPool::run(unsigned int newNumTasks,WorkerPool::Job& newJob)
+	{
+	if(numWorkers==0||newNumTasks<=1)
+		{
+		/* Process all tasks in the calling thread: */
+		for(unsigned int i=0;i<newNumTasks;++i)
+			newJob(i);
+		return;
+		}
+	
+	/* Do not let the calling thread be cancelled while worker threads might still access the job's data: */
+	int oldCancelState;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE,&oldCancelState);
+	
+	/* Submit the job to the worker threads: */
+	{
+	Threads::MutexCond::Lock doneLock(doneCond);
+	numPendingTasks=newNumTasks;
+	}
+	{
+	Threads::MutexCond::Lock jobLock(jobCond);
+	job=&newJob;
+	numTasks=newNumTasks;
+	nextTask=0;
+	++jobIndex;
+	jobCond.broadcast();
+	}
+	
+	/* Help process the job, and then wait until all tasks are completed: */
+	processTasks();
+	{
+	Threads::MutexCond::Lock doneLock(doneCond);
+	while(numPendingTasks>0)
+		doneCond.wait(doneLock);
+	}
+	
+	pthread_setcancelstate(oldCancelState,0);
+	}
+
+}
@@ -0,0 +1,71 @@
+/***********************************************************************
+WorkerPool - Class for a pool of worker threads that help the calling
+thread process a set of independent tasks in parallel.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_WORKERPOOL_INCLUDED
+#define KINECT_WORKERPOOL_INCLUDED
+
+#include <Misc/FunctionCalls.h>
+#include <Threads/MutexCond.h>
+#include <Threads/Thread.h>
+
+namespace Kinect {
+
+class WorkerPool
+	{
+	/* Embedded classes: */
+	public:
+	typedef Misc::FunctionCall<unsigned int> Job; // Type for functions processing a single task, identified by its index
+	
+	/* Elements: */
+	private:
+	unsigned int numWorkers; // Number of worker threads in addition to the calling thread
+	Threads::Thread* workers; // Array of worker threads
+	Threads::MutexCond jobCond; // Condition variable to signal a new job to the worker threads; also protects job state
+	bool shutdown; // Flag to shut down the worker threads
+	unsigned int jobIndex; // Index of the most recently submitted job
+	Job* job; // Function processing the tasks of the current job
+	unsigned int numTasks; // Number of tasks in the current job
+	unsigned int nextTask; // Index of next unprocessed task of the current job
+	Threads::MutexCond doneCond; // Condition variable to signal completion of the current job
+	unsigned int numPendingTasks; // Number of tasks of the current job that have not been completed yet
+	
+	/* Private methods: */
+	void processTasks(void); // Processes tasks of the current job until there are none left
+	void* workerThreadMethod(void); // Thread method for worker threads
+	
+	/* Constructors and destructors: */
+	public:
+	WorkerPool(unsigned int numThreads); // Creates a pool splitting work between the calling thread and numThreads-1 worker threads
+	~WorkerPool(void);
+	
+	/* Methods: */
+	unsigned int getNumThreads(void) const // Returns the number of threads processing tasks, including the calling thread
+		{
+		return numWorkers+1;
+		}
+	void run(unsigned int newNumTasks,Job& newJob); // Processes the given number of tasks with the given function and returns when all tasks are completed; must not be called from more than one thread at a time
+	};
+
+}
+
+#endif
@@ -24,6 +24,7 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include "KinectServer.h"
 
 #include <iostream>
+#include <fstream>
 #include <Misc/SizedTypes.h>
 #include <Misc/FunctionCalls.h>
 #include <Misc/Time.h>
@@ -38,7 +39,9 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <Video/Config.h>
 #include <Kinect/ColorFrameWriter.h>
 #include <Kinect/DepthFrameWriter.h>
+#include <Kinect/RansDepthFrameWriter.h>
 #include <Kinect/LossyDepthFrameWriter.h>
+#include <Kinect/FrameTracer.h>
 
 /******************************************
 Methods of class KinectServer::CameraState:
@@ -74,12 +77,12 @@ void KinectServer::CameraState::depthStreamingCallback(const Kinect::FrameBuffer
 	++depthFrameIndex;
 	}
 
-KinectServer::CameraState::CameraState(USB::Context& usbContext,const char* serialNumber,bool sLossyDepthCompression,Threads::MutexCond& sNewColorFrameCond,Threads::MutexCond& sNewDepthFrameCond)
+KinectServer::CameraState::CameraState(USB::Context& usbContext,const char* serialNumber,Kinect::FrameSource::DepthCompression sDepthCompression,unsigned int numDepthCompressionThreads,unsigned int numDepthCodeTrainingFrames,Threads::MutexCond& sNewColorFrameCond,Threads::MutexCond& sNewDepthFrameCond)
 	:camera(usbContext,serialNumber),
 	 depthCorrection(0),
 	 colorFile(16384),colorCompressor(0),
 	 colorFrameIndex(0),newColorFrameCond(sNewColorFrameCond),hasSentColorFrame(false),
-	 depthFile(16384),lossyDepthCompression(sLossyDepthCompression),depthCompressor(0),
+	 depthFile(16384),depthCompression(sDepthCompression),depthCompressor(0),
 	 depthFrameIndex(0),newDepthFrameCond(sNewDepthFrameCond),hasSentDepthFrame(false)
 	{
 	/* Retrieve the camera's depth correction parameters: */
@@ -91,14 +94,30 @@ KinectServer::CameraState::CameraState(USB::Context& usbContext,const char* seri
 	
 	/* Create the color and depth frame compressors: */
 	colorCompressor=new Kinect::ColorFrameWriter(colorFile,camera.getActualFrameSize(Kinect::FrameSource::COLOR));
-	#if VIDEO_CONFIG_HAVE_THEORA
-	if(lossyDepthCompression)
-		depthCompressor=new Kinect::LossyDepthFrameWriter(depthFile,camera.getActualFrameSize(Kinect::FrameSource::DEPTH));
-	else
-		depthCompressor=new Kinect::DepthFrameWriter(depthFile,camera.getActualFrameSize(Kinect::FrameSource::DEPTH));
-	#else
-	depthCompressor=new Kinect::DepthFrameWriter(depthFile,camera.getActualFrameSize(Kinect::FrameSource::DEPTH));
+	#if !VIDEO_CONFIG_HAVE_THEORA
+	if(depthCompression==Kinect::FrameSource::LOSSY_THEORA)
+		depthCompression=Kinect::FrameSource::LOSSLESS_HUFFMAN; // Fall back to lossless compression
 	#endif
+	switch(depthCompression)
+		{
+		case Kinect::FrameSource::LOSSY_THEORA:
+			#if VIDEO_CONFIG_HAVE_THEORA
+			depthCompressor=new Kinect::LossyDepthFrameWriter(depthFile,camera.getActualFrameSize(Kinect::FrameSource::DEPTH));
+			#endif
+			break;
+		
+		case Kinect::FrameSource::LOSSLESS_RANS:
+			depthCompressor=new Kinect::RansDepthFrameWriter(depthFile,camera.getActualFrameSize(Kinect::FrameSource::DEPTH));
+			break;
+		
+		default:
+			depthCompressor=new Kinect::DepthFrameWriter(depthFile,camera.getActualFrameSize(Kinect::FrameSource::DEPTH),numDepthCompressionThreads);
+		}
+	
+	/* Train the lossless depth compressor's Huffman codes on the first depth frames: */
+	Kinect::DepthFrameWriter* losslessDepthCompressor=dynamic_cast<Kinect::DepthFrameWriter*>(depthCompressor);
+	if(losslessDepthCompressor!=0)
+		losslessDepthCompressor->setNumTrainingFrames(numDepthCodeTrainingFrames);
 	
 	/* Extract the color and depth compressors' stream header data: */
 	colorFile.storeBuffers(colorHeaders);
@@ -107,6 +126,16 @@ KinectServer::CameraState::CameraState(USB::Context& usbContext,const char* seri
 
 KinectServer::CameraState::~CameraState(void)
 	{
+	#ifdef VERBOSE
+	/* Report the streams' frame statistics: */
+	static const char* streamNames[2]={"color","depth"};
+	for(int i=0;i<2;++i)
+		{
+		Kinect::Camera::StreamStatistics stats=camera.getStreamStatistics(i);
+		std::cout<<"KinectServer: Camera "<<camera.getSerialNumber()<<' '<<streamNames[i]<<" stream: "<<stats.numCompletedFrames<<" frames received, "<<stats.numDecodedFrames<<" decoded, "<<stats.numDroppedFrames<<" dropped"<<std::endl;
+		}
+	#endif
+	
 	/* Stop streaming: */
 	camera.stopStreaming();
 	
@@ -128,17 +157,13 @@ void KinectServer::CameraState::writeHeaders(IO::File& sink) const
 	{
 	/* Write the stream format versions: */
 	sink.write<Misc::UInt32>(1);
-	sink.write<Misc::UInt32>(4);
+	sink.write<Misc::UInt32>(Kinect::DepthFrameWriter::encodingVersion);
 	
 	/* Write the camera's depth correction parameters: */
 	depthCorrection->write(sink);
 	
-	/* Check whether the depth stream uses lossy compression: */
-	#if VIDEO_CONFIG_HAVE_THEORA
-	sink.write<Misc::UInt8>(lossyDepthCompression?1:0);
-	#else
-	sink.write<Misc::UInt8>(0);
-	#endif
+	/* Write the depth stream's compression method: */
+	sink.write<Misc::UInt8>(depthCompression);
 	
 	/* Write the camera's intrinsic and extrinsic parameters to the sink: */
 	Misc::Marshaller<Kinect::FrameSource::IntrinsicParameters::PTransform>::write(ips.colorProjection,sink);
@@ -198,6 +223,10 @@ void* KinectServer::listeningThreadMethod(void)
 			Threads::Mutex::Lock clientListLock(clientListMutex);
 			clients.push_back(newClientSocket);
 			}
+			
+			/* Let the new client synchronize with the cameras' depth streams: */
+			for(unsigned i=0;i<numCameras;++i)
+				cameraStates[i]->depthCompressor->requestKeyframe();
 			}
 		catch(std::runtime_error err)
 			{
@@ -396,8 +425,13 @@ void* KinectServer::streamingThreadMethod(void)
 
 KinectServer::KinectServer(USB::Context& usbContext,Misc::ConfigurationFileSection& configFileSection)
 	:numCameras(0),cameraStates(0),
+	 frameTraceFileName(configFileSection.retrieveValue<std::string>("./frameTraceFile",std::string())),
 	 listeningSocket(configFileSection.retrieveValue<int>("./listenPortId",26000),1)
 	{
+	/* Check whether to trace the processing stages of all frames: */
+	if(!frameTraceFileName.empty())
+		Kinect::FrameTracer::setEnabled(true);
+	
 	/* Read the list of cameras: */
 	std::vector<std::string> cameraNames=configFileSection.retrieveValue<std::vector<std::string> >("./cameras",std::vector<std::string>());
 	numCameras=cameraNames.size();
@@ -417,7 +451,26 @@ KinectServer::KinectServer(USB::Context& usbContext,Misc::ConfigurationFileSecti
 			#ifdef VERBOSE
 			std::cout<<"KinectServer: Creating streamer for camera with serial number "<<serialNumber<<std::endl;
 			#endif
-			cameraStates[numFoundCameras]=new CameraState(usbContext,serialNumber.c_str(),cameraSection.retrieveValue<bool>("./lossyDepthCompression",false),newFrameCond,newFrameCond);
+			Kinect::FrameSource::DepthCompression depthCompression=Kinect::FrameSource::LOSSLESS_HUFFMAN;
+			if(cameraSection.retrieveValue<bool>("./lossyDepthCompression",false))
+				depthCompression=Kinect::FrameSource::LOSSY_THEORA;
+			else if(cameraSection.retrieveValue<bool>("./ransDepthCompression",false))
+				depthCompression=Kinect::FrameSource::LOSSLESS_RANS;
+			cameraStates[numFoundCameras]=new CameraState(usbContext,serialNumber.c_str(),depthCompression,cameraSection.retrieveValue<unsigned int>("./depthCompressionThreads",1),cameraSection.retrieveValue<unsigned int>("./depthCodeTrainingFrames",0),newFrameCond,newFrameCond);
+			
+			/* Set the lossless depth compressor's maximum reconstruction error for near-lossless compression, and learn a background mask on the first depth frames: */
+			Kinect::DepthFrameWriter* losslessDepthCompressor=dynamic_cast<Kinect::DepthFrameWriter*>(cameraStates[numFoundCameras]->depthCompressor);
+			if(losslessDepthCompressor!=0)
+				{
+				unsigned int depthMaxError=cameraSection.retrieveValue<unsigned int>("./depthMaxError",0);
+				losslessDepthCompressor->setMaxError(depthMaxError,cameraSection.retrieveValue<unsigned int>("./farDepthMaxError",depthMaxError));
+				losslessDepthCompressor->setNumBackgroundMaskFrames(cameraSection.retrieveValue<unsigned int>("./backgroundMaskFrames",0));
+				}
+			
+			/* Set up color frame decoding: */
+			cameraStates[numFoundCameras]->camera.setColorDecodingThreads(cameraSection.retrieveValue<unsigned int>("./colorDecodingThreads",1));
+			cameraStates[numFoundCameras]->camera.setEdgeAwareDemosaicing(cameraSection.retrieveValue<bool>("./edgeAwareDemosaicing",false));
+			cameraStates[numFoundCameras]->camera.setNumRawFrameSlots(cameraSection.retrieveValue<unsigned int>("./numRawFrameSlots",4));
 			
 			/* Check if camera is to remove background: */
 			if(cameraSection.retrieveValue<bool>("./removeBackground",true))
@@ -545,6 +598,18 @@ KinectServer::~KinectServer(void)
 		delete cameraStates[i];
 	delete[] cameraStates;
 	
+	if(!frameTraceFileName.empty())
+		{
+		/* Report frame latencies and write the frame trace file: */
+		Kinect::FrameTracer::setEnabled(false);
+		Kinect::FrameTracer::printHistograms(std::cout);
+		std::ofstream traceFile(frameTraceFileName.c_str());
+		Kinect::FrameTracer::writeChromeTrace(traceFile);
+		#ifdef VERBOSE
+		std::cout<<"KinectServer: Wrote frame trace file "<<frameTraceFileName<<std::endl;
+		#endif
+		}
+	
 	/* Disconnect all clients: */
 	#ifdef VERBOSE
 	std::cout<<"KinectServer: Disconnecting all clients"<<std::endl;
@@ -24,6 +24,7 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #ifndef KINECTSERVER_INCLUDED
 #define KINECTSERVER_INCLUDED
 
+#include <string>
 #include <vector>
 #include <IO/VariableMemoryFile.h>
 #include <Threads/Mutex.h>
@@ -88,7 +89,7 @@ class KinectServer
 		bool hasSentColorFrame; // Flag whether the camera has sent a color frame as part of the current meta-frame
 		
 		IO::VariableMemoryFile depthFile; // In-memory file to receive compressed depth frame data
-		bool lossyDepthCompression; // Flag whether this camera streams lossy-compressed depth frames
+		Kinect::FrameSource::DepthCompression depthCompression; // Compression method for this camera's depth stream
 		Kinect::FrameWriter* depthCompressor; // Compressor for depth frames
 		IO::VariableMemoryFile::BufferChain depthHeaders; // Write buffer containing the depth compressor's header data
 		unsigned int depthFrameIndex; // Sequential frame index for depth frames
@@ -101,7 +102,7 @@ class KinectServer
 		void depthStreamingCallback(const Kinect::FrameBuffer& frame);
 		
 		/* Constructors and destructors: */
-		CameraState(USB::Context& usbContext,const char* serialNumber,bool sLossyDepthCompression,Threads::MutexCond& sNewColorFrameCond,Threads::MutexCond& sNewDepthFrameCond); // Creates a capture and compression state for the given Kinect camera device
+		CameraState(USB::Context& usbContext,const char* serialNumber,Kinect::FrameSource::DepthCompression sDepthCompression,unsigned int numDepthCompressionThreads,unsigned int numDepthCodeTrainingFrames,Threads::MutexCond& sNewColorFrameCond,Threads::MutexCond& sNewDepthFrameCond); // Creates a capture and compression state for the given Kinect camera device, compressing depth frames with the given method; Huffman-compressed depth frames are compressed in the given number of threads with codes trained on the given number of initial frames
 		~CameraState(void);
 		
 		/* Methods: */
@@ -113,6 +114,7 @@ class KinectServer
 	private:
 	unsigned int numCameras; // Number of Kinect cameras served by the server
 	CameraState** cameraStates; // Array of pointers to camera state objects
+	std::string frameTraceFileName; // Name of file to which a trace of all frames' processing stages is written on shutdown, or empty to disable frame tracing
 	Threads::MutexCond newFrameCond; // Condition variable to signal a new depth or color frame
 	Comm::ListeningTCPSocket listeningSocket; // Socket listening for incoming client connections
 	Threads::Mutex clientListMutex; // Mutex protecting access to the client list
@@ -25,6 +25,8 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <stdlib.h>
 #include <iostream>
 #include <iomanip>
+#include <Misc/Time.h>
+#include <Misc/FunctionCalls.h>
 #include <IO/File.h>
 #include <IO/OpenFile.h>
 #include <USB/Context.h>
@@ -33,6 +35,7 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <USB/Device.h>
 #include <Math/Math.h>
 #include <Math/Matrix.h>
+#include <Kinect/FrameBuffer.h>
 #include <Kinect/Camera.h>
 
 USB::Context usbContext;
@@ -547,6 +550,28 @@ bool setLed(unsigned int index,unsigned int ledState)
 	return true;
 	}
 
+void discardFrame(const Kinect::FrameBuffer& frame)
+	{
+	}
+
+void dumpPackets(unsigned int index,const char* packetDumpFileName,double duration)
+	{
+	/* Open the index-th Kinect camera: */
+	Kinect::Camera camera(usbContext,index);
+	
+	/* Stream color and depth frames for the given duration while dumping all raw packets: */
+	std::cout<<"Dumping raw packets from camera "<<camera.getSerialNumber()<<" to "<<packetDumpFileName<<" for "<<duration<<" s"<<std::endl;
+	camera.setPacketDumpFile(packetDumpFileName);
+	camera.startStreaming(Misc::createFunctionCall(discardFrame),Misc::createFunctionCall(discardFrame));
+	Misc::sleep(duration);
+	Kinect::Camera::StreamStatistics stats[2];
+	for(int i=0;i<2;++i)
+		stats[i]=camera.getStreamStatistics(i);
+	camera.stopStreaming();
+	
+	std::cout<<"Received "<<stats[Kinect::FrameSource::COLOR].numCompletedFrames<<" color frames and "<<stats[Kinect::FrameSource::DEPTH].numCompletedFrames<<" depth frames"<<std::endl;
+	}
+
 int main(int argc,char* argv[])
 	{
 	/* Initialize the USB context: */
@@ -557,7 +582,7 @@ int main(int argc,char* argv[])
 	if(argc<2)
 		{
 		std::cout<<"Missing command. Usage:"<<std::endl;
-		std::cout<<"KinectUtil ( list | ( reset [ all | <index> ] ) | ( getCalib <index> ) | ( setLED [ <index> ] <LED state 0...7>) )"<<std::endl;
+		std::cout<<"KinectUtil ( list | ( reset [ all | <index> ] ) | ( getCalib <index> ) | ( setLED [ <index> ] <LED state 0...7>) | ( dumpPackets <index> <packet dump file name> [ <duration in s> ] ) )"<<std::endl;
 		return 1;
 		}
 	if(strcasecmp(argv[1],"list")==0)
@@ -613,6 +638,16 @@ int main(int argc,char* argv[])
 			return 1;
 			}
 		}
+	else if(strcasecmp(argv[1],"dumpPackets")==0)
+		{
+		/* Dump raw packets from the indicated Kinect device: */
+		if(argc<4)
+			{
+			std::cerr<<"No camera index or packet dump file name provided"<<std::endl;
+			return 1;
+			}
+		dumpPackets(atoi(argv[2]),argv[3],argc>4?atof(argv[4]):10.0);
+		}
 	
 	return 0;
 	}
@@ -30,6 +30,7 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <IO/File.h>
 #include <IO/OpenFile.h>
 #include <Math/Constants.h>
+#include <Threads/MutexCond.h>
 #include <Geometry/Point.h>
 #include <Geometry/Box.h>
 #include <Geometry/ProjectiveTransformation.h>
@@ -287,6 +288,69 @@ void writeFrames(const Kinect::FrameSource::IntrinsicParameters& ip,const Kinect
 	}
 	}
 
+class FrameExporter // Class exporting pairs of color and depth frames delivered by a file frame source in batch mode
+	{
+	/* Elements: */
+	private:
+	Kinect::FrameSource::IntrinsicParameters ip; // Intrinsic parameters of the exported 3D video stream
+	Kinect::Projector& projector; // Projector converting depth frames to meshes
+	const char* lwoFileNameTemplate; // printf-style template for the names of exported files
+	unsigned int frameIndex; // Index of the next delivered depth frame
+	unsigned int maxIndex; // Index one past the last exported depth frame
+	Threads::MutexCond doneCond; // Condition variable to signal the end of the export
+	bool done; // Flag whether all frames have been exported
+	
+	/* Private methods: */
+	void signalCompletion(void) // Signals the end of the export
+		{
+		Threads::MutexCond::Lock doneLock(doneCond);
+		done=true;
+		doneCond.signal();
+		}
+	
+	/* Constructors and destructors: */
+	public:
+	FrameExporter(const Kinect::FrameSource::IntrinsicParameters& sIp,Kinect::Projector& sProjector,const char* sLwoFileNameTemplate,unsigned int sFrameIndex,unsigned int sMaxIndex)
+		:ip(sIp),projector(sProjector),lwoFileNameTemplate(sLwoFileNameTemplate),
+		 frameIndex(sFrameIndex),maxIndex(sMaxIndex),
+		 done(frameIndex>=maxIndex)
+		{
+		}
+	
+	/* Methods: */
+	void framePairCallback(const Kinect::FileFrameSource::FramePair& pair) // Exports the given pair of frames
+		{
+		if(frameIndex<maxIndex)
+			{
+			std::cout<<"\b\b\b\b\b\b"<<std::setw(6)<<frameIndex<<std::flush;
+			
+			/* Convert the depth frame to a mesh: */
+			const Kinect::MeshBuffer& mesh=projector.processDepthFrame(pair.depth);
+			
+			/* Export the frame pair to an LWO file: */
+			char lwoFileName[1024];
+			snprintf(lwoFileName,sizeof(lwoFileName),lwoFileNameTemplate,frameIndex);
+			writeFrames(ip,pair.color,mesh,lwoFileName);
+			
+			++frameIndex;
+			}
+		
+		/* Signal the end of the export once the last requested frame has been exported: */
+		if(frameIndex>=maxIndex)
+			signalCompletion();
+		}
+	void batchCompletionCallback(Kinect::FileFrameSource& frameSource) // Signals the end of the export at the end of the depth stream
+		{
+		signalCompletion();
+		}
+	void waitForCompletion(void) // Waits until all frames have been exported
+		{
+		Threads::MutexCond::Lock doneLock(doneCond);
+		while(!done)
+			doneCond.wait(doneLock);
+		}
+	};
+
 int main(int argc,char* argv[])
 	{
 	/* Open the requested 3D video stream: */
@@ -303,34 +367,23 @@ int main(int argc,char* argv[])
 	Kinect::Projector projector(frameSource);
 	projector.setFilterDepthFrames(true);
 	
-	/* Read pairs of frames from the source and export them to a sequence of Lightwave Object files: */
+	/* Skip ahead to the first requested depth frame: */
 	unsigned int minIndex=argc>3?atoi(argv[3]):0;
 	unsigned int maxIndex=argc>4?atoi(argv[4]):Math::Constants<unsigned int>::max;
-	unsigned int frameIndex=0;
+	const Kinect::FrameIndex& depthFrameIndex=frameSource.getFrameIndex(Kinect::FrameSource::DEPTH);
+	if(maxIndex>depthFrameIndex.getNumFrames())
+		maxIndex=depthFrameIndex.getNumFrames();
+	if(minIndex>0&&minIndex<maxIndex)
+		frameSource.seekToTime(depthFrameIndex.getFrame(minIndex).timeStamp);
+	
+	/* Export pairs of frames matched by time stamp to a sequence of Lightwave Object files as fast as they can be decoded: */
+	FrameExporter exporter(ip,projector,argv[2],minIndex,maxIndex);
 	std::cout<<"Processing frame      0"<<std::flush;
-	while(true)
+	if(minIndex<maxIndex)
 		{
-		std::cout<<"\b\b\b\b\b\b"<<std::setw(6)<<frameIndex<<std::flush;
-		/* Read the next pair of frames: */
-		Kinect::FrameBuffer color=frameSource.readNextColorFrame();
-		Kinect::FrameBuffer depth=frameSource.readNextDepthFrame();
-		
-		/* Bail out if either frame is invalid: */
-		if(color.timeStamp==Math::Constants<double>::max||depth.timeStamp==Math::Constants<double>::max)
-			break;
-		
-		if(frameIndex>=minIndex&&frameIndex<maxIndex)
-			{
-			/* Convert the depth frame to a mesh: */
-			const Kinect::MeshBuffer& mesh=projector.processDepthFrame(depth);
-			
-			/* Export the frame pair to an LWO file: */
-			char lwoFileName[1024];
-			snprintf(lwoFileName,sizeof(lwoFileName),argv[2],frameIndex);
-			writeFrames(ip,color,mesh,lwoFileName);
-			}
-		
-		++frameIndex;
+		frameSource.startBatchProcessing(Misc::createFunctionCall(&exporter,&FrameExporter::framePairCallback),Misc::createFunctionCall(&exporter,&FrameExporter::batchCompletionCallback));
+		exporter.waitForCompletion();
+		frameSource.stopStreaming();
 		}
 	std::cout<<std::endl;
 	
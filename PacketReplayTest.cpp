@@ -0,0 +1,149 @@
+/***********************************************************************
+PacketReplayTest - Utility to replay raw isochronous packets recorded
+from a Kinect camera through the frame assembly and decoding code, and to
+measure decoding throughput and frame drop behavior without a device.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <Misc/Timer.h>
+#include <Misc/FunctionCalls.h>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/Camera.h>
+#include <Kinect/FrameTracer.h>
+
+/**************
+Helper classes:
+**************/
+
+class FrameCounter // Class to count frames received from a replaying camera
+	{
+	/* Elements: */
+	public:
+	unsigned int numFrames[2]; // Number of received color and depth frames
+	
+	/* Constructors and destructors: */
+	FrameCounter(void)
+		{
+		numFrames[0]=numFrames[1]=0;
+		}
+	
+	/* Methods: */
+	void colorStreamingCallback(const Kinect::FrameBuffer& frame)
+		{
+		++numFrames[Kinect::FrameSource::COLOR];
+		}
+	void depthStreamingCallback(const Kinect::FrameBuffer& frame)
+		{
+		++numFrames[Kinect::FrameSource::DEPTH];
+		}
+	};
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	const char* packetDumpFileName=0;
+	double replaySpeed=0.0;
+	unsigned int numRawFrameSlots=4;
+	unsigned int numColorDecodingThreads=1;
+	const char* traceFileName=0;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"speed")==0&&i+1<argc)
+				{
+				++i;
+				replaySpeed=atof(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"slots")==0&&i+1<argc)
+				{
+				++i;
+				numRawFrameSlots=(unsigned int)atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"colorThreads")==0&&i+1<argc)
+				{
+				++i;
+				numColorDecodingThreads=(unsigned int)atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"trace")==0&&i+1<argc)
+				{
+				++i;
+				traceFileName=argv[i];
+				}
+			else
+				std::cerr<<"Ignoring unrecognized option "<<argv[i]<<std::endl;
+			}
+		else if(packetDumpFileName==0)
+			packetDumpFileName=argv[i];
+		}
+	if(packetDumpFileName==0)
+		{
+		std::cerr<<"Usage: "<<argv[0]<<" <packet dump file name> [-speed <replay speed factor, 0 for maximum speed>] [-slots <number of raw frame slots>] [-colorThreads <number of color decoding threads>] [-trace <frame trace file name>]"<<std::endl;
+		std::cerr<<"Packet dump files are recorded with KinectUtil dumpPackets"<<std::endl;
+		return 1;
+		}
+	
+	/* Create a camera replaying the packet dump file: */
+	Kinect::Camera camera(packetDumpFileName);
+	camera.setReplaySpeed(replaySpeed);
+	camera.setNumRawFrameSlots(numRawFrameSlots);
+	camera.setColorDecodingThreads(numColorDecodingThreads);
+	std::cout<<"Replaying packets recorded from camera "<<camera.getSerialNumber()<<std::endl;
+	
+	/* Trace the processing stages of all replayed frames if requested: */
+	if(traceFileName!=0)
+		Kinect::FrameTracer::setEnabled(true);
+	
+	/* Replay all packets and wait until all completed frames have been decoded: */
+	FrameCounter counter;
+	Misc::Timer timer;
+	camera.startStreaming(Misc::createFunctionCall(&counter,&FrameCounter::colorStreamingCallback),Misc::createFunctionCall(&counter,&FrameCounter::depthStreamingCallback));
+	camera.waitForReplay();
+	timer.elapse();
+	double time=timer.getTime();
+	Kinect::Camera::StreamStatistics stats[2];
+	for(int i=0;i<2;++i)
+		stats[i]=camera.getStreamStatistics(i);
+	camera.stopStreaming();
+	
+	/* Print the replay results: */
+	static const char* streamNames[2]={"Color","Depth"};
+	std::cout<<"Replay time: "<<time*1000.0<<" ms"<<std::endl;
+	for(int i=0;i<2;++i)
+		{
+		std::cout<<streamNames[i]<<" stream: "<<stats[i].numCompletedFrames<<" frames received, "<<stats[i].numDecodedFrames<<" decoded, "<<stats[i].numDroppedFrames<<" dropped, ";
+		std::cout<<counter.numFrames[i]<<" delivered, "<<double(stats[i].numDecodedFrames)/time<<" frames/s"<<std::endl;
+		}
+	
+	if(traceFileName!=0)
+		{
+		/* Print frame latencies and write the frame trace file: */
+		Kinect::FrameTracer::setEnabled(false);
+		Kinect::FrameTracer::printHistograms(std::cout);
+		std::ofstream traceFile(traceFileName);
+		Kinect::FrameTracer::writeChromeTrace(traceFile);
+		}
+	
+	return 0;
+	}
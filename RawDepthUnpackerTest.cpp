@@ -0,0 +1,141 @@
+/***********************************************************************
+RawDepthUnpackerTest - Utility to check the vectorized raw depth frame
+unpacking kernels against the scalar reference kernel, and to measure
+their throughput.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <iostream>
+#include <Misc/SizedTypes.h>
+#include <Misc/Timer.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/RawDepthUnpacker.h>
+
+typedef Kinect::FrameSource::DepthPixel DepthPixel;
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	unsigned int frameSize[2]={640,480};
+	unsigned int numFrames=500;
+	int backgroundRemovalFuzz=5;
+	for(int i=1;i<argc;++i)
+		{
+		if(strcasecmp(argv[i],"-size")==0&&i+2<argc)
+			{
+			for(int j=0;j<2;++j)
+				frameSize[j]=(unsigned int)atoi(argv[i+1+j]);
+			i+=2;
+			}
+		else if(strcasecmp(argv[i],"-frames")==0&&i+1<argc)
+			{
+			++i;
+			numFrames=(unsigned int)atoi(argv[i]);
+			}
+		else if(strcasecmp(argv[i],"-fuzz")==0&&i+1<argc)
+			{
+			++i;
+			backgroundRemovalFuzz=atoi(argv[i]);
+			}
+		else
+			{
+			std::cerr<<"Usage: "<<argv[0]<<" [-size <width> <height>] [-frames <number of frames>] [-fuzz <background removal fuzz>]"<<std::endl;
+			return 1;
+			}
+		}
+	if(frameSize[0]==0||frameSize[0]%8!=0||frameSize[1]==0)
+		{
+		std::cerr<<"Frame width must be a positive multiple of 8"<<std::endl;
+		return 1;
+		}
+	
+	/* Create a raw frame of random bits and a random background frame: */
+	size_t numPixels=size_t(frameSize[0])*size_t(frameSize[1]);
+	size_t rawFrameSize=(numPixels*11)/8;
+	Misc::UInt8* rawFrame=new Misc::UInt8[rawFrameSize];
+	for(size_t i=0;i<rawFrameSize;++i)
+		rawFrame[i]=Misc::UInt8(rand());
+	DepthPixel* backgroundFrame=new DepthPixel[numPixels];
+	for(size_t i=0;i<numPixels;++i)
+		backgroundFrame[i]=DepthPixel(rand()%0x0800);
+	
+	/* Calculate reference results for all background processing modes with the scalar kernel: */
+	Kinect::RawDepthUnpacker unpacker(frameSize);
+	unpacker.setKernel(Kinect::RawDepthUnpacker::SCALAR);
+	DepthPixel* referenceFrames[4];
+	DepthPixel* referenceBackgrounds[4];
+	for(int mode=0;mode<4;++mode)
+		{
+		referenceFrames[mode]=new DepthPixel[numPixels];
+		referenceBackgrounds[mode]=new DepthPixel[numPixels];
+		memcpy(referenceBackgrounds[mode],backgroundFrame,numPixels*sizeof(DepthPixel));
+		unpacker.unpackFrame(rawFrame,referenceFrames[mode],referenceBackgrounds[mode],(mode&0x1)!=0,(mode&0x2)!=0,backgroundRemovalFuzz);
+		}
+	
+	/* Test all kernels supported by the host CPU: */
+	static const char* modeNames[4]={"plain","capture","remove","capture+remove"};
+	DepthPixel* frame=new DepthPixel[numPixels];
+	DepthPixel* background=new DepthPixel[numPixels];
+	bool allCorrect=true;
+	for(int kernel=0;kernel<Kinect::RawDepthUnpacker::NUM_KERNELS;++kernel)
+		{
+		Kinect::RawDepthUnpacker::Kernel k=Kinect::RawDepthUnpacker::Kernel(kernel);
+		if(!Kinect::RawDepthUnpacker::isSupported(k))
+			{
+			std::cout<<Kinect::RawDepthUnpacker::getKernelName(k)<<": not supported by this CPU"<<std::endl;
+			continue;
+			}
+		unpacker.setKernel(k);
+		
+		for(int mode=0;mode<4;++mode)
+			{
+			/* Check the kernel's results against the reference results: */
+			memcpy(background,backgroundFrame,numPixels*sizeof(DepthPixel));
+			unpacker.unpackFrame(rawFrame,frame,background,(mode&0x1)!=0,(mode&0x2)!=0,backgroundRemovalFuzz);
+			bool correct=memcmp(frame,referenceFrames[mode],numPixels*sizeof(DepthPixel))==0&&memcmp(background,referenceBackgrounds[mode],numPixels*sizeof(DepthPixel))==0;
+			allCorrect=allCorrect&&correct;
+			
+			/* Measure the kernel's throughput: */
+			Misc::Timer timer;
+			for(unsigned int i=0;i<numFrames;++i)
+				unpacker.unpackFrame(rawFrame,frame,background,(mode&0x1)!=0,(mode&0x2)!=0,backgroundRemovalFuzz);
+			timer.elapse();
+			double time=timer.getTime();
+			
+			std::cout<<Kinect::RawDepthUnpacker::getKernelName(k)<<", "<<modeNames[mode]<<": "<<(correct?"bit-exact":"MISMATCH");
+			std::cout<<", "<<time*1000.0/double(numFrames)<<" ms/frame, "<<double(numPixels)*double(numFrames)/(time*1.0e6)<<" Mpixels/s"<<std::endl;
+			}
+		}
+	
+	/* Clean up: */
+	delete[] rawFrame;
+	delete[] backgroundFrame;
+	for(int mode=0;mode<4;++mode)
+		{
+		delete[] referenceFrames[mode];
+		delete[] referenceBackgrounds[mode];
+		}
+	delete[] frame;
+	delete[] background;
+	
+	return allCorrect?0:1;
+	}
@@ -163,8 +163,8 @@ int main(int argc,char* argv[])
 			/* Calculate the joint projective transformation from 3D world space into depth image space: */
 			Projection proj=Geometry::invert(Projection(projectorTransform)*depthTransform);
 			
-			/* Create a depth frame reader: */
-			DepthFrameReader depthFrameReader(*depthFile);
+			/* Create a depth frame reader for the unversioned depth stream: */
+			DepthFrameReader depthFrameReader(*depthFile,0);
 			
 			/* Read the n-th facade: */
 			FrameBuffer frame;
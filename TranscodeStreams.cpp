@@ -0,0 +1,373 @@
+/***********************************************************************
+TranscodeStreams - Utility to re-encode many recorded pairs of color and
+depth streams in parallel, e.g., to convert losslessly compressed depth
+streams to lossy ones, to update old stream files to the current file
+format, or to mask background in recorded depth frames losslessly.
+Copyright (c) 2013 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdexcept>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <Misc/Timer.h>
+#include <Misc/ThrowStdErr.h>
+#include <Threads/Mutex.h>
+#include <Threads/Thread.h>
+#include <Math/Constants.h>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/FileFrameSource.h>
+#include <Kinect/FrameSaver.h>
+#include <Kinect/RecordingFile.h>
+
+/**************
+Helper classes:
+**************/
+
+struct Settings // Structure for transcoding settings shared by all files
+	{
+	/* Elements: */
+	public:
+	Kinect::FrameSource::DepthCompression depthCompression; // Compression method for transcoded depth streams
+	bool transcodeColor; // Flag whether to re-encode color streams; otherwise, their headers and compressed frames are copied unchanged
+	unsigned int numDepthEncoders; // Number of threads compressing depth frames of each file in parallel
+	unsigned int numDepthDecodingThreads; // Number of threads decompressing each losslessly compressed depth frame
+	unsigned int numBackgroundMaskFrames; // Number of initial depth frames from which to learn a lossless background mask, or 0
+	unsigned int numRemoveBackgroundFrames; // Number of initial depth frames from which to capture a background frame whose pixels are deleted from all subsequent frames, or 0
+	size_t memoryBudget; // Maximum size of frames queued for writing per file in bytes
+	std::string outputDirectory; // Directory receiving transcoded files, or empty to write them next to the input files
+	std::string suffix; // Suffix appended to input file prefixes to create output file prefixes
+	};
+
+struct Result // Structure reporting the outcome of transcoding a single pair of stream files
+	{
+	/* Elements: */
+	public:
+	unsigned int numColorFrames,numDepthFrames; // Number of transcoded color and depth frames
+	size_t rawDepthSize; // Total size of all uncompressed depth frames in bytes
+	off_t inputSize[2],outputSize[2]; // Sizes of the input and output color and depth files in bytes
+	double time; // Wall-clock time to transcode the pair of files in seconds
+	};
+
+class Transcoder // Class to distribute pairs of stream files across a pool of worker threads
+	{
+	/* Elements: */
+	private:
+	const Settings& settings; // Transcoding settings
+	const std::vector<std::string>& inputPrefixes; // Prefixes of all pairs of stream files to transcode
+	Threads::Mutex jobMutex; // Mutex protecting the job queue and results
+	size_t nextJob; // Index of the next pair of stream files to be transcoded
+	unsigned int numFailures; // Number of pairs of stream files that could not be transcoded
+	Threads::Mutex outputMutex; // Mutex serializing report output from worker threads
+	
+	/* Private methods: */
+	std::string getOutputPrefix(const std::string& inputPrefix) const; // Returns the output file prefix for the given input file prefix
+	Result transcode(const std::string& inputPrefix,const std::string& outputPrefix); // Transcodes a single pair of stream files
+	void* workerThreadMethod(void); // Thread method transcoding pairs of stream files until the job queue is empty
+	
+	/* Constructors and destructors: */
+	public:
+	Transcoder(const Settings& sSettings,const std::vector<std::string>& sInputPrefixes)
+		:settings(sSettings),inputPrefixes(sInputPrefixes),
+		 nextJob(0),numFailures(0)
+		{
+		}
+	
+	/* Methods: */
+	unsigned int run(unsigned int numJobs); // Transcodes all pairs of stream files with the given number of worker threads; returns the number of failed pairs
+	};
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+off_t getFileSize(const std::string& fileName) // Returns the size of the given file in bytes
+	{
+	struct stat fileStats;
+	if(stat(fileName.c_str(),&fileStats)!=0)
+		return 0;
+	return fileStats.st_size;
+	}
+
+}
+
+/***************************
+Methods of class Transcoder:
+***************************/
+
+std::string Transcoder::getOutputPrefix(const std::string& inputPrefix) const
+	{
+	if(settings.outputDirectory.empty())
+		return inputPrefix+settings.suffix;
+	
+	/* Place the input prefix's last path component into the output directory: */
+	std::string::size_type slashPos=inputPrefix.rfind('/');
+	std::string baseName=slashPos!=std::string::npos?inputPrefix.substr(slashPos+1):inputPrefix;
+	return settings.outputDirectory+"/"+baseName+settings.suffix;
+	}
+
+Result Transcoder::transcode(const std::string& inputPrefix,const std::string& outputPrefix)
+	{
+	std::string inputFileNames[2]={inputPrefix+".color",inputPrefix+".depth"};
+	std::string outputFileNames[2]={outputPrefix+".color",outputPrefix+".depth"};
+	for(int i=0;i<2;++i)
+		if(outputFileNames[i]==inputFileNames[i])
+			Misc::throwStdErr("TranscodeStreams: Output file %s would overwrite input file",outputFileNames[i].c_str());
+	
+	Result result;
+	result.numColorFrames=0;
+	result.numDepthFrames=0;
+	Misc::Timer timer;
+	
+	{
+	/* Open the input files: */
+	Kinect::FileFrameSource frameSource(inputFileNames[0].c_str(),inputFileNames[1].c_str());
+	frameSource.setNumDepthDecodingThreads(settings.numDepthDecodingThreads);
+	if(settings.numRemoveBackgroundFrames>0)
+		{
+		/* Destructively remove background pixels from the depth frames: */
+		frameSource.captureBackground(settings.numRemoveBackgroundFrames);
+		frameSource.setRemoveBackground(true);
+		}
+	const unsigned int* depthSize=frameSource.getActualFrameSize(Kinect::FrameSource::DEPTH);
+	
+	if(!settings.transcodeColor)
+		{
+		/* Copy the color stream's headers and compressed frames unchanged to avoid another generation of lossy compression: */
+		Kinect::RecordingFile colorFile(outputFileNames[0].c_str());
+		colorFile.setEndianness(Misc::LittleEndian);
+		frameSource.copyStream(Kinect::FrameSource::COLOR,colorFile);
+		colorFile.close();
+		result.numColorFrames=frameSource.getNumFrames(Kinect::FrameSource::COLOR);
+		}
+	
+	/* Create a frame saver, which copies the input files' depth correction and camera parameters into the output files' headers: */
+	Kinect::FrameSaver frameSaver(frameSource,settings.transcodeColor?outputFileNames[0].c_str():0,outputFileNames[1].c_str(),settings.depthCompression,settings.numDepthEncoders);
+	frameSaver.setMemoryBudget(settings.memoryBudget,Kinect::FrameSaver::BLOCK);
+	if(settings.numBackgroundMaskFrames>0)
+		frameSaver.setNumBackgroundMaskFrames(settings.numBackgroundMaskFrames);
+	
+	/* Save all color frames if they are re-encoded, and all depth frames, in time stamp order: */
+	Kinect::FrameBuffer colorFrame;
+	colorFrame.timeStamp=Math::Constants<double>::max;
+	if(settings.transcodeColor)
+		colorFrame=frameSource.readNextColorFrame();
+	Kinect::FrameBuffer depthFrame=frameSource.readNextDepthFrame();
+	while(colorFrame.timeStamp<Math::Constants<double>::max||depthFrame.timeStamp<Math::Constants<double>::max)
+		{
+		if(colorFrame.timeStamp<=depthFrame.timeStamp)
+			{
+			frameSaver.saveColorFrame(colorFrame);
+			++result.numColorFrames;
+			colorFrame=frameSource.readNextColorFrame();
+			}
+		else
+			{
+			frameSaver.saveDepthFrame(depthFrame);
+			++result.numDepthFrames;
+			depthFrame=frameSource.readNextDepthFrame();
+			}
+		}
+	result.rawDepthSize=size_t(result.numDepthFrames)*size_t(depthSize[0])*size_t(depthSize[1])*sizeof(Kinect::FrameSource::DepthPixel);
+	
+	/* Write all queued frames and the frame indices, and fail if the output files could not be written completely: */
+	frameSaver.close();
+	}
+	result.time=timer.peekTime();
+	
+	for(int i=0;i<2;++i)
+		{
+		result.inputSize[i]=getFileSize(inputFileNames[i]);
+		result.outputSize[i]=getFileSize(outputFileNames[i]);
+		}
+	
+	return result;
+	}
+
+void* Transcoder::workerThreadMethod(void)
+	{
+	while(true)
+		{
+		/* Grab the next job: */
+		size_t job;
+		{
+		Threads::Mutex::Lock jobLock(jobMutex);
+		if(nextJob==inputPrefixes.size())
+			break;
+		job=nextJob;
+		++nextJob;
+		}
+		
+		const std::string& inputPrefix=inputPrefixes[job];
+		std::string outputPrefix=getOutputPrefix(inputPrefix);
+		try
+			{
+			Result r=transcode(inputPrefix,outputPrefix);
+			
+			/* Print one comma-separated line of results: */
+			off_t inputSize=r.inputSize[0]+r.inputSize[1];
+			off_t outputSize=r.outputSize[0]+r.outputSize[1];
+			Threads::Mutex::Lock outputLock(outputMutex);
+			std::cout<<inputPrefix<<','<<outputPrefix<<','<<r.numColorFrames<<','<<r.numDepthFrames<<','<<r.time;
+			std::cout<<','<<double(r.numColorFrames+r.numDepthFrames)/r.time;
+			std::cout<<','<<double(inputSize)/(r.time*1024.0*1024.0);
+			std::cout<<','<<inputSize<<','<<outputSize<<','<<double(inputSize)/double(outputSize);
+			std::cout<<','<<r.inputSize[1]<<','<<r.outputSize[1]<<','<<double(r.inputSize[1])/double(r.outputSize[1]);
+			std::cout<<','<<double(r.rawDepthSize)/double(r.outputSize[1])<<std::endl;
+			}
+		catch(std::runtime_error err)
+			{
+			{
+			Threads::Mutex::Lock outputLock(outputMutex);
+			std::cerr<<"Unable to transcode "<<inputPrefix<<" due to exception "<<err.what()<<std::endl;
+			}
+			
+			/* Remove partially written output files: */
+			unlink((outputPrefix+".color").c_str());
+			unlink((outputPrefix+".depth").c_str());
+			
+			Threads::Mutex::Lock jobLock(jobMutex);
+			++numFailures;
+			}
+		}
+	
+	return 0;
+	}
+
+unsigned int Transcoder::run(unsigned int numJobs)
+	{
+	if(numJobs>inputPrefixes.size())
+		numJobs=inputPrefixes.size();
+	if(numJobs<1)
+		numJobs=1;
+	
+	/* Start the worker threads and wait until they have processed all jobs: */
+	std::cout<<"input,output,color_frames,depth_frames,seconds,frames_per_s,input_mb_per_s,input_bytes,output_bytes,ratio,input_depth_bytes,output_depth_bytes,depth_ratio,raw_depth_ratio"<<std::endl;
+	Threads::Thread* workerThreads=new Threads::Thread[numJobs];
+	for(unsigned int i=0;i<numJobs;++i)
+		workerThreads[i].start(this,&Transcoder::workerThreadMethod);
+	for(unsigned int i=0;i<numJobs;++i)
+		workerThreads[i].join();
+	delete[] workerThreads;
+	
+	return numFailures;
+	}
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	Settings settings;
+	settings.depthCompression=Kinect::FrameSource::LOSSLESS_HUFFMAN;
+	settings.transcodeColor=false;
+	settings.numDepthEncoders=1;
+	settings.numDepthDecodingThreads=1;
+	settings.numBackgroundMaskFrames=0;
+	settings.numRemoveBackgroundFrames=0;
+	settings.memoryBudget=size_t(256)*1024*1024;
+	settings.suffix="-transcoded";
+	long numCpus=sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int numJobs=numCpus>0?(unsigned int)(numCpus):1U;
+	std::vector<std::string> inputPrefixes;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"lossless")==0)
+				settings.depthCompression=Kinect::FrameSource::LOSSLESS_HUFFMAN;
+			else if(strcasecmp(argv[i]+1,"lossy")==0)
+				settings.depthCompression=Kinect::FrameSource::LOSSY_THEORA;
+			else if(strcasecmp(argv[i]+1,"rans")==0)
+				settings.depthCompression=Kinect::FrameSource::LOSSLESS_RANS;
+			else if(strcasecmp(argv[i]+1,"transcodeColor")==0)
+				settings.transcodeColor=true;
+			else if(strcasecmp(argv[i]+1,"jobs")==0&&i+1<argc)
+				{
+				++i;
+				numJobs=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"encoders")==0&&i+1<argc)
+				{
+				++i;
+				settings.numDepthEncoders=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"decoders")==0&&i+1<argc)
+				{
+				++i;
+				settings.numDepthDecodingThreads=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"background")==0&&i+1<argc)
+				{
+				++i;
+				settings.numBackgroundMaskFrames=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"removeBackground")==0&&i+1<argc)
+				{
+				++i;
+				settings.numRemoveBackgroundFrames=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"memory")==0&&i+1<argc)
+				{
+				++i;
+				settings.memoryBudget=size_t(atoi(argv[i]))*1024*1024;
+				}
+			else if(strcasecmp(argv[i]+1,"outputDir")==0&&i+1<argc)
+				{
+				++i;
+				settings.outputDirectory=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"suffix")==0&&i+1<argc)
+				{
+				++i;
+				settings.suffix=argv[i];
+				}
+			else
+				std::cerr<<"Ignoring unrecognized option "<<argv[i]<<std::endl;
+			}
+		else
+			inputPrefixes.push_back(argv[i]);
+		}
+	if(inputPrefixes.empty())
+		{
+		std::cerr<<"Usage: "<<argv[0]<<" <input file prefix>+ [-lossless | -lossy | -rans] [-transcodeColor] [-jobs <number of files transcoded in parallel>] [-encoders <number of depth encoding threads per file>] [-decoders <number of depth decoding threads per file>] [-background <number of frames to learn a lossless background mask>] [-removeBackground <number of frames to capture background deleted from all depth frames>] [-memory <queue memory budget per file in MB>] [-outputDir <output directory>] [-suffix <output file prefix suffix>]"<<std::endl;
+		std::cerr<<"Transcodes each pair of <prefix>.color and <prefix>.depth files into <prefix><suffix>.color and <prefix><suffix>.depth"<<std::endl;
+		std::cerr<<"Color streams are copied unchanged unless -transcodeColor is given"<<std::endl;
+		return 1;
+		}
+	if(settings.numBackgroundMaskFrames>0&&settings.depthCompression!=Kinect::FrameSource::LOSSLESS_HUFFMAN)
+		{
+		std::cerr<<"Ignoring -background option; background masks are only supported by -lossless depth compression"<<std::endl;
+		settings.numBackgroundMaskFrames=0;
+		}
+	
+	/* Transcode all pairs of stream files: */
+	Transcoder transcoder(settings,inputPrefixes);
+	unsigned int numFailures=transcoder.run(numJobs);
+	
+	/* Signal failure if any pair of stream files could not be transcoded: */
+	return numFailures!=0?2:0;
+	}
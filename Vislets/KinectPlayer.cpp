@@ -23,18 +23,20 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 
 #include "Vislets/KinectPlayer.h"
 
+#include <string.h>
+#include <stdlib.h>
+#include <iostream>
+#include <stdexcept>
+#include <Misc/ThrowStdErr.h>
 #include <Misc/StandardValueCoders.h>
 #include <Misc/CompoundValueCoders.h>
 #include <Misc/ConfigurationFile.h>
-#include <IO/File.h>
 #include <Math/Constants.h>
-#include <Geometry/GeometryMarshallers.h>
 #include <GL/gl.h>
 #include <GL/GLTransformationWrappers.h>
 #include <Sound/SoundPlayer.h>
-#include <Kinect/ColorFrameReader.h>
-#include <Kinect/DepthFrameReader.h>
-#include <Kinect/LossyDepthFrameReader.h>
+#include <Kinect/FrameIndex.h>
+#include <Kinect/FileFrameSource.h>
 #include <Vrui/Vrui.h>
 #include <Vrui/VisletManager.h>
 #include <Vrui/OpenFile.h>
@@ -55,6 +57,7 @@ KinectPlayerFactory::KinectPlayerFactory(Vrui::VisletManager& visletManager)
 	
 	/* Load class settings: */
 	Misc::ConfigurationFileSection cfs=visletManager.getVisletClassSection(getClassName());
+	cacheSize=size_t(cfs.retrieveValue<unsigned int>("./cacheSize",512))*1024*1024;
 	std::string defaultSaveFileNamePrefix=cfs.retrieveString("./saveFileNamePrefix",".");
 	
 	std::vector<std::string> kinectDevices=cfs.retrieveValue<std::vector<std::string> >("./kinectDevices",std::vector<std::string>());
@@ -142,207 +145,393 @@ extern "C" void destroyKinectPlayerFactory(Vrui::VisletFactory* factory)
 Methods of class KinectPlayer::KinectStreamer:
 *********************************************/
 
-void* KinectPlayer::KinectStreamer::colorDecompressorThreadMethod(void)
+void KinectPlayer::KinectStreamer::unlinkFrame(KinectPlayer::KinectStreamer::CachedFrame* frame)
 	{
-	Threads::Thread::setCancelState(Threads::Thread::CANCEL_ENABLE);
-	// Threads::Thread::setCancelType(Threads::Thread::CANCEL_ASYNCHRONOUS);
+	if(frame->pred!=0)
+		frame->pred->succ=frame->succ;
+	else
+		mostRecentlyUsed=frame->succ;
+	if(frame->succ!=0)
+		frame->succ->pred=frame->pred;
+	else
+		leastRecentlyUsed=frame->pred;
+	}
+
+void KinectPlayer::KinectStreamer::touchFrame(KinectPlayer::KinectStreamer::CachedFrame* frame)
+	{
+	/* Move the frame to the head of the list: */
+	unlinkFrame(frame);
+	frame->pred=0;
+	frame->succ=mostRecentlyUsed;
+	if(mostRecentlyUsed!=0)
+		mostRecentlyUsed->pred=frame;
+	else
+		leastRecentlyUsed=frame;
+	mostRecentlyUsed=frame;
+	}
+
+void KinectPlayer::KinectStreamer::insertFrame(KinectPlayer::KinectStreamer::CachedFrame* frame,bool used)
+	{
+	/* Update the running estimate of the stream's frame size: */
+	size_t& meanSize=meanFrameSizes[frame->sensor];
+	meanSize=meanSize!=0?(meanSize*7+frame->size)/8:frame->size;
 	
-	/* Read color frames: */
-	while(true)
+	/* Add the frame to the cache: */
+	cachedFrames[frame->sensor][frame->frameIndex]=frame;
+	cachedSize+=frame->size;
+	if(used)
 		{
-		/* Read the next color frame: */
-		Kinect::FrameBuffer nextFrame=colorDecompressor->readNextFrame();
-		
-		/* Put the new color frame into the queue: */
+		frame->pred=0;
+		frame->succ=mostRecentlyUsed;
+		if(mostRecentlyUsed!=0)
+			mostRecentlyUsed->pred=frame;
+		else
+			leastRecentlyUsed=frame;
+		mostRecentlyUsed=frame;
+		}
+	else
+		{
+		frame->pred=leastRecentlyUsed;
+		frame->succ=0;
+		if(leastRecentlyUsed!=0)
+			leastRecentlyUsed->succ=frame;
+		else
+			mostRecentlyUsed=frame;
+		leastRecentlyUsed=frame;
+		}
+	
+	/* Evict least recently used frames until the cache fits into the memory budget, but keep the frames at the playhead, and all frames ahead of it when streaming: */
+	CachedFrame* evictFrame=leastRecentlyUsed;
+	while(cachedSize>cacheSize&&evictFrame!=0)
 		{
-		Threads::MutexCond::Lock frameQueueLock(frameQueueCond);
-		while(numColorFrames==2)
-			frameQueueCond.wait(frameQueueLock);
-		mostRecentColorFrame=1-mostRecentColorFrame;
-		colorFrames[mostRecentColorFrame]=nextFrame;
-		++numColorFrames;
-		if(numColorFrames==1)
-			frameQueueCond.broadcast();
+		CachedFrame* pred=evictFrame->pred;
+		if(streaming?evictFrame->frameIndex<playheads[evictFrame->sensor]:evictFrame->frameIndex!=playheads[evictFrame->sensor])
+			{
+			unlinkFrame(evictFrame);
+			cachedFrames[evictFrame->sensor][evictFrame->frameIndex]=0;
+			cachedSize-=evictFrame->size;
+			delete evictFrame;
+			}
+		evictFrame=pred;
 		}
+	}
+
+size_t KinectPlayer::KinectStreamer::getWindowSize(void) const
+	{
+	/* Divide the memory budget by the combined size of a color frame and a depth mesh, assuming both streams have the same frame rate: */
+	size_t pairSize=meanFrameSizes[0]+meanFrameSizes[1];
+	if(pairSize==0)
+		return 2;
+	size_t result=cacheSize/pairSize;
+	return result>=1?result:1;
+	}
+
+bool KinectPlayer::KinectStreamer::findFrameToDecode(int sensor,size_t& frameIndex)
+	{
+	size_t numFrames=cachedFrames[sensor].size();
+	
+	/* Check the window of frames around the playhead in order of importance, favoring frames in the playback direction: */
+	size_t windowSize=getWindowSize();
+	size_t numAhead=(windowSize*2+2)/3;
+	size_t numBehind=windowSize-numAhead;
+	size_t ahead=0;
+	size_t behind=0;
+	bool found=false;
+	while(ahead<numAhead||behind<numBehind)
+		{
+		/* Check two frames ahead of the playhead for every frame behind it: */
+		ptrdiff_t offset;
+		if(ahead<numAhead&&(behind>=numBehind||ahead<2*(behind+1)))
+			offset=ptrdiff_t(ahead++);
+		else
+			offset=-ptrdiff_t(++behind);
+		ptrdiff_t index=ptrdiff_t(playheads[sensor])+offset*playbackDirection;
+		if(index<0||index>=ptrdiff_t(numFrames))
+			continue;
 		
-		if(nextFrame.timeStamp==Math::Constants<double>::max)
-			break;
+		if(cachedFrames[sensor][index]!=0)
+			{
+			/* Protect the frame from eviction while it is in the window: */
+			touchFrame(cachedFrames[sensor][index]);
+			}
+		else if(!found)
+			{
+			frameIndex=size_t(index);
+			found=true;
+			}
 		}
 	
-	return 0;
+	return found;
 	}
 
-void* KinectPlayer::KinectStreamer::depthDecompressorThreadMethod(void)
+KinectPlayer::KinectStreamer::CachedFrame* KinectPlayer::KinectStreamer::decodeNextFrame(int sensor)
 	{
-	Threads::Thread::setCancelState(Threads::Thread::CANCEL_ENABLE);
-	// Threads::Thread::setCancelType(Threads::Thread::CANCEL_ASYNCHRONOUS);
+	CachedFrame* frame=new CachedFrame;
+	frame->sensor=sensor;
+	frame->frameIndex=nextFrameIndices[sensor];
+	if(sensor==Kinect::FrameSource::COLOR)
+		{
+		frame->colorFrame=frameSource->readNextColorFrame();
+		frame->timeStamp=frame->colorFrame.timeStamp;
+		frame->size=size_t(frame->colorFrame.getSize(0))*size_t(frame->colorFrame.getSize(1))*sizeof(Kinect::FrameSource::ColorPixel);
+		}
+	else
+		{
+		/* Process the depth frame into a mesh unless the end of the stream was reached: */
+		Kinect::FrameBuffer depthFrame=frameSource->readNextDepthFrame();
+		frame->timeStamp=depthFrame.timeStamp;
+		frame->size=0;
+		if(frame->timeStamp<Math::Constants<double>::max)
+			{
+			projector.processDepthFrame(depthFrame,frame->mesh);
+			frame->size=size_t(frame->mesh.getMaxNumVertices())*sizeof(Kinect::MeshBuffer::Vertex)+size_t(frame->mesh.getMaxNumTriangles())*3*sizeof(Kinect::MeshBuffer::Index);
+			}
+		}
+	++nextFrameIndices[sensor];
 	
-	/* Read depth frames: */
+	return frame;
+	}
+
+void* KinectPlayer::KinectStreamer::decodingThreadMethod(int sensor)
+	{
 	while(true)
 		{
-		/* Read the next depth frame: */
-		Kinect::FrameBuffer nextFrame=depthDecompressor->readNextFrame();
+		/* Wait until there is a frame to decode: */
+		size_t frameIndex;
+		{
+		Threads::MutexCond::Lock cacheLock(cacheCond);
+		while(!shutdown&&!findFrameToDecode(sensor,frameIndex))
+			cacheCond.wait(cacheLock);
+		if(shutdown)
+			break;
+		}
+		
+		/* Go to the keyframe preceding the frame unless the frame can be reached by decoding forward: */
+		size_t keyframeIndex=frameIndices[sensor]->findKeyframe(frameIndex);
+		if(frameIndex<nextFrameIndices[sensor]||keyframeIndex>nextFrameIndices[sensor])
+			{
+			frameSource->seekToFrame(sensor,keyframeIndex);
+			nextFrameIndices[sensor]=keyframeIndex;
+			}
 		
-		/* Process the next depth frame into a mesh: */
-		Kinect::MeshBuffer nextMesh;
-		projector.processDepthFrame(nextFrame,nextMesh);
+		/* Decode the next frame in the stream, which is either the requested frame or one leading up to it: */
+		CachedFrame* frame=decodeNextFrame(sensor);
 		
-		/* Put the new depth frame into the queue: */
+		/* Add the frame to the cache unless it was decoded in the meantime, and wake up the display: */
 		{
-		Threads::MutexCond::Lock frameQueueLock(frameQueueCond);
-		while(numDepthFrames==2)
-			frameQueueCond.wait(frameQueueLock);
-		mostRecentDepthFrame=1-mostRecentDepthFrame;
-		depthFrames[mostRecentDepthFrame]=nextMesh;
-		++numDepthFrames;
-		if(numDepthFrames==1)
-			frameQueueCond.broadcast();
+		Threads::MutexCond::Lock cacheLock(cacheCond);
+		if(cachedFrames[sensor][frame->frameIndex]==0)
+			{
+			/* Frames decoded on the way to the requested frame are the first to go if the cache is full: */
+			insertFrame(frame,frame->frameIndex==frameIndex);
+			}
+		else
+			delete frame;
+		cacheCond.broadcast();
 		}
-		
-		if(nextMesh.timeStamp>=Math::Constants<double>::max)
-			break;
 		}
 	
 	return 0;
 	}
 
-KinectPlayer::KinectStreamer::KinectStreamer(const KinectPlayerFactory::KinectConfig& config)
-	:colorDecompressor(0),depthDecompressor(0),
-	 numColorFrames(0),mostRecentColorFrame(0),
-	 numDepthFrames(0),mostRecentDepthFrame(0)
+void* KinectPlayer::KinectStreamer::streamingThreadMethod(int sensor)
 	{
-	/* Open the color file: */
-	std::string colorFileName=config.saveFileNamePrefix;
-	colorFileName.push_back('-');
-	colorFileName.append(config.deviceSerialNumber);
-	colorFileName.append(".color");
-	colorFile=Vrui::openFile(colorFileName.c_str());
-	colorFile->setEndianness(Misc::LittleEndian);
-	
-	/* Open the depth file: */
-	std::string depthFileName=config.saveFileNamePrefix;
-	depthFileName.push_back('-');
-	depthFileName.append(config.deviceSerialNumber);
-	depthFileName.append(".depth");
-	depthFile=Vrui::openFile(depthFileName.c_str());
-	depthFile->setEndianness(Misc::LittleEndian);
-	
-	/* Read the files' format version numbers: */
-	// unsigned int colorFormatVersion=colorFile->read<unsigned int>();
-	colorFile->skip<unsigned int>(1);
-	unsigned int depthFormatVersion=depthFile->read<unsigned int>();
-	
-	/* Check if there are per-pixel depth correction coefficients: */
-	Kinect::FrameSource::DepthCorrection* depthCorrection=0;
-	if(depthFormatVersion>=4)
+	while(true)
 		{
-		/* Read new B-spline based depth correction parameters: */
-		depthCorrection=new Kinect::FrameSource::DepthCorrection(*depthFile);
-		}
-	else
+		/* Wait until the next frame in the stream falls into the window ahead of the playhead: */
 		{
-		if(depthFormatVersion>=2&&depthFile->read<char>()!=0)
+		Threads::MutexCond::Lock cacheLock(cacheCond);
+		while(!shutdown&&nextFrameIndices[sensor]>playheads[sensor]+getWindowSize())
+			cacheCond.wait(cacheLock);
+		if(shutdown)
+			break;
+		}
+		
+		/* Decode the next frame in the stream: */
+		CachedFrame* frame=decodeNextFrame(sensor);
+		
+		/* Append the frame to the cache, or mark the end of the stream, and wake up the display: */
+		Threads::MutexCond::Lock cacheLock(cacheCond);
+		if(frame->timeStamp>=Math::Constants<double>::max)
 			{
-			/* Skip the depth correction buffer: */
-			int size[2];
-			depthFile->read<int>(size,2);
-			depthFile->skip<float>(size[1]*size[0]*2);
+			delete frame;
+			endOfStreams[sensor]=true;
+			cacheCond.broadcast();
+			break;
 			}
+		cachedFrames[sensor].push_back(0);
+		insertFrame(frame,true);
+		cacheCond.broadcast();
 		}
 	
-	/* Check if the depth stream uses lossy compression: */
-	bool depthIsLossy=depthFormatVersion>=3&&depthFile->read<unsigned char>()!=0;
-	
-	/* Read the color and depth projections from their respective files: */
-	Kinect::FrameSource::IntrinsicParameters ips;
-	ips.colorProjection=Misc::Marshaller<Kinect::FrameSource::IntrinsicParameters::PTransform>::read(*colorFile);
-	ips.depthProjection=Misc::Marshaller<Kinect::FrameSource::IntrinsicParameters::PTransform>::read(*depthFile);
-	projector.setIntrinsicParameters(ips);
+	return 0;
+	}
+
+KinectPlayer::KinectStreamer::KinectStreamer(const KinectPlayerFactory::KinectConfig& config,size_t sCacheSize)
+	:streaming(Vrui::getClusterMultiplexer()!=0),
+	 frameSource(0),
+	 cacheSize(sCacheSize),
+	 mostRecentlyUsed(0),leastRecentlyUsed(0),cachedSize(0),
+	 playbackDirection(1),shutdown(false)
+	{
+	/* Assemble the color and depth file names: */
+	std::string fileNamePrefix=config.saveFileNamePrefix;
+	fileNamePrefix.push_back('-');
+	fileNamePrefix.append(config.deviceSerialNumber);
+	std::string colorFileName=fileNamePrefix+".color";
+	std::string depthFileName=fileNamePrefix+".depth";
 	
-	/* Read the camera transformation from the depth file: */
-	Kinect::FrameSource::ExtrinsicParameters eps;
-	eps=Misc::Marshaller<Kinect::FrameSource::ExtrinsicParameters>::read(*depthFile);
-	projector.setExtrinsicParameters(eps);
+	/*********************************************************************
+	When running stand-alone, open the color and depth files directly,
+	because the frame decoding threads seek in the files at random. In a
+	cluster, stream the files from the head node through Vrui::openFile
+	instead, which requires all nodes to read them in exactly the same
+	order; frames are then decoded strictly in sequence.
+	*********************************************************************/
 	
-	/* Create the color and depth decompressors: */
-	colorDecompressor=new Kinect::ColorFrameReader(*colorFile);
-	if(depthIsLossy)
+	try
 		{
-		#if VIDEO_CONFIG_HAVE_THEORA
-		depthDecompressor=new Kinect::LossyDepthFrameReader(*depthFile);
-		#else
-		delete colorDecompressor;
-		Misc::throwStdErr("KinectPlayer: Lossy depth compression not supported due to lack of Theora library");
-		#endif
+		if(streaming)
+			frameSource=new Kinect::FileFrameSource(Vrui::openFile(colorFileName.c_str()),Vrui::openFile(depthFileName.c_str()));
+		else
+			frameSource=new Kinect::FileFrameSource(colorFileName.c_str(),depthFileName.c_str());
+		}
+	catch(std::runtime_error err)
+		{
+		Misc::throwStdErr("KinectPlayer: Node %d cannot open recording %s due to exception %s",int(Vrui::getNodeIndex()),fileNamePrefix.c_str(),err.what());
 		}
-	else
-		depthDecompressor=new Kinect::DepthFrameReader(*depthFile);
 	
-	/* Set the projector's depth frame size: */
-	projector.setDepthFrameSize(depthDecompressor->getSize());
+	for(int sensor=0;sensor<2;++sensor)
+		{
+		/* Load or create the frame index of the stream for random access unless streaming: */
+		if(streaming)
+			frameIndices[sensor]=0;
+		else
+			{
+			frameIndices[sensor]=&frameSource->getFrameIndex(sensor);
+			cachedFrames[sensor].resize(frameIndices[sensor]->getNumFrames(),0);
+			}
+		meanFrameSizes[sensor]=0;
+		playheads[sensor]=0;
+		nextFrameIndices[sensor]=0;
+		endOfStreams[sensor]=false;
+		displayedFrames[sensor]=~size_t(0);
+		}
 	
-	/* Set the projector's depth correction coefficients: */
+	/* Initialize the projector from the depth stream's parameters: */
+	projector.setIntrinsicParameters(frameSource->getIntrinsicParameters());
+	projector.setExtrinsicParameters(frameSource->getExtrinsicParameters());
+	projector.setDepthFrameSize(frameSource->getActualFrameSize(Kinect::FrameSource::DEPTH));
+	Kinect::FrameSource::DepthCorrection* depthCorrection=frameSource->getDepthCorrectionParameters();
 	projector.setDepthCorrection(depthCorrection);
-	
-	/* Clean up: */
 	delete depthCorrection;
 	
-	/* Start the color and depth decompression threads: */
-	colorDecompressorThread.start(this,&KinectPlayer::KinectStreamer::colorDecompressorThreadMethod);
-	depthDecompressorThread.start(this,&KinectPlayer::KinectStreamer::depthDecompressorThreadMethod);
+	/* Start the color and depth decoding threads: */
+	void* (KinectPlayer::KinectStreamer::*threadMethod)(int)=streaming?&KinectPlayer::KinectStreamer::streamingThreadMethod:&KinectPlayer::KinectStreamer::decodingThreadMethod;
+	decodingThreads[Kinect::FrameSource::COLOR].start(this,threadMethod,int(Kinect::FrameSource::COLOR));
+	decodingThreads[Kinect::FrameSource::DEPTH].start(this,threadMethod,int(Kinect::FrameSource::DEPTH));
 	}
 
 KinectPlayer::KinectStreamer::~KinectStreamer(void)
 	{
-	/* Shut down the depth and color decompression threads: */
-	colorDecompressorThread.cancel();
-	depthDecompressorThread.cancel();
-	colorDecompressorThread.join();
-	depthDecompressorThread.join();
+	/* Shut down the color and depth decoding threads: */
+	{
+	Threads::MutexCond::Lock cacheLock(cacheCond);
+	shutdown=true;
+	cacheCond.broadcast();
+	}
+	for(int i=0;i<2;++i)
+		decodingThreads[i].join();
+	
+	/* Delete all cached frames: */
+	while(mostRecentlyUsed!=0)
+		{
+		CachedFrame* succ=mostRecentlyUsed->succ;
+		delete mostRecentlyUsed;
+		mostRecentlyUsed=succ;
+		}
 	
-	/* Delete the color and depth decompressors: */
-	delete colorDecompressor;
-	delete depthDecompressor;
+	/* Close the color and depth files: */
+	delete frameSource;
+	}
+
+void KinectPlayer::KinectStreamer::setCacheSize(size_t newCacheSize)
+	{
+	Threads::MutexCond::Lock cacheLock(cacheCond);
+	cacheSize=newCacheSize;
+	cacheCond.broadcast();
 	}
 
-void KinectPlayer::KinectStreamer::updateFrames(double currentTimeStamp)
+void KinectPlayer::KinectStreamer::updateFrames(double currentTimeStamp,int direction,bool waitForFrames)
+	{
+	Kinect::FrameBuffer colorFrame;
+	Kinect::MeshBuffer mesh;
+	bool haveColorFrame=false;
+	bool haveMesh=false;
 	{
-	/* Wait until the next frame is newer than the new time step: */
-	Kinect::FrameBuffer currentColorFrame;
-	Kinect::MeshBuffer currentDepthFrame;
-	while(nextColorFrame.timeStamp<=currentTimeStamp||nextDepthFrame.timeStamp<=currentTimeStamp)
+	Threads::MutexCond::Lock cacheLock(cacheCond);
+	
+	if(streaming)
 		{
-		if(nextColorFrame.timeStamp<=currentTimeStamp)
-			{
-			currentColorFrame=nextColorFrame;
-			{
-			Threads::MutexCond::Lock frameQueueLock(frameQueueCond);
-			while(numColorFrames==0)
-				frameQueueCond.wait(frameQueueLock);
-			nextColorFrame=colorFrames[(mostRecentColorFrame-numColorFrames+3)%2];
-			if(--numColorFrames==1)
-				frameQueueCond.broadcast();
-			}
-			}
-		if(nextDepthFrame.timeStamp<=currentTimeStamp)
-			{
-			currentDepthFrame=nextDepthFrame;
+		/* Advance the playhead to the most recent frames at the new time stamp, waiting for each frame following the playhead to be decoded: */
+		for(int sensor=0;sensor<2;++sensor)
+			while(true)
+				{
+				size_t next=playheads[sensor]+1;
+				while(!endOfStreams[sensor]&&cachedFrames[sensor].size()<=next)
+					cacheCond.wait(cacheLock);
+				if(next>=cachedFrames[sensor].size()||cachedFrames[sensor][next]->timeStamp>currentTimeStamp)
+					break;
+				playheads[sensor]=next;
+				cacheCond.broadcast();
+				}
+		}
+	else
+		{
+		/* Find the most recent color frame and depth mesh at the new time stamp: */
+		size_t newPlayheads[2];
+		for(int sensor=0;sensor<2;++sensor)
+			newPlayheads[sensor]=frameIndices[sensor]->findFrame(currentTimeStamp);
+		
+		/* Move the playhead and redirect the frame decoding threads: */
+		if(newPlayheads[0]!=playheads[0]||newPlayheads[1]!=playheads[1]||direction!=playbackDirection)
 			{
-			Threads::MutexCond::Lock frameQueueLock(frameQueueCond);
-			while(numDepthFrames==0)
-				frameQueueCond.wait(frameQueueLock);
-			nextDepthFrame=depthFrames[(mostRecentDepthFrame-numDepthFrames+3)%2];
-			if(--numDepthFrames==1)
-				frameQueueCond.broadcast();
-			}
+			for(int sensor=0;sensor<2;++sensor)
+				playheads[sensor]=newPlayheads[sensor];
+			playbackDirection=direction;
+			cacheCond.broadcast();
 			}
 		}
 	
+	/* Wait for the frames at the playhead if requested: */
+	if(waitForFrames)
+		{
+		for(int sensor=0;sensor<2;++sensor)
+			if(!cachedFrames[sensor].empty())
+				while(cachedFrames[sensor][playheads[sensor]]==0)
+					cacheCond.wait(cacheLock);
+		}
+	
+	/* Retrieve the frames at the playhead if they changed and are available: */
+	if(!cachedFrames[0].empty()&&displayedFrames[0]!=playheads[0]&&cachedFrames[0][playheads[0]]!=0)
+		{
+		colorFrame=cachedFrames[0][playheads[0]]->colorFrame;
+		displayedFrames[0]=playheads[0];
+		haveColorFrame=true;
+		}
+	if(!cachedFrames[1].empty()&&displayedFrames[1]!=playheads[1]&&cachedFrames[1][playheads[1]]!=0)
+		{
+		mesh=cachedFrames[1][playheads[1]]->mesh;
+		displayedFrames[1]=playheads[1];
+		haveMesh=true;
+		}
+	}
+	
 	/* Update the projector: */
-	if(currentColorFrame.timeStamp!=0.0)
-		projector.setColorFrame(currentColorFrame);
-	if(currentDepthFrame.timeStamp!=0.0)
-		projector.setMesh(currentDepthFrame);
+	if(haveColorFrame)
+		projector.setColorFrame(colorFrame);
+	if(haveMesh)
+		projector.setMesh(mesh);
 	projector.updateFrames();
 	}
 
@@ -364,12 +553,37 @@ Methods of class KinectPlayer:
 
 KinectPlayer::KinectPlayer(int numArguments,const char* const arguments[])
 	:soundPlayer(0),
-	 firstEnable(true)
+	 firstEnable(true),
+	 lastApplicationTime(0.0),playbackTime(0.0),playbackRate(1.0),scrubbing(false)
 	{
+	/* Parse the command line: */
+	size_t cacheSize=factory->cacheSize;
+	for(int i=0;i<numArguments;++i)
+		{
+		if(strcasecmp(arguments[i],"-cacheSize")==0)
+			{
+			++i;
+			if(i<numArguments)
+				cacheSize=size_t(atoi(arguments[i]))*1024*1024;
+			else
+				std::cerr<<"KinectPlayer: Ignoring dangling -cacheSize argument"<<std::endl;
+			}
+		else if(strcasecmp(arguments[i],"-rate")==0)
+			{
+			++i;
+			if(i<numArguments)
+				playbackRate=atof(arguments[i]);
+			else
+				std::cerr<<"KinectPlayer: Ignoring dangling -rate argument"<<std::endl;
+			}
+		}
+	
+	/* Split the memory budget for decoded frames evenly between all cameras: */
+	size_t numStreamers=factory->kinectConfigs.size();
 	for(std::vector<KinectPlayerFactory::KinectConfig>::const_iterator kcIt=factory->kinectConfigs.begin();kcIt!=factory->kinectConfigs.end();++kcIt)
 		{
 		/* Create a streamer for the found camera: */
-		streamers.push_back(new KinectStreamer(*kcIt));
+		streamers.push_back(new KinectStreamer(*kcIt,cacheSize/numStreamers));
 		}
 	
 	for(std::vector<KinectPlayerFactory::SoundConfig>::const_iterator scIt=factory->soundConfigs.begin();scIt!=factory->soundConfigs.end();++scIt)
@@ -412,9 +626,15 @@ void KinectPlayer::enable(void)
 
 void KinectPlayer::frame(void)
 	{
-	/* Block until all streamers have frames valid for the current time stamp: */
+	/* Advance the playhead by the elapsed application time: */
+	double applicationTime=Vrui::getApplicationTime();
+	playbackTime+=(applicationTime-lastApplicationTime)*playbackRate;
+	lastApplicationTime=applicationTime;
+	
+	/* Update all streamers; block until they have frames valid for the playhead unless scrubbing; streamers in a cluster always block to keep all nodes in lockstep: */
+	int direction=playbackRate<0.0?-1:1;
 	for(std::vector<KinectStreamer*>::iterator sIt=streamers.begin();sIt!=streamers.end();++sIt)
-		(*sIt)->updateFrames(Vrui::getApplicationTime());
+		(*sIt)->updateFrames(playbackTime,direction,!scrubbing);
 	}
 
 void KinectPlayer::display(GLContextData& contextData) const
@@ -423,3 +643,31 @@ void KinectPlayer::display(GLContextData& contextData) const
 	for(std::vector<KinectStreamer*>::const_iterator sIt=streamers.begin();sIt!=streamers.end();++sIt)
 		(*sIt)->glRenderAction(contextData);
 	}
+
+void KinectPlayer::seek(double newPlaybackTime)
+	{
+	/* Move the playhead and wait for the exact frames on the next frame: */
+	playbackTime=newPlaybackTime;
+	scrubbing=false;
+	}
+
+void KinectPlayer::scrub(double newPlaybackTime)
+	{
+	/* Move the playhead and show frames as they become available: */
+	playbackTime=newPlaybackTime;
+	scrubbing=true;
+	}
+
+void KinectPlayer::setPlaybackRate(double newPlaybackRate)
+	{
+	/* Resume frame-accurate playback at the new rate: */
+	playbackRate=newPlaybackRate;
+	scrubbing=false;
+	}
+
+void KinectPlayer::setCacheSize(size_t newCacheSize)
+	{
+	/* Split the memory budget evenly between all cameras: */
+	for(std::vector<KinectStreamer*>::iterator sIt=streamers.begin();sIt!=streamers.end();++sIt)
+		(*sIt)->setCacheSize(newCacheSize/streamers.size());
+	}
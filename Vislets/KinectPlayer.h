@@ -24,9 +24,9 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #ifndef VISLETS_KINECTPLAYER_INCLUDED
 #define VISLETS_KINECTPLAYER_INCLUDED
 
+#include <stddef.h>
 #include <string>
 #include <vector>
-#include <IO/File.h>
 #include <Threads/Thread.h>
 #include <Threads/MutexCond.h>
 #include <Geometry/OrthogonalTransformation.h>
@@ -41,8 +41,8 @@ namespace Sound {
 class SoundPlayer;
 }
 namespace Kinect {
-class FrameReader;
-class Projector;
+class FrameIndex;
+class FileFrameSource;
 }
 
 class KinectPlayer;
@@ -71,6 +71,7 @@ class KinectPlayerFactory:public Vrui::VisletFactory
 	
 	/* Elements: */
 	private:
+	size_t cacheSize; // Memory budget for decoded frames of all Kinect devices in bytes
 	std::vector<KinectConfig> kinectConfigs; // List of Kinect device configuration data structures
 	std::vector<SoundConfig> soundConfigs; // List of sound device configuration data structures
 	
@@ -92,38 +93,61 @@ class KinectPlayer:public Vrui::Vislet
 	private:
 	class KinectStreamer // Helper class to play back 3D video data from a pair of time-stamped files
 		{
+		/* Embedded classes: */
+		private:
+		struct CachedFrame // Structure for a decoded color frame or depth mesh in the frame cache
+			{
+			/* Elements: */
+			public:
+			int sensor; // Stream containing the frame
+			size_t frameIndex; // Index of the frame in its stream
+			double timeStamp; // Time stamp of the frame
+			Kinect::FrameBuffer colorFrame; // Decoded color frame
+			Kinect::MeshBuffer mesh; // Mesh created from the decoded depth frame
+			size_t size; // Memory used by the decoded frame in bytes
+			CachedFrame* pred; // Next more recently used frame in the cache
+			CachedFrame* succ; // Next less recently used frame in the cache
+			};
+		
 		/* Elements: */
 		private:
-		IO::FilePtr colorFile; // Pointer to the file containing the color stream
-		Kinect::FrameReader* colorDecompressor; // Decompressor for color frames
-		Threads::Thread colorDecompressorThread; // Thread to decompress color frames from the color file
-		IO::FilePtr depthFile; // Pointer to the file containing the depth stream
-		Kinect::FrameReader* depthDecompressor; // Decompressor for depth frames
-		Threads::Thread depthDecompressorThread; // Thread to decompress depth frames from the depth file
+		bool streaming; // Flag whether the color and depth streams are read strictly in order, to keep all nodes of a Vrui cluster in lockstep
+		Kinect::FileFrameSource* frameSource; // Frame source reading the color and depth streams
+		const Kinect::FrameIndex* frameIndices[2]; // Indices of all frames in the color and depth streams, or null when streaming
 		Kinect::Projector projector; // Projector to render a combined depth/color frame
-		Threads::MutexCond timeStampCond; // Condition variable to signal a change in the next time stamp value
-		double readAheadTimeStamp; // Time stamp up to which to read ahead in the depth and color files
-		Threads::MutexCond frameQueueCond; // Condition variable to signal arrival of a new depth or color frame
-		Kinect::FrameBuffer colorFrames[2]; // The two most recently read depth frames
-		int numColorFrames; // Number of color frames in queue
-		int mostRecentColorFrame; // Index of the most recently read depth frame
-		Kinect::FrameBuffer nextColorFrame; // The next color frame
-		Kinect::MeshBuffer depthFrames[2]; // The two most recently read depth frames
-		int numDepthFrames; // Number of depth frames in queue
-		int mostRecentDepthFrame; // Index of the most recently read depth frame
-		Kinect::MeshBuffer nextDepthFrame; // The next depth frame
+		size_t cacheSize; // Memory budget for decoded color frames and depth meshes in bytes
+		Threads::MutexCond cacheCond; // Condition variable to signal newly decoded frames or a moved playhead; also protects the frame cache and the playhead
+		std::vector<CachedFrame*> cachedFrames[2]; // Decoded color frames and depth meshes by frame index, or null for frames not in the cache
+		CachedFrame* mostRecentlyUsed; // Head of the list of cached frames in order of last use
+		CachedFrame* leastRecentlyUsed; // Tail of the list of cached frames in order of last use
+		size_t cachedSize; // Memory used by all cached frames in bytes
+		size_t meanFrameSizes[2]; // Running estimates of the memory used by a decoded color frame and depth mesh
+		size_t playheads[2]; // Indices of the color and depth frames at the playhead
+		int playbackDirection; // Direction in which the playhead moves; 1 for forward, -1 for backward
+		bool shutdown; // Flag to shut down the frame decoding threads
+		size_t nextFrameIndices[2]; // Indices of the next frames returned by the frame source's color and depth readers
+		bool endOfStreams[2]; // Flags whether the ends of the color and depth streams were reached when streaming
+		Threads::Thread decodingThreads[2]; // Threads decoding color frames and depth meshes around the playhead
+		size_t displayedFrames[2]; // Indices of the color frame and depth mesh passed to the projector, or ~0 if none
 		
 		/* Private methods: */
-		void* colorDecompressorThreadMethod(void); // Thread method to read color frames
-		void* depthDecompressorThreadMethod(void); // Thread method to read depth frames
+		void unlinkFrame(CachedFrame* frame); // Removes the given frame from the list of cached frames
+		void touchFrame(CachedFrame* frame); // Marks the given cached frame as most recently used
+		void insertFrame(CachedFrame* frame,bool used); // Adds the given frame to the cache as most recently or as least recently used, and evicts least recently used frames beyond the memory budget
+		size_t getWindowSize(void) const; // Returns the number of frames per stream around the playhead that fit into the memory budget
+		bool findFrameToDecode(int sensor,size_t& frameIndex); // Returns the most important frame around the playhead that is missing from the cache; returns false if all frames in the window are cached
+		CachedFrame* decodeNextFrame(int sensor); // Reads the next color frame or depth mesh from the frame source
+		void* decodingThreadMethod(int sensor); // Thread method decoding color frames or depth meshes around the playhead
+		void* streamingThreadMethod(int sensor); // Thread method decoding color frames or depth meshes in order ahead of the playhead
 		
 		/* Constructors and destructors: */
 		public:
-		KinectStreamer(const KinectPlayerFactory::KinectConfig& config); // Creates a streamer from the given configuration structure
+		KinectStreamer(const KinectPlayerFactory::KinectConfig& config,size_t sCacheSize); // Creates a streamer from the given configuration structure, caching decoded frames up to the given memory budget in bytes; streams the files from the head node when running in a cluster
 		~KinectStreamer(void); // Destroys the streamer
 		
 		/* Methods: */
-		void updateFrames(double currentTimeStamp); // Updates the streamer's frames for display on the given time stamp
+		void setCacheSize(size_t newCacheSize); // Sets the memory budget for decoded frames in bytes
+		void updateFrames(double currentTimeStamp,int direction,bool waitForFrames); // Moves the playhead to the given time stamp in the given direction, and updates the streamer's frames for display; waits for missing frames to be decoded if the flag is true; when streaming, the playhead only moves forward and always waits
 		void glRenderAction(GLContextData& contextData) const; // Renders the current frame
 		};
 	
@@ -133,6 +157,10 @@ class KinectPlayer:public Vrui::Vislet
 	std::vector<KinectStreamer*> streamers; // List of Kinect streamers
 	Sound::SoundPlayer* soundPlayer; // Pointer to optional sound player
 	bool firstEnable; // Flag to indicate the first time the vislet is enabled at start-up
+	double lastApplicationTime; // Application time at which the playhead was last advanced
+	double playbackTime; // Time stamp of the playhead in the recorded streams
+	double playbackRate; // Playback speed relative to real time; 0 pauses, and negative rates play backwards
+	bool scrubbing; // Flag whether the playhead is being scrubbed, i.e., frames are displayed as they are decoded without blocking; ignored in a cluster
 	
 	/* Constructors and destructors: */
 	public:
@@ -144,6 +172,20 @@ class KinectPlayer:public Vrui::Vislet
 	virtual void enable(void);
 	virtual void frame(void);
 	virtual void display(GLContextData& contextData) const;
+	
+	/* New methods: */
+	double getPlaybackTime(void) const // Returns the time stamp of the playhead
+		{
+		return playbackTime;
+		}
+	void seek(double newPlaybackTime); // Moves the playhead to the given time stamp; the next frame shows exactly the recorded frames at that time; in a cluster, the playhead can only move forward
+	void scrub(double newPlaybackTime); // Moves the playhead to the given time stamp during interactive scrubbing; frames are shown as soon as they are decoded, without blocking, unless running in a cluster
+	double getPlaybackRate(void) const // Returns the playback speed relative to real time
+		{
+		return playbackRate;
+		}
+	void setPlaybackRate(double newPlaybackRate); // Sets the playback speed relative to real time; 0 pauses, and negative rates play backwards except in a cluster
+	void setCacheSize(size_t newCacheSize); // Sets the memory budget for decoded frames of all Kinect devices in bytes
 	};
 
 #endif
@@ -24,7 +24,10 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include "Vislets/KinectRecorder.h"
 
 #include <string.h>
+#include <stdexcept>
+#include <iostream>
 #include <Misc/FunctionCalls.h>
+#include <Misc/ThrowStdErr.h>
 #include <Misc/File.h>
 #include <Misc/StandardValueCoders.h>
 #include <Misc/CompoundValueCoders.h>
@@ -78,6 +81,21 @@ KinectRecorderFactory::KinectRecorderFactory(Vrui::VisletManager& visletManager)
 		config.maxDepth=kds.retrieveValue<unsigned int>("./maxDepth",0);
 		config.backgroundRemovalFuzz=kds.retrieveValue<int>("./backgroundRemovalFuzz",-1000000);
 		
+		/* Read the number of depth compression threads: */
+		config.numDepthEncoders=kds.retrieveValue<unsigned int>("./numDepthEncoders",1);
+		
+		/* Read the memory budget for queued frames in megabytes, and the policy to handle frames exceeding it: */
+		config.memoryBudget=size_t(kds.retrieveValue<unsigned int>("./memoryBudget",0))*size_t(1024*1024);
+		std::string overflowPolicy=kds.retrieveString("./overflowPolicy","Block");
+		if(overflowPolicy=="Block")
+			config.overflowPolicy=Kinect::FrameSaver::BLOCK;
+		else if(overflowPolicy=="DropOldest")
+			config.overflowPolicy=Kinect::FrameSaver::DROP_OLDEST;
+		else if(overflowPolicy=="DropColorFirst")
+			config.overflowPolicy=Kinect::FrameSaver::DROP_COLOR_FIRST;
+		else
+			Misc::throwStdErr("KinectRecorder: Unknown overflow policy %s",overflowPolicy.c_str());
+		
 		/* Store the configuration structure: */
 		kinectConfigs.push_back(config);
 		}
@@ -202,7 +220,8 @@ KinectRecorder::KinectStreamer::KinectStreamer(USB::Context& usbContext,const Ki
 	colorFrameFileName.push_back('-');
 	colorFrameFileName.append(config.deviceSerialNumber);
 	colorFrameFileName.append(".color");
-	frameSaver=new Kinect::FrameSaver(camera,colorFrameFileName.c_str(),depthFrameFileName.c_str());
+	frameSaver=new Kinect::FrameSaver(camera,colorFrameFileName.c_str(),depthFrameFileName.c_str(),Kinect::FrameSource::LOSSLESS_HUFFMAN,config.numDepthEncoders);
+	frameSaver->setMemoryBudget(config.memoryBudget,config.overflowPolicy);
 	}
 
 KinectRecorder::KinectStreamer::~KinectStreamer(void)
@@ -210,6 +229,21 @@ KinectRecorder::KinectStreamer::~KinectStreamer(void)
 	/* Stop streaming: */
 	camera.stopStreaming();
 	
+	/* Report frames that were dropped due to the frame saver's memory budget: */
+	Kinect::FrameSaver::QueueStatistics qs=frameSaver->getQueueStatistics();
+	if(qs.numDroppedColorFrames!=0||qs.numDroppedDepthFrames!=0)
+		std::cout<<"KinectRecorder: Dropped "<<qs.numDroppedColorFrames<<" color and "<<qs.numDroppedDepthFrames<<" depth frames from camera "<<camera.getSerialNumber()<<"; peak queue size "<<qs.maxQueuedBytes/(1024*1024)<<" MB"<<std::endl;
+	
+	/* Write all remaining frames and report recordings that could not be written completely: */
+	try
+		{
+		frameSaver->close();
+		}
+	catch(std::runtime_error err)
+		{
+		std::cerr<<"KinectRecorder: Recording from camera "<<camera.getSerialNumber()<<" is incomplete due to exception "<<err.what()<<std::endl;
+		}
+	
 	/* Delete the frame saver: */
 	delete frameSaver;
 	}
@@ -29,6 +29,7 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <USB/Context.h>
 #include <Sound/SoundDataFormat.h>
 #include <Kinect/Camera.h>
+#include <Kinect/FrameSaver.h>
 #include <Vrui/Vislet.h>
 
 /* Forward declarations: */
@@ -37,7 +38,6 @@ class SoundRecorder;
 }
 namespace Kinect {
 class FrameBuffer;
-class FrameSaver;
 }
 
 class KinectRecorder;
@@ -60,6 +60,9 @@ class KinectRecorderFactory:public Vrui::VisletFactory
 		unsigned int captureBackgroundFrames; // Number of background frames to capture for background removal
 		unsigned int maxDepth; // Depth cutoff value for background removal
 		int backgroundRemovalFuzz; // Fuzz value for background removal
+		unsigned int numDepthEncoders; // Number of threads compressing depth frames in parallel
+		size_t memoryBudget; // Maximum total size of queued frames in bytes, or 0 for no limit
+		Kinect::FrameSaver::OverflowPolicy overflowPolicy; // Policy to handle frames exceeding the memory budget
 		};
 	
 	struct SoundConfig // Structure containing configuration data for sound recording
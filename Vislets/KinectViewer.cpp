@@ -44,6 +44,7 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <Kinect/FunctionCalls.h>
 #include <Kinect/Camera.h>
 #include <Kinect/DepthFrameReader.h>
+#include <Kinect/RansDepthFrameReader.h>
 #if VIDEO_CONFIG_HAVE_THEORA
 #include <Kinect/LossyDepthFrameReader.h>
 #endif
@@ -346,7 +347,7 @@ KinectViewer::SynchedRenderer::SynchedRenderer(const std::string& fileName)
 	/* Read the files' format version numbers: */
 	unsigned int colorFormatVersion=colorFile->read<Misc::UInt32>();
 	unsigned int depthFormatVersion=depthFile->read<Misc::UInt32>();
-	if(colorFormatVersion>1||depthFormatVersion>4)
+	if(colorFormatVersion>2||depthFormatVersion>9)
 		Misc::throwStdErr("KinectViewer::SynchedRenderer: Unsupported 3D video file format");
 	
 	/* Check if there are per-pixel depth correction coefficients: */
@@ -371,8 +372,10 @@ KinectViewer::SynchedRenderer::SynchedRenderer(const std::string& fileName)
 		depthCorrection=new Kinect::FrameSource::DepthCorrection(0,numSegments);
 		}
 	
-	/* Check if the depth stream uses lossy compression: */
-	bool depthIsLossy=depthFormatVersion>=3&&depthFile->read<Misc::UInt8>()!=0;
+	/* Check which compression method the depth stream uses: */
+	unsigned int depthCompression=depthFormatVersion>=3?depthFile->read<Misc::UInt8>():Kinect::FrameSource::LOSSLESS_HUFFMAN;
+	if(depthCompression>Kinect::FrameSource::LOSSLESS_RANS)
+		Misc::throwStdErr("KinectViewer::SynchedRenderer: Unknown depth compression method %u",depthCompression);
 	
 	/* Read the color and depth projections from their respective files: */
 	Kinect::FrameSource::IntrinsicParameters ips;
@@ -385,7 +388,7 @@ KinectViewer::SynchedRenderer::SynchedRenderer(const std::string& fileName)
 	
 	/* Create the color and depth readers: */
 	colorReader=new Kinect::ColorFrameReader(*colorFile);
-	if(depthIsLossy)
+	if(depthCompression==Kinect::FrameSource::LOSSY_THEORA)
 		{
 		#if VIDEO_CONFIG_HAVE_THEORA
 		depthReader=new Kinect::LossyDepthFrameReader(*depthFile);
@@ -394,8 +397,10 @@ KinectViewer::SynchedRenderer::SynchedRenderer(const std::string& fileName)
 		Misc::throwStdErr("KinectViewer::SynchedRenderer: Lossy depth compression not supported due to lack of Theora library");
 		#endif
 		}
+	else if(depthCompression==Kinect::FrameSource::LOSSLESS_RANS)
+		depthReader=new Kinect::RansDepthFrameReader(*depthFile);
 	else
-		depthReader=new Kinect::DepthFrameReader(*depthFile);
+		depthReader=new Kinect::DepthFrameReader(*depthFile,depthFormatVersion);
 	
 	/* Create and initialize the projector: */
 	#if KINECT_USE_SHADERPROJECTOR